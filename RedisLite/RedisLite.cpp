@@ -1,31 +1,69 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <filesystem>
 #include "headers/KeyValueStore.h"
 #include "headers/TCPServer.h"
 #include "headers/AOFManager.h"
+#include "headers/SnapshotManager.h"
 #include "headers/Command.h"
+#include "headers/ServerConfig.h"
+#include "headers/LatencyMonitor.h"
+#include "headers/Logger.h"
+#include "headers/Metrics.h"
 
-int main() {
-    KeyValueStore kvStore;
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    std::string configError;
+    if (!config.parseArgs(argc, argv, configError)) {
+        std::cerr << configError << std::endl;
+        std::cerr << "Usage: RedisLite [--port N] [--aof path] [--appendfsync always|everysec|no]"
+            << " [--auto-aof-rewrite-percentage N] [--auto-aof-rewrite-min-size bytes] [--aof-use-rdb-preamble yes|no]"
+            << " [--dbfilename path] [--rdbcompression yes|no]"
+            << " [--io-model threads|epoll] [--io-threads N] [--shards N]"
+            << " [--maxmemory bytes] [--maxmemory-policy noeviction|allkeys-lru|allkeys-lfu|volatile-lru|volatile-ttl] [--maxmemory-samples N]"
+            << " [--hz N] [--activerehashing yes|no] [--flush-threshold bytes] [--client-query-buffer-limit bytes]"
+            << " [--loglevel debug|verbose|notice|warning] [--metrics-port N] [--latency-tracking yes|no]"
+            << " [--slowlog-log-slower-than usec] [--slowlog-max-len N] [--latency-monitor-threshold ms]"
+            << " [--replicaof host:port] [--repl-backlog-size bytes]" << std::endl;
+        return 1;
+    }
+    Logger::setLevel(config.logLevel);
+    Metrics::setLatencyTracking(config.latencyTracking);
+    LatencyMonitor::setThreshold(config.latencyMonitorThreshold);
+
+    KeyValueStore kvStore(static_cast<size_t>(config.shards));
+    kvStore.setMaxMemory(config.maxMemory, config.maxMemoryPolicy, config.maxMemorySamples);
     
-	std::string aofPath = "appendonly.aof";
-	AOFManager aofManager(aofPath);
+	AOFManager aofManager(config.aofPath, config.appendFsync);
+    SnapshotManager snapshotManager(config.dbFilename, config.rdbCompression);
+    aofManager.setRdbPreamble(config.aofUseRdbPreamble, config.rdbCompression);
 
-    if (aofManager.loadFromFile(kvStore)) {
-		std::cout << "[AOF] Sucessfully loaded data from AOF." << std::endl;
+    // The AOF is the source of truth when it has data; a snapshot is only
+    // loaded when there is no AOF to replay.
+    std::error_code ec;
+    bool haveAof = std::filesystem::file_size(config.aofPath, ec) > 0 && !ec;
+    if (haveAof && aofManager.loadFromFile(kvStore)) {
+		Logger::notice("[AOF] Sucessfully loaded data from AOF.");
+    }
+    else if (!haveAof && snapshotManager.loadFromFile(kvStore)) {
+		Logger::notice("[RDB] Sucessfully loaded data from snapshot.");
     }
     else {
-		std::cout << "[AOF] No AOF data to load or error occurred." << std::endl;
+		Logger::notice("[AOF] No AOF data to load or error occurred.");
     }
+    aofManager.enableAutoRewrite(kvStore, config.autoAofRewritePercentage, config.autoAofRewriteMinSize);
+    kvStore.setActiveRehashing(config.activeRehashing);
 
-	TCPServer server(kvStore, &aofManager);
-    if (!server.start(6379)) {
-        std::cerr << "Failed to start server." << std::endl;
+	TCPServer server(kvStore, &aofManager, &snapshotManager, config);
+    if (!server.start(config.port)) {
+        Logger::warning("Failed to start server.");
 		return -1;
     }
+    // Started after the server, which listens to expiries for CLIENT TRACKING.
+    kvStore.startActiveExpiry(config.hz);
 
-	std::cout << "[Server] RedisLite server listening on port 6379..." << std::endl;
+	Logger::notice("[Server] RedisLite server listening on port ", config.port, "...");
 
     while (true) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -0,0 +1,404 @@
+// Microbenchmarks for the hot paths under the network layer: RESP parsing,
+// reply formatting, the key-value store and pub/sub fan-out. Built with Google Benchmark:
+//   redislite-microbench --benchmark_filter=Store
+#include "../headers/CommandParser.h"
+#include "../headers/KeyValueStore.h"
+#include "../headers/Metrics.h"
+#include "../headers/OutputBuffer.h"
+#include "../headers/PubSub.h"
+#include "../headers/ResponseFormatter.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+std::string encode(const std::vector<std::string>& args) {
+	std::string out = "*" + std::to_string(args.size()) + "\r\n";
+	for (const std::string& arg : args) {
+		out += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+	}
+	return out;
+}
+
+std::string keyName(long long i) {
+	char buf[32];
+	int n = std::snprintf(buf, sizeof(buf), "key:%012lld", i);
+	return std::string(buf, static_cast<size_t>(n));
+}
+
+// keyName formatted into buf, for runs too large to keep every key around.
+std::string_view keyName(char (&buf)[32], long long i) {
+	int n = std::snprintf(buf, sizeof(buf), "key:%012lld", i);
+	return std::string_view(buf, static_cast<size_t>(n));
+}
+
+std::vector<std::string> makeKeys(size_t count) {
+	std::vector<std::string> keys;
+	keys.reserve(count);
+	for (size_t i = 0; i < count; ++i) keys.push_back(keyName(static_cast<long long>(i)));
+	return keys;
+}
+
+size_t residentBytes() {
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0, resident = 0;
+	statm >> pages >> resident;
+	return resident * 4096;
+}
+
+void reportPercentiles(benchmark::State& state, const LatencyHistogram& histogram) {
+	HistogramSnapshot snapshot;
+	snapshot.add(histogram);
+	state.counters["p50_ns"] = static_cast<double>(snapshot.percentile(0.50));
+	state.counters["p99_ns"] = static_cast<double>(snapshot.percentile(0.99));
+	state.counters["p99.9_ns"] = static_cast<double>(snapshot.percentile(0.999));
+	state.counters["max_ns"] = static_cast<double>(snapshot.percentile(1.0));
+}
+
+// --- CommandParser ---
+
+void BM_ParseSet(benchmark::State& state) {
+	std::string input = encode({ "SET", "key:000000000042", std::string(static_cast<size_t>(state.range(0)), 'x') });
+	ParseResult result;
+	for (auto _ : state) {
+		CommandParser::parseCommand(input, result);
+		benchmark::DoNotOptimize(result.command.args.data());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseSet)->Arg(16)->Arg(1024)->Arg(64 * 1024);
+
+void BM_ParseGet(benchmark::State& state) {
+	std::string input = encode({ "GET", "key:000000000042" });
+	ParseResult result;
+	for (auto _ : state) {
+		CommandParser::parseCommand(input, result);
+		benchmark::DoNotOptimize(result.command.args.data());
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseGet);
+
+// A pipelined read buffer, parsed command by command as the server does.
+void BM_ParsePipeline(benchmark::State& state) {
+	std::string input;
+	for (long long i = 0; i < state.range(0); ++i) {
+		input += i % 2 ? encode({ "GET", keyName(i) }) : encode({ "SET", keyName(i), "value" });
+	}
+	ParseResult result;
+	for (auto _ : state) {
+		std::string_view rest = input;
+		while (!rest.empty()) {
+			CommandParser::parseCommand(rest, result);
+			rest.remove_prefix(result.bytesConsumed);
+		}
+		benchmark::DoNotOptimize(result.command.args.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParsePipeline)->Arg(16)->Arg(256);
+
+// --- ResponseFormatter ---
+
+void BM_FormatBulkString(benchmark::State& state) {
+	std::string value(static_cast<size_t>(state.range(0)), 'x');
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(ResponseFormatter::BulkString(value));
+	}
+	state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * value.size()));
+}
+BENCHMARK(BM_FormatBulkString)->Arg(16)->Arg(1024)->Arg(64 * 1024);
+
+void BM_FormatInteger(benchmark::State& state) {
+	long long value = 1234567890123LL;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(ResponseFormatter::Integer(value));
+	}
+}
+BENCHMARK(BM_FormatInteger);
+
+void BM_FormatArray(benchmark::State& state) {
+	std::vector<std::string> values = makeKeys(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		std::string out = ResponseFormatter::ArrayHeader(values.size());
+		for (const std::string& v : values) out += ResponseFormatter::BulkString(v);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FormatArray)->Arg(10)->Arg(1000);
+
+// --- KeyValueStore ---
+
+constexpr size_t STORE_KEYS = 100000;
+
+void BM_StoreSet(benchmark::State& state) {
+	KeyValueStore store;
+	std::vector<std::string> keys = makeKeys(STORE_KEYS);
+	std::string value(static_cast<size_t>(state.range(0)), 'x');
+	size_t i = 0;
+	for (auto _ : state) {
+		store.set(keys[i], value);
+		i = i + 1 == keys.size() ? 0 : i + 1;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StoreSet)->Arg(16)->Arg(1024);
+
+void BM_StoreGet(benchmark::State& state) {
+	KeyValueStore store;
+	std::vector<std::string> keys = makeKeys(STORE_KEYS);
+	for (const std::string& key : keys) store.set(key, "value");
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(store.get(keys[i]));
+		i = i + 1 == keys.size() ? 0 : i + 1;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StoreGet);
+
+void BM_StoreIncr(benchmark::State& state) {
+	KeyValueStore store;
+	long long result = 0;
+	for (auto _ : state) {
+		store.incrBy("counter", 1, result);
+	}
+	benchmark::DoNotOptimize(result);
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StoreIncr);
+
+void BM_StoreMget(benchmark::State& state) {
+	KeyValueStore store;
+	std::vector<std::string> keys = makeKeys(STORE_KEYS);
+	for (const std::string& key : keys) store.set(key, "value");
+	std::vector<std::string_view> batch(static_cast<size_t>(state.range(0)));
+	std::vector<std::optional<std::string>> out;
+	std::mt19937_64 rng(42);
+	for (auto _ : state) {
+		for (std::string_view& key : batch) key = keys[rng() % keys.size()];
+		store.mget(batch.data(), batch.size(), out);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StoreMget)->Arg(10)->Arg(100);
+
+// A 1:1 SET/GET mix from several threads against one store, to show how the
+// sharded locks scale; compare the items/s of each thread count.
+KeyValueStore* sharedStore = nullptr;
+std::vector<std::string>* sharedKeys = nullptr;
+
+void BM_StoreThreadScaling(benchmark::State& state) {
+	if (state.thread_index() == 0) {
+		sharedStore = new KeyValueStore();
+		sharedKeys = new std::vector<std::string>(makeKeys(STORE_KEYS));
+		for (const std::string& key : *sharedKeys) sharedStore->set(key, "value");
+	}
+	std::mt19937_64 rng(static_cast<uint64_t>(state.thread_index()) + 1);
+	for (auto _ : state) {
+		const std::string& key = (*sharedKeys)[rng() % sharedKeys->size()];
+		if (rng() & 1) sharedStore->set(key, "value");
+		else benchmark::DoNotOptimize(sharedStore->get(key));
+	}
+	state.SetItemsProcessed(state.iterations());
+	if (state.thread_index() == 0) {
+		delete sharedStore;
+		delete sharedKeys;
+	}
+}
+BENCHMARK(BM_StoreThreadScaling)->Threads(1)->Threads(2)->Threads(4)->Threads(8)->UseRealTime();
+
+// Bytes per key for N small string keys, as accounted by the store
+// (used_memory) and as seen by the OS (resident set growth). Run the sizes
+// one per process, since freed memory stays resident; 100M keys need about
+// 6GB here and 15GB in the baseline.
+void BM_StoreMemoryPerKey(benchmark::State& state) {
+	const size_t count = static_cast<size_t>(state.range(0));
+	double accounted = 0, resident = 0;
+	for (auto _ : state) {
+		size_t before = residentBytes();
+		KeyValueStore store;
+		char buf[32];
+		for (size_t i = 0; i < count; ++i) store.set(keyName(buf, static_cast<long long>(i)), "value");
+		accounted = static_cast<double>(store.memoryStats().usedMemory) / count;
+		resident = static_cast<double>(residentBytes() - before) / count;
+	}
+	state.counters["used_memory_per_key"] = accounted;
+	state.counters["rss_per_key"] = resident;
+}
+BENCHMARK(BM_StoreMemoryPerKey)->Arg(1'000'000)->Arg(10'000'000)->Arg(100'000'000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// KVPair as it was before the slab-allocated tables, 48 bytes on 64-bit
+// builds. Today's KVPair also holds the collection types and is twice that.
+struct BaselineKVPair {
+	std::string value;
+	std::optional<std::chrono::steady_clock::time_point> expireAt;
+};
+
+// The same keys in the layout the store had before its slab-allocated
+// tables: per shard, a std::unordered_map from std::string to BaselineKVPair.
+void BM_StoreMemoryPerKeyBaseline(benchmark::State& state) {
+	const size_t count = static_cast<size_t>(state.range(0));
+	double resident = 0;
+	for (auto _ : state) {
+		size_t before = residentBytes();
+		std::vector<std::unordered_map<std::string, BaselineKVPair>> shards(KeyValueStore::DEFAULT_SHARDS);
+		char buf[32];
+		for (size_t i = 0; i < count; ++i) {
+			std::string_view key = keyName(buf, static_cast<long long>(i));
+			BaselineKVPair& entry = shards[KeyValueStore::shardOf(key, shards.size())][std::string(key)];
+			entry.value = "value";
+		}
+		resident = static_cast<double>(residentBytes() - before) / count;
+	}
+	state.counters["rss_per_key"] = resident;
+}
+BENCHMARK(BM_StoreMemoryPerKeyBaseline)->Arg(1'000'000)->Arg(10'000'000)->Arg(100'000'000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// Latency of single SETs while one shard grows from empty to 1M keys. The
+// incremental rehash keeps the tail flat; a stop-the-world resize would show
+// up as a max in the milliseconds.
+void BM_StoreRehashLatency(benchmark::State& state) {
+	const size_t count = 1000000;
+	std::vector<std::string> keys = makeKeys(count);
+	auto histogram = std::make_unique<LatencyHistogram>();
+	for (auto _ : state) {
+		KeyValueStore store(1);
+		for (const std::string& key : keys) {
+			Metrics::Clock::time_point started = Metrics::Clock::now();
+			store.set(key, "value");
+			histogram->record(Metrics::nanosBetween(started, Metrics::Clock::now()));
+		}
+	}
+	reportPercentiles(state, *histogram);
+}
+BENCHMARK(BM_StoreRehashLatency)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// --- Sorted sets ---
+
+constexpr size_t ZSET_MEMBERS = 1000000;
+
+std::vector<std::string> makeMembers() {
+	std::vector<std::string> members;
+	members.reserve(ZSET_MEMBERS);
+	for (size_t i = 0; i < ZSET_MEMBERS; ++i) members.push_back("member:" + std::to_string(i));
+	return members;
+}
+
+void fillZset(KeyValueStore& store, const std::vector<std::string>& members) {
+	std::mt19937_64 rng(7);
+	std::uniform_real_distribution<double> score(0, 1e6);
+	size_t added = 0, updated = 0;
+	for (const std::string& member : members) {
+		KeyValueStore::ScoredMember item{ score(rng), member };
+		store.zadd("zset", &item, 1, false, false, added, updated);
+	}
+}
+
+void BM_ZsetZadd1M(benchmark::State& state) {
+	std::vector<std::string> members = makeMembers();
+	for (auto _ : state) {
+		KeyValueStore store;
+		fillZset(store, members);
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ZSET_MEMBERS));
+}
+BENCHMARK(BM_ZsetZadd1M)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+void BM_ZsetZrange(benchmark::State& state) {
+	std::vector<std::string> members = makeMembers();
+	KeyValueStore store;
+	fillZset(store, members);
+	std::mt19937_64 rng(11);
+	std::vector<std::pair<std::string, double>> out;
+	long long width = state.range(0);
+	for (auto _ : state) {
+		long long start = static_cast<long long>(rng() % (ZSET_MEMBERS - static_cast<size_t>(width)));
+		out.clear();
+		store.zrange("zset", start, start + width - 1, out);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * width);
+}
+BENCHMARK(BM_ZsetZrange)->Arg(10)->Arg(100);
+
+void BM_ZsetZrangeByScore(benchmark::State& state) {
+	std::vector<std::string> members = makeMembers();
+	KeyValueStore store;
+	fillZset(store, members);
+	std::mt19937_64 rng(13);
+	std::vector<std::pair<std::string, double>> out;
+	for (auto _ : state) {
+		ScoreRange range;
+		range.min = static_cast<double>(rng() % 999000);
+		range.max = range.min + 100;
+		out.clear();
+		store.zrangeByScore("zset", range, 0, -1, out);
+		benchmark::DoNotOptimize(out.data());
+	}
+}
+BENCHMARK(BM_ZsetZrangeByScore);
+
+// --- PubSub ---
+
+// One PUBLISH to a channel with state.range(0) subscribers, including each
+// subscriber queueing the message in its output buffer and sending it.
+void BM_PubSubFanOut(benchmark::State& state) {
+	size_t count = static_cast<size_t>(state.range(0));
+	PubSub pubsub;
+	std::vector<std::unique_ptr<PubSub::Subscriber>> subscribers;
+	std::vector<OutputBuffer> outputs(count);
+	for (size_t i = 0; i < count; ++i) {
+		subscribers.push_back(std::make_unique<PubSub::Subscriber>(nullptr));
+		pubsub.subscribe(*subscribers.back(), "news");
+	}
+	std::string payload(64, 'x');
+	std::vector<PubSub::Message> messages;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(pubsub.publish("news", payload));
+		for (size_t i = 0; i < count; ++i) {
+			subscribers[i]->take(messages);
+			for (PubSub::Message& message : messages) outputs[i].appendShared(std::move(message));
+			outputs[i].consume(outputs[i].size());
+		}
+	}
+	for (auto& subscriber : subscribers) pubsub.unsubscribeAll(*subscriber);
+	state.SetItemsProcessed(state.iterations() * static_cast<long long>(count));
+}
+BENCHMARK(BM_PubSubFanOut)->Arg(100)->Arg(10000);
+
+// PUBLISH against state.range(0) pattern subscriptions of which one matches;
+// the cost should stay flat as patterns are added.
+void BM_PubSubPatterns(benchmark::State& state) {
+	long long count = state.range(0);
+	PubSub pubsub;
+	PubSub::Subscriber subscriber(nullptr);
+	for (long long i = 0; i < count; ++i) {
+		pubsub.psubscribe(subscriber, "user:" + std::to_string(i) + ":*");
+	}
+	std::string channel = "user:" + std::to_string(count / 2) + ":login";
+	std::vector<PubSub::Message> messages;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(pubsub.publish(channel, "payload"));
+		subscriber.take(messages);
+	}
+	pubsub.unsubscribeAll(subscriber);
+}
+BENCHMARK(BM_PubSubPatterns)->Arg(10)->Arg(1000)->Arg(100000);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,468 @@
+// redislite-benchmark: a RESP load generator in the spirit of redis-benchmark
+// and wrk2. Worker threads each drive a share of the connections from their
+// own epoll loop, issuing a configurable mix of SET and GET over a random key
+// space with optional pipelining.
+//
+// Latency is corrected for coordinated omission. With --rate the load is open
+// loop: every request has an intended send time on a fixed schedule and its
+// latency is measured from that time, so a stalled server is charged for the
+// requests it kept the client from sending. Without --rate the load is closed
+// loop and each sample larger than the running mean is back-filled with the
+// samples a steady sender would have seen meanwhile, as HdrHistogram's
+// recordValueWithExpectedInterval does.
+#include "../headers/Metrics.h"
+#include "../headers/SocketCompat.h"
+
+#include <sys/epoll.h>
+#include <netdb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig {
+	std::string host = "127.0.0.1";
+	int port = 6379;
+	int clients = 50;
+	int threads = 4;
+	long long requests = 100000;
+	double duration = 0;          // seconds; when set, overrides requests
+	int pipeline = 1;             // requests in flight per connection
+	long long keyspace = 100000;
+	size_t valueMin = 3;          // value sizes are uniform in [valueMin, valueMax]
+	size_t valueMax = 3;
+	int setWeight = 1;            // --ratio SET:GET
+	int getWeight = 1;
+	double rate = 0;              // requests per second over all clients; 0 = closed loop
+};
+
+static void usage() {
+	std::cerr << "Usage: redislite-benchmark [--host h] [--port N] [--clients N] [--threads N]"
+		<< " [--requests N | --duration seconds] [--pipeline N] [--keyspace N]"
+		<< " [--value-size N | --value-size min-max] [--ratio set:get] [--rate requests/s]" << std::endl;
+}
+
+template <typename T>
+static bool parseNumber(std::string_view s, T& out) {
+	const char* end = s.data() + s.size();
+	auto [ptr, ec] = std::from_chars(s.data(), end, out);
+	return !s.empty() && ec == std::errc() && ptr == end;
+}
+
+static bool parseArgs(int argc, char* argv[], BenchConfig& config, std::string& error) {
+	for (int i = 1; i < argc; ++i) {
+		std::string name = argv[i];
+		if (i + 1 >= argc) {
+			error = "Missing value for " + name;
+			return false;
+		}
+		std::string value = argv[++i];
+		bool ok = true;
+
+		if (name == "--host") config.host = value;
+		else if (name == "--port") ok = parseNumber(value, config.port) && config.port > 0 && config.port <= 65535;
+		else if (name == "--clients") ok = parseNumber(value, config.clients) && config.clients > 0;
+		else if (name == "--threads") ok = parseNumber(value, config.threads) && config.threads > 0;
+		else if (name == "--requests") ok = parseNumber(value, config.requests) && config.requests > 0;
+		else if (name == "--duration") ok = parseNumber(value, config.duration) && config.duration > 0;
+		else if (name == "--pipeline") ok = parseNumber(value, config.pipeline) && config.pipeline > 0;
+		else if (name == "--keyspace") ok = parseNumber(value, config.keyspace) && config.keyspace > 0;
+		else if (name == "--rate") ok = parseNumber(value, config.rate) && config.rate >= 0;
+		else if (name == "--value-size") {
+			size_t dash = value.find('-');
+			if (dash == std::string::npos) {
+				ok = parseNumber(value, config.valueMin);
+				config.valueMax = config.valueMin;
+			}
+			else {
+				ok = parseNumber(std::string_view(value).substr(0, dash), config.valueMin)
+					&& parseNumber(std::string_view(value).substr(dash + 1), config.valueMax)
+					&& config.valueMin <= config.valueMax;
+			}
+		}
+		else if (name == "--ratio") {
+			size_t colon = value.find(':');
+			ok = colon != std::string::npos
+				&& parseNumber(std::string_view(value).substr(0, colon), config.setWeight)
+				&& parseNumber(std::string_view(value).substr(colon + 1), config.getWeight)
+				&& config.setWeight >= 0 && config.getWeight >= 0 && config.setWeight + config.getWeight > 0;
+		}
+		else {
+			error = "Unknown option: " + name;
+			return false;
+		}
+		if (!ok) {
+			error = "Invalid value for " + name + ": " + value;
+			return false;
+		}
+	}
+	config.threads = std::min(config.threads, config.clients);
+	return true;
+}
+
+// Length of the complete RESP reply at the start of data, 0 if it is not
+// complete yet. Sets isError for a top-level error reply.
+static size_t replyLength(const char* data, size_t size, bool& isError) {
+	const char* lineEnd = static_cast<const char*>(memchr(data, '\n', size));
+	if (size == 0 || !lineEnd) return 0;
+	size_t header = static_cast<size_t>(lineEnd - data) + 1;
+	isError = data[0] == '-';
+
+	long long n = 0;
+	if (data[0] == '$' || data[0] == '*') {
+		std::from_chars(data + 1, lineEnd - 1, n);
+	}
+	if (data[0] == '$') {
+		if (n < 0) return header;
+		size_t total = header + static_cast<size_t>(n) + 2;
+		return total <= size ? total : 0;
+	}
+	if (data[0] == '*') {
+		size_t total = header;
+		for (long long i = 0; i < n; ++i) {
+			bool nestedError = false;
+			size_t element = replyLength(data + total, size - total, nestedError);
+			if (element == 0) return 0;
+			total += element;
+		}
+		return total;
+	}
+	return header; // +simple, -error, :integer
+}
+
+struct ThreadResult {
+	LatencyHistogram latency;
+	uint64_t completed = 0;
+	uint64_t errors = 0;
+	bool failed = false;
+};
+
+class Worker {
+public:
+	Worker(const BenchConfig& config, int connections, std::atomic<long long>& budget, Clock::time_point deadline, unsigned seed)
+		: config(config), connectionCount(connections), budget(budget), deadline(deadline), rng(seed),
+		keyDist(0, config.keyspace - 1), sizeDist(config.valueMin, config.valueMax),
+		opDist(0, config.setWeight + config.getWeight - 1), value(config.valueMax, 'x') {}
+
+	void run(ThreadResult& result);
+
+private:
+	struct Conn {
+		SOCKET fd = INVALID_SOCKET;
+		std::string out;
+		size_t outOffset = 0;
+		std::string in;
+		size_t inOffset = 0;
+		std::deque<Clock::time_point> inflight; // start (or intended start) of each pending request
+		Clock::time_point nextSend;             // open loop: intended time of the next request
+	};
+
+	const BenchConfig& config;
+	int connectionCount;
+	std::atomic<long long>& budget;
+	Clock::time_point deadline;
+	std::mt19937_64 rng;
+	std::uniform_int_distribution<long long> keyDist;
+	std::uniform_int_distribution<size_t> sizeDist;
+	std::uniform_int_distribution<int> opDist;
+	std::string value;
+	std::vector<Conn> conns;
+	int epollFd = -1;
+	bool exhausted = false;
+	Clock::duration interval{};     // open loop: per-connection request interval
+	uint64_t meanCount = 0;         // closed loop: running mean for back-filling
+	double meanNanos = 0;
+
+	bool connectAll();
+	bool claimRequest();
+	void appendRequest(Conn& conn);
+	void fill(Conn& conn, Clock::time_point now);
+	bool flush(Conn& conn);
+	bool drain(Conn& conn, ThreadResult& result);
+	void record(ThreadResult& result, uint64_t nanos);
+};
+
+bool Worker::connectAll() {
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addr = nullptr;
+	if (getaddrinfo(config.host.c_str(), std::to_string(config.port).c_str(), &hints, &addr) != 0 || !addr) {
+		std::cerr << "Cannot resolve " << config.host << std::endl;
+		return false;
+	}
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	conns.resize(static_cast<size_t>(connectionCount));
+	bool ok = epollFd != -1;
+	for (size_t i = 0; ok && i < conns.size(); ++i) {
+		Conn& conn = conns[i];
+		conn.fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (conn.fd == INVALID_SOCKET || connect(conn.fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+			std::cerr << "Cannot connect to " << config.host << ":" << config.port << ": " << std::strerror(errno) << std::endl;
+			ok = false;
+			break;
+		}
+		setNoDelay(conn.fd);
+		setNonBlocking(conn.fd);
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.u64 = i;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, conn.fd, &ev);
+	}
+	freeaddrinfo(addr);
+	return ok;
+}
+
+bool Worker::claimRequest() {
+	if (exhausted) return false;
+	if (config.duration > 0) {
+		exhausted = Clock::now() >= deadline;
+	}
+	else {
+		exhausted = budget.fetch_sub(1, std::memory_order_relaxed) <= 0;
+	}
+	return !exhausted;
+}
+
+void Worker::appendRequest(Conn& conn) {
+	char key[32];
+	int keyLength = std::snprintf(key, sizeof(key), "key:%012lld", keyDist(rng));
+	char header[64];
+	if (opDist(rng) < config.setWeight) {
+		size_t size = sizeDist(rng);
+		int n = std::snprintf(header, sizeof(header), "*3\r\n$3\r\nSET\r\n$%d\r\n", keyLength);
+		conn.out.append(header, static_cast<size_t>(n));
+		conn.out.append(key, static_cast<size_t>(keyLength));
+		n = std::snprintf(header, sizeof(header), "\r\n$%zu\r\n", size);
+		conn.out.append(header, static_cast<size_t>(n));
+		conn.out.append(value.data(), size);
+		conn.out.append("\r\n");
+	}
+	else {
+		int n = std::snprintf(header, sizeof(header), "*2\r\n$3\r\nGET\r\n$%d\r\n", keyLength);
+		conn.out.append(header, static_cast<size_t>(n));
+		conn.out.append(key, static_cast<size_t>(keyLength));
+		conn.out.append("\r\n");
+	}
+}
+
+// Queues as many requests as the mode allows right now.
+void Worker::fill(Conn& conn, Clock::time_point now) {
+	size_t depth = static_cast<size_t>(config.pipeline);
+	if (config.rate > 0) {
+		// Open loop: everything that is due, up to the pipeline depth. A request
+		// that could not be sent on time keeps its intended start.
+		while (conn.inflight.size() < depth && conn.nextSend <= now && claimRequest()) {
+			appendRequest(conn);
+			conn.inflight.push_back(conn.nextSend);
+			conn.nextSend += interval;
+		}
+	}
+	else if (conn.inflight.empty()) {
+		// Closed loop: a full pipeline once the previous one is answered.
+		while (conn.inflight.size() < depth && claimRequest()) {
+			appendRequest(conn);
+			conn.inflight.push_back(now);
+		}
+	}
+}
+
+bool Worker::flush(Conn& conn) {
+	while (conn.outOffset < conn.out.size()) {
+		ssize_t n = send(conn.fd, conn.out.data() + conn.outOffset, conn.out.size() - conn.outOffset, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			return false;
+		}
+		conn.outOffset += static_cast<size_t>(n);
+	}
+	if (conn.outOffset == conn.out.size()) {
+		conn.out.clear();
+		conn.outOffset = 0;
+	}
+	return true;
+}
+
+void Worker::record(ThreadResult& result, uint64_t nanos) {
+	result.latency.record(nanos);
+	if (config.rate > 0) return;
+
+	// Closed loop: back-fill what a sender with the mean interval would have seen.
+	const int MAX_BACKFILL = 10000;
+	++meanCount;
+	meanNanos += (static_cast<double>(nanos) - meanNanos) / static_cast<double>(meanCount);
+	uint64_t expected = static_cast<uint64_t>(meanNanos);
+	if (expected == 0 || nanos <= expected) return;
+	uint64_t missing = nanos - expected;
+	for (int i = 0; i < MAX_BACKFILL && missing >= expected; ++i, missing -= expected) {
+		result.latency.record(missing);
+	}
+}
+
+bool Worker::drain(Conn& conn, ThreadResult& result) {
+	char buf[64 * 1024];
+	while (true) {
+		ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+		if (n > 0) {
+			conn.in.append(buf, static_cast<size_t>(n));
+			continue;
+		}
+		if (n == 0) return false;
+		if (errno == EINTR) continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+		return false;
+	}
+
+	Clock::time_point now = Clock::now();
+	while (true) {
+		bool isError = false;
+		size_t length = replyLength(conn.in.data() + conn.inOffset, conn.in.size() - conn.inOffset, isError);
+		if (length == 0) break;
+		conn.inOffset += length;
+		if (conn.inflight.empty()) continue; // unsolicited; should not happen
+		record(result, Metrics::nanosBetween(conn.inflight.front(), now));
+		conn.inflight.pop_front();
+		++result.completed;
+		if (isError) ++result.errors;
+	}
+	conn.in.erase(0, conn.inOffset);
+	conn.inOffset = 0;
+	return true;
+}
+
+void Worker::run(ThreadResult& result) {
+	if (!connectAll()) {
+		result.failed = true;
+		return;
+	}
+	if (config.rate > 0) {
+		double perConnection = config.rate / config.clients;
+		interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / perConnection));
+		// Stagger the connections across one interval.
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < conns.size(); ++i) {
+			conns[i].nextSend = start + interval * static_cast<long long>(i) / static_cast<long long>(conns.size());
+		}
+	}
+
+	const int MAX_EVENTS = 256;
+	epoll_event events[MAX_EVENTS];
+	while (true) {
+		Clock::time_point now = Clock::now();
+		bool pending = false;
+		Clock::time_point nextDue = now + std::chrono::milliseconds(100);
+		for (Conn& conn : conns) {
+			fill(conn, now);
+			if (!flush(conn)) {
+				result.failed = true;
+				return;
+			}
+			pending = pending || !conn.inflight.empty();
+			if (config.rate > 0 && conn.inflight.size() < static_cast<size_t>(config.pipeline)) {
+				nextDue = std::min(nextDue, conn.nextSend);
+			}
+		}
+		if (!pending && exhausted) break;
+
+		int timeoutMs = 100;
+		if (config.rate > 0 && !exhausted) {
+			// Round up: waking early would only spin.
+			timeoutMs = static_cast<int>(std::max<long long>(0,
+				std::chrono::ceil<std::chrono::milliseconds>(nextDue - Clock::now()).count()));
+		}
+		int n = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+		for (int i = 0; i < n; ++i) {
+			Conn& conn = conns[events[i].data.u64];
+			if (!drain(conn, result)) {
+				std::cerr << "Connection closed by server" << std::endl;
+				result.failed = true;
+				return;
+			}
+		}
+	}
+
+	for (Conn& conn : conns) {
+		closesocket(conn.fd);
+	}
+	::close(epollFd);
+}
+
+static std::string micros(uint64_t nanos) {
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.3f", nanos / 1000.0);
+	return buf;
+}
+
+int main(int argc, char* argv[]) {
+	BenchConfig config;
+	std::string error;
+	if (!parseArgs(argc, argv, config, error)) {
+		std::cerr << error << std::endl;
+		usage();
+		return 1;
+	}
+
+	std::atomic<long long> budget{ config.requests };
+	Clock::time_point started = Clock::now();
+	Clock::time_point deadline = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.duration));
+
+	std::vector<std::unique_ptr<ThreadResult>> results;
+	std::vector<std::thread> threads;
+	std::random_device seed;
+	for (int t = 0; t < config.threads; ++t) {
+		int connections = config.clients / config.threads + (t < config.clients % config.threads ? 1 : 0);
+		results.push_back(std::make_unique<ThreadResult>());
+		unsigned threadSeed = seed();
+		threads.emplace_back([&config, &budget, deadline, connections, threadSeed, result = results.back().get()]() {
+			Worker worker(config, connections, budget, deadline, threadSeed);
+			worker.run(*result);
+		});
+	}
+	for (std::thread& t : threads) {
+		t.join();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+	HistogramSnapshot latency;
+	uint64_t completed = 0;
+	uint64_t errors = 0;
+	bool failed = false;
+	for (const auto& result : results) {
+		latency.add(result->latency);
+		completed += result->completed;
+		errors += result->errors;
+		failed = failed || result->failed;
+	}
+	if (failed && completed == 0) {
+		return 1;
+	}
+
+	std::printf("====== redislite-benchmark ======\n");
+	std::printf("  %d clients over %d threads, pipeline %d, keyspace %lld, value size %zu-%zu bytes, SET:GET %d:%d, %s\n",
+		config.clients, config.threads, config.pipeline, config.keyspace, config.valueMin, config.valueMax,
+		config.setWeight, config.getWeight, config.rate > 0 ? "open loop" : "closed loop");
+	if (config.rate > 0) {
+		std::printf("  target rate: %.0f requests per second\n", config.rate);
+	}
+	std::printf("  %llu requests completed in %.2f seconds (%llu errors)\n",
+		static_cast<unsigned long long>(completed), seconds, static_cast<unsigned long long>(errors));
+	std::printf("  throughput: %.2f requests per second\n", seconds > 0 ? completed / seconds : 0.0);
+	std::printf("  latency (usec, corrected for coordinated omission): p50=%s p99=%s p99.9=%s max=%s\n",
+		micros(latency.percentile(0.50)).c_str(), micros(latency.percentile(0.99)).c_str(),
+		micros(latency.percentile(0.999)).c_str(), micros(latency.percentile(1.0)).c_str());
+	return failed ? 1 : 0;
+}
@@ -1,21 +1,111 @@
 #pragma once
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <string>
 #include <mutex>
+#include <thread>
 #include "../headers/KeyValueStore.h"
 #include "../headers/Command.h"
 
+// Mirrors Redis' appendfsync setting.
+enum class FsyncPolicy {
+	ALWAYS,   // fsync every group commit; replies wait until their write is durable
+	EVERYSEC, // fsync at most once per second
+	NO        // never fsync; the OS flushes when it likes
+};
+
+// Write commands are serialized into an in-memory batch by the calling thread
+// and handed to a dedicated writer thread, which writes each batch with one
+// write() call and fsyncs according to the policy (group commit).
+//
+// A background rewrite (BGREWRITEAOF) writes a minimal AOF from the store's
+// current contents into a temporary file, one shard at a time. A write to a
+// shard that has already been copied is also kept in a rewrite buffer and
+// appended to the new file, which the writer thread then renames over the old
+// one; a write to a shard not yet copied is part of the copy. Shards are
+// marked copied under their lock, and writes are logged under it, so each
+// write lands on exactly one side of the cut. With the RDB preamble enabled,
+// the rewritten file starts with a binary snapshot instead of SET commands.
 class AOFManager {
 private:
 	std::string filePath;
-	std::ofstream aofFile;
+	int fd = -1;                        // owned by the writer thread once it runs
+	bool opened = false;
+	FsyncPolicy policy;
+
 	std::mutex mtx;
+	std::condition_variable pendingCv;  // writer waits for work
+	std::condition_variable durableCv;  // ALWAYS-mode callers wait for fsync
+	std::string pending;                // serialized commands not yet written
+	uint64_t appendedSeq = 0;           // sequence number of the last queued command
+	uint64_t durableSeq = 0;            // last sequence number written (and synced, for ALWAYS)
+	bool stopping = false;
+	std::thread writer;
+
+	std::mutex rewriteThreadMtx;
+	std::thread rewriteThread;
+	bool rewriteInProgress = false;     // guarded by mtx
+	bool rewriteReady = false;          // guarded by mtx: snapshot done, writer should switch files
+	int rewriteFd = -1;
+	std::string rewriteBuffer;          // guarded by mtx: writes to copied shards since the rewrite started
+	KeyValueStore* rewriteStore = nullptr; // guarded by mtx
+	std::vector<bool> rewriteCopied;    // guarded by mtx: shards already in the rewrite file
+	std::atomic<bool> rewriteAbort{ false };
+
+	// Written by the writer thread only; read by stats().
+	std::atomic<uint64_t> currentSize{ 0 }; // bytes in the active AOF
+	std::atomic<uint64_t> baseSize{ 0 };    // size right after the last rewrite (or at startup)
+
+	bool rdbPreamble = false;           // rewrite starts with a binary snapshot
+	bool rdbPreambleCompression = true;
+
+	KeyValueStore* autoRewriteStore = nullptr;
+	int autoRewritePercentage = 0;
+	uint64_t autoRewriteMinSize = 0;
+
+	void writerLoop();
+	void rewriteMain(KeyValueStore& store);
+	void bufferForRewrite(const Command& cmd, std::string_view record);
+	void finishRewrite();
+	std::string tempRewritePath() const;
 
 public:
-	explicit AOFManager(const std::string& path = "./appendonly.aof");
+	struct Stats {
+		uint64_t currentSize = 0;
+		uint64_t baseSize = 0;
+		uint64_t pendingRecords = 0; // queued but not yet written (the AOF lag)
+		uint64_t pendingBytes = 0;
+		bool rewriteInProgress = false;
+	};
+
+	explicit AOFManager(const std::string& path = "./appendonly.aof", FsyncPolicy fsyncPolicy = FsyncPolicy::EVERYSEC);
 	~AOFManager();
 
-	bool appendCommand(const Command& cmd);
+	// Appends the RESP record that logs cmd to out. Returns false, leaving out
+	// untouched, if cmd is not a logged write.
+	static bool serialize(const Command& cmd, std::string& out);
+
+	// Queues cmd for the writer thread. Returns its sequence number, or 0 if the
+	// command was not logged (not a write command, or the file is not open).
+	uint64_t appendCommand(const Command& cmd);
+	// Blocks until every command up to seq has been written and, under
+	// FsyncPolicy::ALWAYS, fsynced.
+	void waitForDurable(uint64_t seq);
+	bool syncBeforeReply() const { return policy == FsyncPolicy::ALWAYS; }
+
+	// Starts a background rewrite from store. Returns false if one is already
+	// running or the AOF is not open.
+	bool startRewrite(KeyValueStore& store);
+	// Rewrites automatically once the AOF has grown by percentage% over its
+	// post-rewrite size and is at least minSize bytes. percentage 0 disables it.
+	void enableAutoRewrite(KeyValueStore& store, int percentage, uint64_t minSize);
+	bool isRewriting();
+	Stats stats();
+	// Hybrid persistence: rewrites write the store as a SnapshotManager snapshot
+	// followed by the RESP tail, instead of one SET per key.
+	void setRdbPreamble(bool enabled, bool compress);
+
 	bool loadFromFile(KeyValueStore& store);
 	void close();
 };
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Wall-clock time in Unix milliseconds, cached like Redis' server.mstime.
+// Key expiry and the LRU clock read the cached value, so a lookup costs one
+// relaxed load instead of a clock read. Every thread that drives commands
+// calls update() once per tick (an event-loop read batch, an expiry cycle,
+// a chunk of AOF or replication stream), so the value lags by at most one
+// tick of the busiest thread.
+class CachedClock {
+public:
+	static int64_t unixMs() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	static int64_t nowMs() { return cached.load(std::memory_order_relaxed); }
+
+	static int64_t update() {
+		int64_t now = unixMs();
+		// Skip the store when the millisecond has not changed, so threads
+		// updating together do not bounce the cache line.
+		if (cached.load(std::memory_order_relaxed) != now) {
+			cached.store(now, std::memory_order_relaxed);
+		}
+		return now;
+	}
+
+private:
+	static inline std::atomic<int64_t> cached{ unixMs() };
+};
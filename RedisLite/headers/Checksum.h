@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, reflected, as used by zlib). Pass the previous result
+// as crc to checksum data incrementally; start from 0.
+uint32_t crc32(uint32_t crc, const void* data, size_t len);
\ No newline at end of file
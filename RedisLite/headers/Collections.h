@@ -0,0 +1,177 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <utility>
+#include "Listpack.h"
+#include "SkipList.h"
+
+// Values of the collection types. Each starts in a single Listpack and moves
+// to a node-based structure once it passes the thresholds below (Redis's
+// defaults); hashes and sets never move back, lists do when they shrink
+// back into one small node.
+static constexpr size_t HASH_MAX_LISTPACK_ENTRIES = 128;
+static constexpr size_t HASH_MAX_LISTPACK_VALUE = 64;
+static constexpr size_t SET_MAX_LISTPACK_ENTRIES = 128;
+static constexpr size_t SET_MAX_LISTPACK_VALUE = 64;
+static constexpr size_t LIST_MAX_LISTPACK_BYTES = 8 * 1024;
+static constexpr size_t ZSET_MAX_LISTPACK_ENTRIES = 128;
+static constexpr size_t ZSET_MAX_LISTPACK_VALUE = 64;
+
+// Lets the tables below be probed with a string_view without a temporary.
+struct StringViewHash {
+	using is_transparent = void;
+	size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+// memoryUsage() is kept up to date incrementally, so it is O(1).
+
+class HashValue {
+private:
+	using Table = std::unordered_map<std::string, std::string, StringViewHash, std::equal_to<>>;
+	Listpack small; // field, value, field, value...
+	std::unique_ptr<Table> table;
+	size_t tableBytes = 0;
+
+	void convertToTable();
+
+public:
+	// Returns true if field is new.
+	bool set(std::string_view field, std::string_view value);
+	bool get(std::string_view field, std::string& value) const;
+	bool erase(std::string_view field);
+	size_t size() const;
+	size_t memoryUsage() const;
+	const char* encodingName() const { return table ? "hashtable" : "listpack"; }
+
+	template <typename F>
+	void forEach(F&& f) const {
+		if (table) {
+			for (const auto& item : *table) f(std::string_view(item.first), std::string_view(item.second));
+			return;
+		}
+		for (size_t pos = small.begin(); pos < small.end();) {
+			std::string_view field = small.get(pos, pos);
+			std::string_view value = small.get(pos, pos);
+			f(field, value);
+		}
+	}
+};
+
+// A list is one Listpack while it fits in LIST_MAX_LISTPACK_BYTES, and a
+// quicklist (a deque of Listpack nodes of up to that size) beyond that.
+class ListValue {
+private:
+	Listpack small;
+	std::unique_ptr<std::deque<Listpack>> nodes;
+	size_t count = 0;
+	size_t nodeBytes = 0;
+
+	void convertToQuicklist();
+	void maybeConvertToListpack();
+
+public:
+	void pushFront(std::string_view value);
+	void pushBack(std::string_view value);
+	bool popFront(std::string& value);
+	bool popBack(std::string& value);
+	// Elements start..stop inclusive; negative indexes count from the end.
+	void range(long long start, long long stop, std::vector<std::string>& out) const;
+	size_t size() const { return count; }
+	size_t memoryUsage() const;
+	const char* encodingName() const { return nodes ? "quicklist" : "listpack"; }
+
+	template <typename F>
+	void forEach(F&& f) const {
+		if (!nodes) {
+			small.forEach(f);
+			return;
+		}
+		for (const Listpack& node : *nodes) node.forEach(f);
+	}
+};
+
+class SetValue {
+private:
+	using Table = std::unordered_set<std::string, StringViewHash, std::equal_to<>>;
+	Listpack small;
+	std::unique_ptr<Table> table;
+	size_t tableBytes = 0;
+
+	void convertToTable();
+
+public:
+	// Returns true if member was not already present.
+	bool add(std::string_view member);
+	bool remove(std::string_view member);
+	bool contains(std::string_view member) const;
+	size_t size() const;
+	size_t memoryUsage() const;
+	const char* encodingName() const { return table ? "hashtable" : "listpack"; }
+
+	template <typename F>
+	void forEach(F&& f) const {
+		if (table) {
+			for (const std::string& member : *table) f(std::string_view(member));
+			return;
+		}
+		small.forEach(f);
+	}
+};
+
+// A sorted set is a Listpack of member, score pairs kept in (score, member)
+// order while small, and a SkipList plus a member index beyond that, as in
+// Redis. Scores are stored as the raw bytes of a double.
+class ZSetValue {
+private:
+	using Index = std::unordered_map<std::string_view, SkipList::Node*, StringViewHash, std::equal_to<>>;
+	Listpack small;
+	std::unique_ptr<SkipList> list;
+	// Keys view the member strings owned by the skiplist nodes.
+	std::unique_ptr<Index> index;
+
+	static double scoreAt(const Listpack& lp, size_t pos);
+	void insertSmall(double score, std::string_view member);
+	void convertToSkipList();
+
+public:
+	enum class AddResult { NONE, ADDED, UPDATED };
+
+	// nx: only add new members; xx: only update existing ones.
+	AddResult add(double score, std::string_view member, bool nx = false, bool xx = false);
+	bool remove(std::string_view member);
+	bool score(std::string_view member, double& out) const;
+	// 0-based rank in ascending order.
+	bool rank(std::string_view member, size_t& out) const;
+	// Members at ranks start..stop inclusive; negative ranks count from the end.
+	void range(long long start, long long stop, std::vector<std::pair<std::string, double>>& out) const;
+	// Members in range, skipping offset of them and returning at most limit
+	// (no limit if negative).
+	void rangeByScore(const ScoreRange& range, long long offset, long long limit, std::vector<std::pair<std::string, double>>& out) const;
+	size_t removeRangeByScore(const ScoreRange& range);
+	size_t size() const;
+	size_t memoryUsage() const;
+	const char* encodingName() const { return list ? "skiplist" : "listpack"; }
+
+	// Shortest text that parses back to the same double, as replies use.
+	static std::string formatScore(double score);
+
+	template <typename F>
+	void forEach(F&& f) const {
+		if (list) {
+			for (SkipList::Node* node = list->first(); node; node = node->next()) f(std::string_view(node->member), node->score);
+			return;
+		}
+		for (size_t pos = small.begin(); pos < small.end();) {
+			std::string_view member = small.get(pos, pos);
+			double score = scoreAt(small, pos);
+			pos = small.next(pos);
+			f(member, score);
+		}
+	}
+};
@@ -1,17 +1,115 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
+#include <utility>
+#include <vector>
+#include "SkipList.h"
 enum class CommandType {
 	SET,
 	GET,
 	DEL,
 	EXISTS,
+	MGET,
+	MSET,
+	INCRBY,      // INCR, DECR, INCRBY and DECRBY, with the signed delta in increment
+	INCRBYFLOAT,
+	BGREWRITEAOF,
+	SAVE,
+	BGSAVE,
+	LASTSAVE,
+	INFO,
+	SCAN,
+	KEYS,
+	DBSIZE,
+	HSET,
+	HGET,
+	HDEL,
+	HGETALL,
+	HLEN,
+	LPUSH,
+	RPUSH,
+	LPOP,
+	RPOP,
+	LRANGE,
+	LLEN,
+	SADD,
+	SREM,
+	SISMEMBER,
+	SMEMBERS,
+	SCARD,
+	EXPIRE,      // EXPIRE, PEXPIRE, EXPIREAT and PEXPIREAT, with the time in expireMillis
+	TTL,
+	PTTL,
+	PERSIST,
+	TYPE,
+	OBJECT,      // OBJECT ENCODING key
+	ZADD,
+	ZREM,
+	ZSCORE,
+	ZRANK,
+	ZCARD,
+	ZRANGE,
+	ZRANGEBYSCORE,
+	ZREMRANGEBYSCORE,
+	SLOWLOG_GET,     // SLOWLOG GET [count], with the count in count
+	SLOWLOG_LEN,
+	SLOWLOG_RESET,
+	LATENCY_LATEST,
+	LATENCY_HISTORY, // LATENCY HISTORY event, with the event in key
+	LATENCY_RESET,   // LATENCY RESET [event ...]
+	PING,            // PING [message], with the message in value
+	REPLCONF,        // REPLCONF option value ...: key is "ACK" for ACK/GETACK, count the offset or listening-port
+	PSYNC,           // PSYNC replid offset, with the replication ID in key and the offset in count
+	REPLICAOF,       // REPLICAOF host port (host in key, port in count) or REPLICAOF NO ONE (empty key)
+	ROLE,
+	SUBSCRIBE,       // SUBSCRIBE channel ..., with the channels in args
+	UNSUBSCRIBE,     // UNSUBSCRIBE [channel ...]; none means all
+	PSUBSCRIBE,
+	PUNSUBSCRIBE,
+	PUBLISH,         // PUBLISH channel message, with the channel in key and the message in value
+	HELLO,           // HELLO [protover], with the version in count (0 when absent)
+	CLIENT_ID,
+	CLIENT_TRACKING, // CLIENT TRACKING on|off [REDIRECT id] [BCAST] [PREFIX prefix ...] [NOLOOP], with the id in count
+	CLIENT_TRACKINGINFO,
+	CLIENT_GETREDIR,
+	COMMAND,         // COMMAND: every top-level command
+	COMMAND_COUNT,
+	COMMAND_INFO,    // COMMAND INFO [name ...], with the names in args
 	UNKNOWN
 };
 
+struct CommandSpec;
+
+// All views point into the buffer the command was parsed from, so a Command
+// is only valid while that buffer is unchanged.
 struct Command {
 	CommandType type = CommandType::UNKNOWN;
-	std::string key;
-	std::string value; // Only for SET
-	std::optional<int> ttlSeconds; // Only for SET with TTL
+	const CommandSpec* spec = nullptr; // table entry of a parsed command; null for one the server builds
+	std::string_view key;
+	std::string_view value; // Only for SET
+	// SET EX/PX/EXAT/PXAT and the EXPIRE family, in milliseconds: a TTL, or a
+	// Unix time when expireAbsolute is set.
+	std::optional<long long> expireMillis;
+	bool expireAbsolute = false;
+	bool keepTtl = false; // SET ... KEEPTTL
+	long long increment = 0; // Only for INCRBY
+	unsigned long long cursor = 0; // Only for SCAN
+	long long count = 10; // SCAN COUNT hint, SLOWLOG GET count, PSYNC offset, REPLCONF value and REPLICAOF port
+	std::string_view pattern; // SCAN MATCH ("*" when absent) and KEYS
+	long long start = 0; // LRANGE and ZRANGE
+	long long stop = -1; // LRANGE and ZRANGE
+	std::vector<std::pair<double, std::string_view>> scoredMembers; // Only for ZADD
+	bool nx = false; // ZADD NX
+	bool xx = false; // ZADD XX
+	bool ch = false; // ZADD CH
+	ScoreRange range; // ZRANGEBYSCORE and ZREMRANGEBYSCORE
+	bool withScores = false; // ZRANGE and ZRANGEBYSCORE
+	long long offset = 0; // ZRANGEBYSCORE LIMIT
+	long long limit = -1; // ZRANGEBYSCORE LIMIT (negative means all)
+	bool on = false; // CLIENT TRACKING on
+	bool bcast = false; // CLIENT TRACKING BCAST
+	bool noloop = false; // CLIENT TRACKING NOLOOP
+	std::vector<std::string_view> prefixes; // CLIENT TRACKING PREFIX
+	std::vector<std::string_view> args; // Every element of the request, including the command name
 };
\ No newline at end of file
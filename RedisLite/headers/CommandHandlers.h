@@ -0,0 +1,68 @@
+#pragma once
+
+class TCPServer;
+struct Command;
+struct Connection;
+
+// The command handlers, one per CommandSpec::handler. Commands that differ only
+// in a direction or a unit (LPUSH/RPUSH, TTL/PTTL) share one.
+struct CommandHandlers {
+	static void set(TCPServer& server, const Command& cmd, Connection& conn);
+	static void get(TCPServer& server, const Command& cmd, Connection& conn);
+	static void del(TCPServer& server, const Command& cmd, Connection& conn);
+	static void exists(TCPServer& server, const Command& cmd, Connection& conn);
+	static void mget(TCPServer& server, const Command& cmd, Connection& conn);
+	static void mset(TCPServer& server, const Command& cmd, Connection& conn);
+	static void incrBy(TCPServer& server, const Command& cmd, Connection& conn);
+	static void incrByFloat(TCPServer& server, const Command& cmd, Connection& conn);
+	static void bgrewriteaof(TCPServer& server, const Command& cmd, Connection& conn);
+	static void save(TCPServer& server, const Command& cmd, Connection& conn);
+	static void bgsave(TCPServer& server, const Command& cmd, Connection& conn);
+	static void lastsave(TCPServer& server, const Command& cmd, Connection& conn);
+	static void info(TCPServer& server, const Command& cmd, Connection& conn);
+	static void scan(TCPServer& server, const Command& cmd, Connection& conn);
+	static void keys(TCPServer& server, const Command& cmd, Connection& conn);
+	static void dbsize(TCPServer& server, const Command& cmd, Connection& conn);
+	static void hset(TCPServer& server, const Command& cmd, Connection& conn);
+	static void hget(TCPServer& server, const Command& cmd, Connection& conn);
+	static void hdel(TCPServer& server, const Command& cmd, Connection& conn);
+	static void readAll(TCPServer& server, const Command& cmd, Connection& conn);
+	static void length(TCPServer& server, const Command& cmd, Connection& conn);
+	static void push(TCPServer& server, const Command& cmd, Connection& conn);
+	static void pop(TCPServer& server, const Command& cmd, Connection& conn);
+	static void lrange(TCPServer& server, const Command& cmd, Connection& conn);
+	static void saddSrem(TCPServer& server, const Command& cmd, Connection& conn);
+	static void sismember(TCPServer& server, const Command& cmd, Connection& conn);
+	static void expire(TCPServer& server, const Command& cmd, Connection& conn);
+	static void ttl(TCPServer& server, const Command& cmd, Connection& conn);
+	static void persist(TCPServer& server, const Command& cmd, Connection& conn);
+	static void type(TCPServer& server, const Command& cmd, Connection& conn);
+	static void objectEncoding(TCPServer& server, const Command& cmd, Connection& conn);
+	static void zadd(TCPServer& server, const Command& cmd, Connection& conn);
+	static void zremove(TCPServer& server, const Command& cmd, Connection& conn);
+	static void zscore(TCPServer& server, const Command& cmd, Connection& conn);
+	static void zrank(TCPServer& server, const Command& cmd, Connection& conn);
+	static void zcard(TCPServer& server, const Command& cmd, Connection& conn);
+	static void zrange(TCPServer& server, const Command& cmd, Connection& conn);
+	static void slowlogGet(TCPServer& server, const Command& cmd, Connection& conn);
+	static void slowlogLen(TCPServer& server, const Command& cmd, Connection& conn);
+	static void slowlogReset(TCPServer& server, const Command& cmd, Connection& conn);
+	static void latencyLatest(TCPServer& server, const Command& cmd, Connection& conn);
+	static void latencyHistory(TCPServer& server, const Command& cmd, Connection& conn);
+	static void latencyReset(TCPServer& server, const Command& cmd, Connection& conn);
+	static void ping(TCPServer& server, const Command& cmd, Connection& conn);
+	static void replconf(TCPServer& server, const Command& cmd, Connection& conn);
+	static void psync(TCPServer& server, const Command& cmd, Connection& conn);
+	static void replicaof(TCPServer& server, const Command& cmd, Connection& conn);
+	static void role(TCPServer& server, const Command& cmd, Connection& conn);
+	static void subscribe(TCPServer& server, const Command& cmd, Connection& conn);
+	static void unsubscribe(TCPServer& server, const Command& cmd, Connection& conn);
+	static void publish(TCPServer& server, const Command& cmd, Connection& conn);
+	static void hello(TCPServer& server, const Command& cmd, Connection& conn);
+	static void clientId(TCPServer& server, const Command& cmd, Connection& conn);
+	static void clientTracking(TCPServer& server, const Command& cmd, Connection& conn);
+	static void clientTrackingInfo(TCPServer& server, const Command& cmd, Connection& conn);
+	static void clientGetRedir(TCPServer& server, const Command& cmd, Connection& conn);
+	static void commandInfo(TCPServer& server, const Command& cmd, Connection& conn);
+	static void commandCount(TCPServer& server, const Command& cmd, Connection& conn);
+};
@@ -1,16 +1,83 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "../headers/Command.h"
 
 struct ParseResult {
 	enum Status {OK, INCOMPLETE, ERR};
 	Status status = Status::INCOMPLETE;
 	Command command;
-	size_t bytesConsumed;
+	size_t bytesConsumed = 0;
 	std::string errorMessage;
 };
 
+// Command flags, reported by COMMAND INFO.
+enum CommandFlag : uint32_t {
+	CMD_WRITE = 1 << 0,     // modifies the dataset; refused by read-only replicas
+	CMD_READONLY = 1 << 1,
+	CMD_DENYOOM = 1 << 2,   // may grow the dataset, so maxmemory is enforced first
+	CMD_ADMIN = 1 << 3,
+	CMD_FAST = 1 << 4,      // O(1) or O(log n)
+	CMD_CONTAINER = 1 << 5, // has subcommands, declared as "name|subcommand"
+	CMD_PUBSUB = 1 << 6,
+};
+
+// How a write reaches the AOF and replicas.
+enum class Propagation : uint8_t {
+	NONE,      // not logged, or logged by its handler in another form
+	VERBATIM,  // the arguments exactly as received
+	REWRITTEN, // re-serialized from the parsed fields, e.g. a TTL made absolute
+};
+
+using CommandArgs = std::vector<std::string_view>;
+
+class TCPServer;
+struct Connection;
+
+// Runs a parsed command and appends its reply to the connection's output.
+using CommandHandler = void (*)(TCPServer& server, const Command& cmd, Connection& conn);
+
+// One entry of the command table, which drives parsing, the READONLY and
+// maxmemory checks, AOF propagation, COMMAND INFO and the per-command stats.
+struct CommandSpec {
+	std::string_view name; // lower case; "container|subcommand" for a subcommand
+	CommandType type;
+	int arity;             // arguments including the name; -N means at least N
+	uint32_t flags;        // CommandFlag bits
+	int firstKey;          // position of the first key (0 when there are none)
+	int lastKey;           // position of the last key; -1 is the last argument
+	int keyStep;
+	Propagation propagation;
+	// Reads the arguments beyond the first key into the Command; returns false
+	// after filling in the error. Null when the key is all the handler needs.
+	bool (*parse)(const CommandArgs& args, Command& cmd, ParseResult& result);
+	CommandHandler handler; // null for a container, which only groups subcommands
+};
+
 class CommandParser {
 public:
-	static ParseResult parseCommand(const std::string& input);
-};
\ No newline at end of file
+	// Entries in the command table, subcommands included.
+	static constexpr size_t COMMAND_COUNT = 81;
+
+	static ParseResult parseCommand(std::string_view input);
+
+	// Reuses result (including the capacity of command.args), so parsing a
+	// stream of commands into the same ParseResult does not allocate.
+	static void parseCommand(std::string_view input, ParseResult& result);
+
+	// Table entry by id, 0 <= id < COMMAND_COUNT. Ids index the per-command
+	// stats; the name is the label in INFO commandstats and /metrics.
+	static const CommandSpec& command(size_t id);
+	static size_t commandId(const CommandSpec& spec);
+
+	// Case-insensitive lookup, "container|subcommand" for a subcommand;
+	// null for an unknown name.
+	static const CommandSpec* lookup(std::string_view name);
+
+	// The absolute expiry time (Unix ms) requested by a SET or EXPIRE-family
+	// command that has expireMillis set.
+	static int64_t expireAt(const Command& cmd, int64_t nowMs);
+};
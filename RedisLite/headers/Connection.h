@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "../headers/OutputBuffer.h"
+#include "../headers/PubSub.h"
+#include "../headers/SocketCompat.h"
+
+// Per-client state shared by both I/O models. readBuffer accumulates bytes
+// until they form complete RESP commands; everything before readOffset has
+// already been executed. output holds replies that the socket has not
+// accepted yet. pendingAofSeq is the AOF sequence number those replies must
+// wait for under appendfsync always (0 if none).
+//
+// A connection that sends PSYNC becomes a replica: replicaHandoff tells the
+// I/O layer to stop serving it and hand the socket to replication.
+//
+// The first SUBSCRIBE or PSUBSCRIBE gives the connection a subscriber, whose
+// inbox publishers on other threads fill; notifyOwner, set up by the I/O
+// layer, gets the messages from there onto the socket. CLIENT TRACKING
+// invalidations arrive through the same inbox.
+struct Connection {
+	SOCKET fd;
+	std::string peer;
+	uint64_t id = 0;                // CLIENT ID
+	bool resp3 = false;             // HELLO 3
+	bool trackingReads = false;     // CLIENT TRACKING on, not BCAST: reads are remembered
+	std::string readBuffer;
+	size_t readOffset = 0;
+	OutputBuffer output;
+	uint64_t pendingAofSeq = 0;
+	bool readPending = false;       // EPOLL model: bytes left unread after the read budget
+	bool closeAfterReply = false;   // broken framing: close once the error is sent
+	bool fromPrimary = false;       // the replica's link to its primary
+	int replicaListeningPort = 0;   // REPLCONF listening-port
+	bool replicaHandoff = false;
+	std::string psyncReplid;
+	long long psyncOffset = -1;
+	std::unique_ptr<PubSub::Subscriber> subscriber;
+	std::function<void()> notifyOwner;
+	// Thread-per-client model: a publisher may write to the socket while the
+	// client's own thread is blocked in recv; both hold sendMtx to use output,
+	// and the publisher leaves it alone while ownerBusy.
+	std::mutex sendMtx;
+	bool ownerBusy = false;
+
+	Connection(SOCKET socket, std::string peerAddr) : fd(socket), peer(std::move(peerAddr)) {}
+
+	bool hasPendingOutput() const {
+		return !output.empty();
+	}
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <charconv>
+#include "KVPair.h"
+
+// One stored key and its value in a single allocation:
+//
+//   header (16 bytes) | [expireAt, heapIndex] | [integer] | key bytes | value bytes
+//
+// The bracketed fields are only present when the matching flag is set, so a
+// key without a TTL pays nothing for one. For the collection types the value
+// bytes hold a pointer to the HashValue, ListValue, SetValue or ZSetValue. Entries are
+// created and resized by KeyValueStore, which owns their memory (and that of
+// the collections) through the shard's SlabAllocator.
+struct Entry {
+	static constexpr uint8_t HAS_EXPIRY = 1;
+	static constexpr uint8_t INT_ENCODED = 2;
+	static constexpr uint8_t TYPE_SHIFT = 2; // bits 2-4 hold the ValueType
+	static constexpr uint8_t TYPE_MASK = 7 << TYPE_SHIFT;
+
+	uint32_t keyLength;
+	uint32_t valueLength;     // bytes of an inline value; 0 when INT_ENCODED
+	uint32_t accessTime;      // store-clock milliseconds, for LRU
+	uint16_t lfuDecayMinute;
+	uint8_t lfuCounter;
+	uint8_t flags;
+
+	static size_t allocationSize(size_t keyLength, size_t valueLength, uint8_t flags) {
+		return sizeof(Entry) + ((flags & HAS_EXPIRY) ? 16 : 0) + ((flags & INT_ENCODED) ? 8 : 0)
+			+ keyLength + ((flags & INT_ENCODED) ? 0 : valueLength);
+	}
+
+	size_t allocationSize() const { return allocationSize(keyLength, valueLength, flags); }
+
+	bool hasExpiry() const { return (flags & HAS_EXPIRY) != 0; }
+	bool isInteger() const { return (flags & INT_ENCODED) != 0; }
+	ValueType type() const { return static_cast<ValueType>((flags & TYPE_MASK) >> TYPE_SHIFT); }
+	static uint8_t typeFlags(ValueType type) { return static_cast<uint8_t>(static_cast<uint8_t>(type) << TYPE_SHIFT); }
+
+	// Expiry as Unix time in milliseconds.
+	int64_t expireAt() const { return load<int64_t>(extra()); }
+	void setExpireAt(int64_t ticks) { store(extra(), ticks); }
+	// Position in the shard's expiry heap.
+	uint32_t heapIndex() const { return load<uint32_t>(extra() + 8); }
+	void setHeapIndex(uint32_t index) { store(extra() + 8, index); }
+
+	long long integer() const { return load<long long>(intField()); }
+	void setInteger(long long v) { store(intField(), v); }
+
+	std::string_view key() const { return std::string_view(keyData(), keyLength); }
+	char* keyData() { return intField() + ((flags & INT_ENCODED) ? 8 : 0); }
+	const char* keyData() const { return const_cast<Entry*>(this)->keyData(); }
+	char* valueData() { return keyData() + keyLength; }
+
+	// The collection a HASH, LIST, SET or ZSET entry points to.
+	template <typename T>
+	T* object() const { return load<T*>(keyData() + keyLength); }
+	void setObject(void* object) { store(valueData(), object); }
+
+	// The value's bytes; an integer is formatted into buffer (at least 24 bytes).
+	std::string_view valueView(char* buffer) const {
+		if (!isInteger()) {
+			return std::string_view(keyData() + keyLength, valueLength);
+		}
+		auto [ptr, ec] = std::to_chars(buffer, buffer + 24, integer());
+		return std::string_view(buffer, static_cast<size_t>(ptr - buffer));
+	}
+
+private:
+	char* extra() { return reinterpret_cast<char*>(this) + sizeof(Entry); }
+	const char* extra() const { return reinterpret_cast<const char*>(this) + sizeof(Entry); }
+	char* intField() { return extra() + ((flags & HAS_EXPIRY) ? 16 : 0); }
+	const char* intField() const { return const_cast<Entry*>(this)->intField(); }
+
+	template <typename T>
+	static T load(const char* p) {
+		T v;
+		std::memcpy(&v, p, sizeof(T));
+		return v;
+	}
+	template <typename T>
+	static void store(char* p, T v) {
+		std::memcpy(p, &v, sizeof(T));
+	}
+};
+
+static_assert(sizeof(Entry) == 16, "Entry header must stay 16 bytes");
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Raw file-descriptor I/O for the persistence code, which needs real
+// fsync/fdatasync semantics that std::ofstream cannot provide.
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Opens path for appending, creating it if needed. Returns -1 on failure.
+inline int openForAppend(const std::string& path) {
+#ifdef _WIN32
+	return _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+#endif
+}
+
+// Creates (or truncates) path for writing. Returns -1 on failure.
+inline int openForWrite(const std::string& path) {
+#ifdef _WIN32
+	return _open(path.c_str(), _O_WRONLY | _O_TRUNC | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return ::open(path.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+#endif
+}
+
+// Opens path read-only. Returns -1 on failure.
+inline int openForRead(const std::string& path) {
+#ifdef _WIN32
+	return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+// Reads up to len bytes. Returns the number read, 0 at end of file, -1 on error.
+inline long long readSome(int fd, char* data, size_t len) {
+#ifdef _WIN32
+	unsigned int chunk = len > 0x40000000 ? 0x40000000u : static_cast<unsigned int>(len);
+	return _read(fd, data, chunk);
+#else
+	while (true) {
+		ssize_t n = ::read(fd, data, len);
+		if (n < 0 && errno == EINTR) continue;
+		return n;
+	}
+#endif
+}
+
+// Writes all len bytes, retrying on short writes. Returns false on error.
+inline bool writeAll(int fd, const char* data, size_t len) {
+	while (len > 0) {
+#ifdef _WIN32
+		unsigned int chunk = len > 0x40000000 ? 0x40000000u : static_cast<unsigned int>(len);
+		int written = _write(fd, data, chunk);
+#else
+		ssize_t written = ::write(fd, data, len);
+		if (written < 0 && errno == EINTR) continue;
+#endif
+		if (written <= 0) return false;
+		data += written;
+		len -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+// Flushes file data to stable storage (fdatasync where available).
+inline bool syncFile(int fd) {
+#if defined(_WIN32)
+	return _commit(fd) == 0;
+#elif defined(__linux__)
+	return ::fdatasync(fd) == 0;
+#else
+	return ::fsync(fd) == 0;
+#endif
+}
+
+// Moves the file position to offset from the start. Returns false on error.
+inline bool seekTo(int fd, unsigned long long offset) {
+#ifdef _WIN32
+	return _lseeki64(fd, static_cast<long long>(offset), SEEK_SET) != -1;
+#else
+	return ::lseek(fd, static_cast<off_t>(offset), SEEK_SET) != -1;
+#endif
+}
+
+inline void closeFile(int fd) {
+#ifdef _WIN32
+	_close(fd);
+#else
+	::close(fd);
+#endif
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <string_view>
+
+// Redis-style glob matching: * matches any run, ? any one byte, [abc], [^abc]
+// and [a-z] match sets of bytes, and a backslash escapes the next character.
+// Runs in O(pattern * text) at worst, without recursion.
+bool globMatch(std::string_view pattern, std::string_view text);
+// True if pattern contains no special characters and so matches only itself.
+bool globIsLiteral(std::string_view pattern);
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include "Entry.h"
+
+// Open-addressing table of Entry pointers with linear probing. A slot is one
+// pointer, so the table costs 8 bytes per slot on 64-bit platforms instead of
+// a node allocation per key. Deletion shifts later members of the probe run
+// back (no tombstones), so lookups stay short after heavy churn. The table
+// never owns the entries it points to.
+//
+// Resizing is incremental, as in Redis's dict: a resize allocates the new
+// table and every insert or erase then migrates a few slots of the old one,
+// with rehashStep available to finish the job while the shard is idle. While
+// both tables are live, lookups probe both, inserts go to the new table and
+// slots vacated in the old table become tombstones so its probe runs stay
+// intact until it is freed.
+//
+// A slot number addresses both tables ([0, old capacity) then the new table)
+// and is only valid until the next insert, erase or rehash step.
+class HashTable {
+private:
+	struct Table {
+		Entry** slots = nullptr;
+		size_t mask = 0;
+		size_t used = 0;
+
+		size_t capacity() const { return slots ? mask + 1 : 0; }
+	};
+
+	// Marks an old-table slot whose entry was migrated or erased mid-resize.
+	static inline Entry tombstone{};
+	static bool isTombstone(const Entry* e) { return e == &tombstone; }
+
+	// During a resize tables[0] is drained into tables[1] from rehashIndex up;
+	// otherwise tables[1] is empty.
+	Table tables[2];
+	size_t rehashIndex = 0;
+	size_t count = 0;
+
+	static Entry** allocateSlots(size_t capacity);
+	size_t probe(const Table& table, std::string_view key, size_t hash) const;
+	static void place(Table& table, Entry* entry, size_t hash);
+	void eraseShifting(Table& table, size_t slot);
+	void startResize(size_t newCapacity);
+	void finishResize();
+
+	static size_t reverseBits(size_t v);
+	// Calls f for each entry whose home slot in table is bucket; they all sit
+	// in the probe run that starts there.
+	template <typename F>
+	static void emitBucket(const Table& table, size_t bucket, F& f) {
+		if (table.used == 0) return;
+		for (size_t i = bucket; table.slots[i]; i = (i + 1) & table.mask) {
+			Entry* e = table.slots[i];
+			if (!isTombstone(e) && (mix(hashKey(e->key())) & table.mask) == bucket) f(e);
+		}
+	}
+
+public:
+	static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+	static constexpr size_t MIN_CAPACITY = 8;
+	// Old-table slots migrated by the step each insert and erase performs.
+	static constexpr size_t REHASH_STEP_SLOTS = 16;
+
+	static size_t hashKey(std::string_view key);
+	// Finalizer applied before masking so the slot depends on every bit of the
+	// hash; the shard index is taken from the unmixed hash.
+	static size_t mix(size_t h);
+
+	HashTable() = default;
+	~HashTable();
+	HashTable(const HashTable&) = delete;
+	HashTable& operator=(const HashTable&) = delete;
+
+	size_t findSlot(std::string_view key, size_t hash) const;
+	Entry* find(std::string_view key, size_t hash) const;
+	// key must not be present.
+	void insert(Entry* entry, size_t hash);
+	void replaceAt(size_t slot, Entry* entry);
+	void eraseAt(size_t slot);
+
+	// nullptr for an empty slot.
+	Entry* at(size_t slot) const;
+	size_t size() const { return count; }
+	size_t capacity() const { return tables[0].capacity() + tables[1].capacity(); }
+	size_t memoryUsage() const { return capacity() * sizeof(Entry*); }
+	// Grows the table for keys entries at once, without incremental steps.
+	void reserve(size_t keys);
+
+	bool isRehashing() const { return tables[1].slots != nullptr; }
+	// Migrates up to slots old-table slots; returns true while a resize is
+	// still in progress.
+	bool rehashStep(size_t slots = REHASH_STEP_SLOTS);
+
+	// One step of a Redis-style SCAN: calls f for the entries whose home slot
+	// is cursor (and, mid-resize, its expansions in the larger table), then
+	// returns the next cursor, or 0 when the walk is complete. The cursor's
+	// bits are incremented from the most significant end, so every entry
+	// present for the whole walk is reported at least once even if the table
+	// is resized between calls; some may be reported twice.
+	template <typename F>
+	size_t scan(size_t cursor, F&& f) const {
+		if (count == 0) return 0;
+		const Table* small = &tables[0];
+		const Table* large = &tables[1];
+		if (!isRehashing()) {
+			emitBucket(*small, cursor & small->mask, f);
+			cursor |= ~small->mask;
+			return reverseBits(reverseBits(cursor) + 1);
+		}
+		if (small->capacity() > large->capacity()) std::swap(small, large);
+		emitBucket(*small, cursor & small->mask, f);
+		do {
+			emitBucket(*large, cursor & large->mask, f);
+			cursor |= ~large->mask;
+			cursor = reverseBits(reverseBits(cursor) + 1);
+		} while (cursor & (small->mask ^ large->mask));
+		return cursor;
+	}
+
+	template <typename F>
+	void forEach(F&& f) const {
+		for (const Table& table : tables) {
+			for (size_t i = 0; i < table.capacity(); ++i) {
+				Entry* e = table.slots[i];
+				if (e && !isTombstone(e)) f(e);
+			}
+		}
+	}
+};
@@ -1,17 +1,90 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
-#include <chrono>
+#include <charconv>
+#include <cstdint>
+#include <vector>
 
+enum class ValueType : uint8_t {
+	STRING,
+	HASH,
+	LIST,
+	SET,
+	ZSET
+};
 
+// A key's value in a form that can be moved between the store and snapshots
+// or AOF rewrites: a string (RAW or INT encoded) or, for the collection
+// types, their flattened elements.
 struct KVPair {
+	enum class Encoding : uint8_t {
+		RAW, // the bytes are in value
+		INT  // a canonical 64-bit integer held in intValue; value is empty
+	};
+
+	// Enough room for any long long in decimal.
+	static constexpr size_t INT_BUFFER_SIZE = 24;
+
+	ValueType type = ValueType::STRING;
 	std::string value;
-	std::optional<std::chrono::steady_clock::time_point> expireAt;
+	long long intValue = 0;
+	Encoding encoding = Encoding::RAW;
+	// HASH: field, value, field, value...; LIST: head to tail; SET: members;
+	// ZSET: member, score, member, score... in ascending order.
+	std::vector<std::string> elements;
+	std::optional<int64_t> expireAt; // Unix time in milliseconds
+
+	// True if s is exactly how out would be printed: no sign, leading zeros or
+	// spaces beyond what std::to_chars produces.
+	static bool parseCanonicalInteger(std::string_view s, long long& out) {
+		if (s.empty() || s.size() > 20) return false;
+		auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+		if (ec != std::errc() || ptr != s.data() + s.size()) return false;
+		size_t digits = s[0] == '-' ? 1 : 0;
+		if (s[digits] == '0' && (s.size() > digits + 1 || digits == 1)) return false;
+		return true;
+	}
 
-	bool isExpired() const {
-		if (!expireAt.has_value()) {
-			return false;
+	void setValue(std::string_view v) {
+		if (parseCanonicalInteger(v, intValue)) {
+			encoding = Encoding::INT;
+			value.clear();
 		}
-		return std::chrono::steady_clock::now() >= expireAt.value();
+		else {
+			encoding = Encoding::RAW;
+			value.assign(v.data(), v.size());
+		}
+	}
+
+	void setInteger(long long v) {
+		encoding = Encoding::INT;
+		intValue = v;
+		value.clear();
+	}
+
+	// The value's bytes; an INT value is formatted into buffer, which must have
+	// INT_BUFFER_SIZE bytes and outlive the returned view.
+	std::string_view valueView(char* buffer) const {
+		if (encoding == Encoding::RAW) {
+			return value;
+		}
+		auto [ptr, ec] = std::to_chars(buffer, buffer + INT_BUFFER_SIZE, intValue);
+		return std::string_view(buffer, static_cast<size_t>(ptr - buffer));
+	}
+
+	static const char* typeName(ValueType type) {
+		switch (type) {
+			case ValueType::HASH: return "hash";
+			case ValueType::LIST: return "list";
+			case ValueType::SET: return "set";
+			case ValueType::ZSET: return "zset";
+			default: return "string";
+		}
+	}
+
+	std::string getValue() const {
+		char buffer[INT_BUFFER_SIZE];
+		return std::string(valueView(buffer));
 	}
-};
\ No newline at end of file
+};
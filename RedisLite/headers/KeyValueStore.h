@@ -1,21 +1,310 @@
 #pragma once
 
-#include <unordered_map>
 #include <string>
+#include <string_view>
+#include <shared_mutex>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+#include "CachedClock.h"
 #include "KVPair.h"
+#include "Entry.h"
+#include "HashTable.h"
+#include "SlabAllocator.h"
+#include "Collections.h"
 
+enum class EvictionPolicy {
+	NOEVICTION,
+	ALLKEYS_LRU,
+	ALLKEYS_LFU,
+	VOLATILE_LRU,
+	VOLATILE_TTL
+};
+
+// The keyspace is split into a power-of-two number of shards selected by key
+// hash. Each shard has its own reader/writer lock, so operations on different
+// shards never contend and concurrent reads of one shard run in parallel.
 class KeyValueStore {
 private:
-	std::unordered_map<std::string, KVPair> store;
-	std::mutex mtx;
+	struct alignas(64) Shard {
+		HashTable table;
+		// Binary min-heap of the entries that have a TTL, ordered by expiry;
+		// each entry records its own position so it can be removed in O(log n).
+		std::vector<Entry*> expiry;
+		SlabAllocator allocator;
+		std::shared_mutex mtx;
+	};
+
+	std::unique_ptr<Shard[]> shards;
+	size_t shardMask;
+	size_t shardBits = 0;
+	// Keys in all shards, kept alongside the tables so DBSIZE is O(1).
+	std::atomic<size_t> keyCount{ 0 };
+
+	// Bytes held by entries (their rounded slab blocks), the collections
+	// they own, table slots and expiry heap slots. Slab page slack is not
+	// counted.
+	std::atomic<long long> usedMemory{ 0 };
+	std::atomic<unsigned long long> evictedKeys{ 0 };
+	size_t maxMemory = 0;
+	EvictionPolicy evictionPolicy = EvictionPolicy::NOEVICTION;
+	int evictionSamples = 5;
+	int64_t clockStart = CachedClock::unixMs(); // LRU clock origin, Unix ms
+
+	// Best eviction candidates seen so far, kept across calls like Redis's
+	// eviction pool, ordered by ascending score. Guarded by evictionMtx.
+	struct EvictionCandidate {
+		unsigned long long score;
+		std::string key;
+	};
+	static constexpr size_t EVICTION_POOL_SIZE = 16;
+	std::vector<EvictionCandidate> evictionPool;
+	std::mutex evictionMtx;
+	size_t evictionCursor = 0;
+	std::minstd_rand evictionRng;
+
+	std::atomic<unsigned long long> expiredKeys{ 0 };
+	std::atomic<unsigned long long> activeExpiredKeys{ 0 };
+	std::atomic<unsigned long long> expireCycles{ 0 };
+	std::atomic<unsigned long long> expireTimeCapReached{ 0 };
+	std::function<void(std::string_view key)> expiryListener;
+
+	// Active expiry runs on its own thread; expireCursor is only touched there.
+	std::thread expiryThread;
+	std::mutex expiryMtx;
+	std::condition_variable expiryCv;
+	bool expiryStopping = false;
+	size_t expireCursor = 0;
+	std::atomic<bool> activeRehashing{ true };
+
+	static size_t shardIndex(size_t hash, size_t mask) { return (hash ^ (hash >> (sizeof(size_t) * 4))) & mask; }
+	size_t shardIndex(size_t hash) const { return shardIndex(hash, shardMask); }
+	Shard& shardFor(size_t hash) { return shards[shardIndex(hash)]; }
+	void groupByShard(const std::string_view* keys, size_t count, size_t stride, std::vector<std::pair<size_t, size_t>>& order) const;
+
+	// Everything below expects the shard's write lock to be held, except touch
+	// and evictionScore, which only need the read lock.
+	Entry* allocateEntry(Shard& shard, std::string_view key, size_t valueLength, uint8_t flags, std::optional<int64_t> expireAt);
+	// value is stored as an integer when it is one in canonical form.
+	Entry* createEntry(Shard& shard, std::string_view key, std::string_view value, std::optional<int64_t> expireAt);
+	Entry* createIntegerEntry(Shard& shard, std::string_view key, long long value, std::optional<int64_t> expireAt);
+	// Puts fresh at key's slot (or inserts it when slot is NOT_FOUND), freeing
+	// the entry it replaces but keeping that entry's LFU history.
+	void placeEntry(Shard& shard, size_t slot, size_t hash, Entry* fresh);
+	void storeLocked(Shard& shard, size_t hash, std::string_view key, std::string_view value, std::optional<int64_t> expireAt, bool keepTtl);
+	// Frees entry's block and, for the collection types, its object.
+	void releaseEntry(Shard& shard, Entry* entry);
+	void eraseSlot(Shard& shard, size_t slot);
+	void expireSlot(Shard& shard, size_t slot);
+	void changeExpiry(Shard& shard, size_t slot, std::optional<int64_t> expireAt);
+	void heapPush(Shard& shard, Entry* entry);
+	void heapRemove(Shard& shard, Entry* entry);
+	void trackMemory(const Entry* entry, long long sign);
+	void trackTable(const Shard& shard, size_t bytesBefore);
+	static size_t objectMemory(const Entry* entry);
+	void touch(Entry* entry);
+	uint32_t clockNow() const;
+	unsigned long long evictionScore(const Entry* entry, uint32_t now) const;
+	void sampleShard(Shard& shard, uint32_t now);
+	bool evictOne(const std::function<void(std::string_view key)>& log);
+	void expiryMain(int hz);
+
+	// Runs f on key's T (of the given type) under the shard's write lock,
+	// creating it first if create is set and key is missing. Keeps memory
+	// accounting current and deletes the key if f leaves it empty. Returns
+	// false if key holds another type.
+	template <typename T, typename F>
+	bool updateCollection(std::string_view key, ValueType type, bool create, F&& f);
+	// Runs f on key's T under the shard's read lock if key exists.
+	template <typename T, typename F>
+	bool readCollection(std::string_view key, ValueType type, F&& f);
 
 public:
-	KeyValueStore() = default;
-	~KeyValueStore() = default;
+	static constexpr size_t DEFAULT_SHARDS = 64;
+
+	// Largest number of keys expired under one shard lock by the active cycle.
+	static constexpr int ACTIVE_EXPIRE_KEYS_PER_LOCK = 20;
+
+	struct ExpiryStats {
+		unsigned long long expiredKeys = 0;        // lazily and actively reclaimed
+		unsigned long long activeExpiredKeys = 0;  // reclaimed by the background cycle
+		unsigned long long expireCycles = 0;
+		unsigned long long timeCapReached = 0;     // cycles stopped by their time budget
+		size_t keysWithExpiry = 0;
+	};
+
+	struct MemoryStats {
+		long long usedMemory = 0;
+		size_t maxMemory = 0;
+		EvictionPolicy policy = EvictionPolicy::NOEVICTION;
+		unsigned long long evictedKeys = 0;
+	};
+
+	explicit KeyValueStore(size_t shardCount = DEFAULT_SHARDS);
+	~KeyValueStore();
+
+	enum class CounterStatus {
+		OK,
+		NOT_INTEGER,
+		NOT_FLOAT,
+		OUT_OF_RANGE,
+		NAN_OR_INFINITY,
+		WRONG_TYPE
+	};
+
+	enum class ExpireStatus {
+		NOT_FOUND,
+		SET,
+		DELETED // the expiry time had already passed
+	};
+
+	// Writers call their log callback while the shards they changed are
+	// still locked, and only if something changed, so writes to one key reach
+	// the AOF and replicas in the order they were applied.
+	using ChangeLog = std::function<void()>;
+	// Called with the key and its new value.
+	using UpdateLog = std::function<void(std::string_view key, std::string_view value)>;
+	// Called with SET or DELETED.
+	using ExpireLog = std::function<void(ExpireStatus status)>;
+
+	// Expiry times are absolute, in Unix milliseconds, and compared against
+	// CachedClock. keepTtl retains the TTL of an existing key instead of
+	// clearing it.
+	void set(std::string_view key, std::string_view value, std::optional<int64_t> expireAt = std::nullopt, bool keepTtl = false,
+		const ChangeLog& log = nullptr);
+	// Gives an existing key of any type the expiry time expireAt, deleting it
+	// if that time has passed.
+	ExpireStatus expire(std::string_view key, int64_t expireAt, const ExpireLog& log = nullptr);
+	// Removes key's TTL; false if it has none or does not exist.
+	bool persist(std::string_view key, const ChangeLog& log = nullptr);
+	// Milliseconds until key expires, -1 if it has no TTL, -2 if it does not exist.
+	long long pttl(std::string_view key);
+
+	// Atomically adds delta to the integer at key (missing keys count as 0),
+	// keeping its TTL. Integer-encoded values are updated in place.
+	CounterStatus incrBy(std::string_view key, long long delta, long long& result, const UpdateLog& log = nullptr);
+	// Same for a decimal increment; result receives the new value as stored.
+	CounterStatus incrByFloat(std::string_view key, std::string_view increment, std::string& result, const UpdateLog& log = nullptr);
+	// Sets *wrongType (if given) when key holds a collection.
+	std::optional<std::string> get(std::string_view key, bool* wrongType = nullptr);
+	bool del(std::string_view key, const ChangeLog& log = nullptr);
+	bool exists(std::string_view key);
+
+	// Batched variants: each shard touched by the batch is locked once. MSET
+	// and DEL hold all of their shard locks at the same time, so they are
+	// atomic and logged once under them.
+	void mget(const std::string_view* keys, size_t count, std::vector<std::optional<std::string>>& out);
+	void mset(const std::string_view* keyValues, size_t pairs, const ChangeLog& log = nullptr); // key, value, key, value...
+	size_t del(const std::string_view* keys, size_t count, const ChangeLog& log = nullptr);
+	size_t exists(const std::string_view* keys, size_t count);
+
+	// Hashes, lists, sets and sorted sets. Every method returns false, without changing
+	// anything, if key holds a value of another type. A collection left empty
+	// is deleted.
+
+	bool hset(std::string_view key, const std::string_view* fieldValues, size_t pairs, size_t& added, const ChangeLog& log = nullptr);
+	bool hget(std::string_view key, std::string_view field, std::optional<std::string>& value);
+	bool hdel(std::string_view key, const std::string_view* fields, size_t count, size_t& removed, const ChangeLog& log = nullptr);
+	bool hgetall(std::string_view key, std::vector<std::string>& fieldValues);
+	bool hlen(std::string_view key, size_t& length);
+
+	bool push(std::string_view key, const std::string_view* values, size_t count, bool front, size_t& length, const ChangeLog& log = nullptr);
+	bool pop(std::string_view key, bool front, std::optional<std::string>& value, const ChangeLog& log = nullptr);
+	bool lrange(std::string_view key, long long start, long long stop, std::vector<std::string>& out);
+	bool llen(std::string_view key, size_t& length);
+
+	bool sadd(std::string_view key, const std::string_view* members, size_t count, size_t& added, const ChangeLog& log = nullptr);
+	bool srem(std::string_view key, const std::string_view* members, size_t count, size_t& removed, const ChangeLog& log = nullptr);
+	bool sismember(std::string_view key, std::string_view member, bool& found);
+	bool smembers(std::string_view key, std::vector<std::string>& members);
+	bool scard(std::string_view key, size_t& count);
+
+	using ScoredMember = std::pair<double, std::string_view>;
+	// ZADD: nx only adds new members, xx only updates existing ones.
+	bool zadd(std::string_view key, const ScoredMember* items, size_t count, bool nx, bool xx,
+		size_t& added, size_t& updated, const ChangeLog& log = nullptr);
+	bool zrem(std::string_view key, const std::string_view* members, size_t count, size_t& removed, const ChangeLog& log = nullptr);
+	bool zscore(std::string_view key, std::string_view member, std::optional<double>& score);
+	bool zrank(std::string_view key, std::string_view member, std::optional<size_t>& rank);
+	bool zcard(std::string_view key, size_t& count);
+	bool zrange(std::string_view key, long long start, long long stop, std::vector<std::pair<std::string, double>>& out);
+	bool zrangeByScore(std::string_view key, const ScoreRange& range, long long offset, long long limit,
+		std::vector<std::pair<std::string, double>>& out);
+	bool zremrangeByScore(std::string_view key, const ScoreRange& range, size_t& removed, const ChangeLog& log = nullptr);
+
+	std::optional<ValueType> type(std::string_view key);
+	// OBJECT ENCODING: "int", "embstr", "listpack", "hashtable", "quicklist"
+	// or "skiplist"; nullptr if key does not exist.
+	const char* encoding(std::string_view key);
+
+	size_t shardCount() const { return shardMask + 1; }
+	size_t shardOf(std::string_view key) const { return shardIndex(HashTable::hashKey(key)); }
+	// The shard key belongs to in a store of shardCount shards (a power of
+	// two), such as another server's.
+	static size_t shardOf(std::string_view key, size_t shardCount) { return shardIndex(HashTable::hashKey(key), shardCount - 1); }
+	// Copies the unexpired entries of one shard while holding its read lock, so
+	// callers can walk the keyspace one shard at a time without blocking it.
+	// copied is called before the lock is released: no write to the shard can
+	// come between the copy and it.
+	void snapshotShard(size_t shard, std::vector<std::pair<std::string, KVPair>>& out, const std::function<void()>& copied = nullptr);
+
+	// Number of stored keys, including expired ones not yet reclaimed.
+	size_t size() const { return keyCount.load(std::memory_order_relaxed); }
+
+	// One SCAN call: appends up to about count unexpired keys matching the glob
+	// pattern and returns the cursor to continue from (0 when done). The
+	// cursor holds the shard in its low bits and that shard's table cursor
+	// above them. Only one shard's read lock is held at a time, for at most
+	// count * 10 table buckets. A key present for the whole scan is returned
+	// at least once; keys may repeat if a table resizes meanwhile.
+	unsigned long long scan(unsigned long long cursor, size_t count, std::string_view pattern, std::vector<std::string>& keys);
+	// Every unexpired key matching pattern, walking one shard at a time under
+	// its read lock. A pattern without wildcards is a single lookup.
+	void keys(std::string_view pattern, std::vector<std::string>& out);
+	// Pre-sizes every shard for about totalKeys keys before a bulk load.
+	void reserve(size_t totalKeys);
+	// Inserts a loaded entry as-is (used by snapshot loading).
+	void restore(std::string&& key, KVPair&& entry);
+	// Removes every key, one shard at a time (a replica before a full resync).
+	void clear();
+
+	// Reclaims expired keys in order of expiry, resuming at the shard where the
+	// previous cycle stopped, until none are due or the budget is spent.
+	// Returns the number of keys removed.
+	size_t activeExpireCycle(std::chrono::microseconds budget);
+	// Advances resizes of shard tables that are mid-rehash, a batch of slots
+	// per lock hold, until all are done or the budget is spent. Lets a resize
+	// finish on a shard that sees few writes. Returns true if any remain.
+	bool activeRehashCycle(std::chrono::microseconds budget);
+	// Runs activeExpireCycle hz times a second, spending at most a quarter of
+	// each tick, on a background thread, followed by a 1ms activeRehashCycle
+	// unless active rehashing is disabled.
+	void startActiveExpiry(int hz);
+	// Called with each key removed by expiry, lazily or by the active cycle,
+	// while its shard is write-locked, so it must be quick and must not use
+	// the store. Set before the store is shared between threads.
+	void setExpiryListener(std::function<void(std::string_view key)> listener) { expiryListener = std::move(listener); }
+	void stopActiveExpiry();
+	ExpiryStats expiryStats();
+	void setActiveRehashing(bool enabled) { activeRehashing.store(enabled, std::memory_order_relaxed); }
+	// Shards whose table is in the middle of an incremental resize.
+	size_t rehashingShards();
 
-	void set(const std::string& key, const std::string& value, std::optional<int> ttlSeconds = std::nullopt);
-	std::optional<std::string> get(const std::string& key);
-	bool del(const std::string& key);
-	bool exists(const std::string& key);
+	// maxBytes == 0 disables the limit. samples is the number of keys examined
+	// per eviction, as in Redis's maxmemory-samples.
+	void setMaxMemory(size_t maxBytes, EvictionPolicy policy, int samples);
+	// Evicts keys until usage is under maxmemory. Called before commands that
+	// may grow the dataset; each evicted key is passed to log, under its
+	// shard lock, so it can be propagated. Returns false when the limit cannot
+	// be met (noeviction, or no key the policy may evict), in which case the
+	// command should be refused.
+	bool evictIfNeeded(const std::function<void(std::string_view key)>& log);
+	MemoryStats memoryStats() const;
+	static const char* policyName(EvictionPolicy policy);
 };
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstddef>
+
+// LZF block compression (the format used by liblzf and Redis RDB files).
+// Both functions return the number of bytes written to out, or 0 if out is
+// too small (compress) or the input is corrupt (decompress).
+size_t lzfCompress(const void* in, size_t inLen, void* out, size_t outLen);
+size_t lzfDecompress(const void* in, size_t inLen, void* out, size_t outLen);
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Redis's LATENCY subsystem: internal operations that may stall clients (AOF
+// writes and fsyncs, table resizes, expiry cycles, loading) report how long
+// they took, and every one at or over the threshold is kept as a sample in a
+// per-event history of the last HISTORY_LEN seconds that had a spike.
+//
+// Call sites bracket the operation with startMonitor() and
+// addSampleIfNeeded(); with the monitor disabled (threshold 0, the default)
+// neither reads the clock.
+class LatencyMonitor {
+public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr size_t HISTORY_LEN = 160;
+
+	struct Sample {
+		long long time = 0;       // unix seconds
+		uint32_t latencyMs = 0;
+	};
+
+	struct EventSummary {
+		std::string event;
+		long long time = 0;       // of the latest sample
+		uint32_t latestMs = 0;
+		uint32_t maxMs = 0;
+	};
+
+	static void setThreshold(long long ms) { thresholdMs.store(ms, std::memory_order_relaxed); }
+	static long long threshold() { return thresholdMs.load(std::memory_order_relaxed); }
+	static bool enabled() { return threshold() > 0; }
+
+	static Clock::time_point startMonitor() { return enabled() ? Clock::now() : Clock::time_point(); }
+	// Records now - started under event if it reaches the threshold.
+	static void addSampleIfNeeded(const char* event, Clock::time_point started);
+	static void addSampleIfNeeded(const char* event, uint64_t latencyMs);
+
+	// LATENCY LATEST, ordered by event name.
+	static std::vector<EventSummary> latest();
+	// LATENCY HISTORY event, oldest first.
+	static std::vector<Sample> history(std::string_view event);
+	// LATENCY RESET: clears the named events, or all when count is 0. Returns
+	// the number of event series removed.
+	static size_t reset(const std::string_view* events, size_t count);
+
+private:
+	static inline std::atomic<long long> thresholdMs{ 0 };
+};
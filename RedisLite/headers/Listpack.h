@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// A sequence of byte strings packed into one contiguous buffer, in the spirit
+// of Redis's listpack: each element is a varint length followed by its bytes.
+// Small hashes, sets and list nodes use it instead of a node per element, so
+// they cost a few bytes of overhead per element and scan without pointer
+// chasing. Lookups are linear, which is cheap at the sizes it is used for.
+//
+// Elements are addressed by the byte offset of their header; an offset stays
+// valid until the listpack is modified.
+class Listpack {
+private:
+	std::string buf;
+	uint32_t count = 0;
+
+	static size_t headerSize(size_t length);
+	static void putHeader(char* out, size_t length);
+
+public:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t bytes() const { return buf.size(); }
+	size_t capacity() const { return buf.capacity(); }
+
+	size_t begin() const { return 0; }
+	size_t end() const { return buf.size(); }
+	// The element at pos; next receives the offset of the element after it.
+	std::string_view get(size_t pos, size_t& next) const;
+	std::string_view get(size_t pos) const { size_t next; return get(pos, next); }
+	size_t next(size_t pos) const { size_t n; get(pos, n); return n; }
+	// Offset of the last element (a forward scan).
+	size_t last() const;
+	// Offset of the first element equal to value among elements 0, stride,
+	// 2 * stride..., or npos.
+	size_t find(std::string_view value, size_t stride = 1) const;
+
+	void pushBack(std::string_view value);
+	void pushFront(std::string_view value) { insert(0, value); }
+	// Inserts value before the element at pos (or at the end if pos is end()).
+	void insert(size_t pos, std::string_view value);
+	// Removes n consecutive elements starting at pos.
+	void erase(size_t pos, size_t n = 1);
+	void replace(size_t pos, std::string_view value);
+	void clear() { buf.clear(); buf.shrink_to_fit(); count = 0; }
+
+	template <typename F>
+	void forEach(F&& f) const {
+		for (size_t pos = 0; pos < buf.size();) {
+			f(get(pos, pos));
+		}
+	}
+};
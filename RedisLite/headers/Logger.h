@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+
+// Redis's log levels, from most to least verbose.
+enum class LogLevel {
+	DEBUG,
+	VERBOSE,
+	NOTICE,
+	WARNING
+};
+
+// Leveled logging to stdout (stderr for warnings), one line per message in
+// Redis's "date level-mark message" format. Messages below the configured
+// level cost one relaxed load; their arguments are never formatted.
+//
+// Messages that could repeat on every request (a failing send, a closed AOF)
+// go through a RateLimit declared at the call site, which lets a few lines per
+// second through and then reports how many it dropped.
+class Logger {
+public:
+	struct RateLimit {
+		static constexpr uint32_t LINES_PER_SECOND = 5;
+		std::atomic<int64_t> windowStart{ 0 };
+		std::atomic<uint32_t> lines{ 0 };
+		std::atomic<uint64_t> suppressed{ 0 };
+	};
+
+	static void setLevel(LogLevel level) { minLevel.store(level, std::memory_order_relaxed); }
+	static bool enabled(LogLevel level) { return level >= minLevel.load(std::memory_order_relaxed); }
+	// Parses "debug", "verbose", "notice" or "warning".
+	static bool parseLevel(const std::string& name, LogLevel& level);
+
+	template <typename... Args>
+	static void log(LogLevel level, Args&&... args) {
+		if (!enabled(level)) return;
+		std::ostringstream message;
+		(message << ... << std::forward<Args>(args));
+		write(level, message.str());
+	}
+
+	template <typename... Args>
+	static void logLimited(RateLimit& limit, LogLevel level, Args&&... args) {
+		if (!enabled(level)) return;
+		uint64_t dropped = 0;
+		if (!admit(limit, dropped)) return;
+		std::ostringstream message;
+		(message << ... << std::forward<Args>(args));
+		if (dropped > 0) message << " (" << dropped << " similar messages suppressed)";
+		write(level, message.str());
+	}
+
+	template <typename... Args> static void debug(Args&&... args) { log(LogLevel::DEBUG, std::forward<Args>(args)...); }
+	template <typename... Args> static void verbose(Args&&... args) { log(LogLevel::VERBOSE, std::forward<Args>(args)...); }
+	template <typename... Args> static void notice(Args&&... args) { log(LogLevel::NOTICE, std::forward<Args>(args)...); }
+	template <typename... Args> static void warning(Args&&... args) { log(LogLevel::WARNING, std::forward<Args>(args)...); }
+
+private:
+	static inline std::atomic<LogLevel> minLevel{ LogLevel::NOTICE };
+
+	static bool admit(RateLimit& limit, uint64_t& dropped);
+	static void write(LogLevel level, const std::string& message);
+};
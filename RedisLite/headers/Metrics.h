@@ -0,0 +1,142 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "CommandParser.h"
+
+// Per-thread counters are written by their owning thread only, with plain
+// relaxed load/store pairs rather than read-modify-write instructions, so
+// recording costs no more than an ordinary increment and no cache line is
+// shared between threads. Readers sum every thread's counters on demand.
+inline void bump(std::atomic<uint64_t>& counter, uint64_t by = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// Log-linear histogram of durations in nanoseconds, in the style of
+// HdrHistogram: every power of two is split into 8 linear sub-buckets, so a
+// recorded value is known to within 12.5% across the whole range (1ns to
+// about 18 minutes) with a fixed 2.4KB of counters.
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BUCKET_BITS = 3;
+	static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr int MAX_EXPONENT = 39;
+	static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+	static size_t bucketOf(uint64_t nanos);
+	// Largest value that falls into bucket.
+	static uint64_t bucketHigh(size_t bucket);
+
+	// Owner thread only.
+	void record(uint64_t nanos) {
+		bump(counts[bucketOf(nanos)]);
+		bump(total);
+		bump(sum, nanos);
+	}
+
+	std::atomic<uint64_t> counts[BUCKET_COUNT] = {};
+	std::atomic<uint64_t> total{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+};
+
+// A point-in-time sum of LatencyHistograms.
+struct HistogramSnapshot {
+	std::vector<uint64_t> counts = std::vector<uint64_t>(LatencyHistogram::BUCKET_COUNT);
+	uint64_t total = 0;
+	uint64_t sum = 0;
+
+	void add(const LatencyHistogram& h);
+	void add(const HistogramSnapshot& h);
+	// Upper bound, in nanoseconds, of the value below which fraction (0-1) of
+	// the recorded values fall.
+	uint64_t percentile(double fraction) const;
+};
+
+// The counters of one thread. Allocated on a thread's first use and folded
+// into the retired totals when the thread exits.
+struct alignas(64) ThreadMetrics {
+	enum Stage {
+		PARSE,   // parsing one command from the read buffer
+		EXECUTE, // executing it and queueing its reply
+		AOF,     // one AOF group commit: write plus any fsync
+		SEND,    // flushing queued replies to a socket
+		STAGE_COUNT
+	};
+
+	struct CommandStats {
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> nanos{ 0 };
+		// Allocated the first time the command is timed on this thread, so
+		// threads only pay for the commands they actually run.
+		std::atomic<LatencyHistogram*> latency{ nullptr };
+	};
+
+	std::array<CommandStats, CommandParser::COMMAND_COUNT> commands;
+	std::array<LatencyHistogram, STAGE_COUNT> stages;
+	std::atomic<uint64_t> bytesIn{ 0 };
+	std::atomic<uint64_t> bytesOut{ 0 };
+
+	ThreadMetrics() = default;
+	~ThreadMetrics();
+	ThreadMetrics(const ThreadMetrics&) = delete;
+	ThreadMetrics& operator=(const ThreadMetrics&) = delete;
+
+	// id is the command's index in the command table.
+	void recordCommand(size_t id, uint64_t nanos);
+	void countCommand(size_t id) { bump(commands[id].calls); }
+};
+
+// Process-wide registry of ThreadMetrics plus the few counters that change
+// too rarely to need per-thread copies.
+class Metrics {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct CommandSnapshot {
+		uint64_t calls = 0;
+		uint64_t nanos = 0;
+		double opsPerSec = 0;
+		HistogramSnapshot latency;
+	};
+
+	struct Snapshot {
+		std::array<CommandSnapshot, CommandParser::COMMAND_COUNT> commands;
+		std::array<HistogramSnapshot, ThreadMetrics::STAGE_COUNT> stages;
+		uint64_t totalCommands = 0;
+		double opsPerSec = 0;
+		uint64_t bytesIn = 0;
+		uint64_t bytesOut = 0;
+		long long connectedClients = 0;
+		uint64_t totalConnections = 0;
+	};
+
+	// The calling thread's counters.
+	static ThreadMetrics& local();
+
+	// Timing is skipped, and only call counts kept, when tracking is off.
+	static void setLatencyTracking(bool enabled) { latencyTracking.store(enabled, std::memory_order_relaxed); }
+	static bool trackingLatency() { return latencyTracking.load(std::memory_order_relaxed); }
+
+	static void clientConnected();
+	static void clientDisconnected();
+
+	// Called every 100ms by the server cron; instantaneous rates are taken
+	// over the last RATE_SAMPLES samples, as Redis does.
+	static void sampleRates();
+	// withHistograms: also sum latency histograms (costlier; INFO all, /metrics).
+	static Snapshot snapshot(bool withHistograms);
+
+	static const char* stageName(int stage);
+
+	static uint64_t nanosBetween(Clock::time_point from, Clock::time_point to) {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+	}
+
+private:
+	static constexpr size_t RATE_SAMPLES = 16;
+	static inline std::atomic<bool> latencyTracking{ true };
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include "../headers/SocketCompat.h"
+
+// Minimal HTTP/1.0 server for Prometheus scrapes: GET /metrics answers with
+// whatever render() returns, anything else with 404. One blocking thread
+// serves one request per connection, which is all a scraper needs and keeps
+// it entirely off the data path.
+class MetricsEndpoint {
+private:
+	std::function<std::string()> render;
+	SOCKET listenSocket = INVALID_SOCKET;
+	std::atomic<bool> running{ false };
+	std::thread acceptThread;
+
+	void serve();
+	void handle(SOCKET client);
+
+public:
+	explicit MetricsEndpoint(std::function<std::string()> renderMetrics);
+	~MetricsEndpoint();
+
+	bool start(int port);
+	void stop();
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Replies queued for one connection, written to the socket in as few calls
+// as possible. Small replies are packed into contiguous chunks; large values
+// handed over with appendOwned() keep their own segment, so a flush sends
+// them with scatter-gather I/O instead of copying them next to their header.
+// A shared segment references a buffer queued to many connections at once,
+// such as a published message.
+class OutputBuffer {
+private:
+	struct Segment {
+		std::string data;
+		bool sealed; // owned payload: never appended to
+		std::shared_ptr<const std::string> shared; // sent in place of data when set
+
+		std::string_view view() const { return shared ? std::string_view(*shared) : std::string_view(data); }
+	};
+
+	std::deque<Segment> segments;
+	size_t headOffset = 0; // bytes of segments.front() already written
+	size_t pendingBytes = 0;
+
+public:
+	static constexpr size_t CHUNK_SIZE = 16 * 1024;
+	// Values at least this large are better moved into their own segment than copied.
+	static constexpr size_t LARGE_VALUE_THRESHOLD = 16 * 1024;
+
+	void append(std::string_view data);
+	void appendOwned(std::string&& data);
+	// Queues data by reference; it must not change until it has been sent.
+	void appendShared(std::shared_ptr<const std::string> data);
+
+	// Fills out with up to maxSegments views of the unwritten data, in order.
+	// Returns the number of views filled.
+	size_t gather(std::string_view* out, size_t maxSegments) const;
+	// Drops the first n pending bytes after they were written.
+	void consume(size_t n);
+
+	size_t size() const { return pendingBytes; }
+	bool empty() const { return pendingBytes == 0; }
+};
\ No newline at end of file
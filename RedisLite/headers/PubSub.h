@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Publish/subscribe channels shared by every connection.
+//
+// PUBLISH encodes its message once into a reference-counted buffer and hands
+// that same buffer to every receiving subscriber; the subscriber's output
+// buffer sends it by reference, so fanning out to N clients costs N pointer
+// copies rather than N copies of the payload. Pattern subscriptions live in a
+// trie of glob tokens, and a channel is matched against all of them in one
+// walk over the channel name, so PUBLISH does not slow down as patterns are
+// added, only as they get more alike.
+class PubSub {
+public:
+	using Message = std::shared_ptr<const std::string>;
+
+	// One subscribed connection. The subscription sets belong to the owning
+	// connection's thread. Publishers on any thread append to the inbox, and
+	// the first message to land in an empty inbox calls wake (without the
+	// inbox lock held) so the owner comes and takes them.
+	class Subscriber {
+	public:
+		explicit Subscriber(std::function<void()> wakeOwner) : wake(std::move(wakeOwner)) {}
+		Subscriber(const Subscriber&) = delete;
+		Subscriber& operator=(const Subscriber&) = delete;
+
+		std::unordered_set<std::string> channels;
+		std::unordered_set<std::string> patterns;
+		size_t count() const { return channels.size() + patterns.size(); }
+
+		// Swaps the pending messages into out (which is cleared first), so the
+		// two vectors trade capacity instead of allocating.
+		void take(std::vector<Message>& out);
+
+	private:
+		friend class PubSub;
+		friend class Tracking; // sends key invalidations through the same inbox
+		std::mutex mtx;
+		std::vector<Message> inbox;
+		std::function<void()> wake;
+
+		void deliver(const Message& message);
+	};
+
+	PubSub();
+	PubSub(const PubSub&) = delete;
+	PubSub& operator=(const PubSub&) = delete;
+
+	// Subscribing twice, or unsubscribing from something not subscribed, is a
+	// no-op; the caller replies with the subscriber's count() either way.
+	void subscribe(Subscriber& subscriber, std::string_view channel);
+	void unsubscribe(Subscriber& subscriber, std::string_view channel);
+	void psubscribe(Subscriber& subscriber, std::string_view pattern);
+	void punsubscribe(Subscriber& subscriber, std::string_view pattern);
+	// Must be called before a subscriber is destroyed.
+	void unsubscribeAll(Subscriber& subscriber);
+
+	// Returns the number of subscriptions (channel and pattern) that received it.
+	size_t publish(std::string_view channel, std::string_view payload);
+
+	// Channels with at least one subscriber, and distinct patterns.
+	size_t channelCount();
+	size_t patternCount();
+
+private:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	struct PatternEntry {
+		const std::string* pattern = nullptr; // the key in patterns
+		std::vector<Subscriber*> subscribers;
+		uint32_t node = 0;  // where the pattern ends in the trie
+		size_t tokens = 0;  // trie depth of the pattern
+	};
+
+	// Each edge consumes one glob token: a literal byte, '?', a run of '*',
+	// or a [...] class. A node entered through '*' also loops on any byte.
+	// Distinct patterns can end on the same node ("a*" and "a**", "a\b"
+	// and "ab"), so a node lists every pattern that ends there.
+	struct TrieNode {
+		std::vector<std::pair<char, uint32_t>> literals; // sorted by byte
+		std::vector<std::pair<std::string, uint32_t>> classes;
+		uint32_t anyChar = NONE;
+		uint32_t anyRun = NONE;
+		bool loops = false;
+		std::vector<PatternEntry*> entries; // patterns that end here
+	};
+
+	std::shared_mutex mtx;
+	std::unordered_map<std::string, std::vector<Subscriber*>> channels;
+	// Entries are referenced from the trie; unordered_map nodes do not move.
+	std::unordered_map<std::string, PatternEntry> patterns;
+	std::vector<TrieNode> nodes; // nodes[0] is the root
+	size_t liveTokens = 0;       // sum of tokens over patterns
+
+	uint32_t insertPattern(std::string_view pattern, size_t& tokens);
+	void rebuildTrie();
+	template <typename Visit>
+	void matchPatterns(std::string_view channel, Visit&& visit);
+};
@@ -0,0 +1,169 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "../headers/AOFManager.h"
+#include "../headers/Command.h"
+#include "../headers/KeyValueStore.h"
+#include "../headers/SocketCompat.h"
+
+// Asynchronous primary-replica replication, following Redis' protocol.
+//
+// A primary serializes every write it logs to the AOF into the replication
+// stream. The stream is kept in a circular backlog, and the replication
+// offset counts its bytes since the replication ID was created. Each replica
+// is served by its own thread, which streams the backlog from the replica's
+// offset over a blocking socket and reads back its REPLCONF ACKs; a replica
+// that falls further behind than the backlog holds is disconnected.
+//
+// A replica runs one thread that connects to its primary and sends PING,
+// REPLCONF listening-port and PSYNC <replid> <offset + 1>. The primary answers
+// +CONTINUE when that offset is still in its backlog, otherwise +FULLRESYNC
+// <replid> <offset> followed by a snapshot ($<length>\r\n<bytes>) and the
+// stream from offset. Like the AOF rewrite, the snapshot is taken shard by
+// shard while writes continue. Writes are streamed under their shard's lock,
+// and each shard's stream offset is recorded under it as the shard is copied;
+// these are sent before the snapshot (+SHARDOFFSETS <offset>...), and the
+// replica skips the keys of stream records that precede their shard's offset,
+// as the snapshot already holds them. A replica serving replicas of its own
+// instead pauses applying its primary's stream while it takes the snapshot.
+// The replica executes the stream as an ordinary client whose replies are
+// dropped, which also logs it to the replica's AOF, and copies the bytes it
+// applied into its own backlog so it can serve PSYNC itself.
+class ReplicationManager {
+public:
+	// Executes a command received from the primary.
+	using Executor = std::function<void(const Command&)>;
+
+	static constexpr size_t REPLID_LENGTH = 40;
+	static constexpr int PING_PERIOD_SECONDS = 10;
+	static constexpr int TIMEOUT_SECONDS = 60;
+
+	struct ReplicaInfo {
+		std::string ip;
+		int port = 0;           // the replica's own listening port
+		bool online = false;    // false while its full resync is being sent
+		uint64_t ackOffset = 0;
+		long long lagSeconds = 0; // since its last ACK
+	};
+
+	struct Info {
+		bool replica = false;
+		std::string primaryHost;
+		int primaryPort = 0;
+		bool linkUp = false;
+		long long lastIoSecondsAgo = -1;
+		bool syncInProgress = false;
+		std::string replid;
+		std::string replid2;
+		uint64_t offset = 0;
+		long long secondOffset = -1;
+		bool backlogActive = false;
+		size_t backlogSize = 0;
+		uint64_t backlogFirstByte = 0;
+		uint64_t backlogHistlen = 0;
+		std::vector<ReplicaInfo> replicas;
+	};
+
+	ReplicationManager(KeyValueStore& store, AOFManager* aof, std::string syncFilePrefix, size_t backlogSize, Executor executor);
+	~ReplicationManager();
+	ReplicationManager(const ReplicationManager&) = delete;
+	ReplicationManager& operator=(const ReplicationManager&) = delete;
+
+	// Port this server listens on, announced to the primary.
+	void setListeningPort(int port) { listeningPort = port; }
+
+	// Primary side. Appends a write to the stream; a no-op until the first
+	// replica has asked for a backlog.
+	void propagate(const Command& cmd);
+	// Takes over fd, whose peer sent PSYNC replid offset, and serves it on a
+	// new thread. replicaPort is its REPLCONF listening-port (0 if unknown).
+	void attachReplica(SOCKET fd, const std::string& peer, std::string replid, long long offset, int replicaPort);
+	// Called by the server cron: pings replicas and reaps finished ones.
+	void cron();
+
+	// Replica side. Connects to host:port (replacing any previous primary) and
+	// keeps reconnecting until stopped.
+	void replicaOf(const std::string& host, int port);
+	// REPLICAOF NO ONE: becomes a primary, keeping the dataset. The old
+	// replication ID stays valid for PSYNC up to the current offset.
+	void promote();
+	bool isReplica() const { return replicaMode.load(); }
+	// A replica can only serve PSYNC while it is in sync with its primary.
+	bool canServeReplicas();
+
+	Info info();
+	void stop();
+
+private:
+	struct Replica {
+		SOCKET fd = INVALID_SOCKET;
+		std::string ip;
+		int port = 0;
+		std::thread thread;
+		std::atomic<bool> online{ false };
+		std::atomic<bool> done{ false };
+		std::atomic<uint64_t> ackOffset{ 0 };
+		std::atomic<long long> lastAck{ 0 }; // steady seconds
+	};
+
+	KeyValueStore& store;
+	AOFManager* aof;
+	std::string syncFilePrefix;
+	Executor execute;
+	int listeningPort = 0;
+
+	std::mutex mtx;
+	std::condition_variable streamCv; // replica threads wait for new stream bytes
+	bool stopping = false;            // guarded by mtx
+	std::string replid;
+	std::string replid2;              // previous ID, valid for PSYNC up to secondOffset
+	long long secondOffset = -1;
+	uint64_t offset = 0;              // replication offset: stream bytes so far
+	std::string backlog;              // circular; empty until first needed
+	size_t backlogCapacity;
+	size_t backlogIndex = 0;          // where the next byte goes
+	uint64_t backlogHistlen = 0;      // valid bytes, ending at offset
+	std::atomic<bool> backlogActive{ false };
+	std::vector<std::unique_ptr<Replica>> replicas;
+	uint64_t nextSyncId = 0;
+	long long lastPing = 0;
+
+	// Replica side.
+	std::atomic<bool> replicaMode{ false };
+	std::string primaryHost;          // guarded by mtx
+	int primaryPort = 0;
+	std::thread primaryThread;
+	std::atomic<bool> primaryStop{ false };
+	std::atomic<SOCKET> primaryFd{ INVALID_SOCKET };
+	std::atomic<bool> linkUp{ false };
+	std::atomic<bool> syncing{ false };
+	std::atomic<long long> lastPrimaryIo{ 0 };
+	std::mutex applyMtx;              // held while applying a batch of the primary's stream
+	// The primary's stream offset at which each of its shards was copied into
+	// the last full resync's snapshot; used by the link thread only.
+	std::vector<uint64_t> shardCut;
+	uint64_t cutEnd = 0;              // the largest of them
+	std::atomic<bool> applyingCut{ false };
+
+	void createBacklogLocked();
+	void feedLocked(std::string_view data);
+	void stopPrimaryLink();
+
+	void serveReplica(Replica& replica, std::string requestedId, long long requestedOffset);
+	bool sendFullResync(Replica& replica, uint64_t& from);
+	void readAcks(Replica& replica, std::string& acks);
+
+	void primaryLinkMain(std::string host, int port);
+	bool syncWithPrimary(SOCKET fd, std::string& buffer);
+	bool receiveSnapshot(SOCKET fd, std::string& buffer, uint64_t length);
+	void streamFromPrimary(SOCKET fd, std::string& buffer);
+	void executeAfterCut(const Command& cmd, uint64_t at);
+};
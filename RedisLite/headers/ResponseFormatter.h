@@ -5,7 +5,16 @@ class ResponseFormatter {
 public:
 	static std::string SimpleString(const std::string& msg);
 	static std::string BulkString(const std::string& msg);
+	static std::string BulkStringHeader(size_t length);
 	static std::string NilBulkString();
-	static std::string Integer(int value);
+	// "*<count>\r\n"; the caller appends the count elements after it.
+	static std::string ArrayHeader(size_t count);
+	// RESP3 "%<pairs>\r\n"; RESP2 clients get ArrayHeader(2 * pairs) instead.
+	static std::string MapHeader(size_t pairs);
+	static std::string Integer(long long value);
 	static std::string Error(const std::string& msg);
+	// Error with its own code in place of ERR, e.g. "OOM".
+	static std::string Error(const std::string& code, const std::string& msg);
+	// Reply to a command applied to a key of another type.
+	static std::string WrongType();
 };
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include "../headers/AOFManager.h"
+#include "../headers/KeyValueStore.h"
+#include "../headers/Logger.h"
+
+enum class IOModel {
+	THREAD_PER_CLIENT,
+	EPOLL
+};
+
+struct ServerConfig {
+	int port = 6379;
+	std::string aofPath = "appendonly.aof";
+	FsyncPolicy appendFsync = FsyncPolicy::EVERYSEC;
+	int autoAofRewritePercentage = 100;                   // 0 disables automatic rewrites
+	unsigned long long autoAofRewriteMinSize = 64ULL << 20;
+	bool aofUseRdbPreamble = false; // rewritten AOFs start with a binary snapshot
+	std::string dbFilename = "dump.rdb";
+	bool rdbCompression = true;
+#ifdef __linux__
+	IOModel ioModel = IOModel::EPOLL;
+#else
+	IOModel ioModel = IOModel::THREAD_PER_CLIENT;
+#endif
+	int ioThreads = 4; // number of event-loop threads for the EPOLL model
+	int shards = 64;   // independently locked KeyValueStore shards (rounded up to a power of two)
+	size_t maxMemory = 0; // 0 means no limit
+	EvictionPolicy maxMemoryPolicy = EvictionPolicy::NOEVICTION;
+	int maxMemorySamples = 5;
+	int hz = 10;       // active expiry cycles per second (0 leaves expiry purely lazy)
+	bool activeRehashing = true; // finish table resizes in the background, not only on writes
+	// Replies are flushed once after every read batch. A non-zero threshold also
+	// flushes in the middle of a batch once this many reply bytes are queued.
+	size_t flushThreshold = 0;
+	size_t clientQueryBufferLimit = 1ULL << 30; // unparsed input a client may leave buffered before it is closed
+	LogLevel logLevel = LogLevel::NOTICE;
+	int metricsPort = 0;          // HTTP port serving /metrics (0 disables it)
+	bool latencyTracking = true;  // time every command, not only count it
+	long long slowlogLogSlowerThan = 10000; // microseconds; negative disables the slow log
+	int slowlogMaxLen = 128;
+	int latencyMonitorThreshold = 0;        // milliseconds; 0 disables the latency monitor
+	std::string replicaOfHost;              // empty: start as a primary
+	int replicaOfPort = 0;
+	size_t replBacklogSize = 1 << 20;
+	int trackingTableMaxKeys = 1000000; // keys remembered for CLIENT TRACKING (0 means no limit)
+
+	// Parses "--name value" pairs from the command line. Returns false and fills
+	// error on an unknown option or bad value.
+	bool parseArgs(int argc, char* argv[], std::string& error);
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// A score interval such as [1, 5] or (1, +inf), as given to ZRANGEBYSCORE.
+struct ScoreRange {
+	double min = 0;
+	double max = 0;
+	bool minExclusive = false;
+	bool maxExclusive = false;
+
+	bool aboveMin(double score) const { return minExclusive ? score > min : score >= min; }
+	bool belowMax(double score) const { return maxExclusive ? score < max : score <= max; }
+	bool contains(double score) const { return aboveMin(score) && belowMax(score); }
+	bool empty() const { return min > max || (min == max && (minExclusive || maxExclusive)); }
+};
+
+// Redis's zskiplist: members ordered by (score, member), where every forward
+// link also records how many nodes it skips. Summing spans along a search
+// path gives a member's rank, so rank lookups and rank or score ranges are
+// O(log n) like plain lookups. Each node is one allocation holding its
+// levels, with a randomly chosen height (P = 1/4, at most MAX_LEVEL).
+class SkipList {
+public:
+	struct Node {
+		struct Level {
+			Node* forward;
+			size_t span;
+		};
+
+		std::string member;
+		double score;
+		Node* backward;
+		uint8_t height;
+
+		Node* next() const { return levels()[0].forward; }
+		Node* prev() const { return backward; }
+		Level* levels() const { return reinterpret_cast<Level*>(const_cast<Node*>(this) + 1); }
+	};
+
+	static constexpr int MAX_LEVEL = 32;
+
+	SkipList();
+	~SkipList();
+	SkipList(const SkipList&) = delete;
+	SkipList& operator=(const SkipList&) = delete;
+
+	// member must not be present.
+	Node* insert(double score, std::string_view member);
+	// node must belong to this list.
+	void erase(Node* node);
+	// Moves node to its position for score; the node itself is kept.
+	void updateScore(Node* node, double score);
+
+	// 1-based rank of (score, member), or 0 if it is not present.
+	size_t rank(double score, std::string_view member) const;
+	// The node at a 1-based rank, or nullptr.
+	Node* byRank(size_t rank) const;
+	// First and last nodes with a score in range, or nullptr.
+	Node* firstInRange(const ScoreRange& range) const;
+	Node* lastInRange(const ScoreRange& range) const;
+	// Removes every node in range, calling onErase with each one first.
+	size_t eraseRange(const ScoreRange& range, const std::function<void(Node*)>& onErase);
+
+	Node* first() const { return head->levels()[0].forward; }
+	Node* last() const { return tail; }
+	size_t size() const { return length; }
+	size_t memoryUsage() const { return nodeBytes; }
+
+private:
+	Node* head;
+	Node* tail = nullptr;
+	size_t length = 0;
+	int level = 1;
+	size_t nodeBytes = 0;
+
+	static int randomLevel();
+	static Node* createNode(int height, double score, std::string_view member);
+	static void destroyNode(Node* node);
+	static size_t nodeSize(const Node* node);
+	static bool before(const Node* node, double score, std::string_view member);
+
+	// Fills update with the last node before (score, member) on each level,
+	// and rank with the position of each of those nodes.
+	void findPath(double score, std::string_view member, Node** update, size_t* rank) const;
+	void link(Node* node, Node** update, size_t* rank);
+	void unlink(Node* node, Node** update);
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Size-class allocator for small entries. Blocks are carved from 64KB pages
+// and recycled through per-class free lists, so an entry costs its rounded
+// size with no per-allocation malloc header. Requests above MAX_SLAB_SIZE go
+// to operator new. Pages are only returned when the allocator is destroyed.
+// Not thread-safe: each shard owns one and uses it under its write lock.
+class SlabAllocator {
+private:
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	std::vector<FreeBlock*> freeLists;
+	std::vector<char*> pages;
+	char* pageCursor = nullptr;
+	char* pageEnd = nullptr;
+
+	static size_t classIndex(size_t size);
+
+public:
+	static constexpr size_t PAGE_SIZE = 64 * 1024;
+	static constexpr size_t MAX_SLAB_SIZE = 1024;
+
+	SlabAllocator();
+	~SlabAllocator();
+	SlabAllocator(const SlabAllocator&) = delete;
+	SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+	void* allocate(size_t size);
+	// size must be the size passed to allocate.
+	void deallocate(void* p, size_t size);
+
+	// Bytes actually reserved for a request of size bytes.
+	static size_t blockSize(size_t size);
+	size_t pageBytes() const { return pages.size() * PAGE_SIZE; }
+};
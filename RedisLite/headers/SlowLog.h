@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SLOWLOG: the most recent commands whose execution took longer than a
+// threshold, kept in a fixed ring of slots that event-loop threads write
+// without taking a lock.
+//
+// A writer takes the next id from a shared counter and claims slot
+// id % capacity by moving its stamp to an odd value, fills it in, then
+// publishes it with an even stamp (a seqlock). Readers copy a slot and keep
+// the copy only if the stamp was even and unchanged across the copy. A writer
+// that finds its slot still being written (the ring wrapped under a burst)
+// drops its entry rather than wait.
+class SlowLog {
+public:
+	// Arguments are truncated as Redis does.
+	static constexpr size_t MAX_ARGS = 32;
+	static constexpr size_t MAX_ARG_BYTES = 128;
+
+	struct Entry {
+		uint64_t id = 0;
+		long long timestamp = 0;    // unix seconds
+		uint64_t durationMicros = 0;
+		std::vector<std::string> args;
+		std::string peer;
+	};
+
+	explicit SlowLog(size_t capacity = 128, long long slowerThanMicros = 10000);
+	~SlowLog();
+	SlowLog(const SlowLog&) = delete;
+	SlowLog& operator=(const SlowLog&) = delete;
+
+	// Negative disables the log; 0 logs every command.
+	void setThreshold(long long micros) { slowerThan.store(micros, std::memory_order_relaxed); }
+	bool enabled() const { return slowerThan.load(std::memory_order_relaxed) >= 0 && capacity > 0; }
+
+	// Logs the command if durationMicros reaches the threshold.
+	void record(const std::vector<std::string_view>& args, uint64_t durationMicros, std::string_view peer);
+
+	// Newest first; count < 0 returns every entry.
+	std::vector<Entry> get(long long count) const;
+	size_t length() const;
+	void reset();
+
+private:
+	static constexpr size_t DATA_BYTES = 1024;
+	static constexpr size_t PEER_BYTES = 48;
+
+	// Plain data only, so a reader can copy a slot that is being rewritten and
+	// detect it afterwards.
+	struct Record {
+		long long timestamp;
+		uint64_t durationMicros;
+		uint16_t dataLength;
+		uint8_t argCount;
+		uint8_t peerLength;
+		char peer[PEER_BYTES];
+		char data[DATA_BYTES];      // argCount arguments, each a uint16 length then its bytes
+	};
+
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> stamp{ 0 }; // 0 empty, 2*id+1 being written, 2*id+2 holds entry id
+		Record record;
+	};
+
+	size_t capacity;
+	std::unique_ptr<Slot[]> slots;
+	std::atomic<long long> slowerThan;
+	std::atomic<uint64_t> nextId{ 0 };
+	std::atomic<uint64_t> resetId{ 0 }; // entries below this id were cleared by reset()
+
+	bool readSlot(const Slot& slot, uint64_t& id, Record& out) const;
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../headers/KeyValueStore.h"
+
+// Binary point-in-time snapshots of the store (RDB-style), written by SAVE and
+// BGSAVE and optionally used as the preamble of a rewritten AOF.
+//
+// File layout (integers little-endian):
+//   "RLDB" | u8 version | u8 flags | u64 key count hint
+//   block*: u32 rawLength | u32 storedLength | payload
+//           (payload is LZF-compressed when storedLength < rawLength)
+//   u32 0 | u32 0                              end-of-data marker
+//   u32 CRC-32 of every preceding byte
+// A block payload is a sequence of records:
+//   u8 type (value type << 1 | 1 if the key has an expiry)
+//   | varint keyLength | key | value | [i64 absolute expiry, Unix epoch ms]
+// where a string value is varint length | bytes, and a hash, list, set or
+// sorted set is varint count followed by count such strings (a hash
+// alternates field and value, a list runs head to tail, a sorted set
+// alternates member and score text in ascending order).
+// Each shard is captured atomically; shards are captured one after another.
+class SnapshotManager {
+private:
+	std::string filePath;
+	bool compression;
+
+	std::mutex saveMtx;                  // one SAVE/BGSAVE at a time
+	std::thread saveThread;
+	std::atomic<bool> saving{ false };
+	std::atomic<long long> lastSaveTime{ 0 }; // Unix seconds of the last successful save
+
+	bool saveToFile(KeyValueStore& store);
+
+public:
+	static constexpr size_t HEADER_SIZE = 14;
+
+	explicit SnapshotManager(const std::string& path = "dump.rdb", bool compress = true);
+	~SnapshotManager();
+
+	// SAVE: writes the snapshot on the calling thread.
+	bool save(KeyValueStore& store);
+	// BGSAVE: writes the snapshot on a background thread. Returns false if a
+	// save is already running.
+	bool startBackgroundSave(KeyValueStore& store);
+	bool isSaving() const { return saving.load(); }
+	long long lastSave() const { return lastSaveTime.load(); }
+
+	bool loadFromFile(KeyValueStore& store);
+
+	// Writes a complete snapshot of store at fd's current position, one shard
+	// at a time; shardCopied is called as each shard is copied, under its lock
+	// (see KeyValueStore::snapshotShard).
+	static bool writeSnapshot(KeyValueStore& store, int fd, bool compress, size_t& keysWritten,
+		const std::function<void(size_t shard)>& shardCopied = nullptr);
+	// Reads one snapshot from fd's current position into store, consuming
+	// exactly its bytes (so an AOF tail can follow). bytesRead is its size.
+	static bool readSnapshot(KeyValueStore& store, int fd, uint64_t& bytesRead, size_t& keysLoaded);
+	// True if data starts with the snapshot magic.
+	static bool hasSnapshotMagic(const char* data, size_t len);
+};
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+#include <string>
+
+// Thin portability layer so the server code can use one set of names for
+// sockets on both Winsock and POSIX.
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+
+using socklen_t = int;
+#ifndef SHUT_RDWR
+#define SHUT_RDWR SD_BOTH
+#endif
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+
+inline int closesocket(SOCKET s) {
+	return ::close(s);
+}
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+inline bool initSockets() {
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	return true;
+#endif
+}
+
+inline void cleanupSockets() {
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+inline int lastSocketError() {
+#ifdef _WIN32
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+inline bool isWouldBlock(int err) {
+#ifdef _WIN32
+	return err == WSAEWOULDBLOCK;
+#else
+	return err == EAGAIN || err == EWOULDBLOCK;
+#endif
+}
+
+// True for the error a blocking call returns when a setTimeouts() limit passes.
+inline bool isTimedOut(int err) {
+#ifdef _WIN32
+	return err == WSAETIMEDOUT;
+#else
+	return err == EAGAIN || err == EWOULDBLOCK;
+#endif
+}
+
+inline bool isInterrupted(int err) {
+#ifdef _WIN32
+	return err == WSAEINTR;
+#else
+	return err == EINTR;
+#endif
+}
+
+inline bool setNonBlocking(SOCKET s) {
+#ifdef _WIN32
+	u_long mode = 1;
+	return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+inline bool setBlocking(SOCKET s) {
+#ifdef _WIN32
+	u_long mode = 0;
+	return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags != -1 && fcntl(s, F_SETFL, flags & ~O_NONBLOCK) != -1;
+#endif
+}
+
+// Bounds blocking recv() and send() calls; see isTimedOut().
+inline void setTimeouts(SOCKET s, int recvMillis, int sendMillis) {
+#ifdef _WIN32
+	DWORD recvTimeout = static_cast<DWORD>(recvMillis);
+	DWORD sendTimeout = static_cast<DWORD>(sendMillis);
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&recvTimeout), sizeof(recvTimeout));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&sendTimeout), sizeof(sendTimeout));
+#else
+	timeval recvTimeout{ recvMillis / 1000, (recvMillis % 1000) * 1000 };
+	timeval sendTimeout{ sendMillis / 1000, (sendMillis % 1000) * 1000 };
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &recvTimeout, sizeof(recvTimeout));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+#endif
+}
+
+// Bytes that a recv() would return right now without blocking.
+inline size_t bytesAvailable(SOCKET s) {
+#ifdef _WIN32
+	u_long available = 0;
+	return ioctlsocket(s, FIONREAD, &available) == 0 ? static_cast<size_t>(available) : 0;
+#else
+	int available = 0;
+	return ioctl(s, FIONREAD, &available) == 0 && available > 0 ? static_cast<size_t>(available) : 0;
+#endif
+}
+
+inline void setNoDelay(SOCKET s) {
+	int opt = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&opt), sizeof(opt));
+}
+
+// Returns "ip:port" of the remote end, or an empty string if it cannot be resolved.
+inline std::string peerAddress(SOCKET s) {
+	sockaddr_in addr{};
+	socklen_t len = sizeof(addr);
+	if (getpeername(s, reinterpret_cast<sockaddr*>(&addr), &len) == SOCKET_ERROR) {
+		return std::string();
+	}
+	char ip[INET_ADDRSTRLEN];
+	if (inet_ntop(AF_INET, &addr.sin_addr, ip, INET_ADDRSTRLEN) == nullptr) {
+		return std::string();
+	}
+	return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
\ No newline at end of file
@@ -1,30 +1,109 @@
 #pragma once
 #include "../headers/KeyValueStore.h"
 #include "../headers/AOFManager.h"
+#include "../headers/Command.h"
+#include "../headers/Connection.h"
+#include "../headers/MetricsEndpoint.h"
+#include "../headers/PubSub.h"
+#include "../headers/ReplicationManager.h"
+#include "../headers/ServerConfig.h"
+#include "../headers/SlowLog.h"
+#include "../headers/SnapshotManager.h"
+#include "../headers/SocketCompat.h"
+#include "../headers/Tracking.h"
 
 #include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <WinSock2.h>
-#include <WS2tcpip.h>
 
 class TCPServer {
 private:
+	friend struct CommandHandlers;
+
 	SOCKET serverSocket;
 	int port;
 	KeyValueStore& kvStore;
 	AOFManager* aofManager;
+	SnapshotManager* snapshotManager;
+	ServerConfig config;
 	std::atomic<bool> running;
+	std::thread cronThread;
+	std::unique_ptr<MetricsEndpoint> metricsEndpoint;
+	SlowLog slowLog;
+	PubSub pubsub;
+	Tracking tracking;
+	std::atomic<uint64_t> nextClientId{ 1 };
+	// Executes the stream from our primary when this server is a replica.
+	Connection primaryLink;
+	std::unique_ptr<ReplicationManager> replication;
+
+	// THREAD_PER_CLIENT model: one blocking thread per accepted socket.
 	std::thread acceptThread;
 	std::vector<std::thread> workers;
+	std::mutex clientsMtx;
+	std::unordered_set<SOCKET> clientSockets;
 
 	void acceptClients();
 	void handleClient(SOCKET client_fd);
+	void sendPublished(Connection& conn);
 	void cleanupThreads();
 
+#ifdef __linux__
+	// EPOLL model: a fixed pool of edge-triggered event loops. Every loop
+	// watches the (non-blocking) listening socket with EPOLLEXCLUSIVE and owns
+	// the connections it accepts, so a connection never changes threads.
+	struct EventLoop {
+		int epollFd = -1;
+		int wakeFd = -1;
+		std::thread thread;
+		std::unordered_map<SOCKET, std::unique_ptr<Connection>> connections;
+		// Connections whose replies wait for the AOF group commit of this iteration.
+		std::vector<SOCKET> awaitingDurable;
+		// Connections that used up their read budget with bytes still unread.
+		// Edge-triggered epoll will not report those bytes again, so the loop
+		// comes back to them itself.
+		std::vector<SOCKET> readReady;
+		// Subscribers with published messages waiting, filled by any thread;
+		// the first one in also signals wakeFd.
+		std::mutex mailboxMtx;
+		std::vector<SOCKET> mailboxReady;
+	};
+	std::vector<std::unique_ptr<EventLoop>> eventLoops;
+
+	bool startEventLoops();
+	void stopEventLoops();
+	void runEventLoop(EventLoop& loop);
+	void acceptPending(EventLoop& loop);
+	bool handleReadable(EventLoop& loop, Connection& conn);
+	void readPendingConnections(EventLoop& loop);
+	void flushAwaitingDurable(EventLoop& loop);
+	void closeConnection(EventLoop& loop, SOCKET fd);
+	void handOverReplica(EventLoop& loop, SOCKET fd);
+	void deliverPublished(EventLoop& loop);
+#endif
+
+	bool processInput(Connection& conn);
+	bool queryBufferExceeded(const Connection& conn);
+	bool flushOutput(Connection& conn);
+	void executeCommand(const Command& cmd, Connection& conn);
+	void logWrite(const Command& cmd, Connection& conn);
+	void logResultingSet(std::string_view key, std::string_view value, Connection& conn);
+	bool ensureMemory(Connection& conn);
+	void dropSubscriptions(Connection& conn);
+	void registerClient(Connection& conn);
+	void updateEndpoint(Connection& conn);
+	std::string buildInfo(std::string_view section);
+	std::string buildMetrics();
+	void serverCron();
+
 public:
-	explicit TCPServer(KeyValueStore& store, AOFManager* aof = nullptr);
+	explicit TCPServer(KeyValueStore& store, AOFManager* aof = nullptr, SnapshotManager* snapshot = nullptr, const ServerConfig& cfg = ServerConfig());
 	~TCPServer();
 
 	bool start(int port);
@@ -0,0 +1,127 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../headers/PubSub.h"
+
+// Server side of client-side caching (CLIENT TRACKING), as in Redis 6.
+//
+// In the default mode the server remembers, per key, the clients that read
+// it; the first change to the key sends each of them one invalidation and
+// forgets the key, until they read it again. In BCAST mode a client instead
+// names key prefixes and hears about every change under them, with nothing
+// remembered per key. The key table is bounded: past maxKeys, keys are
+// dropped at random and their readers told to invalidate them, which keeps
+// the clients' caches correct at the cost of a few extra misses.
+//
+// Changes are queued by invalidate(), which is cheap enough to call under a
+// shard lock of the store, and sent by flush(). Each client's messages go to
+// a mailbox (the pub/sub subscriber of a connection): its own as RESP3
+// pushes, or with REDIRECT another connection's, as messages on the
+// __redis__:invalidate channel when that connection speaks RESP2.
+class Tracking {
+public:
+	static constexpr std::string_view CHANNEL = "__redis__:invalidate";
+
+	struct Options {
+		uint64_t redirect = 0; // client id receiving the messages; 0 for the client itself
+		bool bcast = false;
+		bool noloop = false;   // no invalidations for the client's own writes
+		std::vector<std::string> prefixes; // BCAST only; none means every key
+	};
+
+	struct Stats {
+		size_t clients = 0;  // clients with tracking on
+		size_t keys = 0;     // keys remembered for default-mode clients
+		size_t prefixes = 0; // distinct BCAST prefixes
+	};
+
+	// maxKeys == 0 leaves the key table unbounded.
+	explicit Tracking(size_t maxKeys);
+	Tracking(const Tracking&) = delete;
+	Tracking& operator=(const Tracking&) = delete;
+
+	// Every connection is registered for its lifetime, so that it can be
+	// named by REDIRECT. removeClient must be called before its mailbox is
+	// destroyed.
+	void addClient(uint64_t id);
+	void removeClient(uint64_t id);
+	// Where messages for this client go: resp3 selects pushes; otherwise they
+	// are only sent while listening (subscribed to CHANNEL).
+	void setEndpoint(uint64_t id, PubSub::Subscriber* mailbox, bool resp3, bool listening);
+
+	// CLIENT TRACKING on|off. enable returns false with error set when the
+	// redirect target does not exist or the mode would change while on.
+	bool enable(uint64_t id, Options options, std::string& error);
+	void disable(uint64_t id);
+	// The client's options; false if tracking is off.
+	bool options(uint64_t id, Options& out);
+
+	// True while any client has tracking on; the store hooks check it first.
+	bool active() const { return trackingClients.load(std::memory_order_relaxed) > 0; }
+	// Remembers that a default-mode client read key. Called before the read,
+	// so a change that races with it is never missed.
+	void trackRead(uint64_t id, std::string_view key);
+	// Queues invalidations for a changed key. writer is the client that
+	// changed it (for NOLOOP), 0 for expiry and eviction.
+	void invalidate(std::string_view key, uint64_t writer);
+	// Sends the queued invalidations, one message per receiving mailbox.
+	void flush();
+
+	Stats stats();
+
+private:
+	static constexpr size_t SHARDS = 16;
+
+	struct Client {
+		PubSub::Subscriber* mailbox = nullptr;
+		bool resp3 = false;
+		bool listening = false;
+		bool on = false;
+		Options options;
+	};
+
+	struct Shard {
+		std::mutex mtx;
+		std::unordered_map<std::string, std::vector<uint64_t>> readers;
+	};
+
+	struct Prefix {
+		std::string prefix;
+		std::vector<uint64_t> clients;
+	};
+
+	struct Invalidation {
+		std::string key;
+		uint64_t writer = 0;
+		std::vector<uint64_t> clients;
+	};
+
+	size_t maxKeys;
+	std::atomic<size_t> trackingClients{ 0 };
+	std::atomic<size_t> bcastClients{ 0 };
+	std::atomic<size_t> keyCount{ 0 };
+
+	std::shared_mutex clientsMtx;
+	std::unordered_map<uint64_t, Client> clients;
+
+	std::array<Shard, SHARDS> shards;
+
+	std::shared_mutex prefixMtx;
+	std::vector<Prefix> prefixes;
+
+	std::mutex pendingMtx;
+	std::vector<Invalidation> pending;
+	std::atomic<bool> hasPending{ false };
+
+	Shard& shardFor(std::string_view key);
+	void queue(Invalidation&& invalidation);
+	bool evictFrom(Shard& shard, std::string_view keep);
+	void stopTracking(uint64_t id, Client& client);
+};
@@ -1,11 +1,27 @@
 #include "../headers/AOFManager.h"	
+#include "../headers/CachedClock.h"
+#include "../headers/FileCompat.h"
 #include "../headers/ResponseFormatter.h"
-#include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <filesystem>
 #include "../headers/CommandParser.h"
+#include "../headers/LatencyMonitor.h"
+#include "../headers/Logger.h"
+#include "../headers/Metrics.h"
+#include "../headers/SnapshotManager.h"
 
-AOFManager::AOFManager(const std::string& path) : filePath(path) {
+// Appends "$<len>\r\n<data>\r\n" to out.
+static void appendBulk(std::string& out, std::string_view data) {
+	out += '$';
+	out += std::to_string(data.size());
+	out += "\r\n";
+	out.append(data.data(), data.size());
+	out += "\r\n";
+}
+
+AOFManager::AOFManager(const std::string& path, FsyncPolicy fsyncPolicy) : filePath(path), policy(fsyncPolicy) {
 	try {
 		std::filesystem::path p(filePath);
 
@@ -13,16 +29,21 @@ AOFManager::AOFManager(const std::string& path) : filePath(path) {
 			std::filesystem::create_directories(p.parent_path());
 		}
 
-		aofFile.open(filePath, std::ios::out | std::ios::app);
-		if (!aofFile.is_open()) {
-			std::cerr << "[AOF] Failed to open AOF file: " << filePath << std::endl;
+		fd = openForAppend(filePath);
+		if (fd == -1) {
+			Logger::warning("[AOF] Failed to open AOF file: ", filePath);
 		}
 		else {
-			std::cout << "[AOF] AOF file active at: " << filePath << std::endl;
+			Logger::notice("[AOF] AOF file active at: ", filePath);
+			std::error_code ec;
+			currentSize = std::filesystem::file_size(filePath, ec);
+			baseSize = ec ? 0 : currentSize.load();
+			opened = true;
+			writer = std::thread(&AOFManager::writerLoop, this);
 		}
 	}
 	catch (const std::exception& e) {
-		std::cerr << "[AOF] Error initalizing AOF: " << e.what() << std::endl;
+		Logger::warning("[AOF] Error initalizing AOF: ", e.what());
 	}
 }
 
@@ -31,101 +52,719 @@ AOFManager::~AOFManager() {
 }
 
 void AOFManager::close() {
-	if (aofFile.is_open()) {
-		aofFile.flush();
-		aofFile.close();
-		std::cout << "[AOF] AOF file closed." << std::endl;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (stopping) return;
+		stopping = true;
+	}
+	pendingCv.notify_one();
+
+	rewriteAbort = true;
+	{
+		std::lock_guard<std::mutex> threadLock(rewriteThreadMtx);
+		if (rewriteThread.joinable()) {
+			rewriteThread.join();
+		}
+	}
+	if (writer.joinable()) {
+		writer.join();
+	}
+	if (rewriteFd != -1) {
+		// The rewrite finished but the writer never switched to it.
+		closeFile(rewriteFd);
+		rewriteFd = -1;
+		std::filesystem::remove(tempRewritePath());
+	}
+	if (fd != -1) {
+		syncFile(fd);
+		closeFile(fd);
+		fd = -1;
+		Logger::notice("[AOF] AOF file closed.");
+	}
+}
+
+void AOFManager::writerLoop() {
+	using Clock = std::chrono::steady_clock;
+	std::string batch;
+	auto lastSync = Clock::now();
+	bool unsynced = false;
+
+	while (true) {
+		uint64_t batchSeq = 0;
+		bool exiting = false;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			if (policy == FsyncPolicy::EVERYSEC && unsynced) {
+				// Wake up in time for the next once-per-second fsync even if idle.
+				pendingCv.wait_until(lock, lastSync + std::chrono::seconds(1), [this] { return stopping || rewriteReady || !pending.empty(); });
+			}
+			else {
+				pendingCv.wait(lock, [this] { return stopping || rewriteReady || !pending.empty(); });
+			}
+			batch.swap(pending); // pending keeps the previous batch's capacity
+			batchSeq = appendedSeq;
+			exiting = stopping && batch.empty();
+		}
+
+		Metrics::Clock::time_point commitStart;
+		bool timed = !batch.empty() && Metrics::trackingLatency();
+		if (timed) commitStart = Metrics::Clock::now();
+
+		if (!batch.empty()) {
+			LatencyMonitor::Clock::time_point writeStart = LatencyMonitor::startMonitor();
+			if (!writeAll(fd, batch.data(), batch.size())) {
+				Logger::warning("[AOF] Write to AOF file failed: ", filePath);
+			}
+			LatencyMonitor::addSampleIfNeeded("aof-write", writeStart);
+			currentSize += batch.size();
+			batch.clear();
+			unsynced = true;
+		}
+
+		bool doSync = false;
+		if (policy == FsyncPolicy::ALWAYS) {
+			doSync = unsynced;
+		}
+		else if (policy == FsyncPolicy::EVERYSEC) {
+			doSync = unsynced && Clock::now() - lastSync >= std::chrono::seconds(1);
+		}
+		if (doSync) {
+			LatencyMonitor::Clock::time_point syncStart = LatencyMonitor::startMonitor();
+			if (!syncFile(fd)) {
+				Logger::warning("[AOF] fsync failed: ", filePath);
+			}
+			LatencyMonitor::addSampleIfNeeded(policy == FsyncPolicy::ALWAYS ? "aof-fsync-always" : "aof-fsync", syncStart);
+			lastSync = Clock::now();
+			unsynced = false;
+		}
+		if (timed) {
+			Metrics::local().stages[ThreadMetrics::AOF].record(Metrics::nanosBetween(commitStart, Metrics::Clock::now()));
+		}
+
+		if (batchSeq != 0) {
+			std::lock_guard<std::mutex> lock(mtx);
+			durableSeq = batchSeq;
+		}
+		durableCv.notify_all();
+
+		bool switchFiles = false;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			switchFiles = rewriteReady;
+		}
+		if (switchFiles) {
+			finishRewrite();
+			lastSync = Clock::now();
+			unsynced = false;
+		}
+
+		if (exiting) break;
+
+		if (autoRewriteStore && autoRewritePercentage > 0 && currentSize >= autoRewriteMinSize) {
+			uint64_t base = baseSize > 0 ? baseSize.load() : 1;
+			if ((currentSize - base) * 100 / base >= static_cast<uint64_t>(autoRewritePercentage)) {
+				if (startRewrite(*autoRewriteStore)) {
+					Logger::notice("[AOF] Starting automatic rewrite: AOF is ", currentSize.load(), " bytes, ", baseSize.load(), " after the last rewrite.");
+				}
+			}
+		}
+	}
+}
+
+std::string AOFManager::tempRewritePath() const {
+	return filePath + ".rewrite.tmp";
+}
+
+bool AOFManager::isRewriting() {
+	std::lock_guard<std::mutex> lock(mtx);
+	return rewriteInProgress;
+}
+
+AOFManager::Stats AOFManager::stats() {
+	Stats out;
+	out.currentSize = currentSize.load(std::memory_order_relaxed);
+	out.baseSize = baseSize.load(std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(mtx);
+	out.pendingRecords = appendedSeq - durableSeq;
+	out.pendingBytes = pending.size();
+	out.rewriteInProgress = rewriteInProgress;
+	return out;
+}
+
+void AOFManager::enableAutoRewrite(KeyValueStore& store, int percentage, uint64_t minSize) {
+	std::lock_guard<std::mutex> lock(mtx);
+	autoRewriteStore = &store;
+	autoRewritePercentage = percentage;
+	autoRewriteMinSize = minSize;
+}
+
+void AOFManager::setRdbPreamble(bool enabled, bool compress) {
+	std::lock_guard<std::mutex> lock(mtx);
+	rdbPreamble = enabled;
+	rdbPreambleCompression = compress;
+}
+
+bool AOFManager::startRewrite(KeyValueStore& store) {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!opened || stopping || rewriteInProgress) {
+			return false;
+		}
+		// From here on writes to each shard rewriteMain has copied are also
+		// added to rewriteBuffer.
+		rewriteInProgress = true;
+		rewriteReady = false;
+		rewriteBuffer.clear();
+		rewriteStore = &store;
+		rewriteCopied.assign(store.shardCount(), false);
+	}
+
+	std::lock_guard<std::mutex> threadLock(rewriteThreadMtx);
+	if (rewriteThread.joinable()) {
+		rewriteThread.join(); // the previous rewrite already handed over and exited
+	}
+	rewriteAbort = false;
+	rewriteThread = std::thread(&AOFManager::rewriteMain, this, std::ref(store));
+	return true;
+}
+
+// Expiry is always logged as an absolute Unix time in milliseconds, so a key
+// replayed later expires exactly when it would have.
+static void appendPexpireat(std::string& out, std::string_view key, int64_t expireAt) {
+	out += "*3\r\n";
+	appendBulk(out, "PEXPIREAT");
+	appendBulk(out, key);
+	appendBulk(out, std::to_string(expireAt));
+}
+
+// Appends a SET record that recreates entry, keeping its expiry time.
+static void appendSetRecord(std::string& out, const std::string& key, const KVPair& entry) {
+	char intBuffer[KVPair::INT_BUFFER_SIZE];
+	std::string_view value = entry.valueView(intBuffer);
+	if (entry.expireAt.has_value()) {
+		out += "*5\r\n";
+		appendBulk(out, "SET");
+		appendBulk(out, key);
+		appendBulk(out, value);
+		appendBulk(out, "PXAT");
+		appendBulk(out, std::to_string(entry.expireAt.value()));
+	}
+	else {
+		out += "*3\r\n";
+		appendBulk(out, "SET");
+		appendBulk(out, key);
+		appendBulk(out, value);
 	}
 }
 
-bool AOFManager::appendCommand(const Command& cmd) {
+// Appends the commands that rebuild a hash, list, set or sorted set, at most
+// COLLECTION_CHUNK items per command so no record grows with the collection,
+// followed by its expiry.
+static void appendCollectionRecords(std::string& out, const std::string& key, const KVPair& entry) {
+	const size_t COLLECTION_CHUNK = 64;
+	const char* name = entry.type == ValueType::HASH ? "HSET" : entry.type == ValueType::LIST ? "RPUSH"
+		: entry.type == ValueType::SET ? "SADD" : "ZADD";
+	size_t stride = entry.type == ValueType::HASH || entry.type == ValueType::ZSET ? 2 : 1;
+	for (size_t i = 0; i < entry.elements.size(); i += COLLECTION_CHUNK * stride) {
+		size_t n = std::min(COLLECTION_CHUNK * stride, entry.elements.size() - i);
+		out += "*" + std::to_string(n + 2) + "\r\n";
+		appendBulk(out, name);
+		appendBulk(out, key);
+		for (size_t j = i; j < i + n; j += stride) {
+			if (entry.type == ValueType::ZSET) {
+				// ZADD takes score before member; elements hold member, score.
+				appendBulk(out, entry.elements[j + 1]);
+				appendBulk(out, entry.elements[j]);
+				continue;
+			}
+			for (size_t k = j; k < j + stride; ++k) {
+				appendBulk(out, entry.elements[k]);
+			}
+		}
+	}
+	if (entry.expireAt.has_value()) {
+		appendPexpireat(out, key, entry.expireAt.value());
+	}
+}
+
+// Runs on rewriteThread. Writes the store into the temp file one shard at a
+// time, drains most of the rewrite buffer, then hands the file to the writer.
+void AOFManager::rewriteMain(KeyValueStore& store) {
+	const size_t WRITE_CHUNK = 1024 * 1024;
+	const size_t HANDOVER_THRESHOLD = 64 * 1024;
+	std::string tmpPath = tempRewritePath();
+	auto started = std::chrono::steady_clock::now();
+
+	int tmpFd = openForWrite(tmpPath);
+	bool ok = tmpFd != -1;
+	if (!ok) {
+		Logger::warning("[AOF] Rewrite failed: cannot create ", tmpPath);
+	}
+
+	std::vector<std::pair<std::string, KVPair>> entries;
+	std::string chunk;
+	size_t keys = 0;
+
+	bool usePreamble = false;
+	bool compress = true;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		usePreamble = rdbPreamble;
+		compress = rdbPreambleCompression;
+	}
+	// Runs under the shard's lock, right after it is copied.
+	auto markCopied = [this](size_t shard) {
+		std::lock_guard<std::mutex> lock(mtx);
+		rewriteCopied[shard] = true;
+	};
+	if (ok && usePreamble) {
+		ok = SnapshotManager::writeSnapshot(store, tmpFd, compress, keys, markCopied);
+	}
+
+	for (size_t shard = 0; ok && !usePreamble && shard < store.shardCount(); ++shard) {
+		if (rewriteAbort.load()) {
+			ok = false;
+			break;
+		}
+		store.snapshotShard(shard, entries, [&] { markCopied(shard); });
+		for (const auto& entry : entries) {
+			if (entry.second.type == ValueType::STRING) {
+				appendSetRecord(chunk, entry.first, entry.second);
+			}
+			else {
+				appendCollectionRecords(chunk, entry.first, entry.second);
+			}
+			if (chunk.size() >= WRITE_CHUNK) {
+				ok = writeAll(tmpFd, chunk.data(), chunk.size());
+				chunk.clear();
+				if (!ok) break;
+			}
+		}
+		keys += entries.size();
+	}
+	entries.clear();
+	entries.shrink_to_fit();
+
+	// Catch up with writes made during the snapshot until only a little is left
+	// for the writer thread to append while it switches files.
+	while (ok && !rewriteAbort.load()) {
+		if (!chunk.empty()) {
+			ok = writeAll(tmpFd, chunk.data(), chunk.size());
+			chunk.clear();
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		if (rewriteBuffer.size() < HANDOVER_THRESHOLD) break;
+		chunk.swap(rewriteBuffer);
+	}
+
+	ok = ok && !rewriteAbort.load() && syncFile(tmpFd);
+
 	std::lock_guard<std::mutex> lock(mtx);
+	if (!ok) {
+		if (tmpFd != -1) {
+			closeFile(tmpFd);
+			std::error_code ec;
+			std::filesystem::remove(tmpPath, ec);
+		}
+		if (!rewriteAbort.load()) {
+			Logger::warning("[AOF] Background rewrite failed; keeping the current AOF.");
+		}
+		rewriteInProgress = false;
+		rewriteBuffer.clear();
+		return;
+	}
+
+	auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+	Logger::notice("[AOF] Rewrite snapshot of ", keys, " keys written in ", elapsedMs, " ms.");
+	rewriteFd = tmpFd;
+	rewriteReady = true;
+	pendingCv.notify_one();
+}
+
+// Runs on the writer thread, between batches, once rewriteMain has handed
+// over: appends what is left of the rewrite buffer, then atomically replaces
+// the old AOF with the rewritten one.
+void AOFManager::finishRewrite() {
+	std::string tail;
+	std::string unwritten;
+	uint64_t unwrittenSeq = 0;
+	int newFd = -1;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		tail.swap(rewriteBuffer);
+		// Queued since the writer's last batch, so already in the rewritten file
+		// (in the copy or the tail). The old file gets it too, in case the
+		// switch fails.
+		unwritten.swap(pending);
+		unwrittenSeq = appendedSeq;
+		newFd = rewriteFd;
+		rewriteFd = -1;
+		rewriteReady = false;
+	}
+
+	if (!writeAll(fd, unwritten.data(), unwritten.size())) {
+		Logger::warning("[AOF] Write to AOF file failed: ", filePath);
+	}
+	currentSize += unwritten.size();
 
-	if (!aofFile.is_open()) {
-		std::cerr << "[AOF] File not open for writing!" << std::endl;
+	std::string tmpPath = tempRewritePath();
+	bool ok = writeAll(newFd, tail.data(), tail.size()) && syncFile(newFd);
+	closeFile(newFd);
+
+	if (ok) {
+		LatencyMonitor::Clock::time_point renameStart = LatencyMonitor::startMonitor();
+		// Close before renaming: Windows cannot replace a file that is still open.
+		syncFile(fd);
+		closeFile(fd);
+		std::error_code ec;
+		std::filesystem::rename(tmpPath, filePath, ec);
+		ok = !ec;
+		if (!ok) {
+			Logger::warning("[AOF] Failed to replace AOF with rewritten file: ", ec.message());
+		}
+		fd = openForAppend(filePath);
+		if (fd == -1) {
+			Logger::warning("[AOF] Failed to reopen AOF file: ", filePath);
+		}
+		LatencyMonitor::addSampleIfNeeded("aof-rename", renameStart);
+	}
+	else {
+		Logger::warning("[AOF] Failed to finish rewrite; keeping the current AOF.");
+		syncFile(fd);
+	}
+
+	if (!ok) {
+		std::error_code ec;
+		std::filesystem::remove(tmpPath, ec);
+	}
+	else {
+		std::error_code ec;
+		currentSize = std::filesystem::file_size(filePath, ec);
+		baseSize = currentSize.load();
+		Logger::notice("[AOF] Background rewrite finished; AOF is now ", currentSize.load(), " bytes.");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		rewriteInProgress = false;
+		rewriteBuffer.clear();
+		durableSeq = std::max(durableSeq, unwrittenSeq);
+	}
+	durableCv.notify_all();
+}
+
+bool AOFManager::serialize(const Command& cmd, std::string& out) {
+	// Commands the server builds itself (a TTL made absolute, an eviction's
+	// DEL) have no table entry and are always rewritten.
+	Propagation propagation = cmd.spec ? cmd.spec->propagation : Propagation::REWRITTEN;
+	if (propagation == Propagation::NONE) {
 		return false;
 	}
-	std::string serialized;
+	if (propagation == Propagation::VERBATIM) {
+		// Batches and collection writes are logged as one record, exactly as received.
+		out += "*" + std::to_string(cmd.args.size()) + "\r\n";
+		for (std::string_view arg : cmd.args) {
+			appendBulk(out, arg);
+		}
+		return true;
+	}
 
 	switch (cmd.type) {
 	case CommandType::SET: {
-		if (cmd.ttlSeconds && *cmd.ttlSeconds > 0) {
-			int ttl = *cmd.ttlSeconds;
-			std::string ttlStr = std::to_string(ttl);
-			serialized = "*5\r\n$3\r\nSET\r\n$" +
-				std::to_string(cmd.key.size()) + "\r\n" + cmd.key + "\r\n$" +
-				std::to_string(cmd.value.size()) + "\r\n" + cmd.value +
-				"\r\n$2\r\nEX\r\n$" + std::to_string(ttlStr.size()) +
-				"\r\n" + ttlStr + "\r\n";
+		bool withTtl = cmd.expireMillis.has_value();
+		out += withTtl ? "*5\r\n" : (cmd.keepTtl ? "*4\r\n" : "*3\r\n");
+		appendBulk(out, "SET");
+		appendBulk(out, cmd.key);
+		appendBulk(out, cmd.value);
+		if (withTtl) {
+			appendBulk(out, "PXAT");
+			appendBulk(out, std::to_string(CommandParser::expireAt(cmd, CachedClock::nowMs())));
 		}
-		else {
-			serialized = "*3\r\n$3\r\nSET\r\n$" +
-				std::to_string(cmd.key.size()) + "\r\n" + cmd.key + "\r\n$" +
-				std::to_string(cmd.value.size()) + "\r\n" + cmd.value + "\r\n";
+		else if (cmd.keepTtl) {
+			appendBulk(out, "KEEPTTL");
 		}
-
-		break;
+		return true;
 	}
 
-	case CommandType::DEL: {
-		serialized = "*2\r\n$3\r\nDEL\r\n$" +
-			std::to_string(cmd.key.size()) + "\r\n" + cmd.key + "\r\n";
-		break;
-	}
+	case CommandType::EXPIRE:
+		appendPexpireat(out, cmd.key, CommandParser::expireAt(cmd, CachedClock::nowMs()));
+		return true;
 
+	case CommandType::DEL:
+		out += "*2\r\n";
+		appendBulk(out, "DEL");
+		appendBulk(out, cmd.key);
+		return true;
 
 	default:
 		return false;
 	}
+}
 
-	aofFile << serialized;
-	aofFile.flush();
-	std::cout << "[AOF] Logged command: " << serialized;
-	return true;
+uint64_t AOFManager::appendCommand(const Command& cmd) {
+	if (!opened) {
+		static Logger::RateLimit notOpenLimit;
+		Logger::logLimited(notOpenLimit, LogLevel::WARNING, "[AOF] File not open for writing!");
+		return 0;
+	}
+
+	uint64_t seq = 0;
+	{
+		// Serialize straight into the shared batch; the writer swaps it out whole.
+		std::lock_guard<std::mutex> lock(mtx);
+		size_t recordStart = pending.size();
+		if (stopping || !serialize(cmd, pending)) {
+			return 0;
+		}
+		if (rewriteInProgress) {
+			bufferForRewrite(cmd, std::string_view(pending).substr(recordStart));
+		}
+		seq = ++appendedSeq;
+	}
+	pendingCv.notify_one();
+	return seq;
 }
 
+// Called with mtx held while a rewrite runs, with the record just queued for
+// cmd. Only MSET and DEL can touch both copied shards and shards still to be
+// copied; they keep just the keys in copied shards.
+void AOFManager::bufferForRewrite(const Command& cmd, std::string_view record) {
+	bool multiKey = (cmd.type == CommandType::MSET || cmd.type == CommandType::DEL) && cmd.args.size() > 2;
+	if (!multiKey) {
+		if (rewriteCopied[rewriteStore->shardOf(cmd.key)]) {
+			rewriteBuffer.append(record);
+		}
+		return;
+	}
+
+	size_t step = cmd.type == CommandType::MSET ? 2 : 1;
+	std::vector<size_t> copied;
+	for (size_t i = 1; i + step <= cmd.args.size(); i += step) {
+		if (rewriteCopied[rewriteStore->shardOf(cmd.args[i])]) {
+			copied.push_back(i);
+		}
+	}
+	if (copied.empty()) return;
+	if (copied.size() * step == cmd.args.size() - 1) {
+		rewriteBuffer.append(record);
+		return;
+	}
+	rewriteBuffer += "*" + std::to_string(copied.size() * step + 1) + "\r\n";
+	appendBulk(rewriteBuffer, cmd.args[0]);
+	for (size_t i : copied) {
+		for (size_t j = i; j < i + step; ++j) {
+			appendBulk(rewriteBuffer, cmd.args[j]);
+		}
+	}
+}
+
+void AOFManager::waitForDurable(uint64_t seq) {
+	std::unique_lock<std::mutex> lock(mtx);
+	durableCv.wait(lock, [this, seq] { return durableSeq >= seq; });
+}
+
+// Replays the AOF by streaming it through a fixed-size buffer and parsing in
+// place, so memory stays bounded and each byte is parsed once. A command cut
+// off at the end of the file (a crash mid-write) is truncated away.
 bool AOFManager::loadFromFile(KeyValueStore& kvStore) {
-	std::ifstream inFile(filePath, std::ios::in);
-	if (!inFile.is_open()) {
-		std::cerr << "[AOF] Failed to open AOF file for reading: " << filePath << std::endl;
+	using Clock = std::chrono::steady_clock;
+	const size_t READ_CHUNK = 4 * 1024 * 1024;
+
+	int inFd = openForRead(filePath);
+	if (inFd == -1) {
+		Logger::warning("[AOF] Failed to open AOF file for reading: ", filePath);
 		return false;
 	}
 
-	std::string buffer((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
-	inFile.close();
+	std::error_code sizeError;
+	uint64_t fileSize = std::filesystem::file_size(filePath, sizeError);
+	if (sizeError) fileSize = 0;
+
+	std::string buffer;
+	size_t pos = 0;                   // parse cursor into buffer
+	uint64_t totalBytesProcessed = 0; // file offset of the end of the last complete command
+	uint64_t commands = 0;
 
-	size_t totalBytesProcessed = 0;
+	auto started = Clock::now();
+	CachedClock::update();
 
-	while (totalBytesProcessed < buffer.size()) {
-		std::string remaining = buffer.substr(totalBytesProcessed);
-		ParseResult result = CommandParser::parseCommand(remaining);
+	// A rewritten AOF may start with a binary snapshot; the RESP tail follows it.
+	char magic[8];
+	long long magicBytes = readSome(inFd, magic, sizeof(magic));
+	seekTo(inFd, 0);
+	if (magicBytes > 0 && SnapshotManager::hasSnapshotMagic(magic, static_cast<size_t>(magicBytes))) {
+		size_t keys = 0;
+		if (!SnapshotManager::readSnapshot(kvStore, inFd, totalBytesProcessed, keys)) {
+			Logger::warning("[AOF] Failed to load the snapshot preamble of the AOF.");
+			closeFile(inFd);
+			return false;
+		}
+		Logger::notice("[AOF] Loaded snapshot preamble: ", keys, " keys, ", totalBytesProcessed, " bytes.");
+	}
+	bool eof = false;
+	bool malformed = false;
+	ParseResult result;
+
+	auto lastReport = started;
+
+	while (true) {
+		std::string_view pending(buffer.data() + pos, buffer.size() - pos);
+		CommandParser::parseCommand(pending, result);
 
 		if (result.status == ParseResult::Status::INCOMPLETE) {
-			std::cerr << "[AOF] Incomplete command in AOF file. Stopping replay." << std::endl;
-			break;
+			if (eof) break;
+
+			// Keep the unparsed tail and read the next chunk after it.
+			buffer.erase(0, pos);
+			pos = 0;
+			size_t oldSize = buffer.size();
+			buffer.resize(oldSize + READ_CHUNK);
+			long long n = readSome(inFd, buffer.data() + oldSize, READ_CHUNK);
+			buffer.resize(oldSize + (n > 0 ? static_cast<size_t>(n) : 0));
+			if (n < 0) {
+				Logger::warning("[AOF] Read error while loading AOF. Stopping replay.");
+				break;
+			}
+			eof = n == 0;
+			CachedClock::update();
+
+			auto now = Clock::now();
+			if (now - lastReport >= std::chrono::seconds(1) && fileSize > 0) {
+				double seconds = std::chrono::duration<double>(now - started).count();
+				Logger::notice("[AOF] Loading: ", (totalBytesProcessed * 100 / fileSize), "% (",
+					(totalBytesProcessed >> 20), " MB, ", static_cast<uint64_t>(commands / seconds), " commands/s)");
+				lastReport = now;
+			}
+			continue;
 		}
 		else if (result.status == ParseResult::Status::ERR) {
-			std::cerr << "[AOF] Malformed command in AOF: " << result.errorMessage << ". Stopping replay." << std::endl;
+			Logger::warning("[AOF] Malformed command in AOF: ", result.errorMessage, ". Stopping replay.");
+			malformed = true;
 			break;
 		}
 
 		const Command& cmd = result.command;
 
 		switch (cmd.type) {
-		case CommandType::SET:
-			kvStore.set(cmd.key, cmd.value, cmd.ttlSeconds);
+		case CommandType::SET: {
+			std::optional<int64_t> expireAt;
+			if (cmd.expireMillis) {
+				expireAt = CommandParser::expireAt(cmd, CachedClock::nowMs());
+			}
+			kvStore.set(cmd.key, cmd.value, expireAt, cmd.keepTtl);
+			break;
+		}
+
+		case CommandType::EXPIRE:
+			kvStore.expire(cmd.key, CommandParser::expireAt(cmd, CachedClock::nowMs()));
+			break;
+
+		case CommandType::PERSIST:
+			kvStore.persist(cmd.key);
 			break;
 
 		case CommandType::DEL:
+			if (cmd.args.size() > 2) {
+				kvStore.del(cmd.args.data() + 1, cmd.args.size() - 1);
+				break;
+			}
 			kvStore.del(cmd.key);
 			break;
 
+		case CommandType::MSET:
+			kvStore.mset(cmd.args.data() + 1, (cmd.args.size() - 1) / 2);
+			break;
+
+		case CommandType::HSET: {
+			size_t added = 0;
+			kvStore.hset(cmd.key, cmd.args.data() + 2, (cmd.args.size() - 2) / 2, added);
+			break;
+		}
+
+		case CommandType::HDEL: {
+			size_t removed = 0;
+			kvStore.hdel(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, removed);
+			break;
+		}
+
+		case CommandType::LPUSH:
+		case CommandType::RPUSH: {
+			size_t length = 0;
+			kvStore.push(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, cmd.type == CommandType::LPUSH, length);
+			break;
+		}
+
+		case CommandType::LPOP:
+		case CommandType::RPOP: {
+			std::optional<std::string> unused;
+			kvStore.pop(cmd.key, cmd.type == CommandType::LPOP, unused);
+			break;
+		}
+
+		case CommandType::SADD: {
+			size_t added = 0;
+			kvStore.sadd(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, added);
+			break;
+		}
+
+		case CommandType::SREM: {
+			size_t removed = 0;
+			kvStore.srem(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, removed);
+			break;
+		}
+
+		case CommandType::ZADD: {
+			size_t added = 0;
+			size_t updated = 0;
+			kvStore.zadd(cmd.key, cmd.scoredMembers.data(), cmd.scoredMembers.size(), cmd.nx, cmd.xx, added, updated);
+			break;
+		}
+
+		case CommandType::ZREM: {
+			size_t removed = 0;
+			kvStore.zrem(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, removed);
+			break;
+		}
+
+		case CommandType::ZREMRANGEBYSCORE: {
+			size_t removed = 0;
+			kvStore.zremrangeByScore(cmd.key, cmd.range, removed);
+			break;
+		}
+
 		default:
-			std::cerr << "[AOF] Skipping unsupported command in AOF: " << static_cast<int>(cmd.type) << std::endl;
+			static Logger::RateLimit unsupportedLimit;
+			Logger::logLimited(unsupportedLimit, LogLevel::WARNING, "[AOF] Skipping unsupported command in AOF: ", static_cast<int>(cmd.type));
 			break;
 		}
+		pos += result.bytesConsumed;
 		totalBytesProcessed += result.bytesConsumed;
+		++commands;
+	}
+	closeFile(inFd);
+
+	if (!malformed && totalBytesProcessed < fileSize) {
+		// The last command was only partly written. Drop it so new appends start
+		// on a command boundary.
+		Logger::warning("[AOF] Incomplete command at the end of the AOF (", (fileSize - totalBytesProcessed),
+			" bytes). Truncating the AOF to the last complete command.");
+		std::error_code ec;
+		std::filesystem::resize_file(filePath, totalBytesProcessed, ec);
+		if (ec) {
+			Logger::warning("[AOF] Failed to truncate AOF: ", ec.message());
+		}
+		else {
+			std::lock_guard<std::mutex> lock(mtx);
+			currentSize = totalBytesProcessed;
+			baseSize = totalBytesProcessed;
+		}
 	}
-	std::cout << "[AOF] Replay completed. Processed " << totalBytesProcessed << " bytes from AOF." << std::endl;
+
+	double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+	LatencyMonitor::addSampleIfNeeded("aof-load", static_cast<uint64_t>(seconds * 1000));
+	if (seconds <= 0) seconds = 1e-9;
+	Logger::notice("[AOF] Replay completed. Processed ", totalBytesProcessed, " bytes (", commands, " commands) in ",
+		static_cast<uint64_t>(seconds * 1000), " ms: ", static_cast<uint64_t>((totalBytesProcessed >> 20) / seconds), " MB/s, ",
+		static_cast<uint64_t>(commands / seconds), " commands/s.");
 	return true;
 }
\ No newline at end of file
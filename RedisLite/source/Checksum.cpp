@@ -0,0 +1,24 @@
+#include "../headers/Checksum.h"
+#include <array>
+
+static std::array<uint32_t, 256> makeCrcTable() {
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k) {
+			c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		}
+		table[i] = c;
+	}
+	return table;
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t len) {
+	static const std::array<uint32_t, 256> table = makeCrcTable();
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	crc = ~crc;
+	for (size_t i = 0; i < len; ++i) {
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
\ No newline at end of file
@@ -0,0 +1,531 @@
+#include "../headers/Collections.h"
+#include <charconv>
+#include <cstring>
+
+// Approximate cost of a node in an unordered container: its next pointer and
+// cached hash, plus the heap blocks of strings too long for inline storage.
+static const size_t NODE_OVERHEAD = sizeof(void*) + sizeof(size_t);
+
+static size_t heapBytes(const std::string& s) {
+	static const size_t inlineCapacity = std::string().capacity();
+	return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+}
+
+bool HashValue::set(std::string_view field, std::string_view value)
+{
+	if (!table) {
+		size_t pos = small.find(field, 2);
+		if (pos != Listpack::npos) {
+			if (value.size() <= HASH_MAX_LISTPACK_VALUE) {
+				small.replace(small.next(pos), value);
+				return false;
+			}
+		}
+		else if (small.size() / 2 < HASH_MAX_LISTPACK_ENTRIES && field.size() <= HASH_MAX_LISTPACK_VALUE
+			&& value.size() <= HASH_MAX_LISTPACK_VALUE) {
+			small.pushBack(field);
+			small.pushBack(value);
+			return true;
+		}
+		convertToTable();
+	}
+
+	auto it = table->find(field);
+	if (it != table->end()) {
+		tableBytes -= heapBytes(it->second);
+		it->second.assign(value.data(), value.size());
+		tableBytes += heapBytes(it->second);
+		return false;
+	}
+	auto inserted = table->emplace(std::string(field), std::string(value)).first;
+	tableBytes += NODE_OVERHEAD + sizeof(Table::value_type) + heapBytes(inserted->first) + heapBytes(inserted->second);
+	return true;
+}
+
+bool HashValue::get(std::string_view field, std::string& value) const
+{
+	if (table) {
+		auto it = table->find(field);
+		if (it == table->end()) return false;
+		value = it->second;
+		return true;
+	}
+	size_t pos = small.find(field, 2);
+	if (pos == Listpack::npos) return false;
+	value = small.get(small.next(pos));
+	return true;
+}
+
+bool HashValue::erase(std::string_view field)
+{
+	if (table) {
+		auto it = table->find(field);
+		if (it == table->end()) return false;
+		tableBytes -= NODE_OVERHEAD + sizeof(Table::value_type) + heapBytes(it->first) + heapBytes(it->second);
+		table->erase(it);
+		return true;
+	}
+	size_t pos = small.find(field, 2);
+	if (pos == Listpack::npos) return false;
+	small.erase(pos, 2);
+	return true;
+}
+
+size_t HashValue::size() const
+{
+	return table ? table->size() : small.size() / 2;
+}
+
+size_t HashValue::memoryUsage() const
+{
+	size_t bytes = sizeof(*this) + small.capacity();
+	if (table) {
+		bytes += sizeof(Table) + tableBytes + table->bucket_count() * sizeof(void*);
+	}
+	return bytes;
+}
+
+void HashValue::convertToTable()
+{
+	// Filled before being installed: forEach reads whichever form is live.
+	auto converted = std::make_unique<Table>();
+	converted->reserve(small.size() / 2 + 1);
+	forEach([this, &converted](std::string_view field, std::string_view value) {
+		auto inserted = converted->emplace(std::string(field), std::string(value)).first;
+		tableBytes += NODE_OVERHEAD + sizeof(Table::value_type) + heapBytes(inserted->first) + heapBytes(inserted->second);
+	});
+	table = std::move(converted);
+	small.clear();
+}
+
+void ListValue::pushFront(std::string_view value)
+{
+	++count;
+	if (!nodes) {
+		small.pushFront(value);
+		if (small.bytes() > LIST_MAX_LISTPACK_BYTES && small.size() > 1) convertToQuicklist();
+		return;
+	}
+	Listpack& head = nodes->front();
+	if (head.bytes() + value.size() > LIST_MAX_LISTPACK_BYTES && !head.empty()) {
+		nodes->emplace_front();
+	}
+	Listpack& target = nodes->front();
+	size_t before = target.capacity();
+	target.pushFront(value);
+	nodeBytes += target.capacity() - before;
+}
+
+void ListValue::pushBack(std::string_view value)
+{
+	++count;
+	if (!nodes) {
+		small.pushBack(value);
+		if (small.bytes() > LIST_MAX_LISTPACK_BYTES && small.size() > 1) convertToQuicklist();
+		return;
+	}
+	Listpack& tail = nodes->back();
+	if (tail.bytes() + value.size() > LIST_MAX_LISTPACK_BYTES && !tail.empty()) {
+		nodes->emplace_back();
+	}
+	Listpack& target = nodes->back();
+	size_t before = target.capacity();
+	target.pushBack(value);
+	nodeBytes += target.capacity() - before;
+}
+
+bool ListValue::popFront(std::string& value)
+{
+	if (count == 0) return false;
+	--count;
+	Listpack& head = nodes ? nodes->front() : small;
+	value = head.get(head.begin());
+	size_t before = head.capacity();
+	head.erase(head.begin());
+	if (nodes) {
+		nodeBytes -= before - head.capacity();
+		if (head.empty()) {
+			nodeBytes -= head.capacity();
+			nodes->pop_front();
+		}
+		maybeConvertToListpack();
+	}
+	return true;
+}
+
+bool ListValue::popBack(std::string& value)
+{
+	if (count == 0) return false;
+	--count;
+	Listpack& tail = nodes ? nodes->back() : small;
+	size_t last = tail.last();
+	value = tail.get(last);
+	size_t before = tail.capacity();
+	tail.erase(last);
+	if (nodes) {
+		nodeBytes -= before - tail.capacity();
+		if (tail.empty()) {
+			nodeBytes -= tail.capacity();
+			nodes->pop_back();
+		}
+		maybeConvertToListpack();
+	}
+	return true;
+}
+
+void ListValue::range(long long start, long long stop, std::vector<std::string>& out) const
+{
+	long long length = static_cast<long long>(count);
+	if (start < 0) start += length;
+	if (stop < 0) stop += length;
+	if (start < 0) start = 0;
+	if (stop >= length) stop = length - 1;
+	if (start > stop) return;
+
+	out.reserve(out.size() + static_cast<size_t>(stop - start + 1));
+	long long index = 0;
+	auto visit = [&](const Listpack& node) {
+		long long nodeSize = static_cast<long long>(node.size());
+		if (index + nodeSize <= start) {
+			index += nodeSize;
+			return;
+		}
+		for (size_t pos = node.begin(); pos < node.end() && index <= stop; ++index) {
+			std::string_view element = node.get(pos, pos);
+			if (index >= start) out.emplace_back(element);
+		}
+	};
+	if (!nodes) {
+		visit(small);
+		return;
+	}
+	for (const Listpack& node : *nodes) {
+		if (index > stop) break;
+		visit(node);
+	}
+}
+
+size_t ListValue::memoryUsage() const
+{
+	size_t bytes = sizeof(*this) + small.capacity();
+	if (nodes) {
+		bytes += sizeof(std::deque<Listpack>) + nodes->size() * sizeof(Listpack) + nodeBytes;
+	}
+	return bytes;
+}
+
+void ListValue::convertToQuicklist()
+{
+	nodes = std::make_unique<std::deque<Listpack>>();
+	nodes->emplace_back();
+	small.forEach([this](std::string_view element) {
+		if (nodes->back().bytes() + element.size() > LIST_MAX_LISTPACK_BYTES && !nodes->back().empty()) {
+			nodes->emplace_back();
+		}
+		nodes->back().pushBack(element);
+	});
+	small.clear();
+	nodeBytes = 0;
+	for (const Listpack& node : *nodes) nodeBytes += node.capacity();
+}
+
+void ListValue::maybeConvertToListpack()
+{
+	// Go back to a single listpack only well under the limit, so a list
+	// hovering around it does not convert back and forth.
+	if (nodes->size() > 1 || (nodes->size() == 1 && nodes->front().bytes() > LIST_MAX_LISTPACK_BYTES / 2)) {
+		return;
+	}
+	if (!nodes->empty()) {
+		small = std::move(nodes->front());
+	}
+	nodes.reset();
+	nodeBytes = 0;
+}
+
+bool SetValue::add(std::string_view member)
+{
+	if (!table) {
+		if (small.find(member) != Listpack::npos) {
+			return false;
+		}
+		if (small.size() < SET_MAX_LISTPACK_ENTRIES && member.size() <= SET_MAX_LISTPACK_VALUE) {
+			small.pushBack(member);
+			return true;
+		}
+		convertToTable();
+	}
+	if (table->find(member) != table->end()) {
+		return false;
+	}
+	auto inserted = table->emplace(member).first;
+	tableBytes += NODE_OVERHEAD + sizeof(std::string) + heapBytes(*inserted);
+	return true;
+}
+
+bool SetValue::remove(std::string_view member)
+{
+	if (table) {
+		auto it = table->find(member);
+		if (it == table->end()) return false;
+		tableBytes -= NODE_OVERHEAD + sizeof(std::string) + heapBytes(*it);
+		table->erase(it);
+		return true;
+	}
+	size_t pos = small.find(member);
+	if (pos == Listpack::npos) return false;
+	small.erase(pos);
+	return true;
+}
+
+bool SetValue::contains(std::string_view member) const
+{
+	if (table) {
+		return table->find(member) != table->end();
+	}
+	return small.find(member) != Listpack::npos;
+}
+
+size_t SetValue::size() const
+{
+	return table ? table->size() : small.size();
+}
+
+size_t SetValue::memoryUsage() const
+{
+	size_t bytes = sizeof(*this) + small.capacity();
+	if (table) {
+		bytes += sizeof(Table) + tableBytes + table->bucket_count() * sizeof(void*);
+	}
+	return bytes;
+}
+
+void SetValue::convertToTable()
+{
+	table = std::make_unique<Table>();
+	table->reserve(small.size() + 1);
+	small.forEach([this](std::string_view member) {
+		auto inserted = table->emplace(member).first;
+		tableBytes += NODE_OVERHEAD + sizeof(std::string) + heapBytes(*inserted);
+	});
+	small.clear();
+}
+
+
+double ZSetValue::scoreAt(const Listpack& lp, size_t pos)
+{
+	double score;
+	std::memcpy(&score, lp.get(pos).data(), sizeof(score));
+	return score;
+}
+
+void ZSetValue::insertSmall(double score, std::string_view member)
+{
+	size_t pos = small.begin();
+	while (pos < small.end()) {
+		size_t scorePos;
+		std::string_view current = small.get(pos, scorePos);
+		double currentScore = scoreAt(small, scorePos);
+		if (currentScore > score || (currentScore == score && current > member)) break;
+		pos = small.next(scorePos);
+	}
+	small.insert(pos, member);
+	small.insert(small.next(pos), std::string_view(reinterpret_cast<const char*>(&score), sizeof(score)));
+}
+
+void ZSetValue::convertToSkipList()
+{
+	// Filled before being installed: forEach reads whichever form is live.
+	auto converted = std::make_unique<SkipList>();
+	auto convertedIndex = std::make_unique<Index>();
+	convertedIndex->reserve(small.size() / 2 + 1);
+	forEach([&](std::string_view member, double score) {
+		SkipList::Node* node = converted->insert(score, member);
+		convertedIndex->emplace(std::string_view(node->member), node);
+	});
+	list = std::move(converted);
+	index = std::move(convertedIndex);
+	small.clear();
+}
+
+ZSetValue::AddResult ZSetValue::add(double score, std::string_view member, bool nx, bool xx)
+{
+	if (!list) {
+		size_t pos = small.find(member, 2);
+		if (pos != Listpack::npos) {
+			if (nx || scoreAt(small, small.next(pos)) == score) {
+				return AddResult::NONE;
+			}
+			small.erase(pos, 2);
+			insertSmall(score, member);
+			return AddResult::UPDATED;
+		}
+		if (xx) {
+			return AddResult::NONE;
+		}
+		if (small.size() / 2 < ZSET_MAX_LISTPACK_ENTRIES && member.size() <= ZSET_MAX_LISTPACK_VALUE) {
+			insertSmall(score, member);
+			return AddResult::ADDED;
+		}
+		convertToSkipList();
+	}
+
+	auto it = index->find(member);
+	if (it != index->end()) {
+		if (nx || it->second->score == score) {
+			return AddResult::NONE;
+		}
+		list->updateScore(it->second, score);
+		return AddResult::UPDATED;
+	}
+	if (xx) {
+		return AddResult::NONE;
+	}
+	SkipList::Node* node = list->insert(score, member);
+	index->emplace(std::string_view(node->member), node);
+	return AddResult::ADDED;
+}
+
+bool ZSetValue::remove(std::string_view member)
+{
+	if (list) {
+		auto it = index->find(member);
+		if (it == index->end()) return false;
+		SkipList::Node* node = it->second;
+		index->erase(it);
+		list->erase(node);
+		return true;
+	}
+	size_t pos = small.find(member, 2);
+	if (pos == Listpack::npos) return false;
+	small.erase(pos, 2);
+	return true;
+}
+
+bool ZSetValue::score(std::string_view member, double& out) const
+{
+	if (list) {
+		auto it = index->find(member);
+		if (it == index->end()) return false;
+		out = it->second->score;
+		return true;
+	}
+	size_t pos = small.find(member, 2);
+	if (pos == Listpack::npos) return false;
+	out = scoreAt(small, small.next(pos));
+	return true;
+}
+
+bool ZSetValue::rank(std::string_view member, size_t& out) const
+{
+	if (list) {
+		auto it = index->find(member);
+		if (it == index->end()) return false;
+		out = list->rank(it->second->score, member) - 1;
+		return true;
+	}
+	size_t i = 0;
+	for (size_t pos = small.begin(); pos < small.end(); ++i) {
+		if (small.get(pos, pos) == member) {
+			out = i;
+			return true;
+		}
+		pos = small.next(pos);
+	}
+	return false;
+}
+
+void ZSetValue::range(long long start, long long stop, std::vector<std::pair<std::string, double>>& out) const
+{
+	long long n = static_cast<long long>(size());
+	if (start < 0) start += n;
+	if (stop < 0) stop += n;
+	if (start < 0) start = 0;
+	if (stop >= n) stop = n - 1;
+	if (start > stop) return;
+
+	out.reserve(out.size() + static_cast<size_t>(stop - start + 1));
+	if (list) {
+		SkipList::Node* node = list->byRank(static_cast<size_t>(start) + 1);
+		for (long long i = start; i <= stop && node; ++i, node = node->next()) {
+			out.emplace_back(node->member, node->score);
+		}
+		return;
+	}
+	long long i = 0;
+	for (size_t pos = small.begin(); pos < small.end() && i <= stop; ++i) {
+		std::string_view member = small.get(pos, pos);
+		if (i >= start) out.emplace_back(std::string(member), scoreAt(small, pos));
+		pos = small.next(pos);
+	}
+}
+
+void ZSetValue::rangeByScore(const ScoreRange& range, long long offset, long long limit, std::vector<std::pair<std::string, double>>& out) const
+{
+	if (offset < 0) return;
+	if (list) {
+		SkipList::Node* node = list->firstInRange(range);
+		for (; node && offset > 0; --offset) node = node->next();
+		for (; node && limit != 0 && range.belowMax(node->score); node = node->next(), --limit) {
+			out.emplace_back(node->member, node->score);
+		}
+		return;
+	}
+	if (range.empty()) return;
+	for (size_t pos = small.begin(); pos < small.end() && limit != 0;) {
+		std::string_view member = small.get(pos, pos);
+		double score = scoreAt(small, pos);
+		pos = small.next(pos);
+		if (!range.belowMax(score)) break;
+		if (!range.aboveMin(score)) continue;
+		if (offset > 0) {
+			--offset;
+			continue;
+		}
+		out.emplace_back(std::string(member), score);
+		--limit;
+	}
+}
+
+size_t ZSetValue::removeRangeByScore(const ScoreRange& range)
+{
+	if (list) {
+		return list->eraseRange(range, [this](SkipList::Node* node) { index->erase(std::string_view(node->member)); });
+	}
+	if (range.empty()) return 0;
+	size_t removed = 0;
+	for (size_t pos = small.begin(); pos < small.end();) {
+		double score = scoreAt(small, small.next(pos));
+		if (!range.belowMax(score)) break;
+		if (range.aboveMin(score)) {
+			small.erase(pos, 2);
+			++removed;
+		}
+		else {
+			pos = small.next(small.next(pos));
+		}
+	}
+	return removed;
+}
+
+size_t ZSetValue::size() const
+{
+	return list ? list->size() : small.size() / 2;
+}
+
+size_t ZSetValue::memoryUsage() const
+{
+	size_t bytes = sizeof(*this) + small.capacity();
+	if (list) {
+		bytes += sizeof(SkipList) + list->memoryUsage() + sizeof(Index) + index->bucket_count() * sizeof(void*)
+			+ index->size() * (NODE_OVERHEAD + sizeof(Index::value_type));
+	}
+	return bytes;
+}
+
+std::string ZSetValue::formatScore(double score)
+{
+	char buffer[32];
+	auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), score);
+	return std::string(buffer, static_cast<size_t>(ptr - buffer));
+}
\ No newline at end of file
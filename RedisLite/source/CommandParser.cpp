@@ -1,126 +1,783 @@
 // CommandParser.cpp
 #include "../headers/CommandParser.h"
-#include <algorithm>
-#include <cctype>
-#include <cerrno>
-#include <vector>
+#include "../headers/CommandHandlers.h"
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <iterator>
+#include <cmath>
+#include <limits>
+#include <cstring>
 
 // Helper: find CRLF starting from pos. returns npos if not found.
-static size_t findCRLF(const std::string& buf, size_t pos) {
-    return buf.find("\r\n", pos);
+static size_t findCRLF(std::string_view buf, size_t pos) {
+    while (pos < buf.size()) {
+        const void* cr = std::memchr(buf.data() + pos, '\r', buf.size() - pos);
+        if (cr == nullptr) return std::string_view::npos;
+        size_t idx = static_cast<const char*>(cr) - buf.data();
+        if (idx + 1 >= buf.size()) return std::string_view::npos; // '\n' not received yet
+        if (buf[idx + 1] == '\n') return idx;
+        pos = idx + 1;
+    }
+    return std::string_view::npos;
 }
 
-// Helper: parse a line (up to CRLF). On success line contains contents before CRLF and nextPos is position after CRLF.
+// Helper: parse a line (up to CRLF). On success line views the contents before CRLF and nextPos is position after CRLF.
 // Returns true on success, false if CRLF not found (incomplete).
-static bool parseLine(const std::string& buf, size_t pos, std::string& line, size_t& nextPos) {
+static bool parseLine(std::string_view buf, size_t pos, std::string_view& line, size_t& nextPos) {
     size_t crlf = findCRLF(buf, pos);
-    if (crlf == std::string::npos) return false; // incomplete
+    if (crlf == std::string_view::npos) return false; // incomplete
     line = buf.substr(pos, crlf - pos);
     nextPos = crlf + 2; // skip CRLF
     return true;
 }
 
+// Largest TTL or expiry time accepted, in milliseconds; far enough from the
+// limits of long long that adding the current time cannot overflow.
+static const long long MAX_EXPIRE_MILLIS = LLONG_MAX / 4;
+
+// Framing limits. Anything larger is rejected instead of waited for, so a
+// bogus length cannot keep a client's input buffering. The bulk limit is
+// Redis' default proto-max-bulk-len; the array limit is the one Redis puts
+// on clients that have not authenticated, which is every RedisLite client.
+static const long long MAX_BULK_LENGTH = 512LL * 1024 * 1024;
+static const long long MAX_ARRAY_LENGTH = 1024 * 1024;
+
 // Helper: safe integer parsing
-static bool parseInteger(const std::string& s, long long& out) {
+static bool parseInteger(std::string_view s, long long& out) {
     if (s.empty()) return false;
-    try {
-        size_t idx = 0;
-        long long v = std::stoll(s, &idx, 10);
-        if (idx != s.size()) return false;
-        out = v;
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, out);
+    return ec == std::errc() && ptr == end;
+}
+
+// Helper: ASCII case-insensitive comparison against an upper-case literal, without copying.
+static bool equalsIgnoreCase(std::string_view s, std::string_view upper) {
+    if (s.size() != upper.size()) return false;
+    for (size_t i = 0; i < s.size(); ++i) {
+        char c = s[i];
+        if (c >= 'a' && c <= 'z') c = static_cast<char>(c - ('a' - 'A'));
+        if (c != upper[i]) return false;
+    }
+    return true;
+}
+
+// Helper: sorted-set score, accepting inf, +inf and -inf but not NaN.
+static bool parseScore(std::string_view s, double& out) {
+    if (equalsIgnoreCase(s, "INF") || equalsIgnoreCase(s, "+INF")) {
+        out = std::numeric_limits<double>::infinity();
+        return true;
+    }
+    if (equalsIgnoreCase(s, "-INF")) {
+        out = -std::numeric_limits<double>::infinity();
         return true;
     }
-    catch (...) {
+    if (!s.empty() && s[0] == '+') s.remove_prefix(1);
+    if (s.empty()) return false;
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, out);
+    return ec == std::errc() && ptr == end && !std::isnan(out);
+}
+
+// Helper: one end of a score range; a leading '(' makes it exclusive.
+static bool parseScoreBound(std::string_view s, double& out, bool& exclusive) {
+    exclusive = !s.empty() && s[0] == '(';
+    if (exclusive) s.remove_prefix(1);
+    return parseScore(s, out);
+}
+
+static void fail(ParseResult& result, const char* message) {
+    result.status = ParseResult::Status::ERR;
+    result.errorMessage = message;
+}
+
+static void failArity(ParseResult& result, const CommandSpec& spec) {
+    result.status = ParseResult::Status::ERR;
+    result.errorMessage = "wrong number of arguments for '";
+    result.errorMessage.append(spec.name);
+    result.errorMessage += "' command";
+}
+
+// Per-command parsers, called once the name and arity have been checked and
+// type, spec and the first key (when the table declares one) are filled in.
+// Each reads the remaining arguments into the Command's fields.
+
+static bool parseSet(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // SET key value [EX seconds | PX milliseconds | EXAT unix-seconds | PXAT unix-milliseconds | KEEPTTL]
+    cmd.value = parts[2];
+    for (size_t i = 3; i < parts.size(); ++i) {
+        bool seconds = equalsIgnoreCase(parts[i], "EX") || equalsIgnoreCase(parts[i], "EXAT");
+        bool millis = equalsIgnoreCase(parts[i], "PX") || equalsIgnoreCase(parts[i], "PXAT");
+        if ((seconds || millis) && i + 1 < parts.size() && !cmd.expireMillis && !cmd.keepTtl) {
+            long long ttlVal = 0;
+            if (!parseInteger(parts[i + 1], ttlVal) || ttlVal <= 0 || ttlVal > MAX_EXPIRE_MILLIS / (seconds ? 1000 : 1)) {
+                fail(result, "invalid expire time in 'set' command");
+                return false;
+            }
+            cmd.expireMillis = seconds ? ttlVal * 1000 : ttlVal;
+            cmd.expireAbsolute = parts[i].size() == 4;
+            ++i;
+        }
+        else if (equalsIgnoreCase(parts[i], "KEEPTTL") && !cmd.expireMillis && !cmd.keepTtl) {
+            cmd.keepTtl = true;
+        }
+        else {
+            fail(result, "Unknown SET option");
+            return false;
+        }
+    }
+    return true;
+}
+
+// The argument after the key: HGET's field, a member, INCRBYFLOAT's increment.
+static bool parseValue(const CommandArgs& parts, Command& cmd, ParseResult&) {
+    cmd.value = parts[2];
+    return true;
+}
+
+static bool parseMset(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // MSET key value [key value ...]
+    if (parts.size() % 2 != 1) {
+        failArity(result, *cmd.spec);
+        return false;
+    }
+    cmd.value = parts[2];
+    return true;
+}
+
+static bool parseIncr(const CommandArgs&, Command& cmd, ParseResult&) {
+    cmd.increment = cmd.spec->name[0] == 'i' ? 1 : -1;
+    return true;
+}
+
+static bool parseIncrBy(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    long long delta = 0;
+    if (!parseInteger(parts[2], delta)) {
+        fail(result, "value is not an integer or out of range");
+        return false;
+    }
+    if (cmd.spec->name[0] == 'd') {
+        if (delta == LLONG_MIN) {
+            fail(result, "decrement would overflow");
+            return false;
+        }
+        delta = -delta;
+    }
+    cmd.increment = delta;
+    return true;
+}
+
+static bool parseInfo(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // INFO [section]
+    if (parts.size() > 2) {
+        failArity(result, *cmd.spec);
+        return false;
+    }
+    if (parts.size() == 2) cmd.key = parts[1];
+    return true;
+}
+
+static bool parseScan(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // SCAN cursor [MATCH pattern] [COUNT count]
+    const char* end = parts[1].data() + parts[1].size();
+    auto [ptr, ec] = std::from_chars(parts[1].data(), end, cmd.cursor);
+    if (parts[1].empty() || ec != std::errc() || ptr != end) {
+        fail(result, "invalid cursor");
+        return false;
+    }
+    cmd.pattern = "*";
+    for (size_t i = 2; i < parts.size(); i += 2) {
+        if (i + 1 >= parts.size()) {
+            fail(result, "syntax error");
+            return false;
+        }
+        if (equalsIgnoreCase(parts[i], "MATCH")) {
+            cmd.pattern = parts[i + 1];
+        }
+        else if (equalsIgnoreCase(parts[i], "COUNT")) {
+            if (!parseInteger(parts[i + 1], cmd.count)) {
+                fail(result, "value is not an integer or out of range");
+                return false;
+            }
+            if (cmd.count < 1) {
+                fail(result, "syntax error");
+                return false;
+            }
+        }
+        else {
+            fail(result, "syntax error");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseKeys(const CommandArgs& parts, Command& cmd, ParseResult&) {
+    cmd.pattern = parts[1];
+    return true;
+}
+
+static bool parseHset(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // HSET key field value [field value ...]
+    if (parts.size() % 2 != 0) {
+        failArity(result, *cmd.spec);
+        return false;
+    }
+    return true;
+}
+
+static bool parseRange(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // LRANGE key start stop, negative indexes counting from the tail
+    if (!parseInteger(parts[2], cmd.start) || !parseInteger(parts[3], cmd.stop)) {
+        fail(result, "value is not an integer or out of range");
+        return false;
+    }
+    return true;
+}
+
+static bool parseExpire(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // EXPIRE key seconds, PEXPIRE key milliseconds, EXPIREAT key unix-seconds, PEXPIREAT key unix-milliseconds
+    std::string_view name = cmd.spec->name;
+    bool seconds = name[0] == 'e';
+    long long ttlVal = 0;
+    if (!parseInteger(parts[2], ttlVal)) {
+        fail(result, "value is not an integer or out of range");
+        return false;
+    }
+    long long limit = MAX_EXPIRE_MILLIS / (seconds ? 1000 : 1);
+    if (ttlVal > limit || ttlVal < -limit) {
+        fail(result, "invalid expire time");
+        return false;
+    }
+    cmd.expireMillis = seconds ? ttlVal * 1000 : ttlVal;
+    cmd.expireAbsolute = name.back() == 't';
+    return true;
+}
+
+static bool parseZadd(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // ZADD key [NX|XX] [CH] score member [score member ...]
+    size_t i = 2;
+    for (; i < parts.size(); ++i) {
+        if (equalsIgnoreCase(parts[i], "NX")) cmd.nx = true;
+        else if (equalsIgnoreCase(parts[i], "XX")) cmd.xx = true;
+        else if (equalsIgnoreCase(parts[i], "CH")) cmd.ch = true;
+        else break;
+    }
+    if (cmd.nx && cmd.xx) {
+        fail(result, "XX and NX options at the same time are not compatible");
+        return false;
+    }
+    if (i == parts.size() || (parts.size() - i) % 2 != 0) {
+        fail(result, "syntax error");
+        return false;
+    }
+    for (; i < parts.size(); i += 2) {
+        double score = 0;
+        if (!parseScore(parts[i], score)) {
+            fail(result, "value is not a valid float");
+            return false;
+        }
+        cmd.scoredMembers.emplace_back(score, parts[i + 1]);
+    }
+    return true;
+}
+
+static bool parseZrange(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // ZRANGE key start stop [WITHSCORES]
+    if (parts.size() > 5) {
+        failArity(result, *cmd.spec);
         return false;
     }
+    if (!parseRange(parts, cmd, result)) return false;
+    if (parts.size() == 5) {
+        if (!equalsIgnoreCase(parts[4], "WITHSCORES")) {
+            fail(result, "syntax error");
+            return false;
+        }
+        cmd.withScores = true;
+    }
+    return true;
 }
 
-ParseResult CommandParser::parseCommand(const std::string& buffer) {
+static bool parseScoreRange(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]; ZREMRANGEBYSCORE key min max
+    if (!parseScoreBound(parts[2], cmd.range.min, cmd.range.minExclusive) ||
+        !parseScoreBound(parts[3], cmd.range.max, cmd.range.maxExclusive)) {
+        fail(result, "min or max is not a float");
+        return false;
+    }
+    for (size_t i = 4; i < parts.size(); ++i) {
+        if (equalsIgnoreCase(parts[i], "WITHSCORES")) {
+            cmd.withScores = true;
+        }
+        else if (equalsIgnoreCase(parts[i], "LIMIT") && i + 2 < parts.size()) {
+            if (!parseInteger(parts[i + 1], cmd.offset) || !parseInteger(parts[i + 2], cmd.limit)) {
+                fail(result, "value is not an integer or out of range");
+                return false;
+            }
+            i += 2;
+        }
+        else {
+            fail(result, "syntax error");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parseSlowlogGet(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // SLOWLOG GET [count]
+    if (parts.size() > 3) {
+        failArity(result, *cmd.spec);
+        return false;
+    }
+    if (parts.size() == 3 && (!parseInteger(parts[2], cmd.count) || cmd.count < -1)) {
+        fail(result, "count should be greater than or equal to -1");
+        return false;
+    }
+    return true;
+}
+
+static bool parseLatencyHistory(const CommandArgs& parts, Command& cmd, ParseResult&) {
+    cmd.key = parts[2]; // the event name
+    return true;
+}
+
+static bool parsePing(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    if (parts.size() > 2) {
+        failArity(result, *cmd.spec);
+        return false;
+    }
+    if (parts.size() == 2) cmd.value = parts[1];
+    return true;
+}
+
+static bool parsePublish(const CommandArgs& parts, Command& cmd, ParseResult&) {
+    // PUBLISH channel message
+    cmd.key = parts[1];
+    cmd.value = parts[2];
+    return true;
+}
+
+static bool parseHello(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // HELLO [protover]; AUTH and SETNAME are not supported
+    cmd.count = 0;
+    if (parts.size() == 1) return true;
+    if (!parseInteger(parts[1], cmd.count)) {
+        fail(result, "Protocol version is not an integer or out of range");
+        return false;
+    }
+    if (parts.size() > 2) {
+        result.status = ParseResult::Status::ERR;
+        result.errorMessage = "Syntax error in HELLO option '";
+        result.errorMessage.append(parts[2]);
+        result.errorMessage += "'";
+        return false;
+    }
+    return true;
+}
+
+static bool parseClientTracking(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // CLIENT TRACKING on|off [REDIRECT id] [BCAST] [PREFIX prefix ...] [NOLOOP]
+    cmd.count = 0;
+    if (equalsIgnoreCase(parts[2], "ON")) {
+        cmd.on = true;
+    }
+    else if (!equalsIgnoreCase(parts[2], "OFF")) {
+        fail(result, "syntax error");
+        return false;
+    }
+    for (size_t i = 3; i < parts.size(); ++i) {
+        bool last = i + 1 == parts.size();
+        if (equalsIgnoreCase(parts[i], "REDIRECT") && !last) {
+            if (!parseInteger(parts[++i], cmd.count) || cmd.count <= 0) {
+                fail(result, "Invalid client ID");
+                return false;
+            }
+        }
+        else if (equalsIgnoreCase(parts[i], "PREFIX") && !last) {
+            cmd.prefixes.push_back(parts[++i]);
+        }
+        else if (equalsIgnoreCase(parts[i], "BCAST")) {
+            cmd.bcast = true;
+        }
+        else if (equalsIgnoreCase(parts[i], "NOLOOP")) {
+            cmd.noloop = true;
+        }
+        else if (equalsIgnoreCase(parts[i], "OPTIN") || equalsIgnoreCase(parts[i], "OPTOUT")) {
+            fail(result, "OPTIN and OPTOUT are not supported");
+            return false;
+        }
+        else {
+            fail(result, "syntax error");
+            return false;
+        }
+    }
+    if (!cmd.prefixes.empty() && !cmd.bcast) {
+        fail(result, "PREFIX option requires BCAST mode to be enabled");
+        return false;
+    }
+    return true;
+}
+
+static bool parseReplconf(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // REPLCONF listening-port <port> | ACK <offset> | capa <capability> ...
+    if (parts.size() % 2 != 1) {
+        failArity(result, *cmd.spec);
+        return false;
+    }
+    cmd.count = 0;
+    for (size_t i = 1; i + 1 < parts.size(); i += 2) {
+        if (equalsIgnoreCase(parts[i], "ACK") || equalsIgnoreCase(parts[i], "GETACK")) {
+            cmd.key = "ACK";
+            parseInteger(parts[i + 1], cmd.count);
+        }
+        else if (equalsIgnoreCase(parts[i], "LISTENING-PORT")) {
+            parseInteger(parts[i + 1], cmd.count);
+        }
+    }
+    return true;
+}
+
+static bool parsePsync(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // PSYNC replid offset; "PSYNC ? -1" asks for a full resync
+    if (!parseInteger(parts[2], cmd.count)) {
+        fail(result, "value is not an integer or out of range");
+        return false;
+    }
+    cmd.key = parts[1];
+    return true;
+}
+
+static bool parseReplicaof(const CommandArgs& parts, Command& cmd, ParseResult& result) {
+    // REPLICAOF host port | NO ONE
+    if (equalsIgnoreCase(parts[1], "NO") && equalsIgnoreCase(parts[2], "ONE")) {
+        cmd.count = 0;
+        return true;
+    }
+    if (!parseInteger(parts[2], cmd.count) || cmd.count <= 0 || cmd.count > 65535) {
+        fail(result, "Invalid master port");
+        return false;
+    }
+    cmd.key = parts[1];
+    return true;
+}
+
+using P = Propagation;
+using T = CommandType;
+using H = CommandHandlers;
+
+// Every command the server accepts, one entry per name. Aliases (INCR and
+// INCRBY, EXPIRE and PEXPIREAT) share a handler but keep their own entry, so
+// COMMAND INFO and the per-command stats report them separately. Key
+// positions and flags follow Redis' COMMAND INFO.
+static constexpr CommandSpec COMMAND_TABLE[] = {
+    // name                type                    arity  flags                                firstKey lastKey step  propagation    parser              handler
+    { "set",               T::SET,                 -3,    CMD_WRITE | CMD_DENYOOM,             1,  1, 1,  P::REWRITTEN, parseSet,           &H::set },
+    { "get",               T::GET,                 2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::get },
+    { "del",               T::DEL,                 -2,    CMD_WRITE,                           1, -1, 1,  P::VERBATIM,  nullptr,            &H::del },
+    { "exists",            T::EXISTS,              -2,    CMD_READONLY | CMD_FAST,             1, -1, 1,  P::NONE,      nullptr,            &H::exists },
+    { "mget",              T::MGET,                -2,    CMD_READONLY | CMD_FAST,             1, -1, 1,  P::NONE,      nullptr,            &H::mget },
+    { "mset",              T::MSET,                -3,    CMD_WRITE | CMD_DENYOOM,             1, -1, 2,  P::VERBATIM,  parseMset,          &H::mset },
+    // The counters are logged by their handlers as the SET of the result.
+    { "incr",              T::INCRBY,              2,     CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::NONE,      parseIncr,          &H::incrBy },
+    { "decr",              T::INCRBY,              2,     CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::NONE,      parseIncr,          &H::incrBy },
+    { "incrby",            T::INCRBY,              3,     CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::NONE,      parseIncrBy,        &H::incrBy },
+    { "decrby",            T::INCRBY,              3,     CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::NONE,      parseIncrBy,        &H::incrBy },
+    { "incrbyfloat",       T::INCRBYFLOAT,         3,     CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::NONE,      parseValue,         &H::incrByFloat },
+    { "bgrewriteaof",      T::BGREWRITEAOF,        1,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::bgrewriteaof },
+    { "save",              T::SAVE,                1,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::save },
+    { "bgsave",            T::BGSAVE,              1,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::bgsave },
+    { "lastsave",          T::LASTSAVE,            1,     CMD_FAST,                            0,  0, 0,  P::NONE,      nullptr,            &H::lastsave },
+    { "info",              T::INFO,                -1,    0,                                   0,  0, 0,  P::NONE,      parseInfo,          &H::info },
+    { "scan",              T::SCAN,                -2,    CMD_READONLY,                        0,  0, 0,  P::NONE,      parseScan,          &H::scan },
+    { "keys",              T::KEYS,                2,     CMD_READONLY,                        0,  0, 0,  P::NONE,      parseKeys,          &H::keys },
+    { "dbsize",            T::DBSIZE,              1,     CMD_READONLY | CMD_FAST,             0,  0, 0,  P::NONE,      nullptr,            &H::dbsize },
+    { "hset",              T::HSET,                -4,    CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::VERBATIM,  parseHset,          &H::hset },
+    { "hget",              T::HGET,                3,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      parseValue,         &H::hget },
+    { "hdel",              T::HDEL,                -3,    CMD_WRITE | CMD_FAST,                1,  1, 1,  P::VERBATIM,  nullptr,            &H::hdel },
+    { "hgetall",           T::HGETALL,             2,     CMD_READONLY,                        1,  1, 1,  P::NONE,      nullptr,            &H::readAll },
+    { "hlen",              T::HLEN,                2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::length },
+    { "lpush",             T::LPUSH,               -3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::VERBATIM,  nullptr,            &H::push },
+    { "rpush",             T::RPUSH,               -3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::VERBATIM,  nullptr,            &H::push },
+    { "lpop",              T::LPOP,                2,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::VERBATIM,  nullptr,            &H::pop },
+    { "rpop",              T::RPOP,                2,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::VERBATIM,  nullptr,            &H::pop },
+    { "lrange",            T::LRANGE,              4,     CMD_READONLY,                        1,  1, 1,  P::NONE,      parseRange,         &H::lrange },
+    { "llen",              T::LLEN,                2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::length },
+    { "sadd",              T::SADD,                -3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::VERBATIM,  nullptr,            &H::saddSrem },
+    { "srem",              T::SREM,                -3,    CMD_WRITE | CMD_FAST,                1,  1, 1,  P::VERBATIM,  nullptr,            &H::saddSrem },
+    { "sismember",         T::SISMEMBER,           3,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      parseValue,         &H::sismember },
+    { "smembers",          T::SMEMBERS,            2,     CMD_READONLY,                        1,  1, 1,  P::NONE,      nullptr,            &H::readAll },
+    { "scard",             T::SCARD,               2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::length },
+    { "expire",            T::EXPIRE,              3,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::REWRITTEN, parseExpire,        &H::expire },
+    { "pexpire",           T::EXPIRE,              3,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::REWRITTEN, parseExpire,        &H::expire },
+    { "expireat",          T::EXPIRE,              3,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::REWRITTEN, parseExpire,        &H::expire },
+    { "pexpireat",         T::EXPIRE,              3,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::REWRITTEN, parseExpire,        &H::expire },
+    { "ttl",               T::TTL,                 2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::ttl },
+    { "pttl",              T::PTTL,                2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::ttl },
+    { "persist",           T::PERSIST,             2,     CMD_WRITE | CMD_FAST,                1,  1, 1,  P::VERBATIM,  nullptr,            &H::persist },
+    { "type",              T::TYPE,                2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::type },
+    { "object",            T::UNKNOWN,             -2,    CMD_CONTAINER,                       0,  0, 0,  P::NONE,      nullptr,            nullptr },
+    { "object|encoding",   T::OBJECT,              3,     CMD_READONLY,                        2,  2, 1,  P::NONE,      nullptr,            &H::objectEncoding },
+    { "zadd",              T::ZADD,                -4,    CMD_WRITE | CMD_DENYOOM | CMD_FAST,  1,  1, 1,  P::VERBATIM,  parseZadd,          &H::zadd },
+    { "zrem",              T::ZREM,                -3,    CMD_WRITE | CMD_FAST,                1,  1, 1,  P::VERBATIM,  nullptr,            &H::zremove },
+    { "zscore",            T::ZSCORE,              3,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      parseValue,         &H::zscore },
+    { "zrank",             T::ZRANK,               3,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      parseValue,         &H::zrank },
+    { "zcard",             T::ZCARD,               2,     CMD_READONLY | CMD_FAST,             1,  1, 1,  P::NONE,      nullptr,            &H::zcard },
+    { "zrange",            T::ZRANGE,              -4,    CMD_READONLY,                        1,  1, 1,  P::NONE,      parseZrange,        &H::zrange },
+    { "zrangebyscore",     T::ZRANGEBYSCORE,       -4,    CMD_READONLY,                        1,  1, 1,  P::NONE,      parseScoreRange,    &H::zrange },
+    { "zremrangebyscore",  T::ZREMRANGEBYSCORE,    4,     CMD_WRITE,                           1,  1, 1,  P::VERBATIM,  parseScoreRange,    &H::zremove },
+    { "slowlog",           T::UNKNOWN,             -2,    CMD_ADMIN | CMD_CONTAINER,           0,  0, 0,  P::NONE,      nullptr,            nullptr },
+    { "slowlog|get",       T::SLOWLOG_GET,         -2,    CMD_ADMIN,                           0,  0, 0,  P::NONE,      parseSlowlogGet,    &H::slowlogGet },
+    { "slowlog|len",       T::SLOWLOG_LEN,         2,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::slowlogLen },
+    { "slowlog|reset",     T::SLOWLOG_RESET,       2,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::slowlogReset },
+    { "latency",           T::UNKNOWN,             -2,    CMD_ADMIN | CMD_CONTAINER,           0,  0, 0,  P::NONE,      nullptr,            nullptr },
+    { "latency|latest",    T::LATENCY_LATEST,      2,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::latencyLatest },
+    { "latency|history",   T::LATENCY_HISTORY,     3,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      parseLatencyHistory, &H::latencyHistory },
+    { "latency|reset",     T::LATENCY_RESET,       -2,    CMD_ADMIN,                           0,  0, 0,  P::NONE,      nullptr,            &H::latencyReset },
+    { "ping",              T::PING,                -1,    CMD_FAST,                            0,  0, 0,  P::NONE,      parsePing,          &H::ping },
+    { "replconf",          T::REPLCONF,            -1,    CMD_ADMIN,                           0,  0, 0,  P::NONE,      parseReplconf,      &H::replconf },
+    { "psync",             T::PSYNC,               3,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      parsePsync,         &H::psync },
+    { "replicaof",         T::REPLICAOF,           3,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      parseReplicaof,     &H::replicaof },
+    { "slaveof",           T::REPLICAOF,           3,     CMD_ADMIN,                           0,  0, 0,  P::NONE,      parseReplicaof,     &H::replicaof },
+    { "role",              T::ROLE,                1,     CMD_FAST,                            0,  0, 0,  P::NONE,      nullptr,            &H::role },
+    { "subscribe",         T::SUBSCRIBE,           -2,    CMD_PUBSUB,                          0,  0, 0,  P::NONE,      nullptr,            &H::subscribe },
+    { "unsubscribe",       T::UNSUBSCRIBE,         -1,    CMD_PUBSUB,                          0,  0, 0,  P::NONE,      nullptr,            &H::unsubscribe },
+    { "psubscribe",        T::PSUBSCRIBE,          -2,    CMD_PUBSUB,                          0,  0, 0,  P::NONE,      nullptr,            &H::subscribe },
+    { "punsubscribe",      T::PUNSUBSCRIBE,        -1,    CMD_PUBSUB,                          0,  0, 0,  P::NONE,      nullptr,            &H::unsubscribe },
+    { "publish",           T::PUBLISH,             3,     CMD_PUBSUB | CMD_FAST,               0,  0, 0,  P::NONE,      parsePublish,       &H::publish },
+    { "hello",             T::HELLO,               -1,    CMD_FAST,                            0,  0, 0,  P::NONE,      parseHello,         &H::hello },
+    { "client",            T::UNKNOWN,             -2,    CMD_CONTAINER,                       0,  0, 0,  P::NONE,      nullptr,            nullptr },
+    { "client|id",         T::CLIENT_ID,           2,     CMD_FAST,                            0,  0, 0,  P::NONE,      nullptr,            &H::clientId },
+    { "client|tracking",   T::CLIENT_TRACKING,     -3,    0,                                   0,  0, 0,  P::NONE,      parseClientTracking, &H::clientTracking },
+    { "client|trackinginfo", T::CLIENT_TRACKINGINFO, 2,   0,                                   0,  0, 0,  P::NONE,      nullptr,            &H::clientTrackingInfo },
+    { "client|getredir",   T::CLIENT_GETREDIR,     2,     0,                                   0,  0, 0,  P::NONE,      nullptr,            &H::clientGetRedir },
+    { "command",           T::COMMAND,             -1,    CMD_CONTAINER,                       0,  0, 0,  P::NONE,      nullptr,            &H::commandInfo },
+    { "command|count",     T::COMMAND_COUNT,       2,     0,                                   0,  0, 0,  P::NONE,      nullptr,            &H::commandCount },
+    { "command|info",      T::COMMAND_INFO,        -2,    0,                                   0,  0, 0,  P::NONE,      nullptr,            &H::commandInfo },
+};
+
+static_assert(std::size(COMMAND_TABLE) == CommandParser::COMMAND_COUNT, "COMMAND_COUNT must match the command table");
+
+// Names are looked up through a perfect hash built at compile time by hash
+// and displace (CHD): a name's seed-0 hash picks one of HASH_BUCKETS buckets,
+// and each bucket has its own seed that sends all of its names to distinct
+// slots of HASH_SLOTS. A lookup is two hashes and one compare, and never
+// copies or lower-cases the name.
+static constexpr size_t HASH_BUCKETS = 32;
+static constexpr size_t HASH_SLOTS = 256;
+static constexpr size_t MAX_BUCKET_SIZE = 16;
+
+static_assert(CommandParser::COMMAND_COUNT < 255, "slots hold a table index plus one in a byte");
+
+static constexpr char toLowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// FNV-1a over the lower-cased bytes, so case does not change the hash.
+static constexpr uint32_t hashBytes(uint32_t h, std::string_view s) {
+    for (char c : s) {
+        h ^= static_cast<uint8_t>(toLowerAscii(c));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Hash of "name" or, for a subcommand, of "name|sub", without building it.
+static constexpr uint32_t hashName(uint32_t seed, std::string_view name, std::string_view sub = {}) {
+    uint32_t h = hashBytes(2166136261u ^ (seed * 0x9E3779B9u), name);
+    if (!sub.empty()) h = hashBytes(hashBytes(h, "|"), sub);
+    // FNV's low bits mix poorly; fold the high bits in before taking a modulus.
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+struct CommandHash {
+    uint8_t seeds[HASH_BUCKETS] = {};
+    uint8_t slots[HASH_SLOTS] = {}; // table index + 1; 0 is empty
+};
+
+static constexpr CommandHash buildCommandHash() {
+    CommandHash hash;
+    size_t sizes[HASH_BUCKETS] = {};
+    for (const CommandSpec& spec : COMMAND_TABLE) {
+        ++sizes[hashName(0, spec.name) % HASH_BUCKETS];
+    }
+    // Place the fullest buckets first, while most slots are still free.
+    size_t order[HASH_BUCKETS] = {};
+    for (size_t b = 0; b < HASH_BUCKETS; ++b) {
+        order[b] = b;
+        for (size_t i = b; i > 0 && sizes[order[i]] > sizes[order[i - 1]]; --i) {
+            size_t t = order[i];
+            order[i] = order[i - 1];
+            order[i - 1] = t;
+        }
+    }
+    for (size_t b : order) {
+        if (sizes[b] == 0) break;
+        if (sizes[b] > MAX_BUCKET_SIZE) throw "command hash bucket overflow";
+        bool placed = false;
+        for (uint32_t seed = 1; seed < 256 && !placed; ++seed) {
+            size_t slots[MAX_BUCKET_SIZE] = {};
+            size_t members[MAX_BUCKET_SIZE] = {};
+            size_t n = 0;
+            bool fits = true;
+            for (size_t i = 0; i < std::size(COMMAND_TABLE) && fits; ++i) {
+                if (hashName(0, COMMAND_TABLE[i].name) % HASH_BUCKETS != b) continue;
+                size_t slot = hashName(seed, COMMAND_TABLE[i].name) % HASH_SLOTS;
+                fits = hash.slots[slot] == 0;
+                for (size_t j = 0; j < n && fits; ++j) fits = slots[j] != slot;
+                slots[n] = slot;
+                members[n++] = i;
+            }
+            if (!fits) continue;
+            for (size_t j = 0; j < n; ++j) {
+                hash.slots[slots[j]] = static_cast<uint8_t>(members[j] + 1);
+            }
+            hash.seeds[b] = static_cast<uint8_t>(seed);
+            placed = true;
+        }
+        if (!placed) throw "no perfect hash for the command table";
+    }
+    return hash;
+}
+
+static constexpr CommandHash COMMAND_HASH = buildCommandHash();
+
+// Helper: ASCII case-insensitive comparison against a lower-case name.
+static bool equalsLower(std::string_view s, std::string_view lower) {
+    if (s.size() != lower.size()) return false;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (toLowerAscii(s[i]) != lower[i]) return false;
+    }
+    return true;
+}
+
+static const CommandSpec* findCommand(std::string_view name, std::string_view sub = {}) {
+    size_t bucket = hashName(0, name, sub) % HASH_BUCKETS;
+    uint8_t entry = COMMAND_HASH.slots[hashName(COMMAND_HASH.seeds[bucket], name, sub) % HASH_SLOTS];
+    if (entry == 0) return nullptr;
+    const CommandSpec& spec = COMMAND_TABLE[entry - 1];
+    if (sub.empty()) {
+        return equalsLower(name, spec.name) ? &spec : nullptr;
+    }
+    if (spec.name.size() != name.size() + 1 + sub.size() || spec.name[name.size()] != '|') return nullptr;
+    bool match = equalsLower(name, spec.name.substr(0, name.size())) && equalsLower(sub, spec.name.substr(name.size() + 1));
+    return match ? &spec : nullptr;
+}
+
+ParseResult CommandParser::parseCommand(std::string_view buffer) {
     ParseResult result;
+    parseCommand(buffer, result);
+    return result;
+}
+
+void CommandParser::parseCommand(std::string_view buffer, ParseResult& result) {
     result.status = ParseResult::Status::INCOMPLETE;
     result.bytesConsumed = 0;
     result.errorMessage.clear();
 
+    Command& cmd = result.command;
+    cmd.type = CommandType::UNKNOWN;
+    cmd.spec = nullptr;
+    cmd.key = std::string_view();
+    cmd.value = std::string_view();
+    cmd.expireMillis = std::nullopt;
+    cmd.expireAbsolute = false;
+    cmd.keepTtl = false;
+    cmd.increment = 0;
+    cmd.cursor = 0;
+    cmd.count = 10;
+    cmd.pattern = std::string_view();
+    cmd.start = 0;
+    cmd.stop = -1;
+    cmd.scoredMembers.clear();
+    cmd.nx = false;
+    cmd.xx = false;
+    cmd.ch = false;
+    cmd.range = ScoreRange();
+    cmd.withScores = false;
+    cmd.offset = 0;
+    cmd.limit = -1;
+    cmd.on = false;
+    cmd.bcast = false;
+    cmd.noloop = false;
+    cmd.prefixes.clear();
+    cmd.args.clear();
+
     if (buffer.empty()) {
-        return result; // incomplete
+        return; // incomplete
     }
 
     size_t pos = 0;
 
     // Expect array header: "*<N>\r\n"
     if (buffer[pos] != '*') {
-        result.status = ParseResult::Status::ERR;
-        result.errorMessage = "Expected '*'";
-        return result;
+        fail(result, "Expected '*'");
+        return;
     }
 
     // parse the "*<N>\r\n" line
-    std::string arrayLine;
+    std::string_view arrayLine;
     size_t afterArrayLine = 0;
     if (!parseLine(buffer, pos + 1, arrayLine, afterArrayLine)) {
         // incomplete
-        return result;
+        return;
     }
 
     long long numElements = 0;
-    if (!parseInteger(arrayLine, numElements)) {
-        result.status = ParseResult::Status::ERR;
-        result.errorMessage = "Invalid array length";
-        return result;
+    if (!parseInteger(arrayLine, numElements) || numElements > MAX_ARRAY_LENGTH) {
+        fail(result, "Invalid array length");
+        return;
     }
     if (numElements <= 0) {
-        result.status = ParseResult::Status::ERR;
-        result.errorMessage = "Array must contain at least one element";
-        return result;
+        fail(result, "Array must contain at least one element");
+        return;
     }
 
     pos = afterArrayLine;
 
-    std::vector<std::string> parts;
-    parts.reserve(static_cast<size_t>(numElements));
+    std::vector<std::string_view>& parts = cmd.args;
 
     // Parse each bulk string: $<len>\r\n<data>\r\n
     for (long long i = 0; i < numElements; ++i) {
         // Need at least one char for '$'
         if (pos >= buffer.size()) {
             // incomplete
-            result.status = ParseResult::Status::INCOMPLETE;
-            return result;
+            return;
         }
 
         if (buffer[pos] != '$') {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Expected '$'";
-            return result;
+            fail(result, "Expected '$'");
+            return;
         }
 
         // parse the "$<len>\r\n" line
-        std::string lenLine;
+        std::string_view lenLine;
         size_t afterLenLine = 0;
         if (!parseLine(buffer, pos + 1, lenLine, afterLenLine)) {
             // incomplete
-            result.status = ParseResult::Status::INCOMPLETE;
-            return result;
+            return;
         }
 
         long long len = 0;
-        if (!parseInteger(lenLine, len)) {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Invalid bulk length";
-            return result;
+        if (!parseInteger(lenLine, len) || len > MAX_BULK_LENGTH) {
+            fail(result, "Invalid bulk length");
+            return;
         }
 
         // handle nil bulk string
         if (len == -1) {
-            parts.emplace_back(std::string()); // represent nil as empty string for commands
+            parts.emplace_back(); // represent nil as empty string for commands
             pos = afterLenLine;
             continue;
         }
 
         if (len < 0) {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Negative bulk length";
-            return result;
+            fail(result, "Negative bulk length");
+            return;
         }
 
         // check we have data + CRLF available
@@ -128,21 +785,16 @@ ParseResult CommandParser::parseCommand(const std::string& buffer) {
         size_t dataEnd = dataStart + static_cast<size_t>(len);
         if (buffer.size() < dataEnd + 2) {
             // incomplete
-            result.status = ParseResult::Status::INCOMPLETE;
-            return result;
+            return;
         }
 
-        // extract data
-        std::string data = buffer.substr(dataStart, static_cast<size_t>(len));
-
         // validate trailing CRLF
         if (buffer[dataEnd] != '\r' || buffer[dataEnd + 1] != '\n') {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Missing CRLF after bulk data";
-            return result;
+            fail(result, "Missing CRLF after bulk data");
+            return;
         }
 
-        parts.push_back(std::move(data));
+        parts.push_back(buffer.substr(dataStart, static_cast<size_t>(len)));
         pos = dataEnd + 2; // advance past data and trailing CRLF
     }
 
@@ -150,95 +802,62 @@ ParseResult CommandParser::parseCommand(const std::string& buffer) {
     result.bytesConsumed = pos;
 
     // Interpret parts into Command
-    Command cmd;
-    cmd.type = CommandType::UNKNOWN;
-
     if (parts.empty()) {
+        fail(result, "Empty command");
+        return;
+    }
+
+    const CommandSpec* spec = findCommand(parts[0]);
+    if (spec == nullptr || spec->name.find('|') != std::string_view::npos) {
         result.status = ParseResult::Status::ERR;
-        result.errorMessage = "Empty command";
-        return result;
-    }
-
-    std::string cmdName = parts[0];
-    std::transform(cmdName.begin(), cmdName.end(), cmdName.begin(), [](unsigned char c) { return std::toupper(c); });
-
-    if (cmdName == "SET") {
-        // SET key value            -> parts.size() == 3
-        // SET key value EX seconds -> parts.size() == 5
-        if (parts.size() == 3) {
-            cmd.type = CommandType::SET;
-            cmd.key = parts[1];
-            cmd.value = parts[2];
-            cmd.ttlSeconds = std::nullopt;
-        }
-        else if (parts.size() == 5) {
-            std::string opt = parts[3];
-            std::transform(opt.begin(), opt.end(), opt.begin(), [](unsigned char c) { return std::toupper(c); });
-            if (opt == "EX") {
-                long long ttlVal = 0;
-                if (!parseInteger(parts[4], ttlVal) || ttlVal < 0) {
-                    result.status = ParseResult::Status::ERR;
-                    result.errorMessage = "Invalid TTL value";
-                    return result;
-                }
-                cmd.type = CommandType::SET;
-                cmd.key = parts[1];
-                cmd.value = parts[2];
-                cmd.ttlSeconds = static_cast<int>(ttlVal);
-            }
-            else {
-                result.status = ParseResult::Status::ERR;
-                result.errorMessage = "Unknown SET option";
-                return result;
-            }
-        }
-        else {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Wrong number of arguments for SET";
-            return result;
-        }
+        result.errorMessage = "unknown command '";
+        result.errorMessage.append(parts[0]);
+        result.errorMessage += "'";
+        return;
     }
-    else if (cmdName == "GET") {
-        if (parts.size() == 2) {
-            cmd.type = CommandType::GET;
-            cmd.key = parts[1];
-        }
-        else {
+    if ((spec->flags & CMD_CONTAINER) && parts.size() >= 2) {
+        const CommandSpec* sub = parts[1].empty() ? nullptr : findCommand(spec->name, parts[1]);
+        if (sub == nullptr) {
             result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Wrong number of arguments for GET";
-            return result;
+            result.errorMessage = "unknown subcommand '";
+            result.errorMessage.append(parts[1]);
+            result.errorMessage += "' for '";
+            result.errorMessage.append(spec->name);
+            result.errorMessage += "'";
+            return;
         }
+        spec = sub;
     }
-    else if (cmdName == "DEL") {
-        if (parts.size() == 2) {
-            cmd.type = CommandType::DEL;
-            cmd.key = parts[1];
-        }
-        else {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Wrong number of arguments for DEL";
-            return result;
-        }
+    size_t argc = parts.size();
+    if (spec->arity >= 0 ? argc != static_cast<size_t>(spec->arity) : argc < static_cast<size_t>(-spec->arity)) {
+        failArity(result, *spec);
+        return;
     }
-    else if (cmdName == "EXISTS") {
-        if (parts.size() == 2) {
-            cmd.type = CommandType::EXISTS;
-            cmd.key = parts[1];
-        }
-        else {
-            result.status = ParseResult::Status::ERR;
-            result.errorMessage = "Wrong number of arguments for EXISTS";
-            return result;
-        }
+
+    cmd.type = spec->type;
+    cmd.spec = spec;
+    if (spec->firstKey > 0) {
+        cmd.key = parts[spec->firstKey];
     }
-    else {
-        // Unknown command name  return OK but mark command UNKNOWN, or treat as error
-        result.status = ParseResult::Status::ERR;
-        result.errorMessage = "Unknown command";
-        return result;
+    if (spec->parse != nullptr && !spec->parse(parts, cmd, result)) {
+        return;
     }
 
-    result.command = std::move(cmd);
     result.status = ParseResult::Status::OK;
-    return result;
+}
+
+const CommandSpec& CommandParser::command(size_t id) {
+    return COMMAND_TABLE[id];
+}
+
+size_t CommandParser::commandId(const CommandSpec& spec) {
+    return static_cast<size_t>(&spec - COMMAND_TABLE);
+}
+
+const CommandSpec* CommandParser::lookup(std::string_view name) {
+    return findCommand(name);
+}
+
+int64_t CommandParser::expireAt(const Command& cmd, int64_t nowMs) {
+    return cmd.expireAbsolute ? *cmd.expireMillis : nowMs + *cmd.expireMillis;
 }
@@ -0,0 +1,85 @@
+#include "../headers/Glob.h"
+#include <utility>
+
+// Matches c against the [...] class starting at pattern[i] (the '['); on
+// return i is just past the closing ']'.
+static bool matchClass(std::string_view pattern, size_t& i, char c) {
+	size_t j = i + 1;
+	bool negate = j < pattern.size() && pattern[j] == '^';
+	if (negate) ++j;
+	bool matched = false;
+	while (j < pattern.size() && pattern[j] != ']') {
+		if (pattern[j] == '\\' && j + 1 < pattern.size()) {
+			++j;
+			matched = matched || pattern[j] == c;
+			++j;
+		}
+		else if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+			unsigned char lo = static_cast<unsigned char>(pattern[j]);
+			unsigned char hi = static_cast<unsigned char>(pattern[j + 2]);
+			if (lo > hi) std::swap(lo, hi);
+			unsigned char uc = static_cast<unsigned char>(c);
+			matched = matched || (uc >= lo && uc <= hi);
+			j += 3;
+		}
+		else {
+			matched = matched || pattern[j] == c;
+			++j;
+		}
+	}
+	// An unterminated class runs to the end of the pattern.
+	i = j < pattern.size() ? j + 1 : j;
+	return negate ? !matched : matched;
+}
+
+bool globMatch(std::string_view pattern, std::string_view text) {
+	size_t p = 0;
+	size_t t = 0;
+	// Where to resume after the most recent '*' when a later match fails.
+	size_t starP = std::string_view::npos;
+	size_t starT = 0;
+
+	while (t < text.size()) {
+		if (p < pattern.size()) {
+			char pc = pattern[p];
+			if (pc == '*') {
+				while (p < pattern.size() && pattern[p] == '*') ++p;
+				if (p == pattern.size()) return true;
+				starP = p;
+				starT = t;
+				continue;
+			}
+			size_t next = p + 1;
+			bool ok;
+			if (pc == '?') {
+				ok = true;
+			}
+			else if (pc == '[') {
+				next = p;
+				ok = matchClass(pattern, next, text[t]);
+			}
+			else {
+				if (pc == '\\' && p + 1 < pattern.size()) {
+					++p;
+					next = p + 1;
+				}
+				ok = pattern[p] == text[t];
+			}
+			if (ok) {
+				p = next;
+				++t;
+				continue;
+			}
+		}
+		if (starP == std::string_view::npos) return false;
+		// Let the last '*' swallow one more byte and retry.
+		p = starP;
+		t = ++starT;
+	}
+	while (p < pattern.size() && pattern[p] == '*') ++p;
+	return p == pattern.size();
+}
+
+bool globIsLiteral(std::string_view pattern) {
+	return pattern.find_first_of("*?[\\") == std::string_view::npos;
+}
@@ -0,0 +1,252 @@
+#include "../headers/HashTable.h"
+#include "../headers/LatencyMonitor.h"
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+
+// Grow past 3/4 full; shrink below 1/8 full.
+static bool tooFull(size_t count, size_t capacity) { return count * 4 > capacity * 3; }
+static bool tooSparse(size_t count, size_t capacity) { return capacity > HashTable::MIN_CAPACITY && count * 8 < capacity; }
+
+HashTable::~HashTable()
+{
+	std::free(tables[0].slots);
+	std::free(tables[1].slots);
+}
+
+size_t HashTable::hashKey(std::string_view key)
+{
+	return std::hash<std::string_view>{}(key);
+}
+
+size_t HashTable::mix(size_t h)
+{
+	if constexpr (sizeof(size_t) == 8) {
+		uint64_t x = h;
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return static_cast<size_t>(x);
+	}
+	else {
+		uint32_t x = static_cast<uint32_t>(h);
+		x ^= x >> 16;
+		x *= 0x85ebca6bU;
+		x ^= x >> 13;
+		x *= 0xc2b2ae35U;
+		x ^= x >> 16;
+		return x;
+	}
+}
+
+size_t HashTable::reverseBits(size_t v)
+{
+	size_t width = sizeof(v) * 8;
+	size_t mask = ~static_cast<size_t>(0);
+	while ((width >>= 1) > 0) {
+		mask ^= mask << width;
+		v = ((v >> width) & mask) | ((v << width) & ~mask);
+	}
+	return v;
+}
+
+Entry** HashTable::allocateSlots(size_t capacity)
+{
+	// calloc rather than new[]() so a large table comes from fresh zero pages
+	// instead of being cleared up front, which would stall the resizing write.
+	void* p = std::calloc(capacity, sizeof(Entry*));
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return static_cast<Entry**>(p);
+}
+
+size_t HashTable::probe(const Table& table, std::string_view key, size_t hash) const
+{
+	if (table.used == 0) {
+		return NOT_FOUND;
+	}
+	// Every table keeps at least a quarter of its slots null, so this ends.
+	for (size_t i = mix(hash) & table.mask;; i = (i + 1) & table.mask) {
+		Entry* e = table.slots[i];
+		if (!e) {
+			return NOT_FOUND;
+		}
+		if (!isTombstone(e) && e->keyLength == key.size() && std::memcmp(e->keyData(), key.data(), key.size()) == 0) {
+			return i;
+		}
+	}
+}
+
+size_t HashTable::findSlot(std::string_view key, size_t hash) const
+{
+	size_t slot = probe(tables[0], key, hash);
+	if (slot != NOT_FOUND || !isRehashing()) {
+		return slot;
+	}
+	slot = probe(tables[1], key, hash);
+	return slot == NOT_FOUND ? NOT_FOUND : tables[0].capacity() + slot;
+}
+
+Entry* HashTable::find(std::string_view key, size_t hash) const
+{
+	size_t slot = findSlot(key, hash);
+	return slot == NOT_FOUND ? nullptr : at(slot);
+}
+
+Entry* HashTable::at(size_t slot) const
+{
+	size_t oldCapacity = tables[0].capacity();
+	Entry* e = slot < oldCapacity ? tables[0].slots[slot] : tables[1].slots[slot - oldCapacity];
+	return isTombstone(e) ? nullptr : e;
+}
+
+void HashTable::replaceAt(size_t slot, Entry* entry)
+{
+	size_t oldCapacity = tables[0].capacity();
+	if (slot < oldCapacity) {
+		tables[0].slots[slot] = entry;
+	}
+	else {
+		tables[1].slots[slot - oldCapacity] = entry;
+	}
+}
+
+void HashTable::place(Table& table, Entry* entry, size_t hash)
+{
+	size_t i = mix(hash) & table.mask;
+	while (table.slots[i]) {
+		i = (i + 1) & table.mask;
+	}
+	table.slots[i] = entry;
+	++table.used;
+}
+
+void HashTable::insert(Entry* entry, size_t hash)
+{
+	if (isRehashing()) {
+		rehashStep();
+	}
+	if (!isRehashing() && (!tables[0].slots || tooFull(count + 1, tables[0].capacity()))) {
+		startResize(tables[0].slots ? tables[0].capacity() * 2 : MIN_CAPACITY);
+	}
+	if (isRehashing() && tooFull(tables[1].used + 1, tables[1].capacity())) {
+		// Steps normally finish a resize long before this; if inserts outran
+		// them, complete it now and grow again.
+		finishResize();
+		if (tooFull(count + 1, tables[0].capacity())) {
+			startResize(tables[0].capacity() * 2);
+		}
+	}
+	place(isRehashing() ? tables[1] : tables[0], entry, hash);
+	++count;
+}
+
+void HashTable::eraseShifting(Table& table, size_t slot)
+{
+	// Backward-shift deletion: pull later members of the run into the hole
+	// unless that would move them before their home slot.
+	size_t hole = slot;
+	for (size_t i = (slot + 1) & table.mask; table.slots[i]; i = (i + 1) & table.mask) {
+		size_t home = mix(hashKey(table.slots[i]->key())) & table.mask;
+		// Move i into hole when home is not cyclically within (hole, i].
+		bool homeBetween = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+		if (!homeBetween) {
+			table.slots[hole] = table.slots[i];
+			hole = i;
+		}
+	}
+	table.slots[hole] = nullptr;
+}
+
+void HashTable::eraseAt(size_t slot)
+{
+	size_t oldCapacity = tables[0].capacity();
+	if (slot >= oldCapacity) {
+		eraseShifting(tables[1], slot - oldCapacity);
+		--tables[1].used;
+	}
+	else if (isRehashing()) {
+		// Shifting here could move an unmigrated entry behind rehashIndex.
+		tables[0].slots[slot] = &tombstone;
+		--tables[0].used;
+	}
+	else {
+		eraseShifting(tables[0], slot);
+		--tables[0].used;
+	}
+	--count;
+
+	if (isRehashing()) {
+		rehashStep();
+	}
+	else if (tooSparse(count, tables[0].capacity())) {
+		// Leave the shrunk table at most 3/8 full so it does not bounce
+		// straight back across either threshold.
+		size_t target = MIN_CAPACITY;
+		while (tooFull(count * 2, target)) target *= 2;
+		startResize(target);
+	}
+}
+
+void HashTable::reserve(size_t keys)
+{
+	finishResize();
+	size_t target = MIN_CAPACITY;
+	while (tooFull(keys, target)) target *= 2;
+	if (target > tables[0].capacity()) {
+		startResize(target);
+		finishResize();
+	}
+}
+
+void HashTable::startResize(size_t newCapacity)
+{
+	LatencyMonitor::Clock::time_point started = LatencyMonitor::startMonitor();
+	if (tables[0].used == 0) {
+		// Nothing to migrate: swap in the new table directly.
+		std::free(tables[0].slots);
+		tables[0] = Table{ allocateSlots(newCapacity), newCapacity - 1, 0 };
+	}
+	else {
+		tables[1] = Table{ allocateSlots(newCapacity), newCapacity - 1, 0 };
+		rehashIndex = 0;
+	}
+	LatencyMonitor::addSampleIfNeeded("hash-table-resize", started);
+}
+
+bool HashTable::rehashStep(size_t slots)
+{
+	if (!isRehashing()) {
+		return false;
+	}
+	Table& from = tables[0];
+	size_t end = slots < from.capacity() - rehashIndex ? rehashIndex + slots : from.capacity();
+	for (; rehashIndex < end && from.used > 0; ++rehashIndex) {
+		Entry* e = from.slots[rehashIndex];
+		if (!e || isTombstone(e)) continue;
+		place(tables[1], e, hashKey(e->key()));
+		// A tombstone, not null, so later entries of this run stay reachable.
+		from.slots[rehashIndex] = &tombstone;
+		--from.used;
+	}
+	if (from.used > 0) {
+		return true;
+	}
+	std::free(from.slots);
+	tables[0] = tables[1];
+	tables[1] = Table{};
+	rehashIndex = 0;
+	return false;
+}
+
+void HashTable::finishResize()
+{
+	if (!isRehashing()) return;
+	LatencyMonitor::Clock::time_point started = LatencyMonitor::startMonitor();
+	while (rehashStep(static_cast<size_t>(-1))) {}
+	LatencyMonitor::addSampleIfNeeded("hash-table-resize", started);
+}
@@ -1,60 +1,1483 @@
 #include "../headers/KeyValueStore.h"
+#include "../headers/CachedClock.h"
+#include "../headers/Glob.h"
+#include "../headers/LatencyMonitor.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <new>
 
-void KeyValueStore::set(const std::string& key, const std::string& value, std::optional<int> ttlSeconds)
+// Logarithmic LFU counter parameters, as Redis's defaults.
+static const uint8_t LFU_INIT_VAL = 5;
+static const int LFU_LOG_FACTOR = 10;
+
+static bool isExpired(const Entry* e, int64_t now) {
+	return e->hasExpiry() && now >= e->expireAt();
+}
+
+static std::string entryValue(const Entry* e) {
+	char buffer[KVPair::INT_BUFFER_SIZE];
+	return std::string(e->valueView(buffer));
+}
+
+static size_t roundUpToPowerOfTwo(size_t n) {
+	size_t p = 1;
+	while (p < n) p <<= 1;
+	return p;
+}
+
+KeyValueStore::KeyValueStore(size_t shardCount)
+{
+	size_t count = roundUpToPowerOfTwo(shardCount == 0 ? 1 : shardCount);
+	shards = std::make_unique<Shard[]>(count);
+	shardMask = count - 1;
+	while ((static_cast<size_t>(1) << shardBits) < count) ++shardBits;
+}
+
+KeyValueStore::~KeyValueStore()
 {
-	std::lock_guard<std::mutex> lock(mtx);
-	KVPair kvp;
-	kvp.value = value;
-	if (ttlSeconds.has_value()) {
-		kvp.expireAt = std::chrono::steady_clock::now() + std::chrono::seconds(ttlSeconds.value());
+	stopActiveExpiry();
+	for (size_t i = 0; i <= shardMask; ++i) {
+		Shard& shard = shards[i];
+		shard.table.forEach([this, &shard](Entry* e) { releaseEntry(shard, e); });
 	}
-	store[key] = kvp;
 }
 
-std::optional<std::string> KeyValueStore::get(const std::string& key) 
+// Orders the positions of keys by shard so a batch can take every shard lock it
+// needs once, in ascending shard order (which also rules out deadlocks between
+// concurrent batches).
+void KeyValueStore::groupByShard(const std::string_view* keys, size_t count, size_t stride, std::vector<std::pair<size_t, size_t>>& order) const
 {
-	std::lock_guard<std::mutex> lock(mtx);
-	auto it = store.find(key);
-	if (it == store.end()) {
-		return std::nullopt;
+	order.clear();
+	order.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		order.emplace_back(shardIndex(HashTable::hashKey(keys[i * stride])), i);
+	}
+	std::sort(order.begin(), order.end());
+}
+
+uint32_t KeyValueStore::clockNow() const
+{
+	return static_cast<uint32_t>(CachedClock::nowMs() - clockStart);
+}
+
+void KeyValueStore::trackMemory(const Entry* entry, long long sign)
+{
+	size_t bytes = SlabAllocator::blockSize(entry->allocationSize()) + objectMemory(entry);
+	if (entry->hasExpiry()) {
+		bytes += sizeof(Entry*);
 	}
+	usedMemory.fetch_add(sign * static_cast<long long>(bytes), std::memory_order_relaxed);
+}
 
-	if (it->second.isExpired()) {
-		store.erase(it);
-		return std::nullopt;
+size_t KeyValueStore::objectMemory(const Entry* entry)
+{
+	switch (entry->type()) {
+		case ValueType::HASH: return entry->object<HashValue>()->memoryUsage();
+		case ValueType::LIST: return entry->object<ListValue>()->memoryUsage();
+		case ValueType::SET: return entry->object<SetValue>()->memoryUsage();
+		case ValueType::ZSET: return entry->object<ZSetValue>()->memoryUsage();
+		default: return 0;
+	}
+}
+
+void KeyValueStore::trackTable(const Shard& shard, size_t bytesBefore)
+{
+	long long delta = static_cast<long long>(shard.table.memoryUsage()) - static_cast<long long>(bytesBefore);
+	if (delta != 0) {
+		usedMemory.fetch_add(delta, std::memory_order_relaxed);
+	}
+}
+
+static uint8_t decayedCounter(uint8_t counter, uint16_t lastMinute, uint16_t nowMinute) {
+	uint16_t periods = static_cast<uint16_t>(nowMinute - lastMinute);
+	return periods >= counter ? 0 : static_cast<uint8_t>(counter - periods);
+}
+
+// Runs under the shard's read lock, so the fields are written through relaxed
+// atomic_refs; a lost LFU increment between racing readers is harmless.
+void KeyValueStore::touch(Entry* entry)
+{
+	uint32_t now = clockNow();
+	std::atomic_ref<uint32_t>(entry->accessTime).store(now, std::memory_order_relaxed);
+	if (evictionPolicy != EvictionPolicy::ALLKEYS_LFU) {
+		return;
+	}
+
+	uint16_t minute = static_cast<uint16_t>(now / 60000);
+	std::atomic_ref<uint8_t> counterRef(entry->lfuCounter);
+	std::atomic_ref<uint16_t> minuteRef(entry->lfuDecayMinute);
+	uint8_t counter = decayedCounter(counterRef.load(std::memory_order_relaxed), minuteRef.load(std::memory_order_relaxed), minute);
+	if (counter < 255) {
+		thread_local std::minstd_rand rng(std::random_device{}());
+		double base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+		double r = static_cast<double>(rng() - rng.min()) / static_cast<double>(rng.max() - rng.min());
+		if (r < 1.0 / (base * LFU_LOG_FACTOR + 1)) {
+			++counter;
+		}
+	}
+	counterRef.store(counter, std::memory_order_relaxed);
+	minuteRef.store(minute, std::memory_order_relaxed);
+}
+
+static void heapSet(std::vector<Entry*>& heap, size_t i, Entry* e) {
+	heap[i] = e;
+	e->setHeapIndex(static_cast<uint32_t>(i));
+}
+
+static void siftUp(std::vector<Entry*>& heap, size_t i) {
+	Entry* e = heap[i];
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (heap[parent]->expireAt() <= e->expireAt()) break;
+		heapSet(heap, i, heap[parent]);
+		i = parent;
+	}
+	heapSet(heap, i, e);
+}
+
+static void siftDown(std::vector<Entry*>& heap, size_t i) {
+	Entry* e = heap[i];
+	size_t n = heap.size();
+	while (true) {
+		size_t child = i * 2 + 1;
+		if (child >= n) break;
+		if (child + 1 < n && heap[child + 1]->expireAt() < heap[child]->expireAt()) ++child;
+		if (e->expireAt() <= heap[child]->expireAt()) break;
+		heapSet(heap, i, heap[child]);
+		i = child;
+	}
+	heapSet(heap, i, e);
+}
+
+void KeyValueStore::heapPush(Shard& shard, Entry* entry)
+{
+	shard.expiry.push_back(entry);
+	siftUp(shard.expiry, shard.expiry.size() - 1);
+}
+
+void KeyValueStore::heapRemove(Shard& shard, Entry* entry)
+{
+	std::vector<Entry*>& heap = shard.expiry;
+	size_t i = entry->heapIndex();
+	Entry* last = heap.back();
+	heap.pop_back();
+	if (i < heap.size()) {
+		heapSet(heap, i, last);
+		siftUp(heap, i);
+		siftDown(heap, last->heapIndex());
+	}
+}
+
+Entry* KeyValueStore::allocateEntry(Shard& shard, std::string_view key, size_t valueLength, uint8_t flags, std::optional<int64_t> expireAt)
+{
+	if (expireAt.has_value()) {
+		flags |= Entry::HAS_EXPIRY;
+	}
+	void* memory = shard.allocator.allocate(Entry::allocationSize(key.size(), valueLength, flags));
+	Entry* e = new (memory) Entry;
+	e->keyLength = static_cast<uint32_t>(key.size());
+	e->valueLength = static_cast<uint32_t>((flags & Entry::INT_ENCODED) ? 0 : valueLength);
+	e->accessTime = 0;
+	e->lfuDecayMinute = static_cast<uint16_t>(clockNow() / 60000);
+	e->lfuCounter = LFU_INIT_VAL;
+	e->flags = flags;
+	if (expireAt.has_value()) {
+		e->setExpireAt(expireAt.value());
+		e->setHeapIndex(0);
+	}
+	std::memcpy(e->keyData(), key.data(), key.size());
+	return e;
+}
+
+Entry* KeyValueStore::createEntry(Shard& shard, std::string_view key, std::string_view value, std::optional<int64_t> expireAt)
+{
+	long long integer = 0;
+	if (KVPair::parseCanonicalInteger(value, integer)) {
+		return createIntegerEntry(shard, key, integer, expireAt);
+	}
+	Entry* e = allocateEntry(shard, key, value.size(), 0, expireAt);
+	std::memcpy(e->valueData(), value.data(), value.size());
+	return e;
+}
+
+Entry* KeyValueStore::createIntegerEntry(Shard& shard, std::string_view key, long long value, std::optional<int64_t> expireAt)
+{
+	Entry* e = allocateEntry(shard, key, 0, Entry::INT_ENCODED, expireAt);
+	e->setInteger(value);
+	return e;
+}
+
+void KeyValueStore::placeEntry(Shard& shard, size_t slot, size_t hash, Entry* fresh)
+{
+	if (slot != HashTable::NOT_FOUND) {
+		// An overwrite is an access: keep the key's LFU history.
+		Entry* old = shard.table.at(slot);
+		fresh->lfuCounter = old->lfuCounter;
+		fresh->lfuDecayMinute = old->lfuDecayMinute;
+		trackMemory(old, -1);
+		if (old->hasExpiry()) {
+			heapRemove(shard, old);
+		}
+		shard.table.replaceAt(slot, fresh);
+		releaseEntry(shard, old);
+		// Inserts and erases step a pending resize themselves; overwrites
+		// help too so a write-heavy working set finishes it promptly.
+		if (shard.table.isRehashing()) {
+			size_t before = shard.table.memoryUsage();
+			shard.table.rehashStep();
+			trackTable(shard, before);
+		}
+	}
+	else {
+		size_t before = shard.table.memoryUsage();
+		shard.table.insert(fresh, hash);
+		trackTable(shard, before);
+		keyCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (fresh->hasExpiry()) {
+		heapPush(shard, fresh);
+	}
+	touch(fresh);
+	trackMemory(fresh, 1);
+}
+
+void KeyValueStore::eraseSlot(Shard& shard, size_t slot)
+{
+	Entry* e = shard.table.at(slot);
+	trackMemory(e, -1);
+	if (e->hasExpiry()) {
+		heapRemove(shard, e);
+	}
+	size_t before = shard.table.memoryUsage();
+	shard.table.eraseAt(slot);
+	trackTable(shard, before);
+	keyCount.fetch_sub(1, std::memory_order_relaxed);
+	releaseEntry(shard, e);
+}
+
+void KeyValueStore::releaseEntry(Shard& shard, Entry* entry)
+{
+	switch (entry->type()) {
+		case ValueType::HASH: delete entry->object<HashValue>(); break;
+		case ValueType::LIST: delete entry->object<ListValue>(); break;
+		case ValueType::SET: delete entry->object<SetValue>(); break;
+		case ValueType::ZSET: delete entry->object<ZSetValue>(); break;
+		default: break;
+	}
+	shard.allocator.deallocate(entry, entry->allocationSize());
+}
+
+void KeyValueStore::expireSlot(Shard& shard, size_t slot)
+{
+	if (expiryListener) {
+		expiryListener(shard.table.at(slot)->key());
+	}
+	eraseSlot(shard, slot);
+	expiredKeys.fetch_add(1, std::memory_order_relaxed);
+}
+
+void KeyValueStore::set(std::string_view key, std::string_view value, std::optional<int64_t> expireAt, bool keepTtl,
+	const ChangeLog& log)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	storeLocked(shard, hash, key, value, expireAt, keepTtl);
+	if (log) log();
+}
+
+void KeyValueStore::storeLocked(Shard& shard, size_t hash, std::string_view key, std::string_view value, std::optional<int64_t> expireAt, bool keepTtl)
+{
+	size_t slot = shard.table.findSlot(key, hash);
+	if (keepTtl && slot != HashTable::NOT_FOUND) {
+		Entry* old = shard.table.at(slot);
+		if (old->hasExpiry() && !isExpired(old, CachedClock::nowMs())) {
+			expireAt = old->expireAt();
+		}
+	}
+	placeEntry(shard, slot, hash, createEntry(shard, key, value, expireAt));
+}
+
+KeyValueStore::CounterStatus KeyValueStore::incrBy(std::string_view key, long long delta, long long& result, const UpdateLog& log)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot != HashTable::NOT_FOUND && isExpired(shard.table.at(slot), CachedClock::nowMs())) {
+		expireSlot(shard, slot);
+		slot = HashTable::NOT_FOUND;
+	}
+
+	long long current = 0;
+	Entry* entry = slot != HashTable::NOT_FOUND ? shard.table.at(slot) : nullptr;
+	if (entry) {
+		char buffer[KVPair::INT_BUFFER_SIZE];
+		if (entry->type() != ValueType::STRING) {
+			return CounterStatus::WRONG_TYPE;
+		}
+		if (entry->isInteger()) {
+			current = entry->integer();
+		}
+		else if (!KVPair::parseCanonicalInteger(entry->valueView(buffer), current)) {
+			return CounterStatus::NOT_INTEGER;
+		}
+	}
+	if ((delta > 0 && current > std::numeric_limits<long long>::max() - delta) ||
+		(delta < 0 && current < std::numeric_limits<long long>::min() - delta)) {
+		return CounterStatus::OUT_OF_RANGE;
+	}
+	result = current + delta;
+
+	if (entry && entry->isInteger()) {
+		// The common case: update in place, no allocation or formatting.
+		entry->setInteger(result);
+		touch(entry);
+	}
+	else {
+		std::optional<int64_t> expireAt;
+		if (entry && entry->hasExpiry()) {
+			expireAt = entry->expireAt();
+		}
+		placeEntry(shard, slot, hash, createIntegerEntry(shard, key, result, expireAt));
 	}
 
-	return it->second.value;
+	if (log) {
+		char buffer[KVPair::INT_BUFFER_SIZE];
+		auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), result);
+		log(key, std::string_view(buffer, static_cast<size_t>(end - buffer)));
+	}
+	return CounterStatus::OK;
+}
+
+// Parses a whole string as a long double, rejecting spaces, NaN and infinity.
+static bool parseLongDouble(std::string_view s, long double& out) {
+	char buffer[128];
+	if (s.empty() || s.size() >= sizeof(buffer) || std::isspace(static_cast<unsigned char>(s[0]))) {
+		return false;
+	}
+	std::memcpy(buffer, s.data(), s.size());
+	buffer[s.size()] = '\0';
+	char* end = nullptr;
+	errno = 0;
+	out = std::strtold(buffer, &end);
+	return end == buffer + s.size() && errno != ERANGE && !std::isnan(out) && !std::isinf(out);
+}
+
+KeyValueStore::CounterStatus KeyValueStore::incrByFloat(std::string_view key, std::string_view increment, std::string& result, const UpdateLog& log)
+{
+	long double delta = 0;
+	if (!parseLongDouble(increment, delta)) {
+		return CounterStatus::NOT_FLOAT;
+	}
+
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot != HashTable::NOT_FOUND && isExpired(shard.table.at(slot), CachedClock::nowMs())) {
+		expireSlot(shard, slot);
+		slot = HashTable::NOT_FOUND;
+	}
+
+	long double current = 0;
+	if (slot != HashTable::NOT_FOUND) {
+		Entry* entry = shard.table.at(slot);
+		char buffer[KVPair::INT_BUFFER_SIZE];
+		if (entry->type() != ValueType::STRING) {
+			return CounterStatus::WRONG_TYPE;
+		}
+		if (entry->isInteger()) {
+			current = static_cast<long double>(entry->integer());
+		}
+		else if (!parseLongDouble(entry->valueView(buffer), current)) {
+			return CounterStatus::NOT_FLOAT;
+		}
+	}
+	long double sum = current + delta;
+	if (std::isnan(sum) || std::isinf(sum)) {
+		return CounterStatus::NAN_OR_INFINITY;
+	}
+
+	// Fixed notation with trailing zeros trimmed, as Redis prints it.
+	char buffer[5120];
+	int length = std::snprintf(buffer, sizeof(buffer), "%.17Lf", sum);
+	if (length <= 0 || static_cast<size_t>(length) >= sizeof(buffer)) {
+		return CounterStatus::OUT_OF_RANGE;
+	}
+	result.assign(buffer, static_cast<size_t>(length));
+	if (result.find('.') != std::string::npos) {
+		while (result.back() == '0') result.pop_back();
+		if (result.back() == '.') result.pop_back();
+	}
+	if (result == "-0") result = "0";
+
+	storeLocked(shard, hash, key, result, std::nullopt, true);
+	if (log) {
+		log(key, result);
+	}
+	return CounterStatus::OK;
+}
+
+std::optional<std::string> KeyValueStore::get(std::string_view key, bool* wrongType) 
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	{
+		std::shared_lock<std::shared_mutex> lock(shard.mtx);
+		Entry* e = shard.table.find(key, hash);
+		if (!e) {
+			return std::nullopt;
+		}
+
+		if (!isExpired(e, CachedClock::nowMs())) {
+			touch(e);
+			if (e->type() != ValueType::STRING) {
+				if (wrongType) *wrongType = true;
+				return std::nullopt;
+			}
+			return entryValue(e);
+		}
+	}
+
+	// Lazily reclaim the expired key; it may have been rewritten in between.
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot == HashTable::NOT_FOUND) {
+		return std::nullopt;
+	}
+	if (isExpired(shard.table.at(slot), CachedClock::nowMs())) {
+		expireSlot(shard, slot);
+		return std::nullopt;
+	}
+	if (shard.table.at(slot)->type() != ValueType::STRING) {
+		if (wrongType) *wrongType = true;
+		return std::nullopt;
+	}
+	return entryValue(shard.table.at(slot));
 }
 
-bool KeyValueStore::del(const std::string& key)
+bool KeyValueStore::del(std::string_view key, const ChangeLog& log)
 {
-	std::lock_guard<std::mutex> lock(mtx);
-	auto it = store.find(key);
-	if (it == store.end()) {
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot == HashTable::NOT_FOUND) {
 		return false;
 	}
-	if (it->second.isExpired()) {
-		store.erase(it);
+	if (isExpired(shard.table.at(slot), CachedClock::nowMs())) {
+		expireSlot(shard, slot);
 		return false;
 	}
-	store.erase(it);
+	eraseSlot(shard, slot);
+	if (log) log();
 	return true;
 }
 
-bool KeyValueStore::exists(const std::string& key) 
+void KeyValueStore::mget(const std::string_view* keys, size_t count, std::vector<std::optional<std::string>>& out)
+{
+	out.assign(count, std::nullopt);
+	std::vector<std::pair<size_t, size_t>> order;
+	groupByShard(keys, count, 1, order);
+
+	// Expired keys read as missing here; the active cycle reclaims them.
+	int64_t now = CachedClock::nowMs();
+	size_t i = 0;
+	while (i < order.size()) {
+		Shard& shard = shards[order[i].first];
+		std::shared_lock<std::shared_mutex> lock(shard.mtx);
+		for (size_t current = order[i].first; i < order.size() && order[i].first == current; ++i) {
+			std::string_view key = keys[order[i].second];
+			Entry* e = shard.table.find(key, HashTable::hashKey(key));
+			if (e && !isExpired(e, now)) {
+				touch(e);
+				if (e->type() == ValueType::STRING) out[order[i].second] = entryValue(e);
+			}
+		}
+	}
+}
+
+void KeyValueStore::mset(const std::string_view* keyValues, size_t pairs, const ChangeLog& log)
+{
+	std::vector<std::pair<size_t, size_t>> order;
+	groupByShard(keyValues, pairs, 2, order);
+
+	// All shard locks are held together so readers never see half a batch.
+	std::vector<std::unique_lock<std::shared_mutex>> locks;
+	for (size_t i = 0; i < order.size(); ++i) {
+		if (i == 0 || order[i].first != order[i - 1].first) {
+			locks.emplace_back(shards[order[i].first].mtx);
+		}
+	}
+	// Apply in argument order so a repeated key ends with its last value.
+	for (size_t i = 0; i < pairs; ++i) {
+		std::string_view key = keyValues[i * 2];
+		size_t hash = HashTable::hashKey(key);
+		storeLocked(shardFor(hash), hash, key, keyValues[i * 2 + 1], std::nullopt, false);
+	}
+	if (log) log();
+}
+
+size_t KeyValueStore::del(const std::string_view* keys, size_t count, const ChangeLog& log)
 {
-	std::lock_guard<std::mutex> lock(mtx);
-	auto it = store.find(key);
-	if (it == store.end()) 
+	std::vector<std::pair<size_t, size_t>> order;
+	groupByShard(keys, count, 1, order);
+
+	// Locked together, as in mset, so the one DEL record is logged under all of them.
+	std::vector<std::unique_lock<std::shared_mutex>> locks;
+	for (size_t i = 0; i < order.size(); ++i) {
+		if (i == 0 || order[i].first != order[i - 1].first) {
+			locks.emplace_back(shards[order[i].first].mtx);
+		}
+	}
+	int64_t now = CachedClock::nowMs();
+	size_t deleted = 0;
+	for (const auto& [shardIndex, index] : order) {
+		Shard& shard = shards[shardIndex];
+		std::string_view key = keys[index];
+		size_t slot = shard.table.findSlot(key, HashTable::hashKey(key));
+		if (slot == HashTable::NOT_FOUND) continue;
+		if (isExpired(shard.table.at(slot), now)) {
+			expireSlot(shard, slot);
+			continue;
+		}
+		eraseSlot(shard, slot);
+		++deleted;
+	}
+	if (deleted > 0 && log) log();
+	return deleted;
+}
+
+size_t KeyValueStore::exists(const std::string_view* keys, size_t count)
+{
+	std::vector<std::pair<size_t, size_t>> order;
+	groupByShard(keys, count, 1, order);
+
+	// A key named twice counts twice, as in Redis.
+	int64_t now = CachedClock::nowMs();
+	size_t found = 0;
+	size_t i = 0;
+	while (i < order.size()) {
+		Shard& shard = shards[order[i].first];
+		std::shared_lock<std::shared_mutex> lock(shard.mtx);
+		for (size_t current = order[i].first; i < order.size() && order[i].first == current; ++i) {
+			std::string_view key = keys[order[i].second];
+			Entry* e = shard.table.find(key, HashTable::hashKey(key));
+			if (e && !isExpired(e, now)) {
+				touch(e);
+				++found;
+			}
+		}
+	}
+	return found;
+}
+
+bool KeyValueStore::exists(std::string_view key) 
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	{
+		std::shared_lock<std::shared_mutex> lock(shard.mtx);
+		Entry* e = shard.table.find(key, hash);
+		if (!e) 
+		{
+			return false;
+		}
+		if (!isExpired(e, CachedClock::nowMs())) 
+		{
+			touch(e);
+			return true;
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot == HashTable::NOT_FOUND) 
+	{
+		return false;
+	}
+	if (isExpired(shard.table.at(slot), CachedClock::nowMs())) 
 	{
+		expireSlot(shard, slot);
 		return false;
 	}
+	return true;
+}
+
+// Adds, moves or (with nullopt) removes the TTL of the entry at slot. Moving
+// an existing TTL is done in place; adding or removing one changes the
+// entry's layout, so its bytes move to a block of the other size. A
+// collection's object pointer moves with them.
+void KeyValueStore::changeExpiry(Shard& shard, size_t slot, std::optional<int64_t> expireAt)
+{
+	Entry* old = shard.table.at(slot);
+	if (old->hasExpiry() && expireAt.has_value()) {
+		heapRemove(shard, old);
+		old->setExpireAt(expireAt.value());
+		heapPush(shard, old);
+		return;
+	}
+	if (!old->hasExpiry() && !expireAt.has_value()) {
+		return;
+	}
 
-	if (it->second.isExpired()) 
+	uint8_t flags = static_cast<uint8_t>(old->flags ^ Entry::HAS_EXPIRY);
+	size_t valueBytes = old->type() == ValueType::STRING ? old->valueLength : sizeof(void*);
+	void* memory = shard.allocator.allocate(Entry::allocationSize(old->keyLength, valueBytes, flags));
+	Entry* fresh = new (memory) Entry(*old);
+	fresh->flags = flags;
+	if (expireAt.has_value()) {
+		fresh->setExpireAt(expireAt.value());
+		fresh->setHeapIndex(0);
+	}
+	if (old->isInteger()) {
+		fresh->setInteger(old->integer());
+	}
+	std::memcpy(fresh->keyData(), old->keyData(), old->keyLength + valueBytes);
+
+	trackMemory(old, -1);
+	if (old->hasExpiry()) {
+		heapRemove(shard, old);
+	}
+	shard.table.replaceAt(slot, fresh);
+	shard.allocator.deallocate(old, old->allocationSize());
+	if (fresh->hasExpiry()) {
+		heapPush(shard, fresh);
+	}
+	trackMemory(fresh, 1);
+}
+
+KeyValueStore::ExpireStatus KeyValueStore::expire(std::string_view key, int64_t expireAt, const ExpireLog& log)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot == HashTable::NOT_FOUND) {
+		return ExpireStatus::NOT_FOUND;
+	}
+	int64_t now = CachedClock::nowMs();
+	if (isExpired(shard.table.at(slot), now)) {
+		expireSlot(shard, slot);
+		return ExpireStatus::NOT_FOUND;
+	}
+	if (expireAt <= now) {
+		eraseSlot(shard, slot);
+		if (log) log(ExpireStatus::DELETED);
+		return ExpireStatus::DELETED;
+	}
+	changeExpiry(shard, slot, expireAt);
+	if (log) log(ExpireStatus::SET);
+	return ExpireStatus::SET;
+}
+
+bool KeyValueStore::persist(std::string_view key, const ChangeLog& log)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot == HashTable::NOT_FOUND) {
+		return false;
+	}
+	Entry* e = shard.table.at(slot);
+	if (isExpired(e, CachedClock::nowMs())) {
+		expireSlot(shard, slot);
+		return false;
+	}
+	if (!e->hasExpiry()) {
+		return false;
+	}
+	changeExpiry(shard, slot, std::nullopt);
+	if (log) log();
+	return true;
+}
+
+long long KeyValueStore::pttl(std::string_view key)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::shared_lock<std::shared_mutex> lock(shard.mtx);
+	Entry* e = shard.table.find(key, hash);
+	int64_t now = CachedClock::nowMs();
+	if (!e || isExpired(e, now)) {
+		return -2;
+	}
+	return e->hasExpiry() ? e->expireAt() - now : -1;
+}
+
+void KeyValueStore::snapshotShard(size_t shard, std::vector<std::pair<std::string, KVPair>>& out, const std::function<void()>& copied)
+{
+	out.clear();
+	Shard& s = shards[shard];
+	std::shared_lock<std::shared_mutex> lock(s.mtx);
+	out.reserve(s.table.size());
+	int64_t now = CachedClock::nowMs();
+	s.table.forEach([&out, now](const Entry* e) {
+		if (isExpired(e, now)) return;
+		KVPair kvp;
+		kvp.type = e->type();
+		switch (kvp.type) {
+			case ValueType::HASH:
+				kvp.elements.reserve(e->object<HashValue>()->size() * 2);
+				e->object<HashValue>()->forEach([&kvp](std::string_view field, std::string_view value) {
+					kvp.elements.emplace_back(field);
+					kvp.elements.emplace_back(value);
+				});
+				break;
+			case ValueType::LIST:
+				kvp.elements.reserve(e->object<ListValue>()->size());
+				e->object<ListValue>()->forEach([&kvp](std::string_view element) { kvp.elements.emplace_back(element); });
+				break;
+			case ValueType::SET:
+				kvp.elements.reserve(e->object<SetValue>()->size());
+				e->object<SetValue>()->forEach([&kvp](std::string_view member) { kvp.elements.emplace_back(member); });
+				break;
+			case ValueType::ZSET:
+				kvp.elements.reserve(e->object<ZSetValue>()->size() * 2);
+				e->object<ZSetValue>()->forEach([&kvp](std::string_view member, double score) {
+					kvp.elements.emplace_back(member);
+					kvp.elements.push_back(ZSetValue::formatScore(score));
+				});
+				break;
+			default:
+				if (e->isInteger()) {
+					kvp.setInteger(e->integer());
+				}
+				else {
+					char unused[KVPair::INT_BUFFER_SIZE];
+					kvp.value = e->valueView(unused);
+				}
+				break;
+		}
+		if (e->hasExpiry()) {
+			kvp.expireAt = e->expireAt();
+		}
+		out.emplace_back(std::string(e->key()), std::move(kvp));
+	});
+	if (copied) copied();
+}
+
+unsigned long long KeyValueStore::scan(unsigned long long cursor, size_t count, std::string_view pattern, std::vector<std::string>& keys)
+{
+	size_t shard = static_cast<size_t>(cursor & shardMask);
+	size_t tableCursor = static_cast<size_t>(cursor >> shardBits);
+	size_t maxBuckets = count * 10;
+	size_t buckets = 0;
+	size_t wanted = keys.size() + count;
+	bool matchAll = pattern == "*";
+
+	while (true) {
+		Shard& s = shards[shard];
+		{
+			std::shared_lock<std::shared_mutex> lock(s.mtx);
+			int64_t now = CachedClock::nowMs();
+			auto emit = [&](const Entry* e) {
+				if (isExpired(e, now)) return;
+				if (matchAll || globMatch(pattern, e->key())) keys.emplace_back(e->key());
+			};
+			do {
+				tableCursor = s.table.scan(tableCursor, emit);
+				++buckets;
+			} while (tableCursor != 0 && keys.size() < wanted && buckets < maxBuckets);
+		}
+		if (tableCursor == 0) {
+			if (++shard > shardMask) {
+				return 0;
+			}
+		}
+		if (keys.size() >= wanted || buckets >= maxBuckets) {
+			return (static_cast<unsigned long long>(tableCursor) << shardBits) | shard;
+		}
+	}
+}
+
+void KeyValueStore::keys(std::string_view pattern, std::vector<std::string>& out)
+{
+	if (globIsLiteral(pattern)) {
+		if (exists(pattern)) {
+			out.emplace_back(pattern);
+		}
+		return;
+	}
+	bool matchAll = pattern == "*";
+	for (size_t i = 0; i <= shardMask; ++i) {
+		std::shared_lock<std::shared_mutex> lock(shards[i].mtx);
+		int64_t now = CachedClock::nowMs();
+		shards[i].table.forEach([&](const Entry* e) {
+			if (isExpired(e, now)) return;
+			if (matchAll || globMatch(pattern, e->key())) out.emplace_back(e->key());
+		});
+	}
+}
+
+void KeyValueStore::reserve(size_t totalKeys)
+{
+	size_t perShard = totalKeys / (shardMask + 1) + 1;
+	for (size_t i = 0; i <= shardMask; ++i) {
+		Shard& shard = shards[i];
+		std::unique_lock<std::shared_mutex> lock(shard.mtx);
+		size_t before = shard.table.memoryUsage();
+		shard.table.reserve(shard.table.size() + perShard);
+		trackTable(shard, before);
+	}
+}
+
+void KeyValueStore::restore(std::string&& key, KVPair&& entry)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::optional<int64_t> expireAt = entry.expireAt;
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot != HashTable::NOT_FOUND) {
+		eraseSlot(shard, slot);
+	}
+	Entry* fresh = nullptr;
+	switch (entry.type) {
+		case ValueType::HASH: {
+			HashValue* value = new HashValue();
+			for (size_t i = 0; i + 1 < entry.elements.size(); i += 2) {
+				value->set(entry.elements[i], entry.elements[i + 1]);
+			}
+			fresh = allocateEntry(shard, key, sizeof(void*), Entry::typeFlags(entry.type), expireAt);
+			fresh->setObject(value);
+			break;
+		}
+		case ValueType::LIST: {
+			ListValue* value = new ListValue();
+			for (const std::string& element : entry.elements) {
+				value->pushBack(element);
+			}
+			fresh = allocateEntry(shard, key, sizeof(void*), Entry::typeFlags(entry.type), expireAt);
+			fresh->setObject(value);
+			break;
+		}
+		case ValueType::SET: {
+			SetValue* value = new SetValue();
+			for (const std::string& member : entry.elements) {
+				value->add(member);
+			}
+			fresh = allocateEntry(shard, key, sizeof(void*), Entry::typeFlags(entry.type), expireAt);
+			fresh->setObject(value);
+			break;
+		}
+		case ValueType::ZSET: {
+			ZSetValue* value = new ZSetValue();
+			for (size_t i = 0; i + 1 < entry.elements.size(); i += 2) {
+				const std::string& text = entry.elements[i + 1];
+				double score = 0;
+				std::from_chars(text.data(), text.data() + text.size(), score);
+				value->add(score, entry.elements[i]);
+			}
+			fresh = allocateEntry(shard, key, sizeof(void*), Entry::typeFlags(entry.type), expireAt);
+			fresh->setObject(value);
+			break;
+		}
+		default:
+			fresh = entry.encoding == KVPair::Encoding::INT
+				? createIntegerEntry(shard, key, entry.intValue, expireAt)
+				: createEntry(shard, key, entry.value, expireAt);
+			break;
+	}
+	placeEntry(shard, HashTable::NOT_FOUND, hash, fresh);
+}
+
+void KeyValueStore::clear()
+{
+	std::vector<std::string> keys;
+	for (size_t i = 0; i <= shardMask; ++i) {
+		Shard& shard = shards[i];
+		std::unique_lock<std::shared_mutex> lock(shard.mtx);
+		keys.clear();
+		shard.table.forEach([&keys](Entry* e) { keys.emplace_back(e->key()); });
+		for (const std::string& key : keys) {
+			size_t slot = shard.table.findSlot(key, HashTable::hashKey(key));
+			if (slot != HashTable::NOT_FOUND) {
+				eraseSlot(shard, slot);
+			}
+		}
+	}
+}
+
+template <typename T, typename F>
+bool KeyValueStore::updateCollection(std::string_view key, ValueType type, bool create, F&& f)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::unique_lock<std::shared_mutex> lock(shard.mtx);
+	size_t slot = shard.table.findSlot(key, hash);
+	if (slot != HashTable::NOT_FOUND && isExpired(shard.table.at(slot), CachedClock::nowMs())) {
+		expireSlot(shard, slot);
+		slot = HashTable::NOT_FOUND;
+	}
+
+	Entry* entry = slot != HashTable::NOT_FOUND ? shard.table.at(slot) : nullptr;
+	if (entry && entry->type() != type) {
+		return false;
+	}
+	if (!entry) {
+		if (!create) {
+			return true;
+		}
+		entry = allocateEntry(shard, key, sizeof(void*), Entry::typeFlags(type), std::nullopt);
+		entry->setObject(new T());
+		placeEntry(shard, HashTable::NOT_FOUND, hash, entry);
+	}
+	else {
+		touch(entry);
+	}
+
+	T* object = entry->object<T>();
+	size_t before = object->memoryUsage();
+	f(*object);
+	usedMemory.fetch_add(static_cast<long long>(object->memoryUsage()) - static_cast<long long>(before), std::memory_order_relaxed);
+	if (object->size() == 0) {
+		eraseSlot(shard, shard.table.findSlot(key, hash));
+	}
+	return true;
+}
+
+template <typename T, typename F>
+bool KeyValueStore::readCollection(std::string_view key, ValueType type, F&& f)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::shared_lock<std::shared_mutex> lock(shard.mtx);
+	Entry* entry = shard.table.find(key, hash);
+	if (!entry || isExpired(entry, CachedClock::nowMs())) {
+		return true;
+	}
+	if (entry->type() != type) {
+		return false;
+	}
+	touch(entry);
+	f(static_cast<const T&>(*entry->object<T>()));
+	return true;
+}
+
+bool KeyValueStore::hset(std::string_view key, const std::string_view* fieldValues, size_t pairs, size_t& added, const ChangeLog& log)
+{
+	added = 0;
+	return updateCollection<HashValue>(key, ValueType::HASH, true, [&](HashValue& hash) {
+		for (size_t i = 0; i < pairs; ++i) {
+			if (hash.set(fieldValues[i * 2], fieldValues[i * 2 + 1])) ++added;
+		}
+		if (log) log();
+	});
+}
+
+bool KeyValueStore::hget(std::string_view key, std::string_view field, std::optional<std::string>& value)
+{
+	value.reset();
+	return readCollection<HashValue>(key, ValueType::HASH, [&](const HashValue& hash) {
+		std::string found;
+		if (hash.get(field, found)) value = std::move(found);
+	});
+}
+
+bool KeyValueStore::hdel(std::string_view key, const std::string_view* fields, size_t count, size_t& removed, const ChangeLog& log)
+{
+	removed = 0;
+	return updateCollection<HashValue>(key, ValueType::HASH, false, [&](HashValue& hash) {
+		for (size_t i = 0; i < count; ++i) {
+			if (hash.erase(fields[i])) ++removed;
+		}
+		if (removed > 0 && log) log();
+	});
+}
+
+bool KeyValueStore::hgetall(std::string_view key, std::vector<std::string>& fieldValues)
+{
+	return readCollection<HashValue>(key, ValueType::HASH, [&](const HashValue& hash) {
+		fieldValues.reserve(fieldValues.size() + hash.size() * 2);
+		hash.forEach([&](std::string_view field, std::string_view value) {
+			fieldValues.emplace_back(field);
+			fieldValues.emplace_back(value);
+		});
+	});
+}
+
+bool KeyValueStore::hlen(std::string_view key, size_t& length)
+{
+	length = 0;
+	return readCollection<HashValue>(key, ValueType::HASH, [&](const HashValue& hash) { length = hash.size(); });
+}
+
+bool KeyValueStore::push(std::string_view key, const std::string_view* values, size_t count, bool front, size_t& length, const ChangeLog& log)
+{
+	length = 0;
+	return updateCollection<ListValue>(key, ValueType::LIST, true, [&](ListValue& list) {
+		for (size_t i = 0; i < count; ++i) {
+			if (front) list.pushFront(values[i]);
+			else list.pushBack(values[i]);
+		}
+		length = list.size();
+		if (log) log();
+	});
+}
+
+bool KeyValueStore::pop(std::string_view key, bool front, std::optional<std::string>& value, const ChangeLog& log)
+{
+	value.reset();
+	return updateCollection<ListValue>(key, ValueType::LIST, false, [&](ListValue& list) {
+		std::string element;
+		if (front ? list.popFront(element) : list.popBack(element)) {
+			value = std::move(element);
+			if (log) log();
+		}
+	});
+}
+
+bool KeyValueStore::lrange(std::string_view key, long long start, long long stop, std::vector<std::string>& out)
+{
+	return readCollection<ListValue>(key, ValueType::LIST, [&](const ListValue& list) { list.range(start, stop, out); });
+}
+
+bool KeyValueStore::llen(std::string_view key, size_t& length)
+{
+	length = 0;
+	return readCollection<ListValue>(key, ValueType::LIST, [&](const ListValue& list) { length = list.size(); });
+}
+
+bool KeyValueStore::sadd(std::string_view key, const std::string_view* members, size_t count, size_t& added, const ChangeLog& log)
+{
+	added = 0;
+	return updateCollection<SetValue>(key, ValueType::SET, true, [&](SetValue& set) {
+		for (size_t i = 0; i < count; ++i) {
+			if (set.add(members[i])) ++added;
+		}
+		if (added > 0 && log) log();
+	});
+}
+
+bool KeyValueStore::srem(std::string_view key, const std::string_view* members, size_t count, size_t& removed, const ChangeLog& log)
+{
+	removed = 0;
+	return updateCollection<SetValue>(key, ValueType::SET, false, [&](SetValue& set) {
+		for (size_t i = 0; i < count; ++i) {
+			if (set.remove(members[i])) ++removed;
+		}
+		if (removed > 0 && log) log();
+	});
+}
+
+bool KeyValueStore::sismember(std::string_view key, std::string_view member, bool& found)
+{
+	found = false;
+	return readCollection<SetValue>(key, ValueType::SET, [&](const SetValue& set) { found = set.contains(member); });
+}
+
+bool KeyValueStore::smembers(std::string_view key, std::vector<std::string>& members)
+{
+	return readCollection<SetValue>(key, ValueType::SET, [&](const SetValue& set) {
+		members.reserve(members.size() + set.size());
+		set.forEach([&](std::string_view member) { members.emplace_back(member); });
+	});
+}
+
+bool KeyValueStore::scard(std::string_view key, size_t& count)
+{
+	count = 0;
+	return readCollection<SetValue>(key, ValueType::SET, [&](const SetValue& set) { count = set.size(); });
+}
+
+bool KeyValueStore::zadd(std::string_view key, const ScoredMember* items, size_t count, bool nx, bool xx,
+	size_t& added, size_t& updated, const ChangeLog& log)
+{
+	added = 0;
+	updated = 0;
+	return updateCollection<ZSetValue>(key, ValueType::ZSET, !xx, [&](ZSetValue& zset) {
+		for (size_t i = 0; i < count; ++i) {
+			ZSetValue::AddResult result = zset.add(items[i].first, items[i].second, nx, xx);
+			if (result == ZSetValue::AddResult::ADDED) ++added;
+			else if (result == ZSetValue::AddResult::UPDATED) ++updated;
+		}
+		if (added + updated > 0 && log) log();
+	});
+}
+
+bool KeyValueStore::zrem(std::string_view key, const std::string_view* members, size_t count, size_t& removed, const ChangeLog& log)
+{
+	removed = 0;
+	return updateCollection<ZSetValue>(key, ValueType::ZSET, false, [&](ZSetValue& zset) {
+		for (size_t i = 0; i < count; ++i) {
+			if (zset.remove(members[i])) ++removed;
+		}
+		if (removed > 0 && log) log();
+	});
+}
+
+bool KeyValueStore::zscore(std::string_view key, std::string_view member, std::optional<double>& score)
+{
+	score.reset();
+	return readCollection<ZSetValue>(key, ValueType::ZSET, [&](const ZSetValue& zset) {
+		double found;
+		if (zset.score(member, found)) score = found;
+	});
+}
+
+bool KeyValueStore::zrank(std::string_view key, std::string_view member, std::optional<size_t>& rank)
+{
+	rank.reset();
+	return readCollection<ZSetValue>(key, ValueType::ZSET, [&](const ZSetValue& zset) {
+		size_t found;
+		if (zset.rank(member, found)) rank = found;
+	});
+}
+
+bool KeyValueStore::zcard(std::string_view key, size_t& count)
+{
+	count = 0;
+	return readCollection<ZSetValue>(key, ValueType::ZSET, [&](const ZSetValue& zset) { count = zset.size(); });
+}
+
+bool KeyValueStore::zrange(std::string_view key, long long start, long long stop, std::vector<std::pair<std::string, double>>& out)
+{
+	return readCollection<ZSetValue>(key, ValueType::ZSET, [&](const ZSetValue& zset) { zset.range(start, stop, out); });
+}
+
+bool KeyValueStore::zrangeByScore(std::string_view key, const ScoreRange& range, long long offset, long long limit,
+	std::vector<std::pair<std::string, double>>& out)
+{
+	return readCollection<ZSetValue>(key, ValueType::ZSET, [&](const ZSetValue& zset) { zset.rangeByScore(range, offset, limit, out); });
+}
+
+bool KeyValueStore::zremrangeByScore(std::string_view key, const ScoreRange& range, size_t& removed, const ChangeLog& log)
+{
+	removed = 0;
+	return updateCollection<ZSetValue>(key, ValueType::ZSET, false, [&](ZSetValue& zset) {
+		removed = zset.removeRangeByScore(range);
+		if (removed > 0 && log) log();
+	});
+}
+
+std::optional<ValueType> KeyValueStore::type(std::string_view key)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::shared_lock<std::shared_mutex> lock(shard.mtx);
+	Entry* entry = shard.table.find(key, hash);
+	if (!entry || isExpired(entry, CachedClock::nowMs())) {
+		return std::nullopt;
+	}
+	return entry->type();
+}
+
+const char* KeyValueStore::encoding(std::string_view key)
+{
+	size_t hash = HashTable::hashKey(key);
+	Shard& shard = shardFor(hash);
+	std::shared_lock<std::shared_mutex> lock(shard.mtx);
+	Entry* entry = shard.table.find(key, hash);
+	if (!entry || isExpired(entry, CachedClock::nowMs())) {
+		return nullptr;
+	}
+	switch (entry->type()) {
+		case ValueType::HASH: return entry->object<HashValue>()->encodingName();
+		case ValueType::LIST: return entry->object<ListValue>()->encodingName();
+		case ValueType::SET: return entry->object<SetValue>()->encodingName();
+		case ValueType::ZSET: return entry->object<ZSetValue>()->encodingName();
+		default: return entry->isInteger() ? "int" : "embstr";
+	}
+}
+
+size_t KeyValueStore::activeExpireCycle(std::chrono::microseconds budget)
+{
+	auto deadline = std::chrono::steady_clock::now() + budget;
+	size_t removed = 0;
+	expireCycles.fetch_add(1, std::memory_order_relaxed);
+
+	for (size_t visited = 0; visited <= shardMask; ++visited) {
+		Shard& shard = shards[expireCursor];
+		while (true) {
+			int64_t now = CachedClock::nowMs();
+			{
+				// Peek under the read lock so idle shards never block readers.
+				std::shared_lock<std::shared_mutex> lock(shard.mtx);
+				if (shard.expiry.empty() || shard.expiry.front()->expireAt() > now) {
+					break;
+				}
+			}
+
+			// Expire a small batch per lock hold to keep writers' waits short.
+			int batch = 0;
+			{
+				std::unique_lock<std::shared_mutex> lock(shard.mtx);
+				while (batch < ACTIVE_EXPIRE_KEYS_PER_LOCK && !shard.expiry.empty() && shard.expiry.front()->expireAt() <= now) {
+					std::string_view key = shard.expiry.front()->key();
+					expireSlot(shard, shard.table.findSlot(key, HashTable::hashKey(key)));
+					++batch;
+				}
+			}
+			removed += batch;
+
+			if (std::chrono::steady_clock::now() >= deadline) {
+				// Resume with this shard on the next tick.
+				expireTimeCapReached.fetch_add(1, std::memory_order_relaxed);
+				activeExpiredKeys.fetch_add(removed, std::memory_order_relaxed);
+				return removed;
+			}
+		}
+		expireCursor = (expireCursor + 1) & shardMask;
+	}
+
+	activeExpiredKeys.fetch_add(removed, std::memory_order_relaxed);
+	return removed;
+}
+
+bool KeyValueStore::activeRehashCycle(std::chrono::microseconds budget)
+{
+	// Slots migrated per lock hold: about the same work as a few hundred GETs.
+	static const size_t SLOTS_PER_LOCK = HashTable::REHASH_STEP_SLOTS * 64;
+
+	auto deadline = std::chrono::steady_clock::now() + budget;
+	for (size_t i = 0; i <= shardMask; ++i) {
+		Shard& shard = shards[i];
+		{
+			// Peek under the read lock so shards that are not resizing never block readers.
+			std::shared_lock<std::shared_mutex> lock(shard.mtx);
+			if (!shard.table.isRehashing()) continue;
+		}
+		bool rehashing = true;
+		while (rehashing) {
+			{
+				std::unique_lock<std::shared_mutex> lock(shard.mtx);
+				size_t before = shard.table.memoryUsage();
+				rehashing = shard.table.rehashStep(SLOTS_PER_LOCK);
+				trackTable(shard, before);
+			}
+			if (rehashing && std::chrono::steady_clock::now() >= deadline) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+size_t KeyValueStore::rehashingShards()
+{
+	size_t rehashing = 0;
+	for (size_t i = 0; i <= shardMask; ++i) {
+		std::shared_lock<std::shared_mutex> lock(shards[i].mtx);
+		if (shards[i].table.isRehashing()) ++rehashing;
+	}
+	return rehashing;
+}
+
+void KeyValueStore::startActiveExpiry(int hz)
+{
+	stopActiveExpiry();
+	if (hz <= 0) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(expiryMtx);
+		expiryStopping = false;
+	}
+	expiryThread = std::thread(&KeyValueStore::expiryMain, this, hz);
+}
+
+void KeyValueStore::stopActiveExpiry()
+{
 	{
-		store.erase(it);
+		std::lock_guard<std::mutex> lock(expiryMtx);
+		expiryStopping = true;
+	}
+	expiryCv.notify_all();
+	if (expiryThread.joinable()) {
+		expiryThread.join();
+	}
+}
+
+void KeyValueStore::expiryMain(int hz)
+{
+	auto tick = std::chrono::microseconds(1000000 / hz);
+	auto budget = tick / 4;
+
+	std::unique_lock<std::mutex> lock(expiryMtx);
+	while (!expiryStopping) {
+		expiryCv.wait_for(lock, tick, [this] { return expiryStopping; });
+		if (expiryStopping) {
+			break;
+		}
+		lock.unlock();
+		CachedClock::update();
+		LatencyMonitor::Clock::time_point cycleStart = LatencyMonitor::startMonitor();
+		activeExpireCycle(budget);
+		LatencyMonitor::addSampleIfNeeded("expire-cycle", cycleStart);
+		if (activeRehashing.load(std::memory_order_relaxed)) {
+			activeRehashCycle(std::chrono::milliseconds(1));
+		}
+		lock.lock();
+	}
+}
+
+KeyValueStore::ExpiryStats KeyValueStore::expiryStats()
+{
+	ExpiryStats stats;
+	stats.expiredKeys = expiredKeys.load(std::memory_order_relaxed);
+	stats.activeExpiredKeys = activeExpiredKeys.load(std::memory_order_relaxed);
+	stats.expireCycles = expireCycles.load(std::memory_order_relaxed);
+	stats.timeCapReached = expireTimeCapReached.load(std::memory_order_relaxed);
+	for (size_t i = 0; i <= shardMask; ++i) {
+		std::shared_lock<std::shared_mutex> lock(shards[i].mtx);
+		stats.keysWithExpiry += shards[i].expiry.size();
+	}
+	return stats;
+}
+
+void KeyValueStore::setMaxMemory(size_t maxBytes, EvictionPolicy policy, int samples)
+{
+	std::lock_guard<std::mutex> lock(evictionMtx);
+	maxMemory = maxBytes;
+	evictionPolicy = policy;
+	evictionSamples = samples > 0 ? samples : 1;
+	evictionPool.clear();
+}
+
+// Higher scores are better eviction candidates.
+unsigned long long KeyValueStore::evictionScore(const Entry* entry, uint32_t now) const
+{
+	if (evictionPolicy == EvictionPolicy::ALLKEYS_LFU) {
+		uint8_t counter = decayedCounter(std::atomic_ref<uint8_t>(const_cast<Entry*>(entry)->lfuCounter).load(std::memory_order_relaxed),
+			std::atomic_ref<uint16_t>(const_cast<Entry*>(entry)->lfuDecayMinute).load(std::memory_order_relaxed),
+			static_cast<uint16_t>(now / 60000));
+		return 255 - counter;
+	}
+	if (evictionPolicy == EvictionPolicy::VOLATILE_TTL) {
+		return std::numeric_limits<unsigned long long>::max() - static_cast<unsigned long long>(std::max<int64_t>(entry->expireAt(), 0));
+	}
+	// Idle time; unsigned subtraction copes with the 32-bit clock wrapping.
+	uint32_t accessTime = std::atomic_ref<uint32_t>(const_cast<Entry*>(entry)->accessTime).load(std::memory_order_relaxed);
+	return static_cast<uint32_t>(now - accessTime);
+}
+
+// Samples keys from one shard into the eviction pool. Called with evictionMtx held.
+void KeyValueStore::sampleShard(Shard& shard, uint32_t now)
+{
+	auto offer = [this](unsigned long long score, std::string_view key) {
+		auto existing = std::find_if(evictionPool.begin(), evictionPool.end(),
+			[&key](const EvictionCandidate& c) { return c.key == key; });
+		if (existing != evictionPool.end()) {
+			evictionPool.erase(existing);
+		}
+		if (evictionPool.size() >= EVICTION_POOL_SIZE && score <= evictionPool.front().score) {
+			return;
+		}
+		auto pos = std::upper_bound(evictionPool.begin(), evictionPool.end(), score,
+			[](unsigned long long s, const EvictionCandidate& c) { return s < c.score; });
+		evictionPool.insert(pos, EvictionCandidate{ score, std::string(key) });
+		if (evictionPool.size() > EVICTION_POOL_SIZE) {
+			evictionPool.erase(evictionPool.begin());
+		}
+	};
+
+	std::shared_lock<std::shared_mutex> lock(shard.mtx);
+	bool volatileOnly = evictionPolicy == EvictionPolicy::VOLATILE_LRU || evictionPolicy == EvictionPolicy::VOLATILE_TTL;
+	if (shard.table.size() == 0 || (volatileOnly && shard.expiry.empty())) {
+		return;
+	}
+
+	int taken = 0;
+	if (evictionPolicy != EvictionPolicy::VOLATILE_TTL) {
+		// Start at a random slot and take the next occupied ones; the table is
+		// at least 1/8 full, so the walk stays short.
+		size_t capacity = shard.table.capacity();
+		size_t slot = evictionRng() % capacity;
+		for (size_t probe = 0; probe < capacity && taken < evictionSamples; ++probe, slot = (slot + 1) % capacity) {
+			Entry* e = shard.table.at(slot);
+			if (!e || (volatileOnly && !e->hasExpiry())) continue;
+			offer(evictionScore(e, now), e->key());
+			++taken;
+		}
+	}
+	if (taken == 0 && volatileOnly) {
+		// The top of the expiry heap holds the keys that expire soonest; for
+		// volatile-ttl these are better candidates than a random sample.
+		for (size_t i = 0; i < shard.expiry.size() && taken < evictionSamples; ++i, ++taken) {
+			offer(evictionScore(shard.expiry[i], now), shard.expiry[i]->key());
+		}
+	}
+}
+
+// Called with evictionMtx held.
+bool KeyValueStore::evictOne(const std::function<void(std::string_view key)>& log)
+{
+	uint32_t now = clockNow();
+	for (size_t attempt = 0; attempt <= shardMask; ++attempt) {
+		sampleShard(shards[evictionCursor], now);
+		evictionCursor = (evictionCursor + 1) & shardMask;
+
+		// Candidates may have been deleted since they were sampled.
+		while (!evictionPool.empty()) {
+			EvictionCandidate candidate = std::move(evictionPool.back());
+			evictionPool.pop_back();
+
+			size_t hash = HashTable::hashKey(candidate.key);
+			Shard& shard = shardFor(hash);
+			std::unique_lock<std::shared_mutex> lock(shard.mtx);
+			size_t slot = shard.table.findSlot(candidate.key, hash);
+			if (slot == HashTable::NOT_FOUND) continue;
+			if (evictionPolicy != EvictionPolicy::ALLKEYS_LRU && evictionPolicy != EvictionPolicy::ALLKEYS_LFU
+				&& !shard.table.at(slot)->hasExpiry()) {
+				continue;
+			}
+			eraseSlot(shard, slot);
+			evictedKeys.fetch_add(1, std::memory_order_relaxed);
+			if (log) log(candidate.key);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool KeyValueStore::evictIfNeeded(const std::function<void(std::string_view key)>& log)
+{
+	if (maxMemory == 0 || usedMemory.load(std::memory_order_relaxed) <= static_cast<long long>(maxMemory)) {
+		return true;
+	}
+	if (evictionPolicy == EvictionPolicy::NOEVICTION) {
 		return false;
 	}
+
+	std::lock_guard<std::mutex> lock(evictionMtx);
+	while (usedMemory.load(std::memory_order_relaxed) > static_cast<long long>(maxMemory)) {
+		if (!evictOne(log)) {
+			return false;
+		}
+	}
 	return true;
+}
+
+KeyValueStore::MemoryStats KeyValueStore::memoryStats() const
+{
+	MemoryStats stats;
+	stats.usedMemory = usedMemory.load(std::memory_order_relaxed);
+	stats.maxMemory = maxMemory;
+	stats.policy = evictionPolicy;
+	stats.evictedKeys = evictedKeys.load(std::memory_order_relaxed);
+	return stats;
+}
+
+const char* KeyValueStore::policyName(EvictionPolicy policy)
+{
+	switch (policy) {
+		case EvictionPolicy::ALLKEYS_LRU: return "allkeys-lru";
+		case EvictionPolicy::ALLKEYS_LFU: return "allkeys-lfu";
+		case EvictionPolicy::VOLATILE_LRU: return "volatile-lru";
+		case EvictionPolicy::VOLATILE_TTL: return "volatile-ttl";
+		default: return "noeviction";
+	}
 }
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "../headers/LZF.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Encoding: a control byte below 32 starts a run of ctrl + 1 literal bytes.
+// Otherwise it is a back reference: the top 3 bits hold length - 2 (7 means
+// "add the next byte"), the low 5 bits and the following byte hold offset - 1.
+static const unsigned HASH_BITS = 14;
+static const size_t MAX_OFFSET = 1 << 13;
+static const size_t MAX_LITERAL = 1 << 5;
+static const size_t MAX_MATCH = (1 << 8) + (1 << 3); // 264
+
+static inline unsigned hash3(const uint8_t* p) {
+	uint32_t v = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t lzfCompress(const void* inData, size_t inLen, void* outData, size_t outLen) {
+	const uint8_t* in = static_cast<const uint8_t*>(inData);
+	uint8_t* out = static_cast<uint8_t*>(outData);
+	if (inLen == 0 || outLen == 0) return 0;
+
+	// Positions are stored + 1 so that 0 means "empty".
+	std::vector<size_t> table(size_t(1) << HASH_BITS, 0);
+
+	size_t ip = 0;
+	size_t op = 1;      // out[0] is the control byte of the first literal run
+	size_t litCtrl = 0;
+	size_t lit = 0;
+
+	while (ip + 2 < inLen) {
+		unsigned h = hash3(in + ip);
+		size_t ref = table[h];
+		table[h] = ip + 1;
+
+		if (ref != 0) {
+			ref -= 1;
+			size_t off = ip - ref - 1;
+			if (off < MAX_OFFSET && std::memcmp(in + ref, in + ip, 3) == 0) {
+				size_t maxLen = inLen - ip < MAX_MATCH ? inLen - ip : MAX_MATCH;
+				size_t len = 3;
+				while (len < maxLen && in[ref + len] == in[ip + len]) ++len;
+
+				// Close the pending literal run (or drop its unused control byte).
+				if (lit > 0) {
+					out[litCtrl] = static_cast<uint8_t>(lit - 1);
+				}
+				else {
+					--op;
+				}
+				if (op + 4 > outLen) return 0;
+
+				size_t code = len - 2;
+				if (code < 7) {
+					out[op++] = static_cast<uint8_t>((off >> 8) + (code << 5));
+				}
+				else {
+					out[op++] = static_cast<uint8_t>((off >> 8) + (7 << 5));
+					out[op++] = static_cast<uint8_t>(code - 7);
+				}
+				out[op++] = static_cast<uint8_t>(off & 0xFF);
+
+				litCtrl = op++;
+				lit = 0;
+				ip += len;
+				if (ip + 2 < inLen) {
+					table[hash3(in + ip - 1)] = ip; // position ip - 1, stored + 1
+				}
+				continue;
+			}
+		}
+
+		if (op >= outLen) return 0;
+		out[op++] = in[ip++];
+		if (++lit == MAX_LITERAL) {
+			out[litCtrl] = static_cast<uint8_t>(lit - 1);
+			litCtrl = op++;
+			lit = 0;
+		}
+	}
+
+	while (ip < inLen) {
+		if (op >= outLen) return 0;
+		out[op++] = in[ip++];
+		if (++lit == MAX_LITERAL) {
+			out[litCtrl] = static_cast<uint8_t>(lit - 1);
+			litCtrl = op++;
+			lit = 0;
+		}
+	}
+
+	if (lit > 0) {
+		out[litCtrl] = static_cast<uint8_t>(lit - 1);
+	}
+	else {
+		--op;
+	}
+	return op;
+}
+
+size_t lzfDecompress(const void* inData, size_t inLen, void* outData, size_t outLen) {
+	const uint8_t* in = static_cast<const uint8_t*>(inData);
+	uint8_t* out = static_cast<uint8_t*>(outData);
+	size_t ip = 0;
+	size_t op = 0;
+
+	while (ip < inLen) {
+		size_t ctrl = in[ip++];
+
+		if (ctrl < MAX_LITERAL) {
+			size_t len = ctrl + 1;
+			if (ip + len > inLen || op + len > outLen) return 0;
+			std::memcpy(out + op, in + ip, len);
+			ip += len;
+			op += len;
+			continue;
+		}
+
+		size_t len = ctrl >> 5;
+		if (len == 7) {
+			if (ip >= inLen) return 0;
+			len += in[ip++];
+		}
+		if (ip >= inLen) return 0;
+		size_t back = ((ctrl & 0x1F) << 8) + in[ip++] + 1;
+		len += 2;
+		if (back > op || op + len > outLen) return 0;
+
+		// Byte by byte: source and destination may overlap.
+		const uint8_t* ref = out + op - back;
+		for (size_t i = 0; i < len; ++i) {
+			out[op + i] = ref[i];
+		}
+		op += len;
+	}
+	return op;
+}
\ No newline at end of file
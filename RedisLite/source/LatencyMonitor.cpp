@@ -0,0 +1,112 @@
+#include "../headers/LatencyMonitor.h"
+#include <array>
+#include <map>
+#include <mutex>
+
+namespace {
+
+struct Series {
+	std::array<LatencyMonitor::Sample, LatencyMonitor::HISTORY_LEN> samples{};
+	size_t next = 0;
+	size_t size = 0;
+	uint32_t maxMs = 0;
+};
+
+struct Registry {
+	std::mutex mtx;
+	std::map<std::string, Series, std::less<>> events;
+};
+
+Registry& registry()
+{
+	static Registry instance;
+	return instance;
+}
+
+long long unixSeconds()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void LatencyMonitor::addSampleIfNeeded(const char* event, Clock::time_point started)
+{
+	if (started == Clock::time_point()) return;
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count();
+	addSampleIfNeeded(event, static_cast<uint64_t>(ms));
+}
+
+void LatencyMonitor::addSampleIfNeeded(const char* event, uint64_t latencyMs)
+{
+	long long limit = threshold();
+	if (limit <= 0 || latencyMs < static_cast<uint64_t>(limit)) return;
+
+	uint32_t ms = latencyMs > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(latencyMs);
+	long long now = unixSeconds();
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	auto it = r.events.find(std::string_view(event));
+	if (it == r.events.end()) {
+		it = r.events.emplace(event, Series()).first;
+	}
+	Series& series = it->second;
+	if (ms > series.maxMs) series.maxMs = ms;
+
+	// Spikes within the same second share one sample holding the worst of them.
+	size_t last = (series.next + HISTORY_LEN - 1) % HISTORY_LEN;
+	if (series.size > 0 && series.samples[last].time == now) {
+		if (ms > series.samples[last].latencyMs) series.samples[last].latencyMs = ms;
+		return;
+	}
+	series.samples[series.next] = Sample{ now, ms };
+	series.next = (series.next + 1) % HISTORY_LEN;
+	if (series.size < HISTORY_LEN) ++series.size;
+}
+
+std::vector<LatencyMonitor::EventSummary> LatencyMonitor::latest()
+{
+	std::vector<EventSummary> out;
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	for (const auto& [name, series] : r.events) {
+		const Sample& last = series.samples[(series.next + HISTORY_LEN - 1) % HISTORY_LEN];
+		out.push_back(EventSummary{ name, last.time, last.latencyMs, series.maxMs });
+	}
+	return out;
+}
+
+std::vector<LatencyMonitor::Sample> LatencyMonitor::history(std::string_view event)
+{
+	std::vector<Sample> out;
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	auto it = r.events.find(event);
+	if (it == r.events.end()) return out;
+	const Series& series = it->second;
+	size_t first = (series.next + HISTORY_LEN - series.size) % HISTORY_LEN;
+	for (size_t i = 0; i < series.size; ++i) {
+		out.push_back(series.samples[(first + i) % HISTORY_LEN]);
+	}
+	return out;
+}
+
+size_t LatencyMonitor::reset(const std::string_view* events, size_t count)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	if (count == 0) {
+		size_t removed = r.events.size();
+		r.events.clear();
+		return removed;
+	}
+	size_t removed = 0;
+	for (size_t i = 0; i < count; ++i) {
+		auto it = r.events.find(events[i]);
+		if (it != r.events.end()) {
+			r.events.erase(it);
+			++removed;
+		}
+	}
+	return removed;
+}
@@ -0,0 +1,101 @@
+#include "../headers/Listpack.h"
+
+size_t Listpack::headerSize(size_t length)
+{
+	size_t n = 1;
+	while (length >= 0x80) {
+		length >>= 7;
+		++n;
+	}
+	return n;
+}
+
+void Listpack::putHeader(char* out, size_t length)
+{
+	while (length >= 0x80) {
+		*out++ = static_cast<char>((length & 0x7F) | 0x80);
+		length >>= 7;
+	}
+	*out = static_cast<char>(length);
+}
+
+std::string_view Listpack::get(size_t pos, size_t& next) const
+{
+	size_t length = 0;
+	int shift = 0;
+	unsigned char b;
+	do {
+		b = static_cast<unsigned char>(buf[pos++]);
+		length |= static_cast<size_t>(b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	next = pos + length;
+	return std::string_view(buf.data() + pos, length);
+}
+
+size_t Listpack::last() const
+{
+	if (count == 0) {
+		return npos;
+	}
+	size_t pos = 0;
+	for (uint32_t i = 1; i < count; ++i) {
+		pos = next(pos);
+	}
+	return pos;
+}
+
+size_t Listpack::find(std::string_view value, size_t stride) const
+{
+	size_t pos = 0;
+	while (pos < buf.size()) {
+		size_t after;
+		if (get(pos, after) == value) {
+			return pos;
+		}
+		pos = after;
+		for (size_t i = 1; i < stride && pos < buf.size(); ++i) {
+			pos = next(pos);
+		}
+	}
+	return npos;
+}
+
+void Listpack::pushBack(std::string_view value)
+{
+	size_t header = headerSize(value.size());
+	size_t at = buf.size();
+	buf.resize(at + header + value.size());
+	putHeader(&buf[at], value.size());
+	buf.replace(at + header, value.size(), value.data(), value.size());
+	++count;
+}
+
+void Listpack::insert(size_t pos, std::string_view value)
+{
+	size_t header = headerSize(value.size());
+	buf.insert(pos, header + value.size(), '\0');
+	putHeader(&buf[pos], value.size());
+	buf.replace(pos + header, value.size(), value.data(), value.size());
+	++count;
+}
+
+void Listpack::erase(size_t pos, size_t n)
+{
+	size_t stop = pos;
+	for (size_t i = 0; i < n; ++i) {
+		stop = next(stop);
+	}
+	buf.erase(pos, stop - pos);
+	count -= static_cast<uint32_t>(n);
+}
+
+void Listpack::replace(size_t pos, std::string_view value)
+{
+	size_t stop = next(pos);
+	size_t header = headerSize(value.size());
+	std::string encoded(header + value.size(), '\0');
+	putHeader(&encoded[0], value.size());
+	encoded.replace(header, value.size(), value.data(), value.size());
+	buf.replace(pos, stop - pos, encoded);
+}
@@ -0,0 +1,57 @@
+#include "../headers/Logger.h"
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level)
+{
+	if (name == "debug") level = LogLevel::DEBUG;
+	else if (name == "verbose") level = LogLevel::VERBOSE;
+	else if (name == "notice") level = LogLevel::NOTICE;
+	else if (name == "warning") level = LogLevel::WARNING;
+	else return false;
+	return true;
+}
+
+bool Logger::admit(RateLimit& limit, uint64_t& dropped)
+{
+	int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t window = limit.windowStart.load(std::memory_order_relaxed);
+	if (second != window && limit.windowStart.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+		limit.lines.store(0, std::memory_order_relaxed);
+	}
+	if (limit.lines.fetch_add(1, std::memory_order_relaxed) >= RateLimit::LINES_PER_SECOND) {
+		limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	dropped = limit.suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
+void Logger::write(LogLevel level, const std::string& message)
+{
+	static const char marks[] = { '.', '-', '*', '#' };
+	static std::mutex outputMtx;
+
+	auto now = std::chrono::system_clock::now();
+	std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+	int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+	std::tm local{};
+#ifdef _WIN32
+	localtime_s(&local, &seconds);
+#else
+	localtime_r(&seconds, &local);
+#endif
+	char stamp[48];
+	size_t n = std::strftime(stamp, sizeof(stamp), "%d %b %Y %H:%M:%S", &local);
+	std::snprintf(stamp + n, sizeof(stamp) - n, ".%03d %c ", millis, marks[static_cast<int>(level)]);
+
+	// One lock per line so lines from different threads never interleave.
+	std::lock_guard<std::mutex> lock(outputMtx);
+	std::ostream& out = level == LogLevel::WARNING ? std::cerr : std::cout;
+	out << stamp << message << '\n';
+	out.flush();
+}
@@ -0,0 +1,258 @@
+#include "../headers/Metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <mutex>
+
+size_t LatencyHistogram::bucketOf(uint64_t nanos)
+{
+	if (nanos < SUB_BUCKETS) {
+		return static_cast<size_t>(nanos);
+	}
+	int exponent = std::bit_width(nanos) - 1;
+	if (exponent > MAX_EXPONENT) {
+		return BUCKET_COUNT - 1;
+	}
+	uint64_t sub = (nanos >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+	return static_cast<size_t>((exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub);
+}
+
+uint64_t LatencyHistogram::bucketHigh(size_t bucket)
+{
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	int exponent = static_cast<int>(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+	uint64_t sub = bucket % SUB_BUCKETS;
+	uint64_t low = (SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS);
+	return low + (uint64_t(1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+void HistogramSnapshot::add(const LatencyHistogram& h)
+{
+	for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+		counts[i] += h.counts[i].load(std::memory_order_relaxed);
+	}
+	total += h.total.load(std::memory_order_relaxed);
+	sum += h.sum.load(std::memory_order_relaxed);
+}
+
+void HistogramSnapshot::add(const HistogramSnapshot& h)
+{
+	for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+		counts[i] += h.counts[i];
+	}
+	total += h.total;
+	sum += h.sum;
+}
+
+uint64_t HistogramSnapshot::percentile(double fraction) const
+{
+	if (total == 0) {
+		return 0;
+	}
+	uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < counts.size(); ++i) {
+		seen += counts[i];
+		if (seen >= target) {
+			return LatencyHistogram::bucketHigh(i);
+		}
+	}
+	return LatencyHistogram::bucketHigh(counts.size() - 1);
+}
+
+ThreadMetrics::~ThreadMetrics()
+{
+	for (CommandStats& c : commands) {
+		delete c.latency.load(std::memory_order_relaxed);
+	}
+}
+
+void ThreadMetrics::recordCommand(size_t id, uint64_t nanos)
+{
+	CommandStats& c = commands[id];
+	bump(c.calls);
+	bump(c.nanos, nanos);
+	LatencyHistogram* h = c.latency.load(std::memory_order_relaxed);
+	if (!h) {
+		h = new LatencyHistogram();
+		c.latency.store(h, std::memory_order_release);
+	}
+	h->record(nanos);
+}
+
+namespace {
+
+struct RateSample {
+	Metrics::Clock::time_point at;
+	std::array<uint64_t, CommandParser::COMMAND_COUNT> calls{};
+};
+
+struct Registry {
+	std::mutex mtx;
+	std::vector<ThreadMetrics*> live;
+	// Counters of threads that have exited.
+	ThreadMetrics retired;
+	std::atomic<long long> connectedClients{ 0 };
+	std::atomic<uint64_t> totalConnections{ 0 };
+
+	std::vector<RateSample> samples; // ring, guarded by mtx
+	size_t nextSample = 0;
+	std::array<double, CommandParser::COMMAND_COUNT> rates{};
+	double totalRate = 0;
+};
+
+Registry& registry()
+{
+	static Registry instance;
+	return instance;
+}
+
+void mergeHistogram(LatencyHistogram& into, const LatencyHistogram& from)
+{
+	for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+		bump(into.counts[i], from.counts[i].load(std::memory_order_relaxed));
+	}
+	bump(into.total, from.total.load(std::memory_order_relaxed));
+	bump(into.sum, from.sum.load(std::memory_order_relaxed));
+}
+
+// Called with the registry lock held.
+void retire(Registry& r, const ThreadMetrics& m)
+{
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		const ThreadMetrics::CommandStats& from = m.commands[i];
+		ThreadMetrics::CommandStats& into = r.retired.commands[i];
+		bump(into.calls, from.calls.load(std::memory_order_relaxed));
+		bump(into.nanos, from.nanos.load(std::memory_order_relaxed));
+		if (const LatencyHistogram* h = from.latency.load(std::memory_order_acquire)) {
+			if (!into.latency.load(std::memory_order_relaxed)) {
+				into.latency.store(new LatencyHistogram(), std::memory_order_release);
+			}
+			mergeHistogram(*into.latency.load(std::memory_order_relaxed), *h);
+		}
+	}
+	for (size_t s = 0; s < ThreadMetrics::STAGE_COUNT; ++s) {
+		mergeHistogram(r.retired.stages[s], m.stages[s]);
+	}
+	bump(r.retired.bytesIn, m.bytesIn.load(std::memory_order_relaxed));
+	bump(r.retired.bytesOut, m.bytesOut.load(std::memory_order_relaxed));
+}
+
+// Registers the thread's counters on first use and retires them at exit.
+struct LocalMetrics {
+	ThreadMetrics* metrics = new ThreadMetrics();
+
+	LocalMetrics() {
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mtx);
+		r.live.push_back(metrics);
+	}
+
+	~LocalMetrics() {
+		Registry& r = registry();
+		{
+			std::lock_guard<std::mutex> lock(r.mtx);
+			retire(r, *metrics);
+			r.live.erase(std::find(r.live.begin(), r.live.end(), metrics));
+		}
+		delete metrics;
+	}
+};
+
+// Called with the registry lock held.
+template <typename F>
+void forEachThread(Registry& r, F&& f)
+{
+	f(r.retired);
+	for (const ThreadMetrics* m : r.live) f(*m);
+}
+
+} // namespace
+
+ThreadMetrics& Metrics::local()
+{
+	thread_local LocalMetrics holder;
+	return *holder.metrics;
+}
+
+void Metrics::clientConnected()
+{
+	registry().connectedClients.fetch_add(1, std::memory_order_relaxed);
+	registry().totalConnections.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::clientDisconnected()
+{
+	registry().connectedClients.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Metrics::sampleRates()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	RateSample sample;
+	sample.at = Clock::now();
+	forEachThread(r, [&sample](const ThreadMetrics& m) {
+		for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+			sample.calls[i] += m.commands[i].calls.load(std::memory_order_relaxed);
+		}
+	});
+
+	if (r.samples.size() < RATE_SAMPLES) {
+		r.samples.push_back(sample);
+	}
+	else {
+		r.samples[r.nextSample] = sample;
+	}
+	r.nextSample = (r.nextSample + 1) % RATE_SAMPLES;
+
+	// The oldest sample in the ring is the one that will be overwritten next.
+	const RateSample& oldest = r.samples.size() < RATE_SAMPLES ? r.samples.front() : r.samples[r.nextSample];
+	double seconds = std::chrono::duration<double>(sample.at - oldest.at).count();
+	r.totalRate = 0;
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		r.rates[i] = seconds > 0 ? static_cast<double>(sample.calls[i] - oldest.calls[i]) / seconds : 0;
+		r.totalRate += r.rates[i];
+	}
+}
+
+Metrics::Snapshot Metrics::snapshot(bool withHistograms)
+{
+	Registry& r = registry();
+	Snapshot out;
+	std::lock_guard<std::mutex> lock(r.mtx);
+	forEachThread(r, [&](const ThreadMetrics& m) {
+		for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+			const ThreadMetrics::CommandStats& c = m.commands[i];
+			out.commands[i].calls += c.calls.load(std::memory_order_relaxed);
+			out.commands[i].nanos += c.nanos.load(std::memory_order_relaxed);
+			const LatencyHistogram* h = c.latency.load(std::memory_order_acquire);
+			if (withHistograms && h) out.commands[i].latency.add(*h);
+		}
+		if (withHistograms) {
+			for (size_t s = 0; s < ThreadMetrics::STAGE_COUNT; ++s) out.stages[s].add(m.stages[s]);
+		}
+		out.bytesIn += m.bytesIn.load(std::memory_order_relaxed);
+		out.bytesOut += m.bytesOut.load(std::memory_order_relaxed);
+	});
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		out.commands[i].opsPerSec = r.rates[i];
+		out.totalCommands += out.commands[i].calls;
+	}
+	out.opsPerSec = r.totalRate;
+	out.connectedClients = r.connectedClients.load(std::memory_order_relaxed);
+	out.totalConnections = r.totalConnections.load(std::memory_order_relaxed);
+	return out;
+}
+
+const char* Metrics::stageName(int stage)
+{
+	switch (stage) {
+		case ThreadMetrics::PARSE: return "parse";
+		case ThreadMetrics::EXECUTE: return "execute";
+		case ThreadMetrics::AOF: return "aof";
+		default: return "send";
+	}
+}
@@ -0,0 +1,125 @@
+#include "../headers/MetricsEndpoint.h"
+#include "../headers/Logger.h"
+#include <string_view>
+
+MetricsEndpoint::MetricsEndpoint(std::function<std::string()> renderMetrics) : render(std::move(renderMetrics)) {}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+	stop();
+}
+
+bool MetricsEndpoint::start(int port)
+{
+	listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listenSocket == INVALID_SOCKET) {
+		Logger::warning("[Metrics] Socket creation failed: ", lastSocketError());
+		return false;
+	}
+	int opt = 1;
+	setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt));
+
+	sockaddr_in service{};
+	service.sin_family = AF_INET;
+	service.sin_addr.s_addr = INADDR_ANY;
+	service.sin_port = htons(static_cast<u_short>(port));
+	if (bind(listenSocket, reinterpret_cast<sockaddr*>(&service), sizeof(service)) == SOCKET_ERROR
+		|| listen(listenSocket, 16) == SOCKET_ERROR) {
+		Logger::warning("[Metrics] Cannot listen on port ", port, ": ", lastSocketError());
+		closesocket(listenSocket);
+		listenSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	running = true;
+	acceptThread = std::thread(&MetricsEndpoint::serve, this);
+	Logger::notice("[Metrics] Serving /metrics on port ", port);
+	return true;
+}
+
+void MetricsEndpoint::stop()
+{
+	if (!running.exchange(false)) return;
+	shutdown(listenSocket, SHUT_RDWR);
+	closesocket(listenSocket);
+	listenSocket = INVALID_SOCKET;
+	if (acceptThread.joinable()) {
+		acceptThread.join();
+	}
+}
+
+void MetricsEndpoint::serve()
+{
+	while (running.load()) {
+		SOCKET client = accept(listenSocket, nullptr, nullptr);
+		if (client == INVALID_SOCKET) {
+			if (!running.load()) break;
+			static Logger::RateLimit acceptLimit;
+			Logger::logLimited(acceptLimit, LogLevel::WARNING, "[Metrics] accept() failed: ", lastSocketError());
+			continue;
+		}
+		handle(client);
+		closesocket(client);
+	}
+}
+
+void MetricsEndpoint::handle(SOCKET client)
+{
+	const size_t MAX_REQUEST = 8192;
+
+	// A stalled scraper must not hold the only serving thread for long.
+#ifdef _WIN32
+	DWORD timeout = 2000;
+#else
+	timeval timeout{ 2, 0 };
+#endif
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+	std::string request;
+	char buf[1024];
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST) {
+		int n = recv(client, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			if (n == SOCKET_ERROR && isInterrupted(lastSocketError())) continue;
+			return;
+		}
+		request.append(buf, n);
+	}
+
+	// Only the request line matters: "GET /metrics HTTP/1.1".
+	std::string_view line(request);
+	line = line.substr(0, line.find("\r\n"));
+	std::string_view path;
+	if (line.substr(0, 4) == "GET ") {
+		path = line.substr(4, line.find(' ', 4) - 4);
+		path = path.substr(0, path.find('?'));
+	}
+
+	std::string status;
+	std::string body;
+	std::string contentType = "text/plain; charset=utf-8";
+	if (path == "/metrics") {
+		status = "200 OK";
+		body = render();
+		contentType = "text/plain; version=0.0.4; charset=utf-8";
+	}
+	else {
+		status = "404 Not Found";
+		body = "Not found\n";
+	}
+
+	std::string response = "HTTP/1.1 " + status + "\r\n"
+		+ "Content-Type: " + contentType + "\r\n"
+		+ "Content-Length: " + std::to_string(body.size()) + "\r\n"
+		+ "Connection: close\r\n\r\n"
+		+ body;
+	size_t sent = 0;
+	while (sent < response.size()) {
+		int n = send(client, response.data() + sent, static_cast<int>(response.size() - sent), MSG_NOSIGNAL);
+		if (n <= 0) {
+			if (n == SOCKET_ERROR && isInterrupted(lastSocketError())) continue;
+			return;
+		}
+		sent += static_cast<size_t>(n);
+	}
+}
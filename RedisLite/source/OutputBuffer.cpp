@@ -0,0 +1,61 @@
+#include "../headers/OutputBuffer.h"
+
+void OutputBuffer::append(std::string_view data) {
+	if (data.empty()) return;
+
+	if (segments.empty() || segments.back().sealed || segments.back().data.size() + data.size() > CHUNK_SIZE) {
+		if (data.size() >= CHUNK_SIZE) {
+			segments.push_back(Segment{ std::string(data), true, nullptr });
+			pendingBytes += data.size();
+			return;
+		}
+		segments.push_back(Segment{ std::string(), false, nullptr });
+		segments.back().data.reserve(CHUNK_SIZE);
+	}
+	segments.back().data.append(data.data(), data.size());
+	pendingBytes += data.size();
+}
+
+void OutputBuffer::appendOwned(std::string&& data) {
+	if (data.empty()) return;
+	if (data.size() < LARGE_VALUE_THRESHOLD) {
+		append(data);
+		return;
+	}
+	pendingBytes += data.size();
+	segments.push_back(Segment{ std::move(data), true, nullptr });
+}
+
+void OutputBuffer::appendShared(std::shared_ptr<const std::string> data) {
+	if (!data || data->empty()) return;
+	pendingBytes += data->size();
+	segments.push_back(Segment{ std::string(), true, std::move(data) });
+}
+
+size_t OutputBuffer::gather(std::string_view* out, size_t maxSegments) const {
+	size_t count = 0;
+	for (size_t i = 0; i < segments.size() && count < maxSegments; ++i) {
+		std::string_view view = segments[i].view();
+		if (i == 0) view.remove_prefix(headOffset);
+		if (!view.empty()) out[count++] = view;
+	}
+	return count;
+}
+
+void OutputBuffer::consume(size_t n) {
+	pendingBytes -= n;
+	while (n > 0 && !segments.empty()) {
+		size_t available = segments.front().view().size() - headOffset;
+		if (n < available) {
+			headOffset += n;
+			return;
+		}
+		n -= available;
+		headOffset = 0;
+		if (segments.size() == 1 && !segments.front().sealed) {
+			segments.front().data.clear(); // keep the chunk's capacity for the next batch
+			return;
+		}
+		segments.pop_front();
+	}
+}
\ No newline at end of file
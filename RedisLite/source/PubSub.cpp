@@ -0,0 +1,293 @@
+#include "../headers/PubSub.h"
+#include "../headers/Glob.h"
+#include <algorithm>
+
+static void appendBulk(std::string& out, std::string_view s) {
+	out += '$';
+	out += std::to_string(s.size());
+	out += "\r\n";
+	out.append(s.data(), s.size());
+	out += "\r\n";
+}
+
+template <typename T>
+static void removeFrom(std::vector<T*>& list, T* item) {
+	auto it = std::find(list.begin(), list.end(), item);
+	if (it != list.end()) {
+		*it = list.back();
+		list.pop_back();
+	}
+}
+
+// End of the [...] class starting at pattern[i], scanned exactly as
+// globMatch reads it: just past the ']', or the end of an unterminated class.
+static size_t classEnd(std::string_view pattern, size_t i) {
+	size_t j = i + 1;
+	if (j < pattern.size() && pattern[j] == '^') ++j;
+	while (j < pattern.size() && pattern[j] != ']') {
+		if (pattern[j] == '\\' && j + 1 < pattern.size()) {
+			j += 2;
+		}
+		else if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+			j += 3;
+		}
+		else {
+			++j;
+		}
+	}
+	return j < pattern.size() ? j + 1 : j;
+}
+
+void PubSub::Subscriber::take(std::vector<Message>& out) {
+	out.clear();
+	std::lock_guard<std::mutex> lock(mtx);
+	out.swap(inbox);
+}
+
+void PubSub::Subscriber::deliver(const Message& message) {
+	bool first = false;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		first = inbox.empty();
+		inbox.push_back(message);
+	}
+	if (first && wake) {
+		wake();
+	}
+}
+
+PubSub::PubSub() {
+	nodes.emplace_back();
+}
+
+void PubSub::subscribe(Subscriber& subscriber, std::string_view channel) {
+	std::unique_lock<std::shared_mutex> lock(mtx);
+	if (!subscriber.channels.emplace(channel).second) return;
+	channels[std::string(channel)].push_back(&subscriber);
+}
+
+void PubSub::unsubscribe(Subscriber& subscriber, std::string_view channel) {
+	std::unique_lock<std::shared_mutex> lock(mtx);
+	auto own = subscriber.channels.find(std::string(channel));
+	if (own == subscriber.channels.end()) return;
+	subscriber.channels.erase(own);
+	auto it = channels.find(std::string(channel));
+	if (it == channels.end()) return;
+	removeFrom(it->second, &subscriber);
+	if (it->second.empty()) channels.erase(it);
+}
+
+void PubSub::psubscribe(Subscriber& subscriber, std::string_view pattern) {
+	std::unique_lock<std::shared_mutex> lock(mtx);
+	if (!subscriber.patterns.emplace(pattern).second) return;
+	auto [it, added] = patterns.try_emplace(std::string(pattern));
+	if (added) {
+		PatternEntry& entry = it->second;
+		entry.pattern = &it->first;
+		entry.node = insertPattern(pattern, entry.tokens);
+		nodes[entry.node].entries.push_back(&entry);
+		liveTokens += entry.tokens;
+	}
+	it->second.subscribers.push_back(&subscriber);
+}
+
+void PubSub::punsubscribe(Subscriber& subscriber, std::string_view pattern) {
+	std::unique_lock<std::shared_mutex> lock(mtx);
+	auto own = subscriber.patterns.find(std::string(pattern));
+	if (own == subscriber.patterns.end()) return;
+	subscriber.patterns.erase(own);
+	auto it = patterns.find(std::string(pattern));
+	if (it == patterns.end()) return;
+	removeFrom(it->second.subscribers, &subscriber);
+	if (!it->second.subscribers.empty()) return;
+
+	liveTokens -= it->second.tokens;
+	removeFrom(nodes[it->second.node].entries, &it->second);
+	patterns.erase(it);
+	// The nodes of removed patterns stay in the trie until they outnumber the
+	// live ones, then the trie is rebuilt from the remaining patterns.
+	if (nodes.size() > 64 && nodes.size() > 2 * (liveTokens + 1)) {
+		rebuildTrie();
+	}
+}
+
+void PubSub::unsubscribeAll(Subscriber& subscriber) {
+	std::vector<std::string> names(subscriber.channels.begin(), subscriber.channels.end());
+	for (const std::string& channel : names) {
+		unsubscribe(subscriber, channel);
+	}
+	names.assign(subscriber.patterns.begin(), subscriber.patterns.end());
+	for (const std::string& pattern : names) {
+		punsubscribe(subscriber, pattern);
+	}
+}
+
+size_t PubSub::publish(std::string_view channel, std::string_view payload) {
+	size_t receivers = 0;
+	std::shared_lock<std::shared_mutex> lock(mtx);
+
+	auto it = channels.find(std::string(channel));
+	if (it != channels.end()) {
+		auto message = std::make_shared<std::string>();
+		message->reserve(32 + channel.size() + payload.size());
+		*message += "*3\r\n$7\r\nmessage\r\n";
+		appendBulk(*message, channel);
+		appendBulk(*message, payload);
+		Message shared = std::move(message);
+		for (Subscriber* subscriber : it->second) {
+			subscriber->deliver(shared);
+		}
+		receivers += it->second.size();
+	}
+
+	if (!patterns.empty()) {
+		matchPatterns(channel, [&](PatternEntry& entry) {
+			const std::string& pattern = *entry.pattern;
+			auto message = std::make_shared<std::string>();
+			message->reserve(48 + pattern.size() + channel.size() + payload.size());
+			*message += "*4\r\n$8\r\npmessage\r\n";
+			appendBulk(*message, pattern);
+			appendBulk(*message, channel);
+			appendBulk(*message, payload);
+			Message shared = std::move(message);
+			for (Subscriber* subscriber : entry.subscribers) {
+				subscriber->deliver(shared);
+			}
+			receivers += entry.subscribers.size();
+		});
+	}
+	return receivers;
+}
+
+size_t PubSub::channelCount() {
+	std::shared_lock<std::shared_mutex> lock(mtx);
+	return channels.size();
+}
+
+size_t PubSub::patternCount() {
+	std::shared_lock<std::shared_mutex> lock(mtx);
+	return patterns.size();
+}
+
+// Walks pattern's tokens from the root, adding missing nodes, and returns the
+// node where it ends. tokens is set to the number of edges walked.
+uint32_t PubSub::insertPattern(std::string_view pattern, size_t& tokens) {
+	uint32_t node = 0;
+	tokens = 0;
+	auto addNode = [this](bool loops) {
+		nodes.emplace_back();
+		nodes.back().loops = loops;
+		return static_cast<uint32_t>(nodes.size() - 1);
+	};
+
+	size_t i = 0;
+	while (i < pattern.size()) {
+		char c = pattern[i];
+		uint32_t next = NONE;
+		if (c == '*') {
+			while (i < pattern.size() && pattern[i] == '*') ++i;
+			next = nodes[node].anyRun;
+			if (next == NONE) {
+				next = addNode(true);
+				nodes[node].anyRun = next;
+			}
+		}
+		else if (c == '?') {
+			++i;
+			next = nodes[node].anyChar;
+			if (next == NONE) {
+				next = addNode(false);
+				nodes[node].anyChar = next;
+			}
+		}
+		else if (c == '[') {
+			size_t end = classEnd(pattern, i);
+			std::string_view token = pattern.substr(i, end - i);
+			i = end;
+			for (const auto& edge : nodes[node].classes) {
+				if (edge.first == token) next = edge.second;
+			}
+			if (next == NONE) {
+				next = addNode(false);
+				nodes[node].classes.emplace_back(std::string(token), next);
+			}
+		}
+		else {
+			if (c == '\\' && i + 1 < pattern.size()) c = pattern[++i];
+			++i;
+			const auto& literals = nodes[node].literals;
+			auto it = std::lower_bound(literals.begin(), literals.end(), c,
+				[](const std::pair<char, uint32_t>& edge, char b) { return edge.first < b; });
+			size_t at = static_cast<size_t>(it - literals.begin());
+			if (it != literals.end() && it->first == c) {
+				next = it->second;
+			}
+			else {
+				next = addNode(false); // may reallocate nodes, so index again below
+				nodes[node].literals.insert(nodes[node].literals.begin() + at, { c, next });
+			}
+		}
+		node = next;
+		++tokens;
+	}
+	return node;
+}
+
+void PubSub::rebuildTrie() {
+	nodes.clear();
+	nodes.emplace_back();
+	for (auto& [pattern, entry] : patterns) {
+		entry.node = insertPattern(pattern, entry.tokens);
+		nodes[entry.node].entries.push_back(&entry);
+	}
+}
+
+// Runs the trie as an NFA over the channel: the active set holds every node
+// reachable by the bytes so far, each node at most once, so the walk costs
+// O(channel length * active nodes) no matter how the patterns overlap.
+template <typename Visit>
+void PubSub::matchPatterns(std::string_view channel, Visit&& visit) {
+	thread_local std::vector<uint32_t> active;
+	thread_local std::vector<uint32_t> next;
+	thread_local std::vector<uint64_t> seen; // generation a node was last added in
+	thread_local uint64_t generation = 0;
+	if (seen.size() < nodes.size()) seen.resize(nodes.size(), 0);
+
+	// Adds n and the '*' node below it, which matches the empty run.
+	auto add = [&](std::vector<uint32_t>& set, uint32_t n) {
+		while (n != NONE && seen[n] != generation) {
+			seen[n] = generation;
+			set.push_back(n);
+			n = nodes[n].anyRun;
+		}
+	};
+
+	active.clear();
+	++generation;
+	add(active, 0);
+	for (char c : channel) {
+		next.clear();
+		++generation;
+		for (uint32_t n : active) {
+			const TrieNode& node = nodes[n];
+			if (node.loops) add(next, n);
+			if (node.anyChar != NONE) add(next, node.anyChar);
+			if (!node.literals.empty()) {
+				auto it = std::lower_bound(node.literals.begin(), node.literals.end(), c,
+					[](const std::pair<char, uint32_t>& edge, char b) { return edge.first < b; });
+				if (it != node.literals.end() && it->first == c) add(next, it->second);
+			}
+			for (const auto& edge : node.classes) {
+				if (globMatch(edge.first, std::string_view(&c, 1))) add(next, edge.second);
+			}
+		}
+		active.swap(next);
+		if (active.empty()) return;
+	}
+
+	for (uint32_t n : active) {
+		for (PatternEntry* entry : nodes[n].entries) {
+			visit(*entry);
+		}
+	}
+}
@@ -0,0 +1,781 @@
+#include "../headers/ReplicationManager.h"
+#include "../headers/CachedClock.h"
+#include "../headers/CommandParser.h"
+#include "../headers/FileCompat.h"
+#include "../headers/Logger.h"
+#include "../headers/SnapshotManager.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <initializer_list>
+#include <iterator>
+#include <random>
+
+static const size_t STREAM_CHUNK = 64 * 1024;
+static const char PING_RECORD[] = "*1\r\n$4\r\nPING\r\n";
+
+static long long steadySeconds()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string generateReplid()
+{
+	static const char hex[] = "0123456789abcdef";
+	std::random_device seed;
+	std::mt19937_64 rng((static_cast<uint64_t>(seed()) << 32) ^ seed()
+		^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+	std::string id(ReplicationManager::REPLID_LENGTH, '0');
+	for (char& c : id) c = hex[rng() & 0xF];
+	return id;
+}
+
+static std::string encodeCommand(std::initializer_list<std::string_view> args)
+{
+	std::string out = "*" + std::to_string(args.size()) + "\r\n";
+	for (std::string_view arg : args) {
+		out += "$" + std::to_string(arg.size()) + "\r\n";
+		out.append(arg.data(), arg.size());
+		out += "\r\n";
+	}
+	return out;
+}
+
+static bool sendAll(SOCKET fd, const char* data, size_t len)
+{
+	while (len > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(len, STREAM_CHUNK));
+		int sent = send(fd, data, chunk, MSG_NOSIGNAL);
+		if (sent == SOCKET_ERROR) {
+			if (isInterrupted(lastSocketError())) continue;
+			return false;
+		}
+		data += sent;
+		len -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+static bool sendAll(SOCKET fd, const std::string& data)
+{
+	return sendAll(fd, data.data(), data.size());
+}
+
+// "ip:port" -> "ip"
+static std::string hostOf(const std::string& peer)
+{
+	size_t colon = peer.rfind(':');
+	return colon == std::string::npos ? peer : peer.substr(0, colon);
+}
+
+static SOCKET connectTo(const std::string& host, int port)
+{
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addr = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addr) != 0 || !addr) {
+		return INVALID_SOCKET;
+	}
+	SOCKET fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (fd != INVALID_SOCKET && connect(fd, addr->ai_addr, static_cast<socklen_t>(addr->ai_addrlen)) == SOCKET_ERROR) {
+		closesocket(fd);
+		fd = INVALID_SOCKET;
+	}
+	freeaddrinfo(addr);
+	return fd;
+}
+
+ReplicationManager::ReplicationManager(KeyValueStore& store, AOFManager* aof, std::string syncFilePrefix, size_t backlogSize, Executor executor)
+	: store(store), aof(aof), syncFilePrefix(std::move(syncFilePrefix)), execute(std::move(executor)),
+	replid(generateReplid()), backlogCapacity(backlogSize) {}
+
+ReplicationManager::~ReplicationManager()
+{
+	stop();
+}
+
+void ReplicationManager::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (stopping) return;
+		stopping = true;
+		for (auto& replica : replicas) {
+			shutdown(replica->fd, SHUT_RDWR);
+		}
+	}
+	streamCv.notify_all();
+	stopPrimaryLink();
+
+	// No lock needed: stopping keeps attachReplica and cron from touching the list.
+	for (auto& replica : replicas) {
+		if (replica->thread.joinable()) replica->thread.join();
+		closesocket(replica->fd);
+	}
+	replicas.clear();
+}
+
+void ReplicationManager::createBacklogLocked()
+{
+	if (!backlog.empty()) return;
+	backlog.assign(backlogCapacity, '\0');
+	backlogIndex = 0;
+	backlogHistlen = 0;
+	backlogActive.store(true);
+}
+
+void ReplicationManager::feedLocked(std::string_view data)
+{
+	offset += data.size();
+	if (backlog.empty() || data.empty()) return;
+
+	size_t capacity = backlog.size();
+	backlogHistlen = std::min<uint64_t>(backlogHistlen + data.size(), capacity);
+	if (data.size() > capacity) {
+		data.remove_prefix(data.size() - capacity); // only the tail survives
+	}
+	while (!data.empty()) {
+		size_t chunk = std::min(data.size(), capacity - backlogIndex);
+		std::memcpy(&backlog[backlogIndex], data.data(), chunk);
+		backlogIndex = (backlogIndex + chunk) % capacity;
+		data.remove_prefix(chunk);
+	}
+	streamCv.notify_all();
+}
+
+void ReplicationManager::propagate(const Command& cmd)
+{
+	if (!backlogActive.load(std::memory_order_relaxed)) return;
+	thread_local std::string record;
+	record.clear();
+	if (!AOFManager::serialize(cmd, record)) return;
+	std::lock_guard<std::mutex> lock(mtx);
+	feedLocked(record);
+}
+
+void ReplicationManager::cron()
+{
+	std::vector<std::unique_ptr<Replica>> finished;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (stopping) return;
+		// Pings keep idle links from timing out; a replica relays its primary's.
+		long long now = steadySeconds();
+		if (!replicas.empty() && !replicaMode.load() && now - lastPing >= PING_PERIOD_SECONDS) {
+			lastPing = now;
+			feedLocked(std::string_view(PING_RECORD, sizeof(PING_RECORD) - 1));
+		}
+		auto done = std::stable_partition(replicas.begin(), replicas.end(), [](const auto& r) { return !r->done.load(); });
+		std::move(done, replicas.end(), std::back_inserter(finished));
+		replicas.erase(done, replicas.end());
+	}
+	for (auto& replica : finished) {
+		if (replica->thread.joinable()) replica->thread.join();
+		closesocket(replica->fd);
+	}
+}
+
+bool ReplicationManager::canServeReplicas()
+{
+	// Until the stream passes the cut, the dataset holds writes that the
+	// backlog still has ahead of it.
+	return !replicaMode.load() || (linkUp.load() && !applyingCut.load());
+}
+
+void ReplicationManager::attachReplica(SOCKET fd, const std::string& peer, std::string requestedId, long long requestedOffset, int replicaPort)
+{
+	setBlocking(fd);
+	setTimeouts(fd, 1000, TIMEOUT_SECONDS * 1000);
+
+	std::lock_guard<std::mutex> lock(mtx);
+	if (stopping) {
+		closesocket(fd);
+		return;
+	}
+	createBacklogLocked();
+	auto replica = std::make_unique<Replica>();
+	replica->fd = fd;
+	replica->ip = hostOf(peer);
+	replica->port = replicaPort;
+	replica->lastAck = steadySeconds();
+	replica->thread = std::thread(&ReplicationManager::serveReplica, this, std::ref(*replica), std::move(requestedId), requestedOffset);
+	replicas.push_back(std::move(replica));
+}
+
+// Runs on the replica's own thread until the link fails or the server stops.
+void ReplicationManager::serveReplica(Replica& replica, std::string requestedId, long long requestedOffset)
+{
+	std::string name = replica.ip + ":" + std::to_string(replica.port);
+	uint64_t from = 0;
+	bool partial = false;
+	std::string id;
+	{
+		// PSYNC sends the offset of the first byte it wants, counting from 1.
+		std::lock_guard<std::mutex> lock(mtx);
+		uint64_t wanted = requestedOffset > 0 ? static_cast<uint64_t>(requestedOffset - 1) : 0;
+		bool knownId = requestedId == replid
+			|| (!replid2.empty() && requestedId == replid2 && static_cast<long long>(wanted) <= secondOffset);
+		partial = requestedOffset > 0 && knownId && wanted >= offset - backlogHistlen && wanted <= offset;
+		if (partial) from = wanted;
+		id = replid;
+	}
+
+	bool ok = true;
+	if (partial) {
+		Logger::notice("[Replication] Partial resynchronization accepted for replica ", name, ", continuing from offset ", from);
+		ok = sendAll(replica.fd, "+CONTINUE " + id + "\r\n");
+	}
+	else {
+		ok = sendFullResync(replica, from);
+	}
+
+	replica.online = ok;
+	replica.lastAck = steadySeconds();
+	std::string chunk;
+	std::string acks;
+	while (ok) {
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			streamCv.wait_for(lock, std::chrono::seconds(1), [&] { return stopping || offset > from; });
+			if (stopping) break;
+			if (from < offset - backlogHistlen) {
+				Logger::warning("[Replication] Replica ", name, " fell behind the replication backlog; disconnecting it. Consider a larger --repl-backlog-size.");
+				break;
+			}
+			size_t n = static_cast<size_t>(std::min<uint64_t>(offset - from, STREAM_CHUNK));
+			chunk.resize(n);
+			size_t capacity = backlog.size();
+			size_t start = (backlogIndex + capacity - static_cast<size_t>(offset - from) % capacity) % capacity;
+			size_t first = std::min(n, capacity - start);
+			std::memcpy(chunk.data(), &backlog[start], first);
+			std::memcpy(chunk.data() + first, backlog.data(), n - first);
+		}
+		if (!chunk.empty()) {
+			if (!sendAll(replica.fd, chunk)) break;
+			from += chunk.size();
+		}
+		readAcks(replica, acks);
+		if (steadySeconds() - replica.lastAck.load() > TIMEOUT_SECONDS) {
+			Logger::warning("[Replication] Replica ", name, " timed out.");
+			break;
+		}
+	}
+
+	shutdown(replica.fd, SHUT_RDWR);
+	replica.online = false;
+	replica.done = true;
+	Logger::notice("[Replication] Connection with replica ", name, " closed.");
+}
+
+// Sends +FULLRESYNC, then a snapshot taken after the current offset was
+// recorded. from is set to that offset, where streaming resumes. A primary
+// records the offset at which each shard is copied and sends those ahead of
+// the snapshot. A replica has no writers but its primary's stream, which it
+// relays after applying, so it pauses that stream instead: its snapshot is
+// exactly the dataset at from.
+bool ReplicationManager::sendFullResync(Replica& replica, uint64_t& from)
+{
+	bool relaying = replicaMode.load();
+	std::unique_lock<std::mutex> applyLock(applyMtx, std::defer_lock);
+	if (relaying) applyLock.lock();
+	std::string id;
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		from = offset;
+		id = replid;
+		path = syncFilePrefix + ".repl-" + std::to_string(++nextSyncId) + ".tmp";
+	}
+	Logger::notice("[Replication] Starting full resynchronization of replica ", replica.ip, ":", replica.port, " at offset ", from);
+	auto started = std::chrono::steady_clock::now();
+	if (!sendAll(replica.fd, "+FULLRESYNC " + id + " " + std::to_string(from) + "\r\n")) {
+		return false;
+	}
+
+	size_t keys = 0;
+	std::vector<uint64_t> cut(store.shardCount(), from);
+	int out = openForWrite(path);
+	// Runs under the shard's lock, which writers hold while they propagate.
+	bool ok = out != -1 && SnapshotManager::writeSnapshot(store, out, true, keys, [&](size_t shard) {
+		if (relaying) return;
+		std::lock_guard<std::mutex> lock(mtx);
+		cut[shard] = offset;
+	});
+	if (out != -1) closeFile(out);
+	if (applyLock.owns_lock()) applyLock.unlock();
+	std::error_code ec;
+	uint64_t size = ok ? std::filesystem::file_size(path, ec) : 0;
+	ok = ok && !ec;
+
+	if (ok && !relaying) {
+		std::string offsets = "+SHARDOFFSETS";
+		for (uint64_t shardOffset : cut) {
+			offsets += ' ';
+			offsets += std::to_string(shardOffset);
+		}
+		offsets += "\r\n";
+		ok = sendAll(replica.fd, offsets);
+	}
+	int in = ok ? openForRead(path) : -1;
+	ok = in != -1 && sendAll(replica.fd, "$" + std::to_string(size) + "\r\n");
+	std::vector<char> buffer(STREAM_CHUNK);
+	for (uint64_t sent = 0; ok && sent < size;) {
+		long long n = readSome(in, buffer.data(), buffer.size());
+		ok = n > 0 && sendAll(replica.fd, buffer.data(), static_cast<size_t>(n));
+		sent += n > 0 ? static_cast<uint64_t>(n) : 0;
+	}
+	if (in != -1) closeFile(in);
+	std::filesystem::remove(path, ec);
+
+	if (!ok) {
+		Logger::warning("[Replication] Full resynchronization of replica ", replica.ip, ":", replica.port, " failed.");
+		return false;
+	}
+	auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+	Logger::notice("[Replication] Sent a snapshot of ", keys, " keys (", size, " bytes) to replica ", replica.ip, ":", replica.port,
+		" in ", elapsedMs, " ms.");
+	return true;
+}
+
+// Consumes whatever the replica has sent without blocking: REPLCONF ACK <offset>.
+void ReplicationManager::readAcks(Replica& replica, std::string& acks)
+{
+	size_t available = bytesAvailable(replica.fd);
+	if (available == 0) return;
+	size_t oldSize = acks.size();
+	acks.resize(oldSize + available);
+	int n = recv(replica.fd, acks.data() + oldSize, static_cast<int>(available), 0);
+	acks.resize(oldSize + (n > 0 ? static_cast<size_t>(n) : 0));
+
+	ParseResult result;
+	size_t pos = 0;
+	while (pos < acks.size()) {
+		CommandParser::parseCommand(std::string_view(acks).substr(pos), result);
+		if (result.status == ParseResult::Status::INCOMPLETE) break;
+		if (result.bytesConsumed == 0) {
+			pos = acks.size();
+			break;
+		}
+		const Command& cmd = result.command;
+		if (result.status == ParseResult::Status::OK && cmd.type == CommandType::REPLCONF && cmd.key == "ACK" && cmd.count >= 0) {
+			replica.ackOffset = static_cast<uint64_t>(cmd.count);
+			replica.lastAck = steadySeconds();
+		}
+		pos += result.bytesConsumed;
+	}
+	acks.erase(0, pos);
+}
+
+void ReplicationManager::replicaOf(const std::string& host, int port)
+{
+	stopPrimaryLink();
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (stopping) return;
+		primaryHost = host;
+		primaryPort = port;
+		// Replicas of this server resync against the new history.
+		for (auto& replica : replicas) {
+			shutdown(replica->fd, SHUT_RDWR);
+		}
+	}
+	replicaMode = true;
+	primaryStop = false;
+	primaryThread = std::thread(&ReplicationManager::primaryLinkMain, this, host, port);
+}
+
+void ReplicationManager::promote()
+{
+	if (!replicaMode.load()) return;
+	stopPrimaryLink();
+	replicaMode = false;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	replid2 = replid;
+	secondOffset = static_cast<long long>(offset);
+	replid = generateReplid();
+	createBacklogLocked();
+	for (auto& replica : replicas) {
+		shutdown(replica->fd, SHUT_RDWR);
+	}
+	Logger::notice("[Replication] Now a primary with replication ID ", replid, "; the previous ID stays valid up to offset ", offset, ".");
+}
+
+void ReplicationManager::stopPrimaryLink()
+{
+	primaryStop = true;
+	SOCKET fd = primaryFd.load();
+	if (fd != INVALID_SOCKET) {
+		shutdown(fd, SHUT_RDWR);
+	}
+	if (primaryThread.joinable()) {
+		primaryThread.join();
+	}
+}
+
+// The replica's connection to its primary: connect, resync, stream, and on
+// any failure start over after a second.
+void ReplicationManager::primaryLinkMain(std::string host, int port)
+{
+	Logger::notice("[Replication] Replicating from primary ", host, ":", port);
+	while (!primaryStop.load()) {
+		SOCKET fd = connectTo(host, port);
+		if (fd == INVALID_SOCKET) {
+			static Logger::RateLimit connectLimit;
+			Logger::logLimited(connectLimit, LogLevel::WARNING, "[Replication] Cannot connect to primary ", host, ":", port);
+		}
+		else {
+			primaryFd = fd;
+			setNoDelay(fd);
+			setTimeouts(fd, 1000, TIMEOUT_SECONDS * 1000);
+			std::string buffer;
+			if (!primaryStop.load() && syncWithPrimary(fd, buffer)) {
+				linkUp = true;
+				streamFromPrimary(fd, buffer);
+				linkUp = false;
+			}
+			primaryFd = INVALID_SOCKET;
+			closesocket(fd);
+			if (!primaryStop.load()) {
+				Logger::warning("[Replication] Lost the connection with primary ", host, ":", port, "; reconnecting.");
+			}
+		}
+		for (int i = 0; i < 10 && !primaryStop.load(); ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+}
+
+// Reads one CRLF-terminated line into line, leaving what follows in buffer.
+// Gives up after TIMEOUT_SECONDS without data or once the link is stopped.
+static bool readLine(SOCKET fd, std::string& buffer, std::string& line, const std::atomic<bool>& stop)
+{
+	long long lastIo = steadySeconds();
+	char chunk[4096];
+	while (true) {
+		size_t end = buffer.find("\r\n");
+		if (end != std::string::npos) {
+			line = buffer.substr(0, end);
+			buffer.erase(0, end + 2);
+			return true;
+		}
+		if (stop.load() || steadySeconds() - lastIo > ReplicationManager::TIMEOUT_SECONDS) return false;
+		int n = recv(fd, chunk, sizeof(chunk), 0);
+		if (n > 0) {
+			buffer.append(chunk, static_cast<size_t>(n));
+			lastIo = steadySeconds();
+			continue;
+		}
+		if (n == 0) return false;
+		int err = lastSocketError();
+		if (!isTimedOut(err) && !isInterrupted(err)) return false;
+	}
+}
+
+bool ReplicationManager::syncWithPrimary(SOCKET fd, std::string& buffer)
+{
+	std::string line;
+	if (!sendAll(fd, encodeCommand({ "PING" })) || !readLine(fd, buffer, line, primaryStop) || line.empty() || line[0] == '-') {
+		Logger::warning("[Replication] Primary did not answer PING", line.empty() ? "" : ": ", line);
+		return false;
+	}
+	if (!sendAll(fd, encodeCommand({ "REPLCONF", "listening-port", std::to_string(listeningPort) }))
+		|| !readLine(fd, buffer, line, primaryStop) || line != "+OK") {
+		Logger::warning("[Replication] Primary refused REPLCONF", line.empty() ? "" : ": ", line);
+		return false;
+	}
+
+	std::string id;
+	uint64_t known = 0;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		id = replid;
+		known = offset;
+	}
+	shardCut.clear();
+	cutEnd = 0;
+	applyingCut = false;
+	if (!sendAll(fd, encodeCommand({ "PSYNC", id, std::to_string(known + 1) })) || !readLine(fd, buffer, line, primaryStop)) {
+		return false;
+	}
+
+	if (line.rfind("+CONTINUE", 0) == 0) {
+		std::string newId = line.size() > 10 ? line.substr(10) : std::string();
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!newId.empty() && newId != replid) {
+			// The primary was promoted since; keep accepting PSYNC for the old history.
+			replid2 = replid;
+			secondOffset = static_cast<long long>(offset);
+			replid = newId;
+		}
+		createBacklogLocked();
+		Logger::notice("[Replication] Partial resynchronization with primary succeeded at offset ", offset);
+		return true;
+	}
+
+	if (line.rfind("+FULLRESYNC ", 0) != 0) {
+		Logger::warning("[Replication] Unexpected reply to PSYNC: ", line);
+		return false;
+	}
+	size_t space = line.find(' ', 12);
+	uint64_t startOffset = 0;
+	if (space == std::string::npos
+		|| std::from_chars(line.data() + space + 1, line.data() + line.size(), startOffset).ec != std::errc()) {
+		Logger::warning("[Replication] Malformed FULLRESYNC reply: ", line);
+		return false;
+	}
+	std::string newId = line.substr(12, space - 12);
+
+	// The snapshot follows as $<length>\r\n<bytes>, after the offsets of the
+	// primary's shards if it sends them; empty lines are keepalives.
+	std::vector<uint64_t> cut;
+	do {
+		if (!readLine(fd, buffer, line, primaryStop)) return false;
+		if (line.rfind("+SHARDOFFSETS", 0) == 0) {
+			const char* p = line.data() + 13;
+			const char* end = line.data() + line.size();
+			while (p < end && *p == ' ') {
+				uint64_t shardOffset = 0;
+				auto parsed = std::from_chars(p + 1, end, shardOffset);
+				if (parsed.ec != std::errc()) break;
+				cut.push_back(shardOffset);
+				p = parsed.ptr;
+			}
+			if (p != end || cut.empty() || (cut.size() & (cut.size() - 1)) != 0) {
+				Logger::warning("[Replication] Malformed shard offsets from primary: ", line);
+				return false;
+			}
+			line.clear();
+		}
+	} while (line.empty());
+	uint64_t length = 0;
+	if (line[0] != '$' || std::from_chars(line.data() + 1, line.data() + line.size(), length).ec != std::errc()) {
+		Logger::warning("[Replication] Malformed snapshot header from primary: ", line);
+		return false;
+	}
+	if (!receiveSnapshot(fd, buffer, length)) {
+		return false;
+	}
+
+	cutEnd = cut.empty() ? 0 : *std::max_element(cut.begin(), cut.end());
+	shardCut = std::move(cut);
+	applyingCut = cutEnd > startOffset;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	replid = newId;
+	replid2.clear();
+	secondOffset = -1;
+	offset = startOffset;
+	backlog.clear();
+	createBacklogLocked();
+	return true;
+}
+
+// Receives length snapshot bytes into a temporary file, then replaces the
+// dataset with it. Bytes past the snapshot stay in buffer.
+bool ReplicationManager::receiveSnapshot(SOCKET fd, std::string& buffer, uint64_t length)
+{
+	std::string path = syncFilePrefix + ".sync.tmp";
+	int out = openForWrite(path);
+	if (out == -1) {
+		Logger::warning("[Replication] Cannot create ", path);
+		return false;
+	}
+	syncing = true;
+	auto started = std::chrono::steady_clock::now();
+	long long lastIo = steadySeconds();
+	uint64_t received = 0;
+	bool ok = true;
+	std::vector<char> chunk(STREAM_CHUNK);
+	while (ok && received < length) {
+		if (!buffer.empty()) {
+			size_t n = static_cast<size_t>(std::min<uint64_t>(buffer.size(), length - received));
+			ok = writeAll(out, buffer.data(), n);
+			buffer.erase(0, n);
+			received += n;
+			continue;
+		}
+		if (primaryStop.load() || steadySeconds() - lastIo > TIMEOUT_SECONDS) {
+			ok = false;
+			break;
+		}
+		int n = recv(fd, chunk.data(), static_cast<int>(chunk.size()), 0);
+		if (n > 0) {
+			buffer.append(chunk.data(), static_cast<size_t>(n));
+			lastIo = steadySeconds();
+			lastPrimaryIo = lastIo;
+		}
+		else if (n == 0 || (!isTimedOut(lastSocketError()) && !isInterrupted(lastSocketError()))) {
+			ok = false;
+		}
+	}
+	ok = ok && syncFile(out);
+	closeFile(out);
+
+	size_t keys = 0;
+	if (ok) {
+		int in = openForRead(path);
+		uint64_t bytesRead = 0;
+		store.clear();
+		ok = in != -1 && SnapshotManager::readSnapshot(store, in, bytesRead, keys);
+		if (in != -1) closeFile(in);
+	}
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+	syncing = false;
+
+	if (!ok) {
+		Logger::warning("[Replication] Failed to receive the snapshot from the primary.");
+		return false;
+	}
+	auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+	Logger::notice("[Replication] Full resynchronization: loaded ", keys, " keys (", length, " bytes) in ", elapsedMs, " ms.");
+	// The old AOF no longer describes the dataset.
+	if (aof && aof->startRewrite(store)) {
+		Logger::notice("[Replication] Rewriting the AOF after the full resynchronization.");
+	}
+	return true;
+}
+
+// Applies the primary's stream as it arrives and acknowledges the offset
+// once a second.
+void ReplicationManager::streamFromPrimary(SOCKET fd, std::string& buffer)
+{
+	long long lastAck = 0;
+	lastPrimaryIo = steadySeconds();
+	ParseResult result;
+	char chunk[16 * 1024];
+	uint64_t at = 0; // stream offset of buffer's first byte
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		at = offset;
+	}
+
+	while (!primaryStop.load()) {
+		CachedClock::update();
+		size_t pos = 0;
+		uint64_t applied = 0;
+		{
+			std::lock_guard<std::mutex> applyLock(applyMtx);
+			while (pos < buffer.size()) {
+				CommandParser::parseCommand(std::string_view(buffer).substr(pos), result);
+				if (result.status == ParseResult::Status::INCOMPLETE) break;
+				if (result.bytesConsumed == 0) {
+					Logger::warning("[Replication] Protocol error in the stream from the primary: ", result.errorMessage);
+					return;
+				}
+				if (result.status == ParseResult::Status::OK) {
+					if (at + pos < cutEnd) {
+						executeAfterCut(result.command, at + pos);
+					}
+					else {
+						execute(result.command);
+					}
+				}
+				pos += result.bytesConsumed;
+			}
+			if (pos > 0) {
+				std::lock_guard<std::mutex> lock(mtx);
+				feedLocked(std::string_view(buffer.data(), pos));
+				applied = offset;
+				buffer.erase(0, pos);
+			}
+		}
+		at += pos;
+		if (applyingCut.load() && at >= cutEnd) {
+			shardCut.clear();
+			applyingCut = false;
+		}
+
+		long long now = steadySeconds();
+		if (now != lastAck) {
+			if (pos == 0) {
+				std::lock_guard<std::mutex> lock(mtx);
+				applied = offset;
+			}
+			if (!sendAll(fd, encodeCommand({ "REPLCONF", "ACK", std::to_string(applied) }))) return;
+			lastAck = now;
+		}
+
+		int n = recv(fd, chunk, sizeof(chunk), 0);
+		if (n > 0) {
+			buffer.append(chunk, static_cast<size_t>(n));
+			lastPrimaryIo = steadySeconds();
+			continue;
+		}
+		if (n == 0) return;
+		int err = lastSocketError();
+		if (!isTimedOut(err) && !isInterrupted(err)) return;
+		if (steadySeconds() - lastPrimaryIo.load() > TIMEOUT_SECONDS) {
+			Logger::warning("[Replication] Timed out waiting for the primary.");
+			return;
+		}
+	}
+}
+
+// Executes a record that starts at stream offset at, which comes before some
+// shard's offset in the full resync's cut. Keys in such shards were written
+// before the shard was copied, so the snapshot already holds them. Only MSET
+// and DEL can name keys on both sides of the cut; they keep the others.
+void ReplicationManager::executeAfterCut(const Command& cmd, uint64_t at)
+{
+	if (!cmd.spec || !(cmd.spec->flags & CMD_WRITE)) {
+		execute(cmd);
+		return;
+	}
+	auto inSnapshot = [&](std::string_view key) { return at < shardCut[KeyValueStore::shardOf(key, shardCut.size())]; };
+	bool multiKey = (cmd.type == CommandType::MSET || cmd.type == CommandType::DEL) && cmd.args.size() > 2;
+	if (!multiKey) {
+		if (!inSnapshot(cmd.key)) execute(cmd);
+		return;
+	}
+
+	size_t step = cmd.type == CommandType::MSET ? 2 : 1;
+	Command rest = cmd;
+	rest.args.resize(1);
+	for (size_t i = 1; i + step <= cmd.args.size(); i += step) {
+		if (!inSnapshot(cmd.args[i])) {
+			rest.args.insert(rest.args.end(), cmd.args.begin() + i, cmd.args.begin() + i + step);
+		}
+	}
+	if (rest.args.size() == 1) return;
+	rest.key = rest.args[1];
+	if (step == 2) rest.value = rest.args[2];
+	execute(rest);
+}
+
+ReplicationManager::Info ReplicationManager::info()
+{
+	Info out;
+	long long now = steadySeconds();
+	out.replica = replicaMode.load();
+	out.linkUp = linkUp.load();
+	out.syncInProgress = syncing.load();
+	out.lastIoSecondsAgo = out.linkUp ? now - lastPrimaryIo.load() : -1;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	out.primaryHost = primaryHost;
+	out.primaryPort = primaryPort;
+	out.replid = replid;
+	out.replid2 = replid2;
+	out.offset = offset;
+	out.secondOffset = secondOffset < 0 ? -1 : secondOffset + 1;
+	out.backlogActive = !backlog.empty();
+	out.backlogSize = backlogCapacity;
+	out.backlogHistlen = backlogHistlen;
+	out.backlogFirstByte = out.backlogActive ? offset - backlogHistlen + 1 : 0;
+	for (const auto& replica : replicas) {
+		if (replica->done.load()) continue;
+		ReplicaInfo r;
+		r.ip = replica->ip;
+		r.port = replica->port;
+		r.online = replica->online.load();
+		r.ackOffset = replica->ackOffset.load();
+		r.lagSeconds = now - replica->lastAck.load();
+		out.replicas.push_back(std::move(r));
+	}
+	return out;
+}
@@ -8,14 +8,34 @@ std::string ResponseFormatter::BulkString(const std::string& msg) {
 	return "$" + std::to_string(msg.size()) + "\r\n" + msg + "\r\n";
 }
 
+std::string ResponseFormatter::BulkStringHeader(size_t length) {
+	return "$" + std::to_string(length) + "\r\n";
+}
+
 std::string ResponseFormatter::NilBulkString() {
 	return "$-1\r\n";
 }
 
-std::string ResponseFormatter::Integer(int value) {
+std::string ResponseFormatter::ArrayHeader(size_t count) {
+	return "*" + std::to_string(count) + "\r\n";
+}
+
+std::string ResponseFormatter::MapHeader(size_t pairs) {
+	return "%" + std::to_string(pairs) + "\r\n";
+}
+
+std::string ResponseFormatter::Integer(long long value) {
 	return ":" + std::to_string(value) + "\r\n";
 }
 
 std::string ResponseFormatter::Error(const std::string& msg) {
 	return "-ERR " + msg + "\r\n";
+}
+
+std::string ResponseFormatter::Error(const std::string& code, const std::string& msg) {
+	return "-" + code + " " + msg + "\r\n";
+}
+
+std::string ResponseFormatter::WrongType() {
+	return Error("WRONGTYPE", "Operation against a key holding the wrong kind of value");
 }
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "../headers/ServerConfig.h"
+#include <cctype>
+#include <charconv>
+
+static bool parseInt(const std::string& s, int& out) {
+	const char* end = s.data() + s.size();
+	auto [ptr, ec] = std::from_chars(s.data(), end, out);
+	return ec == std::errc() && ptr == end;
+}
+
+// Accepts a byte count with an optional kb/mb/gb suffix (case-insensitive).
+static bool parseBytes(const std::string& s, unsigned long long& out) {
+	const char* begin = s.data();
+	const char* end = s.data() + s.size();
+	auto [ptr, ec] = std::from_chars(begin, end, out);
+	if (ec != std::errc() || ptr == begin) return false;
+
+	std::string unit(ptr, end);
+	for (char& c : unit) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	if (unit.empty() || unit == "b") return true;
+	if (unit == "kb" || unit == "k") { out <<= 10; return true; }
+	if (unit == "mb" || unit == "m") { out <<= 20; return true; }
+	if (unit == "gb" || unit == "g") { out <<= 30; return true; }
+	return false;
+}
+
+static bool parseYesNo(const std::string& s, bool& out) {
+	if (s == "yes") { out = true; return true; }
+	if (s == "no") { out = false; return true; }
+	return false;
+}
+
+bool ServerConfig::parseArgs(int argc, char* argv[], std::string& error) {
+	for (int i = 1; i < argc; ++i) {
+		std::string name = argv[i];
+		if (i + 1 >= argc) {
+			error = "Missing value for " + name;
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (name == "--port") {
+			if (!parseInt(value, port) || port <= 0 || port > 65535) {
+				error = "Invalid port: " + value;
+				return false;
+			}
+		}
+		else if (name == "--aof") {
+			aofPath = value;
+		}
+		else if (name == "--appendfsync") {
+			if (value == "always") {
+				appendFsync = FsyncPolicy::ALWAYS;
+			}
+			else if (value == "everysec") {
+				appendFsync = FsyncPolicy::EVERYSEC;
+			}
+			else if (value == "no") {
+				appendFsync = FsyncPolicy::NO;
+			}
+			else {
+				error = "Unknown appendfsync policy: " + value;
+				return false;
+			}
+		}
+		else if (name == "--auto-aof-rewrite-percentage") {
+			if (!parseInt(value, autoAofRewritePercentage) || autoAofRewritePercentage < 0) {
+				error = "Invalid auto-aof-rewrite-percentage: " + value;
+				return false;
+			}
+		}
+		else if (name == "--auto-aof-rewrite-min-size") {
+			if (!parseBytes(value, autoAofRewriteMinSize)) {
+				error = "Invalid auto-aof-rewrite-min-size: " + value;
+				return false;
+			}
+		}
+		else if (name == "--aof-use-rdb-preamble") {
+			if (!parseYesNo(value, aofUseRdbPreamble)) {
+				error = "Expected yes or no for aof-use-rdb-preamble: " + value;
+				return false;
+			}
+		}
+		else if (name == "--dbfilename") {
+			dbFilename = value;
+		}
+		else if (name == "--rdbcompression") {
+			if (!parseYesNo(value, rdbCompression)) {
+				error = "Expected yes or no for rdbcompression: " + value;
+				return false;
+			}
+		}
+		else if (name == "--io-model") {
+			if (value == "threads") {
+				ioModel = IOModel::THREAD_PER_CLIENT;
+			}
+			else if (value == "epoll") {
+#ifdef __linux__
+				ioModel = IOModel::EPOLL;
+#else
+				error = "The epoll I/O model is only available on Linux";
+				return false;
+#endif
+			}
+			else {
+				error = "Unknown I/O model: " + value;
+				return false;
+			}
+		}
+		else if (name == "--io-threads") {
+			if (!parseInt(value, ioThreads) || ioThreads <= 0) {
+				error = "Invalid io-threads: " + value;
+				return false;
+			}
+		}
+		else if (name == "--shards") {
+			if (!parseInt(value, shards) || shards <= 0) {
+				error = "Invalid shards: " + value;
+				return false;
+			}
+		}
+		else if (name == "--maxmemory") {
+			unsigned long long bytes = 0;
+			if (!parseBytes(value, bytes)) {
+				error = "Invalid maxmemory: " + value;
+				return false;
+			}
+			maxMemory = static_cast<size_t>(bytes);
+		}
+		else if (name == "--maxmemory-policy") {
+			if (value == "noeviction") {
+				maxMemoryPolicy = EvictionPolicy::NOEVICTION;
+			}
+			else if (value == "allkeys-lru") {
+				maxMemoryPolicy = EvictionPolicy::ALLKEYS_LRU;
+			}
+			else if (value == "allkeys-lfu") {
+				maxMemoryPolicy = EvictionPolicy::ALLKEYS_LFU;
+			}
+			else if (value == "volatile-lru") {
+				maxMemoryPolicy = EvictionPolicy::VOLATILE_LRU;
+			}
+			else if (value == "volatile-ttl") {
+				maxMemoryPolicy = EvictionPolicy::VOLATILE_TTL;
+			}
+			else {
+				error = "Unknown maxmemory-policy: " + value;
+				return false;
+			}
+		}
+		else if (name == "--maxmemory-samples") {
+			if (!parseInt(value, maxMemorySamples) || maxMemorySamples <= 0) {
+				error = "Invalid maxmemory-samples: " + value;
+				return false;
+			}
+		}
+		else if (name == "--hz") {
+			if (!parseInt(value, hz) || hz < 0 || hz > 500) {
+				error = "Invalid hz (0-500): " + value;
+				return false;
+			}
+		}
+		else if (name == "--activerehashing") {
+			if (!parseYesNo(value, activeRehashing)) {
+				error = "Expected yes or no for activerehashing: " + value;
+				return false;
+			}
+		}
+		else if (name == "--flush-threshold") {
+			int bytes = 0;
+			if (!parseInt(value, bytes) || bytes < 0) {
+				error = "Invalid flush-threshold: " + value;
+				return false;
+			}
+			flushThreshold = static_cast<size_t>(bytes);
+		}
+		else if (name == "--client-query-buffer-limit") {
+			unsigned long long bytes = 0;
+			if (!parseBytes(value, bytes) || bytes < 1024 * 1024) {
+				error = "Invalid client-query-buffer-limit (at least 1mb): " + value;
+				return false;
+			}
+			clientQueryBufferLimit = static_cast<size_t>(bytes);
+		}
+		else if (name == "--loglevel") {
+			if (!Logger::parseLevel(value, logLevel)) {
+				error = "Unknown loglevel: " + value;
+				return false;
+			}
+		}
+		else if (name == "--metrics-port") {
+			if (!parseInt(value, metricsPort) || metricsPort < 0 || metricsPort > 65535) {
+				error = "Invalid metrics-port: " + value;
+				return false;
+			}
+		}
+		else if (name == "--slowlog-log-slower-than") {
+			int micros = 0;
+			if (!parseInt(value, micros)) {
+				error = "Invalid slowlog-log-slower-than: " + value;
+				return false;
+			}
+			slowlogLogSlowerThan = micros;
+		}
+		else if (name == "--slowlog-max-len") {
+			if (!parseInt(value, slowlogMaxLen) || slowlogMaxLen < 0) {
+				error = "Invalid slowlog-max-len: " + value;
+				return false;
+			}
+		}
+		else if (name == "--latency-monitor-threshold") {
+			if (!parseInt(value, latencyMonitorThreshold) || latencyMonitorThreshold < 0) {
+				error = "Invalid latency-monitor-threshold: " + value;
+				return false;
+			}
+		}
+		else if (name == "--latency-tracking") {
+			if (!parseYesNo(value, latencyTracking)) {
+				error = "Expected yes or no for latency-tracking: " + value;
+				return false;
+			}
+		}
+		else if (name == "--replicaof") {
+			// host:port (the last colon separates the port)
+			size_t colon = value.rfind(':');
+			if (colon == std::string::npos || colon == 0 || !parseInt(value.substr(colon + 1), replicaOfPort)
+				|| replicaOfPort <= 0 || replicaOfPort > 65535) {
+				error = "Expected host:port for replicaof: " + value;
+				return false;
+			}
+			replicaOfHost = value.substr(0, colon);
+		}
+		else if (name == "--repl-backlog-size") {
+			unsigned long long bytes = 0;
+			if (!parseBytes(value, bytes) || bytes < 16 * 1024) {
+				error = "Invalid repl-backlog-size (at least 16kb): " + value;
+				return false;
+			}
+			replBacklogSize = static_cast<size_t>(bytes);
+		}
+		else if (name == "--tracking-table-max-keys") {
+			if (!parseInt(value, trackingTableMaxKeys) || trackingTableMaxKeys < 0) {
+				error = "Invalid tracking-table-max-keys: " + value;
+				return false;
+			}
+		}
+		else {
+			error = "Unknown option: " + name;
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,256 @@
+#include "../headers/SkipList.h"
+#include <new>
+
+SkipList::SkipList() : head(createNode(MAX_LEVEL, 0, std::string_view())) {}
+
+SkipList::~SkipList()
+{
+	Node* node = head->next();
+	while (node) {
+		Node* next = node->next();
+		destroyNode(node);
+		node = next;
+	}
+	destroyNode(head);
+}
+
+int SkipList::randomLevel()
+{
+	// xorshift64*; each extra level has a 1 in 4 chance.
+	static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ reinterpret_cast<uintptr_t>(&state);
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	uint64_t bits = state * 0x2545F4914F6CDD1DULL;
+	int height = 1;
+	while (height < MAX_LEVEL && (bits & 3) == 0) {
+		++height;
+		bits >>= 2;
+	}
+	return height;
+}
+
+SkipList::Node* SkipList::createNode(int height, double score, std::string_view member)
+{
+	void* memory = ::operator new(sizeof(Node) + height * sizeof(Node::Level));
+	Node* node = new (memory) Node{ std::string(member), score, nullptr, static_cast<uint8_t>(height) };
+	for (int i = 0; i < height; ++i) {
+		node->levels()[i] = Node::Level{ nullptr, 0 };
+	}
+	return node;
+}
+
+void SkipList::destroyNode(Node* node)
+{
+	node->~Node();
+	::operator delete(node);
+}
+
+size_t SkipList::nodeSize(const Node* node)
+{
+	static const size_t inlineCapacity = std::string().capacity();
+	size_t member = node->member.capacity() > inlineCapacity ? node->member.capacity() + 1 : 0;
+	return sizeof(Node) + node->height * sizeof(Node::Level) + member;
+}
+
+bool SkipList::before(const Node* node, double score, std::string_view member)
+{
+	return node->score < score || (node->score == score && std::string_view(node->member) < member);
+}
+
+void SkipList::findPath(double score, std::string_view member, Node** update, size_t* rank) const
+{
+	Node* x = head;
+	for (int i = level - 1; i >= 0; --i) {
+		rank[i] = i == level - 1 ? 0 : rank[i + 1];
+		while (x->levels()[i].forward && before(x->levels()[i].forward, score, member)) {
+			rank[i] += x->levels()[i].span;
+			x = x->levels()[i].forward;
+		}
+		update[i] = x;
+	}
+}
+
+void SkipList::link(Node* node, Node** update, size_t* rank)
+{
+	int height = node->height;
+	if (height > level) {
+		for (int i = level; i < height; ++i) {
+			rank[i] = 0;
+			update[i] = head;
+			update[i]->levels()[i].span = length;
+		}
+		level = height;
+	}
+	for (int i = 0; i < height; ++i) {
+		Node::Level& prev = update[i]->levels()[i];
+		node->levels()[i].forward = prev.forward;
+		prev.forward = node;
+		// prev now skips the nodes between it and node, plus node itself.
+		node->levels()[i].span = prev.span - (rank[0] - rank[i]);
+		prev.span = (rank[0] - rank[i]) + 1;
+	}
+	for (int i = height; i < level; ++i) {
+		++update[i]->levels()[i].span;
+	}
+	node->backward = update[0] == head ? nullptr : update[0];
+	if (node->next()) {
+		node->next()->backward = node;
+	}
+	else {
+		tail = node;
+	}
+	++length;
+}
+
+void SkipList::unlink(Node* node, Node** update)
+{
+	for (int i = 0; i < level; ++i) {
+		Node::Level& prev = update[i]->levels()[i];
+		if (prev.forward == node) {
+			prev.span += node->levels()[i].span - 1;
+			prev.forward = node->levels()[i].forward;
+		}
+		else {
+			--prev.span;
+		}
+	}
+	if (node->next()) {
+		node->next()->backward = node->backward;
+	}
+	else {
+		tail = node->backward;
+	}
+	while (level > 1 && !head->levels()[level - 1].forward) {
+		--level;
+	}
+	--length;
+}
+
+SkipList::Node* SkipList::insert(double score, std::string_view member)
+{
+	Node* update[MAX_LEVEL];
+	size_t rank[MAX_LEVEL];
+	findPath(score, member, update, rank);
+	Node* node = createNode(randomLevel(), score, member);
+	link(node, update, rank);
+	nodeBytes += nodeSize(node);
+	return node;
+}
+
+void SkipList::erase(Node* node)
+{
+	Node* update[MAX_LEVEL];
+	size_t rank[MAX_LEVEL];
+	findPath(node->score, node->member, update, rank);
+	unlink(node, update);
+	nodeBytes -= nodeSize(node);
+	destroyNode(node);
+}
+
+void SkipList::updateScore(Node* node, double score)
+{
+	Node* prev = node->prev();
+	Node* next = node->next();
+	if ((!prev || prev->score < score) && (!next || next->score > score)) {
+		// Still strictly between its neighbours: no relinking needed.
+		node->score = score;
+		return;
+	}
+	Node* update[MAX_LEVEL];
+	size_t rank[MAX_LEVEL];
+	findPath(node->score, node->member, update, rank);
+	unlink(node, update);
+	node->score = score;
+	findPath(score, node->member, update, rank);
+	link(node, update, rank);
+}
+
+size_t SkipList::rank(double score, std::string_view member) const
+{
+	Node* x = head;
+	size_t traversed = 0;
+	for (int i = level - 1; i >= 0; --i) {
+		while (x->levels()[i].forward && (before(x->levels()[i].forward, score, member)
+			|| (x->levels()[i].forward->score == score && x->levels()[i].forward->member == member))) {
+			traversed += x->levels()[i].span;
+			x = x->levels()[i].forward;
+		}
+		if (x != head && x->score == score && x->member == member) {
+			return traversed;
+		}
+	}
+	return 0;
+}
+
+SkipList::Node* SkipList::byRank(size_t rank) const
+{
+	Node* x = head;
+	size_t traversed = 0;
+	for (int i = level - 1; i >= 0; --i) {
+		while (x->levels()[i].forward && traversed + x->levels()[i].span <= rank) {
+			traversed += x->levels()[i].span;
+			x = x->levels()[i].forward;
+		}
+		if (traversed == rank) {
+			return x == head ? nullptr : x;
+		}
+	}
+	return nullptr;
+}
+
+SkipList::Node* SkipList::firstInRange(const ScoreRange& range) const
+{
+	if (range.empty() || !tail || !range.aboveMin(tail->score) || !range.belowMax(first()->score)) {
+		return nullptr;
+	}
+	Node* x = head;
+	for (int i = level - 1; i >= 0; --i) {
+		while (x->levels()[i].forward && !range.aboveMin(x->levels()[i].forward->score)) {
+			x = x->levels()[i].forward;
+		}
+	}
+	x = x->next();
+	return x && range.belowMax(x->score) ? x : nullptr;
+}
+
+SkipList::Node* SkipList::lastInRange(const ScoreRange& range) const
+{
+	if (range.empty() || !tail || !range.aboveMin(tail->score) || !range.belowMax(first()->score)) {
+		return nullptr;
+	}
+	Node* x = head;
+	for (int i = level - 1; i >= 0; --i) {
+		while (x->levels()[i].forward && range.belowMax(x->levels()[i].forward->score)) {
+			x = x->levels()[i].forward;
+		}
+	}
+	return x != head && range.aboveMin(x->score) ? x : nullptr;
+}
+
+size_t SkipList::eraseRange(const ScoreRange& range, const std::function<void(Node*)>& onErase)
+{
+	if (range.empty()) {
+		return 0;
+	}
+	Node* update[MAX_LEVEL];
+	Node* x = head;
+	for (int i = level - 1; i >= 0; --i) {
+		while (x->levels()[i].forward && !range.aboveMin(x->levels()[i].forward->score)) {
+			x = x->levels()[i].forward;
+		}
+		update[i] = x;
+	}
+	size_t removed = 0;
+	x = x->next();
+	while (x && range.belowMax(x->score)) {
+		Node* next = x->next();
+		onErase(x);
+		unlink(x, update);
+		nodeBytes -= nodeSize(x);
+		destroyNode(x);
+		++removed;
+		x = next;
+	}
+	return removed;
+}
@@ -0,0 +1,73 @@
+#include "../headers/SlabAllocator.h"
+#include <new>
+
+// Classes step by 8 bytes up to 256, then by 32 bytes up to MAX_SLAB_SIZE.
+static const size_t FINE_LIMIT = 256;
+static const size_t FINE_STEP = 8;
+static const size_t COARSE_STEP = 32;
+static const size_t CLASS_COUNT = FINE_LIMIT / FINE_STEP + (SlabAllocator::MAX_SLAB_SIZE - FINE_LIMIT) / COARSE_STEP;
+
+SlabAllocator::SlabAllocator() : freeLists(CLASS_COUNT, nullptr) {}
+
+SlabAllocator::~SlabAllocator()
+{
+	for (char* page : pages) {
+		::operator delete(page);
+	}
+}
+
+size_t SlabAllocator::classIndex(size_t size)
+{
+	if (size <= FINE_LIMIT) {
+		return (size + FINE_STEP - 1) / FINE_STEP - 1;
+	}
+	return FINE_LIMIT / FINE_STEP + (size - FINE_LIMIT + COARSE_STEP - 1) / COARSE_STEP - 1;
+}
+
+size_t SlabAllocator::blockSize(size_t size)
+{
+	if (size == 0) size = 1;
+	if (size > MAX_SLAB_SIZE) {
+		return (size + 15) & ~static_cast<size_t>(15);
+	}
+	if (size <= FINE_LIMIT) {
+		return (size + FINE_STEP - 1) / FINE_STEP * FINE_STEP;
+	}
+	return (size + COARSE_STEP - 1) / COARSE_STEP * COARSE_STEP;
+}
+
+void* SlabAllocator::allocate(size_t size)
+{
+	if (size > MAX_SLAB_SIZE) {
+		return ::operator new(size);
+	}
+
+	size_t index = classIndex(size == 0 ? 1 : size);
+	if (FreeBlock* block = freeLists[index]) {
+		freeLists[index] = block->next;
+		return block;
+	}
+
+	size_t bytes = blockSize(size);
+	if (static_cast<size_t>(pageEnd - pageCursor) < bytes) {
+		// The tail of the old page is abandoned; at most MAX_SLAB_SIZE per page.
+		pageCursor = static_cast<char*>(::operator new(PAGE_SIZE));
+		pageEnd = pageCursor + PAGE_SIZE;
+		pages.push_back(pageCursor);
+	}
+	void* p = pageCursor;
+	pageCursor += bytes;
+	return p;
+}
+
+void SlabAllocator::deallocate(void* p, size_t size)
+{
+	if (size > MAX_SLAB_SIZE) {
+		::operator delete(p);
+		return;
+	}
+	size_t index = classIndex(size == 0 ? 1 : size);
+	FreeBlock* block = static_cast<FreeBlock*>(p);
+	block->next = freeLists[index];
+	freeLists[index] = block;
+}
@@ -0,0 +1,136 @@
+#include "../headers/SlowLog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+SlowLog::SlowLog(size_t capacity, long long slowerThanMicros)
+	: capacity(capacity), slots(std::make_unique<Slot[]>(capacity)), slowerThan(slowerThanMicros) {}
+
+SlowLog::~SlowLog() = default;
+
+// Appends a uint16 length and the bytes of part + suffix to data.
+static void appendArg(char* data, uint16_t& length, std::string_view part, std::string_view suffix = std::string_view())
+{
+	uint16_t size = static_cast<uint16_t>(part.size() + suffix.size());
+	std::memcpy(data + length, &size, sizeof(size));
+	std::memcpy(data + length + sizeof(size), part.data(), part.size());
+	if (!suffix.empty()) {
+		std::memcpy(data + length + sizeof(size) + part.size(), suffix.data(), suffix.size());
+	}
+	length = static_cast<uint16_t>(length + sizeof(size) + size);
+}
+
+void SlowLog::record(const std::vector<std::string_view>& args, uint64_t durationMicros, std::string_view peer)
+{
+	// Room always left for the "... (N more arguments)" marker.
+	const size_t MARKER_BYTES = 40;
+
+	long long limit = slowerThan.load(std::memory_order_relaxed);
+	if (limit < 0 || capacity == 0 || durationMicros < static_cast<uint64_t>(limit)) {
+		return;
+	}
+
+	uint64_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = slots[id % capacity];
+	uint64_t current = slot.stamp.load(std::memory_order_relaxed);
+	do {
+		// Still being written, or already holds a newer entry.
+		if ((current & 1) || current >= 2 * id + 2) return;
+	} while (!slot.stamp.compare_exchange_weak(current, 2 * id + 1, std::memory_order_relaxed));
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Record& r = slot.record;
+	r.timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	r.durationMicros = durationMicros;
+	r.peerLength = static_cast<uint8_t>(std::min(peer.size(), PEER_BYTES));
+	std::memcpy(r.peer, peer.data(), r.peerLength);
+
+	uint16_t length = 0;
+	size_t stored = 0;
+	char suffix[48];
+	for (size_t i = 0; i < args.size(); ++i) {
+		std::string_view arg = args[i];
+		std::string_view tail;
+		if (arg.size() > MAX_ARG_BYTES) {
+			int n = std::snprintf(suffix, sizeof(suffix), "... (%zu more bytes)", arg.size() - MAX_ARG_BYTES);
+			tail = std::string_view(suffix, static_cast<size_t>(n));
+			arg = arg.substr(0, MAX_ARG_BYTES);
+		}
+		bool last = i + 1 == args.size();
+		bool fits = length + sizeof(uint16_t) + arg.size() + tail.size() + (last ? 0 : MARKER_BYTES) <= DATA_BYTES;
+		if (!fits || (stored == MAX_ARGS - 1 && !last)) {
+			int n = std::snprintf(suffix, sizeof(suffix), "... (%zu more arguments)", args.size() - i);
+			appendArg(r.data, length, std::string_view(suffix, static_cast<size_t>(n)));
+			++stored;
+			break;
+		}
+		appendArg(r.data, length, arg, tail);
+		++stored;
+	}
+	r.dataLength = length;
+	r.argCount = static_cast<uint8_t>(stored);
+
+	slot.stamp.store(2 * id + 2, std::memory_order_release);
+}
+
+bool SlowLog::readSlot(const Slot& slot, uint64_t& id, Record& out) const
+{
+	uint64_t before = slot.stamp.load(std::memory_order_acquire);
+	if (before == 0 || (before & 1)) {
+		return false;
+	}
+	std::memcpy(&out, &slot.record, sizeof(Record));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.stamp.load(std::memory_order_relaxed) != before) {
+		return false; // overwritten while we copied it
+	}
+	id = before / 2 - 1;
+	return id >= resetId.load(std::memory_order_relaxed);
+}
+
+std::vector<SlowLog::Entry> SlowLog::get(long long count) const
+{
+	std::vector<Entry> entries;
+	auto record = std::make_unique<Record>();
+	for (size_t i = 0; i < capacity; ++i) {
+		uint64_t id = 0;
+		if (!readSlot(slots[i], id, *record)) continue;
+
+		Entry entry;
+		entry.id = id;
+		entry.timestamp = record->timestamp;
+		entry.durationMicros = record->durationMicros;
+		entry.peer.assign(record->peer, record->peerLength);
+		size_t pos = 0;
+		for (uint8_t a = 0; a < record->argCount; ++a) {
+			uint16_t size = 0;
+			std::memcpy(&size, record->data + pos, sizeof(size));
+			entry.args.emplace_back(record->data + pos + sizeof(size), size);
+			pos += sizeof(size) + size;
+		}
+		entries.push_back(std::move(entry));
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.id > b.id; });
+	if (count >= 0 && entries.size() > static_cast<size_t>(count)) {
+		entries.resize(static_cast<size_t>(count));
+	}
+	return entries;
+}
+
+size_t SlowLog::length() const
+{
+	size_t n = 0;
+	auto record = std::make_unique<Record>();
+	for (size_t i = 0; i < capacity; ++i) {
+		uint64_t id = 0;
+		if (readSlot(slots[i], id, *record)) ++n;
+	}
+	return n;
+}
+
+void SlowLog::reset()
+{
+	resetId.store(nextId.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
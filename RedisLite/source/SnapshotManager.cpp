@@ -0,0 +1,388 @@
+#include "../headers/SnapshotManager.h"
+#include "../headers/CachedClock.h"
+#include "../headers/Checksum.h"
+#include "../headers/FileCompat.h"
+#include "../headers/LZF.h"
+#include "../headers/Logger.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+static const char MAGIC[4] = { 'R', 'L', 'D', 'B' };
+// Version 1 files hold only strings and read the same under version 2.
+static const uint8_t FORMAT_VERSION = 2;
+static const uint8_t MIN_FORMAT_VERSION = 1;
+static const uint8_t FLAG_COMPRESSED = 0x01;
+static const uint8_t RECORD_PLAIN = 0;
+static const uint8_t RECORD_EXPIRES = 1;
+static const uint8_t RECORD_TYPE_SHIFT = 1;
+static const size_t BLOCK_SIZE = 64 * 1024;
+static const size_t MIN_COMPRESS_SIZE = 64;
+
+static void putU32(std::string& out, uint32_t v) {
+	for (int i = 0; i < 4; ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+static void putU64(std::string& out, uint64_t v) {
+	for (int i = 0; i < 8; ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+static void putVarint(std::string& out, uint64_t v) {
+	while (v >= 0x80) {
+		out += static_cast<char>((v & 0x7F) | 0x80);
+		v >>= 7;
+	}
+	out += static_cast<char>(v);
+}
+
+static uint32_t getU32(const unsigned char* p) {
+	uint32_t v = 0;
+	for (int i = 3; i >= 0; --i) v = (v << 8) | p[i];
+	return v;
+}
+
+static uint64_t getU64(const unsigned char* p) {
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+	return v;
+}
+
+static bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+	v = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7) {
+		unsigned char b = *p++;
+		v |= static_cast<uint64_t>(b & 0x7F) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+// Buffers records into blocks, compresses them if asked, and keeps the
+// running checksum of everything written.
+class SnapshotWriter {
+private:
+	int fd;
+	bool compress;
+	uint32_t crc = 0;
+	std::string block;
+	std::string frame;
+	std::vector<char> scratch;
+
+	bool writeRaw(const std::string& data) {
+		crc = crc32(crc, data.data(), data.size());
+		return writeAll(fd, data.data(), data.size());
+	}
+
+public:
+	SnapshotWriter(int fileFd, bool useCompression) : fd(fileFd), compress(useCompression) {
+		block.reserve(BLOCK_SIZE + 1024);
+	}
+
+	bool writeHeader(uint64_t keyCountHint) {
+		std::string header(MAGIC, sizeof(MAGIC));
+		header += static_cast<char>(FORMAT_VERSION);
+		header += static_cast<char>(compress ? FLAG_COMPRESSED : 0);
+		putU64(header, keyCountHint);
+		return writeRaw(header);
+	}
+
+	bool addEntry(const std::string& key, const KVPair& entry) {
+		uint8_t type = static_cast<uint8_t>(static_cast<uint8_t>(entry.type) << RECORD_TYPE_SHIFT);
+		block += static_cast<char>(type | (entry.expireAt.has_value() ? RECORD_EXPIRES : RECORD_PLAIN));
+		putVarint(block, key.size());
+		block += key;
+		if (entry.type == ValueType::STRING) {
+			char intBuffer[KVPair::INT_BUFFER_SIZE];
+			std::string_view value = entry.valueView(intBuffer);
+			putVarint(block, value.size());
+			block += value;
+		}
+		else {
+			putVarint(block, entry.elements.size());
+			for (const std::string& element : entry.elements) {
+				putVarint(block, element.size());
+				block += element;
+			}
+		}
+		if (entry.expireAt.has_value()) {
+			putU64(block, static_cast<uint64_t>(entry.expireAt.value()));
+		}
+		return block.size() < BLOCK_SIZE || flushBlock();
+	}
+
+	bool flushBlock() {
+		if (block.empty()) return true;
+
+		frame.clear();
+		putU32(frame, static_cast<uint32_t>(block.size()));
+		size_t stored = 0;
+		if (compress && block.size() >= MIN_COMPRESS_SIZE) {
+			scratch.resize(block.size());
+			// Only keep the compressed form if it actually saves space.
+			stored = lzfCompress(block.data(), block.size(), scratch.data(), block.size() - 1);
+		}
+		if (stored > 0) {
+			putU32(frame, static_cast<uint32_t>(stored));
+			frame.append(scratch.data(), stored);
+		}
+		else {
+			putU32(frame, static_cast<uint32_t>(block.size()));
+			frame += block;
+		}
+		block.clear();
+		return writeRaw(frame);
+	}
+
+	bool finish() {
+		if (!flushBlock()) return false;
+		std::string trailer;
+		putU32(trailer, 0);
+		putU32(trailer, 0);
+		if (!writeRaw(trailer)) return false;
+		std::string checksum;
+		putU32(checksum, crc);
+		return writeAll(fd, checksum.data(), checksum.size());
+	}
+};
+
+// Reads exactly len bytes, folding them into crc.
+static bool readExact(int fd, void* data, size_t len, uint32_t& crc, uint64_t& total) {
+	char* p = static_cast<char*>(data);
+	size_t left = len;
+	while (left > 0) {
+		long long n = readSome(fd, p, left);
+		if (n <= 0) return false;
+		p += n;
+		left -= static_cast<size_t>(n);
+	}
+	crc = crc32(crc, data, len);
+	total += len;
+	return true;
+}
+
+SnapshotManager::SnapshotManager(const std::string& path, bool compress) : filePath(path), compression(compress) {}
+
+SnapshotManager::~SnapshotManager() {
+	std::lock_guard<std::mutex> lock(saveMtx);
+	if (saveThread.joinable()) {
+		saveThread.join();
+	}
+}
+
+bool SnapshotManager::hasSnapshotMagic(const char* data, size_t len) {
+	return len >= sizeof(MAGIC) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool SnapshotManager::writeSnapshot(KeyValueStore& store, int fd, bool compress, size_t& keysWritten,
+	const std::function<void(size_t shard)>& shardCopied) {
+	SnapshotWriter writer(fd, compress);
+	keysWritten = 0;
+
+	if (!writer.writeHeader(store.size())) return false;
+
+	std::vector<std::pair<std::string, KVPair>> entries;
+	for (size_t shard = 0; shard < store.shardCount(); ++shard) {
+		store.snapshotShard(shard, entries, [&] { if (shardCopied) shardCopied(shard); });
+		for (const auto& entry : entries) {
+			if (!writer.addEntry(entry.first, entry.second)) return false;
+		}
+		keysWritten += entries.size();
+	}
+	return writer.finish();
+}
+
+bool SnapshotManager::readSnapshot(KeyValueStore& store, int fd, uint64_t& bytesRead, size_t& keysLoaded) {
+	uint32_t crc = 0;
+	bytesRead = 0;
+	keysLoaded = 0;
+	int64_t now = CachedClock::update();
+
+	unsigned char header[HEADER_SIZE];
+	if (!readExact(fd, header, sizeof(header), crc, bytesRead) ||
+		!hasSnapshotMagic(reinterpret_cast<const char*>(header), sizeof(header))) {
+		Logger::warning("[RDB] Not a snapshot file.");
+		return false;
+	}
+	if (header[4] < MIN_FORMAT_VERSION || header[4] > FORMAT_VERSION) {
+		Logger::warning("[RDB] Unsupported snapshot version ", static_cast<int>(header[4]), ".");
+		return false;
+	}
+	store.reserve(static_cast<size_t>(getU64(header + 6)));
+
+	std::vector<unsigned char> stored;
+	std::vector<unsigned char> raw;
+	while (true) {
+		unsigned char frame[8];
+		if (!readExact(fd, frame, sizeof(frame), crc, bytesRead)) {
+			Logger::warning("[RDB] Unexpected end of snapshot.");
+			return false;
+		}
+		uint32_t rawLength = getU32(frame);
+		uint32_t storedLength = getU32(frame + 4);
+		if (rawLength == 0 && storedLength == 0) break;
+		if (storedLength > rawLength) {
+			Logger::warning("[RDB] Corrupt block header.");
+			return false;
+		}
+
+		stored.resize(storedLength);
+		if (!readExact(fd, stored.data(), storedLength, crc, bytesRead)) {
+			Logger::warning("[RDB] Unexpected end of snapshot.");
+			return false;
+		}
+		const unsigned char* p = stored.data();
+		if (storedLength < rawLength) {
+			raw.resize(rawLength);
+			if (lzfDecompress(stored.data(), storedLength, raw.data(), rawLength) != rawLength) {
+				Logger::warning("[RDB] Corrupt compressed block.");
+				return false;
+			}
+			p = raw.data();
+		}
+		const unsigned char* end = p + rawLength;
+
+		// Reads one varint-prefixed string at p.
+		auto getString = [&p, end](std::string_view& out) {
+			uint64_t length = 0;
+			if (!getVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) return false;
+			out = std::string_view(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+			p += length;
+			return true;
+		};
+
+		while (p < end) {
+			uint8_t type = *p++;
+			uint8_t valueType = type >> RECORD_TYPE_SHIFT;
+			std::string_view keyView;
+			if (valueType > static_cast<uint8_t>(ValueType::ZSET) || !getString(keyView)) {
+				Logger::warning("[RDB] Corrupt record.");
+				return false;
+			}
+			KVPair entry;
+			entry.type = static_cast<ValueType>(valueType);
+			if (entry.type == ValueType::STRING) {
+				std::string_view value;
+				if (!getString(value)) {
+					Logger::warning("[RDB] Corrupt record.");
+					return false;
+				}
+				entry.setValue(value);
+			}
+			else {
+				uint64_t count = 0;
+				// Every element takes at least one byte, which bounds a corrupt count.
+				if (!getVarint(p, end, count) || count > static_cast<uint64_t>(end - p)) {
+					Logger::warning("[RDB] Corrupt record.");
+					return false;
+				}
+				entry.elements.reserve(static_cast<size_t>(count));
+				for (uint64_t i = 0; i < count; ++i) {
+					std::string_view element;
+					if (!getString(element)) {
+						Logger::warning("[RDB] Corrupt record.");
+						return false;
+					}
+					entry.elements.emplace_back(element);
+				}
+			}
+			std::string key(keyView);
+			if (type & RECORD_EXPIRES) {
+				if (end - p < 8) {
+					Logger::warning("[RDB] Corrupt record.");
+					return false;
+				}
+				entry.expireAt = static_cast<int64_t>(getU64(p));
+				p += 8;
+				if (entry.expireAt.value() <= now) continue; // expired while on disk
+			}
+			store.restore(std::move(key), std::move(entry));
+			++keysLoaded;
+		}
+	}
+
+	unsigned char checksum[4];
+	uint32_t expected = crc;
+	uint32_t ignored = 0;
+	if (!readExact(fd, checksum, sizeof(checksum), ignored, bytesRead) || getU32(checksum) != expected) {
+		Logger::warning("[RDB] Snapshot checksum mismatch.");
+		return false;
+	}
+	return true;
+}
+
+bool SnapshotManager::saveToFile(KeyValueStore& store) {
+	auto started = std::chrono::steady_clock::now();
+	std::string tmpPath = filePath + ".tmp";
+
+	int fd = openForWrite(tmpPath);
+	if (fd == -1) {
+		Logger::warning("[RDB] Failed to create ", tmpPath);
+		return false;
+	}
+
+	size_t keys = 0;
+	bool ok = writeSnapshot(store, fd, compression, keys) && syncFile(fd);
+	closeFile(fd);
+
+	std::error_code ec;
+	if (ok) {
+		std::filesystem::rename(tmpPath, filePath, ec);
+		ok = !ec;
+	}
+	if (!ok) {
+		Logger::warning("[RDB] Failed to write snapshot to ", filePath);
+		std::filesystem::remove(tmpPath, ec);
+		return false;
+	}
+
+	auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+	Logger::notice("[RDB] Saved ", keys, " keys to ", filePath, " in ", elapsedMs, " ms.");
+	lastSaveTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	return true;
+}
+
+bool SnapshotManager::save(KeyValueStore& store) {
+	if (saving.exchange(true)) {
+		return false;
+	}
+	bool ok = saveToFile(store);
+	saving = false;
+	return ok;
+}
+
+bool SnapshotManager::startBackgroundSave(KeyValueStore& store) {
+	std::lock_guard<std::mutex> lock(saveMtx);
+	if (saving.exchange(true)) {
+		return false;
+	}
+	if (saveThread.joinable()) {
+		saveThread.join(); // previous BGSAVE, already finished
+	}
+	saveThread = std::thread([this, &store] {
+		saveToFile(store);
+		saving = false;
+	});
+	return true;
+}
+
+bool SnapshotManager::loadFromFile(KeyValueStore& store) {
+	int fd = openForRead(filePath);
+	if (fd == -1) {
+		return false;
+	}
+
+	auto started = std::chrono::steady_clock::now();
+	uint64_t bytes = 0;
+	size_t keys = 0;
+	bool ok = readSnapshot(store, fd, bytes, keys);
+	closeFile(fd);
+
+	if (ok) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+		if (seconds <= 0) seconds = 1e-9;
+		Logger::notice("[RDB] Loaded ", keys, " keys (", bytes, " bytes) from ", filePath, " in ",
+			static_cast<uint64_t>(seconds * 1000), " ms: ", static_cast<uint64_t>((bytes >> 20) / seconds), " MB/s.");
+	}
+	return ok;
+}
\ No newline at end of file
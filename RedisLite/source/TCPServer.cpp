@@ -1,18 +1,55 @@
 #include "../headers/TCPServer.h"
+#include "../headers/CommandHandlers.h"
+#include "../headers/CachedClock.h"
 #include "../headers/CommandParser.h"
+#include "../headers/LatencyMonitor.h"
+#include "../headers/Logger.h"
+#include "../headers/Metrics.h"
 #include "../headers/ResponseFormatter.h"
 
-#include <iostream>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 #include <chrono>
 #include <thread>
 #include <sstream>
 
-#pragma comment(lib, "ws2_32.lib")
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
-TCPServer::TCPServer(KeyValueStore& store, AOFManager* aof) :
-	kvStore(store), aofManager(aof), running(false) , port(0), serverSocket(INVALID_SOCKET) {}
+static const size_t MAX_IDLE_READ_BUFFER = 64 * 1024;
+// Bytes the epoll model reads from one connection before it serves the
+// others; what is left is read on the loop's next pass.
+static const size_t READ_BUDGET = 64 * 1024;
+// A subscriber whose unsent output passes this is disconnected, like Redis'
+// client-output-buffer-limit for pub/sub clients.
+static const size_t PUBSUB_OUTPUT_LIMIT = 32 * 1024 * 1024;
+
+// Moves the messages published to conn into its output buffer, by reference.
+static void queuePublished(Connection& conn) {
+	thread_local std::vector<PubSub::Message> messages;
+	conn.subscriber->take(messages);
+	for (PubSub::Message& message : messages) {
+		conn.output.appendShared(std::move(message));
+	}
+	messages.clear();
+}
+
+TCPServer::TCPServer(KeyValueStore& store, AOFManager* aof, SnapshotManager* snapshot, const ServerConfig& cfg) :
+	serverSocket(INVALID_SOCKET), port(0), kvStore(store), aofManager(aof), snapshotManager(snapshot), config(cfg), running(false),
+	slowLog(static_cast<size_t>(cfg.slowlogMaxLen), cfg.slowlogLogSlowerThan),
+	tracking(static_cast<size_t>(cfg.trackingTableMaxKeys)), primaryLink(INVALID_SOCKET, "primary") {
+	primaryLink.fromPrimary = true;
+	kvStore.setExpiryListener([this](std::string_view key) {
+		if (tracking.active()) tracking.invalidate(key, 0);
+	});
+	// The primary's stream runs through the normal command path; its replies are dropped.
+	replication = std::make_unique<ReplicationManager>(store, aof, cfg.dbFilename, cfg.replBacklogSize, [this](const Command& cmd) {
+		executeCommand(cmd, primaryLink);
+		primaryLink.output.consume(primaryLink.output.size());
+		tracking.flush();
+		primaryLink.pendingAofSeq = 0;
+	});
+}
 
 TCPServer::~TCPServer() {
 	stop();
@@ -22,23 +59,23 @@ bool TCPServer::start(int port) {
 	this->port = port;
 	running = true;
 
-	WSADATA wsaData;
-	int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (result != 0) {
-		std::cerr << "WSAStartup failed: " << result << std::endl;
+	if (!initSockets()) {
+		Logger::warning("Socket library initialization failed: ", lastSocketError());
+		running = false;
 		return false;
 	}
 
 	serverSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if (serverSocket == INVALID_SOCKET) {
-		std::cerr << "Socket creation failed: " << WSAGetLastError() << std::endl;
-		WSACleanup();
+		Logger::warning("Socket creation failed: ", lastSocketError());
+		cleanupSockets();
+		running = false;
 		return false;
 	}
 
 	int opt = 1;
 	if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt)) == SOCKET_ERROR) {
-		std::cerr << "setsockopt(SO_REUSEADDR) failed: " << WSAGetLastError() << std::endl;
+		Logger::warning("setsockopt(SO_REUSEADDR) failed: ", lastSocketError());
 	}
 	sockaddr_in service{};
 	service.sin_family = AF_INET;
@@ -46,51 +83,94 @@ bool TCPServer::start(int port) {
 	service.sin_port = htons(static_cast<u_short>(port));
 
 	if (bind(serverSocket, reinterpret_cast<sockaddr*>(&service), sizeof(service)) == SOCKET_ERROR) {
-		std::cerr << "Bind failed: " << WSAGetLastError() << std::endl;
+		Logger::warning("Bind failed: ", lastSocketError());
 		closesocket(serverSocket);
-		WSACleanup();
+		serverSocket = INVALID_SOCKET;
+		cleanupSockets();
+		running = false;
 		return false;
 	}
 
 	if (listen(serverSocket, SOMAXCONN) == SOCKET_ERROR) {
-		std::cerr << "Listen failed: " << WSAGetLastError() << std::endl;
+		Logger::warning("Listen failed: ", lastSocketError());
 		closesocket(serverSocket);
-		WSACleanup();
+		serverSocket = INVALID_SOCKET;
+		cleanupSockets();
+		running = false;
 		return false;
 	}
 
-	if (aofManager && aofManager->loadFromFile(kvStore)) {
-		std::cout << "[AOF] Loaded data from AOF." << std::endl;
+	cronThread = std::thread(&TCPServer::serverCron, this);
+	replication->setListeningPort(port);
+	if (!config.replicaOfHost.empty()) {
+		replication->replicaOf(config.replicaOfHost, config.replicaOfPort);
 	}
-	else {
-		std::cout << "[AOF] No AOF data loaded (file missing or empty)." << std::endl;
+	if (config.metricsPort > 0) {
+		metricsEndpoint = std::make_unique<MetricsEndpoint>([this]() { return buildMetrics(); });
+		if (!metricsEndpoint->start(config.metricsPort)) {
+			metricsEndpoint.reset();
+		}
+	}
+
+#ifdef __linux__
+	if (config.ioModel == IOModel::EPOLL) {
+		if (!startEventLoops()) {
+			stop();
+			return false;
+		}
+		Logger::notice("RedisLite listening on port ", port, " (epoll, ", eventLoops.size(), " event loops)");
+		return true;
 	}
+#endif
 
 	acceptThread = std::thread(&TCPServer::acceptClients, this);
-	std::cout << "RedisLite listening on port " << port << std::endl;
+	Logger::notice("RedisLite listening on port ", port, " (thread per client)");
 	return true;
 }
 
+// Periodic housekeeping that does not belong to any connection.
+void TCPServer::serverCron() {
+	while (running.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		Metrics::sampleRates();
+		CachedClock::update();
+		replication->cron();
+		tracking.flush(); // keys removed by active expiry
+	}
+}
+
 void TCPServer::acceptClients() {
 	while (running.load()) {
 		sockaddr_in clientAddr;
-		int addrlen = sizeof(clientAddr);
+		socklen_t addrlen = sizeof(clientAddr);
 		SOCKET clientSocket = accept(serverSocket, reinterpret_cast<sockaddr*>(&clientAddr), &addrlen);
 
 		if (clientSocket == INVALID_SOCKET) {
-			int err = WSAGetLastError();
+			int err = lastSocketError();
 			if (!running.load()) {
 				break;
 			}
-			std::cerr << "accept() failed: " << err << std::endl;
+			static Logger::RateLimit acceptLimit;
+			Logger::logLimited(acceptLimit, LogLevel::WARNING, "accept() failed: ", err);
 			std::this_thread::sleep_for(std::chrono::milliseconds(100));
 			continue;
 		}
+		{
+			std::lock_guard<std::mutex> lock(clientsMtx);
+			clientSockets.insert(clientSocket);
+		}
 		workers.emplace_back(&TCPServer::handleClient, this, clientSocket);
 	}
 }
 
 void TCPServer::cleanupThreads() {
+	{
+		// Unblock workers that are parked in recv().
+		std::lock_guard<std::mutex> lock(clientsMtx);
+		for (SOCKET s : clientSockets) {
+			shutdown(s, SHUT_RDWR);
+		}
+	}
 	for (auto& t : workers) {
 		if (t.joinable()) {
 			t.join();
@@ -104,108 +184,1725 @@ void TCPServer::stop() {
 	running = false;
 
 	if (serverSocket != INVALID_SOCKET) {
+		shutdown(serverSocket, SHUT_RDWR);
 		closesocket(serverSocket);
 		serverSocket = INVALID_SOCKET;
 	}
 
+	replication->stop();
 	if (acceptThread.joinable()) {
 		acceptThread.join();
 	}
 	cleanupThreads();
-	WSACleanup();
-	std::cout << "RedisLite server stopped." << std::endl;
+#ifdef __linux__
+	stopEventLoops();
+#endif
+	if (metricsEndpoint) {
+		metricsEndpoint->stop();
+		metricsEndpoint.reset();
+	}
+	if (cronThread.joinable()) {
+		cronThread.join();
+	}
+	cleanupSockets();
+	Logger::notice("RedisLite server stopped.");
 }
 
 void TCPServer::handleClient(SOCKET clientSocket) {
-	sockaddr_in addr;
-	int len = sizeof(addr);
-	getpeername(clientSocket, reinterpret_cast<sockaddr*>(&addr), &len);
-
-	char clientIp[INET_ADDRSTRLEN];
-	if (InetNtopA(AF_INET, &addr.sin_addr, clientIp, INET_ADDRSTRLEN)) {
-		std::cout << "Client connected: " << clientIp << ":" << ntohs(addr.sin_port) << std::endl;
-	}
-	else {
-		std::cerr << "Failed to convert client IP address." << std::endl;
-	}
+	Connection conn(clientSocket, peerAddress(clientSocket));
+	setNoDelay(clientSocket);
+	registerClient(conn);
+	Metrics::clientConnected();
+	Logger::verbose("Client connected: ", conn.peer);
 
-	std::string buffer;
+	ThreadMetrics& metrics = Metrics::local();
 	const int BUF_SIZE = 4096;
 	std::vector<char> temp(BUF_SIZE);
+	conn.notifyOwner = [this, &conn]() { sendPublished(conn); };
 
 	while (running.load()) {
 		int bytesRead = recv(clientSocket, temp.data(), static_cast<int>(temp.size()), 0);
 
 		if (bytesRead == 0) break;
 		if (bytesRead == SOCKET_ERROR) {
-			int err = WSAGetLastError();
-			std::cerr << "recv() failed: " << err << std::endl;
+			int err = lastSocketError();
+			if (isInterrupted(err)) continue;
+			if (running.load()) {
+				static Logger::RateLimit recvLimit;
+				Logger::logLimited(recvLimit, LogLevel::WARNING, "recv() failed: ", err);
+			}
+			break;
+		}
+
+		bump(metrics.bytesIn, static_cast<uint64_t>(bytesRead));
+		conn.readBuffer.append(temp.data(), bytesRead);
+		{
+			std::lock_guard<std::mutex> lock(conn.sendMtx);
+			conn.ownerBusy = true;
+		}
+		bool ok = processInput(conn) && !queryBufferExceeded(conn);
+		{
+			// Messages published meanwhile go out after this batch's replies.
+			std::lock_guard<std::mutex> lock(conn.sendMtx);
+			conn.ownerBusy = false;
+			if (conn.subscriber) queuePublished(conn);
+			ok = ok && flushOutput(conn);
+		}
+		if (!ok || conn.replicaHandoff || conn.closeAfterReply) {
 			break;
 		}
+	}
+
+	dropSubscriptions(conn);
+	{
+		std::lock_guard<std::mutex> lock(clientsMtx);
+		clientSockets.erase(clientSocket);
+	}
+	Metrics::clientDisconnected();
+	if (conn.replicaHandoff) {
+		replication->attachReplica(clientSocket, conn.peer, conn.psyncReplid, conn.psyncOffset, conn.replicaListeningPort);
+		return;
+	}
+	closesocket(clientSocket);
+	Logger::verbose("Client disconnected: ", conn.peer);
+}
+
+// Thread-per-client model: an idle client's thread is blocked in recv, so the
+// publishing thread sends the messages itself. While the client's thread is
+// busy it leaves them queued for that thread to send after its replies. A
+// subscriber that stops reading stalls its publishers here; the epoll model
+// queues instead.
+void TCPServer::sendPublished(Connection& conn) {
+	std::lock_guard<std::mutex> lock(conn.sendMtx);
+	if (conn.ownerBusy || !conn.subscriber) return;
+	queuePublished(conn);
+	flushOutput(conn);
+}
+
+// Parses and executes every complete command in conn.readBuffer, queueing the
+// replies in conn.output for the caller to flush once per read batch (or
+// earlier, when config.flushThreshold is reached). Commands are parsed in place
+// and consumed by advancing readOffset; the buffer is compacted once per call,
+// not per command. Returns false if a threshold flush failed.
+//
+// With latency tracking on, parsing and execution are timed per command into
+// the calling thread's metrics; with it off only call counts are kept.
+// Execution is also timed whenever the slow log or latency monitor needs it.
+bool TCPServer::processInput(Connection& conn) {
+	std::string& buffer = conn.readBuffer;
+	ParseResult result;
+	bool ok = true;
+	ThreadMetrics& metrics = Metrics::local();
+	bool trackLatency = Metrics::trackingLatency();
+	bool timed = trackLatency || slowLog.enabled() || LatencyMonitor::enabled();
+	CachedClock::update(); // one clock read per batch, shared by every key lookup in it
+
+	while (conn.readOffset < buffer.size()) {
+		std::string_view pending(buffer.data() + conn.readOffset, buffer.size() - conn.readOffset);
+		Metrics::Clock::time_point parseStart;
+		if (trackLatency) parseStart = Metrics::Clock::now();
+		CommandParser::parseCommand(pending, result);
+
+		if (result.status == ParseResult::Status::INCOMPLETE) break;
+
+		if (result.status == ParseResult::Status::ERR) {
+			conn.output.append(ResponseFormatter::Error(result.errorMessage));
+			if (result.bytesConsumed == 0) {
+				// Broken framing: there is no way to find the next command.
+				conn.readOffset = buffer.size();
+				conn.closeAfterReply = true;
+				break;
+			}
+			conn.readOffset += result.bytesConsumed;
+			continue;
+		}
+
+		size_t id = CommandParser::commandId(*result.command.spec);
+		if (timed) {
+			Metrics::Clock::time_point parsed = Metrics::Clock::now();
+			executeCommand(result.command, conn);
+			uint64_t nanos = Metrics::nanosBetween(parsed, Metrics::Clock::now());
+			if (trackLatency) {
+				metrics.stages[ThreadMetrics::PARSE].record(Metrics::nanosBetween(parseStart, parsed));
+				metrics.stages[ThreadMetrics::EXECUTE].record(nanos);
+				metrics.recordCommand(id, nanos);
+			}
+			else {
+				metrics.countCommand(id);
+			}
+			slowLog.record(result.command.args, nanos / 1000, conn.peer);
+			LatencyMonitor::addSampleIfNeeded("command", nanos / 1000000);
+		}
+		else {
+			executeCommand(result.command, conn);
+			metrics.countCommand(id);
+		}
+		conn.readOffset += result.bytesConsumed;
+		if (conn.replicaHandoff) {
+			break; // the socket now belongs to replication
+		}
+
+		if (config.flushThreshold > 0 && conn.output.size() >= config.flushThreshold && !flushOutput(conn)) {
+			ok = false;
+			break;
+		}
+	}
+
+	if (conn.readOffset == buffer.size()) {
+		buffer.clear();
+		if (buffer.capacity() > MAX_IDLE_READ_BUFFER) {
+			buffer.shrink_to_fit(); // don't let one large request pin memory on an idle client
+		}
+		conn.readOffset = 0;
+	}
+	else if (conn.readOffset > 0) {
+		buffer.erase(0, conn.readOffset);
+		conn.readOffset = 0;
+	}
+	tracking.flush();
+	return ok;
+}
+
+// Called after processInput: whatever is still buffered is an incomplete
+// command, and one that has grown this large is not going to end.
+bool TCPServer::queryBufferExceeded(const Connection& conn) {
+	if (conn.readBuffer.size() <= config.clientQueryBufferLimit) return false;
+	static Logger::RateLimit limitLog;
+	Logger::logLimited(limitLog, LogLevel::WARNING, "Closing client ", conn.peer,
+		" that reached max query buffer length (", conn.readBuffer.size(), " bytes)");
+	return true;
+}
+
+// Writes as much of conn.output as the socket accepts, handing all queued
+// segments to one scatter-gather send per iteration. Returns false if the
+// connection failed; on a non-blocking socket the remainder stays queued.
+bool TCPServer::flushOutput(Connection& conn) {
+	const size_t MAX_IOV = 64;
+	std::string_view views[MAX_IOV];
+
+	if (conn.pendingAofSeq != 0) {
+		aofManager->waitForDurable(conn.pendingAofSeq);
+		conn.pendingAofSeq = 0;
+	}
+
+	if (!conn.hasPendingOutput()) {
+		return true;
+	}
+	ThreadMetrics& metrics = Metrics::local();
+	bool timed = Metrics::trackingLatency();
+	Metrics::Clock::time_point sendStart;
+	if (timed) sendStart = Metrics::Clock::now();
+
+	while (conn.hasPendingOutput()) {
+		size_t count = conn.output.gather(views, MAX_IOV);
+#ifdef _WIN32
+		WSABUF bufs[MAX_IOV];
+		for (size_t i = 0; i < count; ++i) {
+			bufs[i].buf = const_cast<char*>(views[i].data());
+			bufs[i].len = static_cast<ULONG>(views[i].size());
+		}
+		DWORD bytesSent = 0;
+		int rc = WSASend(conn.fd, bufs, static_cast<DWORD>(count), &bytesSent, 0, nullptr, nullptr);
+		long long sent = rc == SOCKET_ERROR ? -1 : static_cast<long long>(bytesSent);
+#else
+		iovec iov[MAX_IOV];
+		for (size_t i = 0; i < count; ++i) {
+			iov[i].iov_base = const_cast<char*>(views[i].data());
+			iov[i].iov_len = views[i].size();
+		}
+		// sendmsg rather than writev so MSG_NOSIGNAL suppresses SIGPIPE.
+		msghdr msg{};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+		long long sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+#endif
+
+		if (sent < 0) {
+			int err = lastSocketError();
+			if (isInterrupted(err)) continue;
+			if (isWouldBlock(err)) break;
+			static Logger::RateLimit sendLimit;
+			Logger::logLimited(sendLimit, LogLevel::WARNING, "send() failed: ", err);
+			return false;
+		}
+		bump(metrics.bytesOut, static_cast<uint64_t>(sent));
+		conn.output.consume(static_cast<size_t>(sent));
+	}
+	if (timed) {
+		metrics.stages[ThreadMetrics::SEND].record(Metrics::nanosBetween(sendStart, Metrics::Clock::now()));
+	}
+	return true;
+}
+
+// Queues a write command for the AOF and the replication stream. Under
+// appendfsync always the reply must not leave before the record is durable,
+// so remember its sequence number. A replica relays its primary's stream
+// byte for byte, so writes it applies from there are not propagated again.
+void TCPServer::logWrite(const Command& cmd, Connection& conn) {
+	if (!conn.fromPrimary) {
+		replication->propagate(cmd);
+	}
+	if (!aofManager) return;
+	uint64_t seq = aofManager->appendCommand(cmd);
+	if (seq != 0 && aofManager->syncBeforeReply()) {
+		conn.pendingAofSeq = seq;
+	}
+}
+
+// Counters are logged as the SET of their new value rather than the delta, so
+// replay does not depend on the value the key had before.
+void TCPServer::logResultingSet(std::string_view key, std::string_view value, Connection& conn) {
+	Command set;
+	set.type = CommandType::SET;
+	set.key = key;
+	set.value = value;
+	set.keepTtl = true;
+	logWrite(set, conn);
+}
+
+// Makes room under maxmemory before a command that may grow the dataset.
+// Evictions are logged as DELs so the AOF and replicas stay in step with
+// memory. A replica leaves eviction to its primary.
+bool TCPServer::ensureMemory(Connection& conn) {
+	if (conn.fromPrimary) return true;
+	bool ok = kvStore.evictIfNeeded([&](std::string_view key) {
+		if (tracking.active()) tracking.invalidate(key, 0);
+		Command del;
+		del.type = CommandType::DEL;
+		del.key = key;
+		logWrite(del, conn);
+	});
+	if (!ok) {
+		conn.output.append(ResponseFormatter::Error("OOM", "command not allowed when used memory > 'maxmemory'."));
+	}
+	return ok;
+}
+
+static bool isSubcommand(const CommandSpec& spec) {
+	return spec.name.find('|') != std::string_view::npos;
+}
+
+// One COMMAND INFO reply in Redis 7's layout: name, arity, flags, first key,
+// last key, key step, ACL categories, tips, key specs and subcommands.
+static void appendCommandInfo(OutputBuffer& out, const CommandSpec& spec) {
+	static const std::pair<uint32_t, const char*> flagNames[] = {
+		{ CMD_WRITE, "write" }, { CMD_READONLY, "readonly" }, { CMD_DENYOOM, "denyoom" },
+		{ CMD_ADMIN, "admin" }, { CMD_FAST, "fast" }, { CMD_PUBSUB, "pubsub" },
+	};
+	size_t flagCount = 0;
+	for (const auto& flag : flagNames) {
+		if (spec.flags & flag.first) ++flagCount;
+	}
+	out.append(ResponseFormatter::ArrayHeader(10));
+	out.append(ResponseFormatter::BulkString(std::string(spec.name)));
+	out.append(ResponseFormatter::Integer(spec.arity));
+	out.append(ResponseFormatter::ArrayHeader(flagCount));
+	for (const auto& flag : flagNames) {
+		if (spec.flags & flag.first) out.append(ResponseFormatter::SimpleString(flag.second));
+	}
+	out.append(ResponseFormatter::Integer(spec.firstKey));
+	out.append(ResponseFormatter::Integer(spec.lastKey));
+	out.append(ResponseFormatter::Integer(spec.keyStep));
+	out.append(ResponseFormatter::ArrayHeader(0));
+	out.append(ResponseFormatter::ArrayHeader(0));
+	out.append(ResponseFormatter::ArrayHeader(0));
+	if (!(spec.flags & CMD_CONTAINER)) {
+		out.append(ResponseFormatter::ArrayHeader(0));
+		return;
+	}
+	// Subcommands follow their container in the table.
+	size_t first = CommandParser::commandId(spec) + 1;
+	size_t last = first;
+	while (last < CommandParser::COMMAND_COUNT && isSubcommand(CommandParser::command(last))) ++last;
+	out.append(ResponseFormatter::ArrayHeader(last - first));
+	for (size_t i = first; i < last; ++i) {
+		appendCommandInfo(out, CommandParser::command(i));
+	}
+}
+
+static size_t topLevelCommandCount() {
+	size_t count = 0;
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		if (!isSubcommand(CommandParser::command(i))) ++count;
+	}
+	return count;
+}
+
+void TCPServer::registerClient(Connection& conn) {
+	conn.id = nextClientId.fetch_add(1, std::memory_order_relaxed);
+	tracking.addClient(conn.id);
+}
+
+// Tells tracking where this connection can be sent invalidations. It gets a
+// mailbox once it can receive them: in RESP3, or (in RESP2) subscribed to the
+// invalidation channel, which SUBSCRIBE has already given it a mailbox for.
+void TCPServer::updateEndpoint(Connection& conn) {
+	if (!conn.subscriber) {
+		if (!conn.resp3) return;
+		conn.subscriber = std::make_unique<PubSub::Subscriber>(conn.notifyOwner);
+	}
+	bool listening = conn.subscriber->channels.count(std::string(Tracking::CHANNEL)) > 0;
+	tracking.setEndpoint(conn.id, conn.subscriber.get(), conn.resp3, listening);
+}
+
+void TCPServer::dropSubscriptions(Connection& conn) {
+	tracking.removeClient(conn.id);
+	if (conn.subscriber) {
+		pubsub.unsubscribeAll(*conn.subscriber);
+	}
+}
+
+static bool allowedWhileSubscribed(CommandType type) {
+	switch (type) {
+		case CommandType::SUBSCRIBE: case CommandType::UNSUBSCRIBE:
+		case CommandType::PSUBSCRIBE: case CommandType::PUNSUBSCRIBE:
+		case CommandType::PING:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void appendSubscriptionReply(OutputBuffer& out, const char* kind, std::string_view name, size_t count) {
+	out.append(ResponseFormatter::ArrayHeader(3));
+	out.append(ResponseFormatter::BulkString(kind));
+	out.append(ResponseFormatter::BulkString(std::string(name)));
+	out.append(ResponseFormatter::Integer(static_cast<long long>(count)));
+}
+
+// Calls f with each key argument of cmd, at the positions its table entry declares.
+template <typename F>
+static void forEachKey(const Command& cmd, F&& f) {
+	const CommandSpec& spec = *cmd.spec;
+	if (spec.firstKey <= 0) return;
+	int size = static_cast<int>(cmd.args.size());
+	int last = spec.lastKey < 0 ? size + spec.lastKey : spec.lastKey;
+	for (int i = spec.firstKey; i <= last && i < size; i += spec.keyStep) {
+		f(cmd.args[i]);
+	}
+}
+
+static void appendTrackingRedirect(OutputBuffer& out, bool on, const Tracking::Options& options) {
+	out.append(ResponseFormatter::Integer(on ? static_cast<long long>(options.redirect) : -1));
+}
+
+static const char* counterError(KeyValueStore::CounterStatus status) {
+	switch (status) {
+		case KeyValueStore::CounterStatus::NOT_INTEGER: return "value is not an integer or out of range";
+		case KeyValueStore::CounterStatus::NOT_FLOAT: return "value is not a valid float";
+		case KeyValueStore::CounterStatus::NAN_OR_INFINITY: return "increment would produce NaN or Infinity";
+		default: return "increment or decrement would overflow";
+	}
+}
+
+static std::string humanBytes(long long bytes) {
+	std::ostringstream out;
+	out.setf(std::ios::fixed);
+	out.precision(2);
+	if (bytes >= (1LL << 30)) out << bytes / double(1LL << 30) << "G";
+	else if (bytes >= (1LL << 20)) out << bytes / double(1LL << 20) << "M";
+	else if (bytes >= (1LL << 10)) out << bytes / double(1LL << 10) << "K";
+	else out << bytes << "B";
+	return out.str();
+}
+
+// Latencies are reported in microseconds, like Redis' INFO latencystats.
+static std::string formatMicros(uint64_t nanos) {
+	std::ostringstream out;
+	out.setf(std::ios::fixed);
+	out.precision(3);
+	out << nanos / 1000.0;
+	return out.str();
+}
+
+static std::string latencyPercentiles(const HistogramSnapshot& h) {
+	return "p50=" + formatMicros(h.percentile(0.50)) + ",p99=" + formatMicros(h.percentile(0.99))
+		+ ",p99.9=" + formatMicros(h.percentile(0.999));
+}
+
+// Sections follow Redis: no argument or "default" gives the cheap sections,
+// "all"/"everything" adds commandstats and latencystats, and a section name
+// gives just that section.
+std::string TCPServer::buildInfo(std::string_view section) {
+	std::string wanted;
+	for (char c : section) {
+		wanted.push_back(static_cast<char>((c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c));
+	}
+	bool defaults = wanted.empty() || wanted == "default";
+	bool everything = wanted == "all" || wanted == "everything";
+	std::ostringstream info;
+	info.setf(std::ios::fixed);
+	info.precision(2);
+	bool first = true;
+	auto include = [&](const char* name, bool inDefault) {
+		if (!(everything || (defaults && inDefault) || wanted == name)) return false;
+		if (!first) info << "\r\n";
+		first = false;
+		return true;
+	};
+
+	KeyValueStore::ExpiryStats expiry = kvStore.expiryStats();
+	KeyValueStore::MemoryStats memory = kvStore.memoryStats();
+	bool histograms = everything || wanted == "commandstats" || wanted == "latencystats";
+	Metrics::Snapshot metrics = Metrics::snapshot(histograms);
+
+	if (include("clients", true)) {
+		info << "# Clients\r\n"
+			<< "connected_clients:" << metrics.connectedClients << "\r\n";
+	}
+	if (include("memory", true)) {
+		info << "# Memory\r\n"
+			<< "used_memory:" << memory.usedMemory << "\r\n"
+			<< "used_memory_human:" << humanBytes(memory.usedMemory) << "\r\n"
+			<< "maxmemory:" << memory.maxMemory << "\r\n"
+			<< "maxmemory_human:" << humanBytes(static_cast<long long>(memory.maxMemory)) << "\r\n"
+			<< "maxmemory_policy:" << KeyValueStore::policyName(memory.policy) << "\r\n"
+			<< "rehashing_shards:" << kvStore.rehashingShards() << "\r\n";
+	}
+	if (include("persistence", true)) {
+		info << "# Persistence\r\n"
+			<< "aof_enabled:" << (aofManager ? 1 : 0) << "\r\n";
+		if (aofManager) {
+			AOFManager::Stats aof = aofManager->stats();
+			info << "aof_rewrite_in_progress:" << (aof.rewriteInProgress ? 1 : 0) << "\r\n"
+				<< "aof_current_size:" << aof.currentSize << "\r\n"
+				<< "aof_base_size:" << aof.baseSize << "\r\n"
+				<< "aof_pending_records:" << aof.pendingRecords << "\r\n"
+				<< "aof_buffer_length:" << aof.pendingBytes << "\r\n";
+		}
+		info << "rdb_bgsave_in_progress:" << (snapshotManager && snapshotManager->isSaving() ? 1 : 0) << "\r\n"
+			<< "rdb_last_save_time:" << (snapshotManager ? snapshotManager->lastSave() : 0) << "\r\n";
+	}
+	if (include("stats", true)) {
+		Tracking::Stats trackingStats = tracking.stats();
+		info << "# Stats\r\n"
+			<< "total_connections_received:" << metrics.totalConnections << "\r\n"
+			<< "total_commands_processed:" << metrics.totalCommands << "\r\n"
+			<< "instantaneous_ops_per_sec:" << static_cast<uint64_t>(metrics.opsPerSec + 0.5) << "\r\n"
+			<< "total_net_input_bytes:" << metrics.bytesIn << "\r\n"
+			<< "total_net_output_bytes:" << metrics.bytesOut << "\r\n"
+			<< "evicted_keys:" << memory.evictedKeys << "\r\n"
+			<< "expired_keys:" << expiry.expiredKeys << "\r\n"
+			<< "expired_keys_active:" << expiry.activeExpiredKeys << "\r\n"
+			<< "expire_cycles:" << expiry.expireCycles << "\r\n"
+			<< "expired_time_cap_reached_count:" << expiry.timeCapReached << "\r\n"
+			<< "pubsub_channels:" << pubsub.channelCount() << "\r\n"
+			<< "pubsub_patterns:" << pubsub.patternCount() << "\r\n"
+			<< "tracking_clients:" << trackingStats.clients << "\r\n"
+			<< "tracking_total_keys:" << trackingStats.keys << "\r\n"
+			<< "tracking_total_prefixes:" << trackingStats.prefixes << "\r\n";
+	}
+	if (include("replication", true)) {
+		ReplicationManager::Info repl = replication->info();
+		info << "# Replication\r\n"
+			<< "role:" << (repl.replica ? "slave" : "master") << "\r\n";
+		if (repl.replica) {
+			info << "master_host:" << repl.primaryHost << "\r\n"
+				<< "master_port:" << repl.primaryPort << "\r\n"
+				<< "master_link_status:" << (repl.linkUp ? "up" : "down") << "\r\n"
+				<< "master_last_io_seconds_ago:" << repl.lastIoSecondsAgo << "\r\n"
+				<< "master_sync_in_progress:" << (repl.syncInProgress ? 1 : 0) << "\r\n";
+		}
+		info << "connected_slaves:" << repl.replicas.size() << "\r\n";
+		for (size_t i = 0; i < repl.replicas.size(); ++i) {
+			const ReplicationManager::ReplicaInfo& r = repl.replicas[i];
+			info << "slave" << i << ":ip=" << r.ip << ",port=" << r.port
+				<< ",state=" << (r.online ? "online" : "wait_bgsave")
+				<< ",offset=" << r.ackOffset << ",lag=" << r.lagSeconds << "\r\n";
+		}
+		info << "master_replid:" << repl.replid << "\r\n"
+			<< "master_replid2:" << (repl.replid2.empty() ? std::string(ReplicationManager::REPLID_LENGTH, '0') : repl.replid2) << "\r\n"
+			<< "master_repl_offset:" << repl.offset << "\r\n"
+			<< "second_repl_offset:" << repl.secondOffset << "\r\n"
+			<< "repl_backlog_active:" << (repl.backlogActive ? 1 : 0) << "\r\n"
+			<< "repl_backlog_size:" << repl.backlogSize << "\r\n"
+			<< "repl_backlog_first_byte_offset:" << repl.backlogFirstByte << "\r\n"
+			<< "repl_backlog_histlen:" << repl.backlogHistlen << "\r\n";
+	}
+	if (include("commandstats", false)) {
+		info << "# Commandstats\r\n";
+		for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+			const Metrics::CommandSnapshot& c = metrics.commands[i];
+			if (c.calls == 0) continue;
+			info << "cmdstat_" << CommandParser::command(i).name
+				<< ":calls=" << c.calls
+				<< ",usec=" << c.nanos / 1000
+				<< ",usec_per_call=" << c.nanos / 1000.0 / c.calls
+				<< ",ops_per_sec=" << c.opsPerSec << "\r\n";
+		}
+	}
+	if (include("latencystats", false)) {
+		info << "# Latencystats\r\n";
+		for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+			const Metrics::CommandSnapshot& c = metrics.commands[i];
+			if (c.latency.total == 0) continue;
+			info << "latency_percentiles_usec_" << CommandParser::command(i).name
+				<< ":" << latencyPercentiles(c.latency) << "\r\n";
+		}
+		for (int stage = 0; stage < ThreadMetrics::STAGE_COUNT; ++stage) {
+			if (metrics.stages[stage].total == 0) continue;
+			info << "latency_percentiles_usec_stage_" << Metrics::stageName(stage)
+				<< ":" << latencyPercentiles(metrics.stages[stage]) << "\r\n";
+		}
+	}
+	if (include("keyspace", true)) {
+		info << "# Keyspace\r\n"
+			<< "db0:keys=" << kvStore.size() << ",expires=" << expiry.keysWithExpiry << "\r\n";
+	}
+	return info.str();
+}
 
-		buffer.append(temp.data(), bytesRead);
+static void appendQuantiles(std::ostringstream& out, const char* metric, const std::string& labels, const HistogramSnapshot& h) {
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	std::string prefix = labels.empty() ? "" : labels + ",";
+	for (double q : quantiles) {
+		out << metric << "{" << prefix << "quantile=\"" << q << "\"} " << h.percentile(q) / 1e9 << "\n";
+	}
+	std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+	out << metric << "_sum" << suffix << " " << h.sum / 1e9 << "\n"
+		<< metric << "_count" << suffix << " " << h.total << "\n";
+}
 
-		while (true) {
-			ParseResult result = CommandParser::parseCommand(buffer);
+// Prometheus text exposition format, served by MetricsEndpoint. Latencies are
+// summaries in seconds whose quantiles come from the log-linear histograms.
+std::string TCPServer::buildMetrics() {
+	Metrics::Snapshot metrics = Metrics::snapshot(true);
+	KeyValueStore::ExpiryStats expiry = kvStore.expiryStats();
+	KeyValueStore::MemoryStats memory = kvStore.memoryStats();
 
-			if (result.status == ParseResult::Status::INCOMPLETE) break;
+	std::ostringstream out;
+	out.precision(9);
+	out << "# TYPE redislite_connected_clients gauge\n"
+		<< "redislite_connected_clients " << metrics.connectedClients << "\n"
+		<< "# TYPE redislite_connections_received_total counter\n"
+		<< "redislite_connections_received_total " << metrics.totalConnections << "\n"
+		<< "# TYPE redislite_net_input_bytes_total counter\n"
+		<< "redislite_net_input_bytes_total " << metrics.bytesIn << "\n"
+		<< "# TYPE redislite_net_output_bytes_total counter\n"
+		<< "redislite_net_output_bytes_total " << metrics.bytesOut << "\n"
+		<< "# TYPE redislite_keys gauge\n"
+		<< "redislite_keys " << kvStore.size() << "\n"
+		<< "# TYPE redislite_keys_with_expiry gauge\n"
+		<< "redislite_keys_with_expiry " << expiry.keysWithExpiry << "\n"
+		<< "# TYPE redislite_used_memory_bytes gauge\n"
+		<< "redislite_used_memory_bytes " << memory.usedMemory << "\n"
+		<< "# TYPE redislite_evicted_keys_total counter\n"
+		<< "redislite_evicted_keys_total " << memory.evictedKeys << "\n"
+		<< "# TYPE redislite_expired_keys_total counter\n"
+		<< "redislite_expired_keys_total " << expiry.expiredKeys << "\n"
+		<< "# TYPE redislite_instantaneous_ops_per_sec gauge\n"
+		<< "redislite_instantaneous_ops_per_sec " << metrics.opsPerSec << "\n";
+	ReplicationManager::Info repl = replication->info();
+	out << "# TYPE redislite_connected_replicas gauge\n"
+		<< "redislite_connected_replicas " << repl.replicas.size() << "\n"
+		<< "# TYPE redislite_repl_offset_bytes counter\n"
+		<< "redislite_repl_offset_bytes " << repl.offset << "\n";
+	if (aofManager) {
+		AOFManager::Stats aof = aofManager->stats();
+		out << "# TYPE redislite_aof_current_size_bytes gauge\n"
+			<< "redislite_aof_current_size_bytes " << aof.currentSize << "\n"
+			<< "# TYPE redislite_aof_pending_records gauge\n"
+			<< "redislite_aof_pending_records " << aof.pendingRecords << "\n"
+			<< "# TYPE redislite_aof_pending_bytes gauge\n"
+			<< "redislite_aof_pending_bytes " << aof.pendingBytes << "\n";
+	}
 
-			if (result.status == ParseResult::Status::ERR) {
-				std::string errMsg = ResponseFormatter::Error(result.errorMessage);
-				send(clientSocket, errMsg.c_str(), static_cast<int>(errMsg.size()), 0);
-				buffer.clear();
+	out << "# TYPE redislite_commands_total counter\n";
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		if (metrics.commands[i].calls == 0) continue;
+		out << "redislite_commands_total{cmd=\"" << CommandParser::command(i).name << "\"} "
+			<< metrics.commands[i].calls << "\n";
+	}
+	out << "# TYPE redislite_command_ops_per_sec gauge\n";
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		if (metrics.commands[i].calls == 0) continue;
+		out << "redislite_command_ops_per_sec{cmd=\"" << CommandParser::command(i).name << "\"} "
+			<< metrics.commands[i].opsPerSec << "\n";
+	}
+	out << "# TYPE redislite_command_duration_seconds summary\n";
+	for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+		if (metrics.commands[i].latency.total == 0) continue;
+		std::string label = "cmd=\"" + std::string(CommandParser::command(i).name) + "\"";
+		appendQuantiles(out, "redislite_command_duration_seconds", label, metrics.commands[i].latency);
+	}
+	out << "# TYPE redislite_stage_duration_seconds summary\n";
+	for (int stage = 0; stage < ThreadMetrics::STAGE_COUNT; ++stage) {
+		std::string label = std::string("stage=\"") + Metrics::stageName(stage) + "\"";
+		appendQuantiles(out, "redislite_stage_duration_seconds", label, metrics.stages[stage]);
+	}
+	return out.str();
+}
+
+void CommandHandlers::set(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!cmd.expireMillis) {
+		server.kvStore.set(cmd.key, cmd.value, std::nullopt, cmd.keepTtl, [&] { server.logWrite(cmd, conn); });
+		out.append(ResponseFormatter::SimpleString("OK"));
+		return;
+	}
+	// Logged with the absolute time the store was given, so replay and
+	// replicas expire the key at the same moment.
+	Command set;
+	set.type = CommandType::SET;
+	set.key = cmd.key;
+	set.value = cmd.value;
+	set.expireMillis = CommandParser::expireAt(cmd, CachedClock::nowMs());
+	set.expireAbsolute = true;
+	server.kvStore.set(cmd.key, cmd.value, *set.expireMillis, false, [&] { server.logWrite(set, conn); });
+	out.append(ResponseFormatter::SimpleString("OK"));
+}
+
+void CommandHandlers::get(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	bool wrongType = false;
+	auto val = server.kvStore.get(cmd.key, &wrongType);
+	if (wrongType) {
+		out.append(ResponseFormatter::WrongType());
+	}
+	else if (val.has_value()) {
+		out.append(ResponseFormatter::BulkStringHeader(val->size()));
+		out.appendOwned(std::move(*val));
+		out.append("\r\n");
+	}
+	else {
+		out.append(ResponseFormatter::NilBulkString());
+	}
+}
+
+void CommandHandlers::del(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	auto log = [&] { server.logWrite(cmd, conn); };
+	size_t deleted = cmd.args.size() > 2
+		? server.kvStore.del(cmd.args.data() + 1, cmd.args.size() - 1, log)
+		: (server.kvStore.del(cmd.key, log) ? 1 : 0);
+	out.append(ResponseFormatter::Integer(static_cast<long long>(deleted)));
+}
+
+void CommandHandlers::exists(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t exists = cmd.args.size() > 2
+		? server.kvStore.exists(cmd.args.data() + 1, cmd.args.size() - 1)
+		: (server.kvStore.exists(cmd.key) ? 1 : 0);
+	out.append(ResponseFormatter::Integer(static_cast<long long>(exists)));
+}
+
+void CommandHandlers::mget(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<std::optional<std::string>> values;
+	server.kvStore.mget(cmd.args.data() + 1, cmd.args.size() - 1, values);
+	out.append(ResponseFormatter::ArrayHeader(values.size()));
+	for (auto& val : values) {
+		if (val.has_value()) {
+			out.append(ResponseFormatter::BulkStringHeader(val->size()));
+			out.appendOwned(std::move(*val));
+			out.append("\r\n");
+		}
+		else {
+			out.append(ResponseFormatter::NilBulkString());
+		}
+	}
+}
+
+void CommandHandlers::mset(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	server.kvStore.mset(cmd.args.data() + 1, (cmd.args.size() - 1) / 2, [&] { server.logWrite(cmd, conn); });
+	out.append(ResponseFormatter::SimpleString("OK"));
+}
+
+void CommandHandlers::incrBy(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	long long result = 0;
+	KeyValueStore::CounterStatus status = server.kvStore.incrBy(cmd.key, cmd.increment, result,
+		[&server, &conn](std::string_view key, std::string_view value) { server.logResultingSet(key, value, conn); });
+	if (status == KeyValueStore::CounterStatus::WRONG_TYPE) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	if (status != KeyValueStore::CounterStatus::OK) {
+		out.append(ResponseFormatter::Error(counterError(status)));
+		return;
+	}
+	out.append(ResponseFormatter::Integer(result));
+}
+
+void CommandHandlers::incrByFloat(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::string result;
+	KeyValueStore::CounterStatus status = server.kvStore.incrByFloat(cmd.key, cmd.value, result,
+		[&server, &conn](std::string_view key, std::string_view value) { server.logResultingSet(key, value, conn); });
+	if (status == KeyValueStore::CounterStatus::WRONG_TYPE) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	if (status != KeyValueStore::CounterStatus::OK) {
+		out.append(ResponseFormatter::Error(counterError(status)));
+		return;
+	}
+	out.append(ResponseFormatter::BulkString(result));
+}
+
+void CommandHandlers::bgrewriteaof(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!server.aofManager) {
+		out.append(ResponseFormatter::Error("AOF is not enabled"));
+	}
+	else if (server.aofManager->startRewrite(server.kvStore)) {
+		out.append(ResponseFormatter::SimpleString("Background append only file rewriting started"));
+	}
+	else {
+		out.append(ResponseFormatter::Error("Background append only file rewriting already in progress"));
+	}
+}
+
+void CommandHandlers::save(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!server.snapshotManager) {
+		out.append(ResponseFormatter::Error("Snapshots are not enabled"));
+	}
+	else if (server.snapshotManager->save(server.kvStore)) {
+		out.append(ResponseFormatter::SimpleString("OK"));
+	}
+	else if (server.snapshotManager->isSaving()) {
+		out.append(ResponseFormatter::Error("Background save already in progress"));
+	}
+	else {
+		out.append(ResponseFormatter::Error("Failed to save snapshot"));
+	}
+}
+
+void CommandHandlers::bgsave(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!server.snapshotManager) {
+		out.append(ResponseFormatter::Error("Snapshots are not enabled"));
+	}
+	else if (server.snapshotManager->startBackgroundSave(server.kvStore)) {
+		out.append(ResponseFormatter::SimpleString("Background saving started"));
+	}
+	else {
+		out.append(ResponseFormatter::Error("Background save already in progress"));
+	}
+}
+
+void CommandHandlers::lastsave(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::Integer(server.snapshotManager ? server.snapshotManager->lastSave() : 0));
+}
+
+void CommandHandlers::info(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::BulkString(server.buildInfo(cmd.key)));
+}
+
+void CommandHandlers::scan(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<std::string> keys;
+	unsigned long long next = server.kvStore.scan(cmd.cursor, static_cast<size_t>(cmd.count), cmd.pattern, keys);
+	out.append(ResponseFormatter::ArrayHeader(2));
+	out.append(ResponseFormatter::BulkString(std::to_string(next)));
+	out.append(ResponseFormatter::ArrayHeader(keys.size()));
+	for (const std::string& key : keys) {
+		out.append(ResponseFormatter::BulkString(key));
+	}
+}
+
+void CommandHandlers::keys(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<std::string> keys;
+	server.kvStore.keys(cmd.pattern, keys);
+	out.append(ResponseFormatter::ArrayHeader(keys.size()));
+	for (const std::string& key : keys) {
+		out.append(ResponseFormatter::BulkString(key));
+	}
+}
+
+void CommandHandlers::dbsize(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::Integer(static_cast<long long>(server.kvStore.size())));
+}
+
+void CommandHandlers::hset(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t added = 0;
+	if (!server.kvStore.hset(cmd.key, cmd.args.data() + 2, (cmd.args.size() - 2) / 2, added, [&] { server.logWrite(cmd, conn); })) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::Integer(static_cast<long long>(added)));
+}
+
+void CommandHandlers::hget(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::optional<std::string> val;
+	if (!server.kvStore.hget(cmd.key, cmd.value, val)) {
+		out.append(ResponseFormatter::WrongType());
+	}
+	else if (val.has_value()) {
+		out.append(ResponseFormatter::BulkString(*val));
+	}
+	else {
+		out.append(ResponseFormatter::NilBulkString());
+	}
+}
+
+void CommandHandlers::hdel(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t removed = 0;
+	if (!server.kvStore.hdel(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, removed, [&] { server.logWrite(cmd, conn); })) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::Integer(static_cast<long long>(removed)));
+}
+
+void CommandHandlers::readAll(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<std::string> items;
+	bool ok = cmd.type == CommandType::HGETALL ? server.kvStore.hgetall(cmd.key, items) : server.kvStore.smembers(cmd.key, items);
+	if (!ok) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::ArrayHeader(items.size()));
+	for (const std::string& item : items) {
+		out.append(ResponseFormatter::BulkString(item));
+	}
+}
+
+void CommandHandlers::length(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t length = 0;
+	bool ok = cmd.type == CommandType::HLEN ? server.kvStore.hlen(cmd.key, length)
+		: cmd.type == CommandType::LLEN ? server.kvStore.llen(cmd.key, length)
+		: server.kvStore.scard(cmd.key, length);
+	out.append(ok ? ResponseFormatter::Integer(static_cast<long long>(length)) : ResponseFormatter::WrongType());
+}
+
+void CommandHandlers::push(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t length = 0;
+	if (!server.kvStore.push(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, cmd.type == CommandType::LPUSH, length, [&] { server.logWrite(cmd, conn); })) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::Integer(static_cast<long long>(length)));
+}
+
+void CommandHandlers::pop(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::optional<std::string> val;
+	if (!server.kvStore.pop(cmd.key, cmd.type == CommandType::LPOP, val, [&] { server.logWrite(cmd, conn); })) {
+		out.append(ResponseFormatter::WrongType());
+	}
+	else if (val.has_value()) {
+		out.append(ResponseFormatter::BulkString(*val));
+	}
+	else {
+		out.append(ResponseFormatter::NilBulkString());
+	}
+}
+
+void CommandHandlers::lrange(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<std::string> items;
+	if (!server.kvStore.lrange(cmd.key, cmd.start, cmd.stop, items)) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::ArrayHeader(items.size()));
+	for (const std::string& item : items) {
+		out.append(ResponseFormatter::BulkString(item));
+	}
+}
+
+void CommandHandlers::saddSrem(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	bool add = cmd.type == CommandType::SADD;
+	size_t changed = 0;
+	bool ok = add
+		? server.kvStore.sadd(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, changed, [&] { server.logWrite(cmd, conn); })
+		: server.kvStore.srem(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, changed, [&] { server.logWrite(cmd, conn); });
+	out.append(ok ? ResponseFormatter::Integer(static_cast<long long>(changed)) : ResponseFormatter::WrongType());
+}
+
+void CommandHandlers::sismember(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	bool found = false;
+	if (!server.kvStore.sismember(cmd.key, cmd.value, found)) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::Integer(found ? 1 : 0));
+}
+
+void CommandHandlers::expire(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	Command expire;
+	expire.type = CommandType::EXPIRE;
+	expire.key = cmd.key;
+	expire.expireMillis = CommandParser::expireAt(cmd, CachedClock::nowMs());
+	expire.expireAbsolute = true;
+	KeyValueStore::ExpireStatus status = server.kvStore.expire(cmd.key, *expire.expireMillis,
+		[&](KeyValueStore::ExpireStatus result) {
+			if (result == KeyValueStore::ExpireStatus::SET) {
+				server.logWrite(expire, conn);
+				return;
+			}
+			Command del;
+			del.type = CommandType::DEL;
+			del.key = cmd.key;
+			server.logWrite(del, conn);
+		});
+	out.append(ResponseFormatter::Integer(status == KeyValueStore::ExpireStatus::NOT_FOUND ? 0 : 1));
+}
+
+void CommandHandlers::ttl(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	long long ttl = server.kvStore.pttl(cmd.key);
+	if (ttl >= 0 && cmd.type == CommandType::TTL) {
+		ttl = (ttl + 500) / 1000;
+	}
+	out.append(ResponseFormatter::Integer(ttl));
+}
+
+void CommandHandlers::persist(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	bool removed = server.kvStore.persist(cmd.key, [&] { server.logWrite(cmd, conn); });
+	out.append(ResponseFormatter::Integer(removed ? 1 : 0));
+}
+
+void CommandHandlers::type(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::optional<ValueType> type = server.kvStore.type(cmd.key);
+	out.append(ResponseFormatter::SimpleString(type ? KVPair::typeName(*type) : "none"));
+}
+
+void CommandHandlers::objectEncoding(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	const char* encoding = server.kvStore.encoding(cmd.key);
+	out.append(encoding ? ResponseFormatter::BulkString(encoding) : ResponseFormatter::NilBulkString());
+}
+
+void CommandHandlers::zadd(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t added = 0;
+	size_t updated = 0;
+	if (!server.kvStore.zadd(cmd.key, cmd.scoredMembers.data(), cmd.scoredMembers.size(), cmd.nx, cmd.xx, added, updated,
+		[&] { server.logWrite(cmd, conn); })) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::Integer(static_cast<long long>(cmd.ch ? added + updated : added)));
+}
+
+void CommandHandlers::zremove(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t removed = 0;
+	bool ok = cmd.type == CommandType::ZREM
+		? server.kvStore.zrem(cmd.key, cmd.args.data() + 2, cmd.args.size() - 2, removed, [&] { server.logWrite(cmd, conn); })
+		: server.kvStore.zremrangeByScore(cmd.key, cmd.range, removed, [&] { server.logWrite(cmd, conn); });
+	out.append(ok ? ResponseFormatter::Integer(static_cast<long long>(removed)) : ResponseFormatter::WrongType());
+}
+
+void CommandHandlers::zscore(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::optional<double> score;
+	if (!server.kvStore.zscore(cmd.key, cmd.value, score)) {
+		out.append(ResponseFormatter::WrongType());
+	}
+	else if (score.has_value()) {
+		out.append(ResponseFormatter::BulkString(ZSetValue::formatScore(*score)));
+	}
+	else {
+		out.append(ResponseFormatter::NilBulkString());
+	}
+}
+
+void CommandHandlers::zrank(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::optional<size_t> rank;
+	if (!server.kvStore.zrank(cmd.key, cmd.value, rank)) {
+		out.append(ResponseFormatter::WrongType());
+	}
+	else if (rank.has_value()) {
+		out.append(ResponseFormatter::Integer(static_cast<long long>(*rank)));
+	}
+	else {
+		out.append(ResponseFormatter::NilBulkString());
+	}
+}
+
+void CommandHandlers::zcard(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t count = 0;
+	out.append(server.kvStore.zcard(cmd.key, count) ? ResponseFormatter::Integer(static_cast<long long>(count)) : ResponseFormatter::WrongType());
+}
+
+void CommandHandlers::zrange(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<std::pair<std::string, double>> items;
+	bool ok = cmd.type == CommandType::ZRANGE
+		? server.kvStore.zrange(cmd.key, cmd.start, cmd.stop, items)
+		: server.kvStore.zrangeByScore(cmd.key, cmd.range, cmd.offset, cmd.limit, items);
+	if (!ok) {
+		out.append(ResponseFormatter::WrongType());
+		return;
+	}
+	out.append(ResponseFormatter::ArrayHeader(cmd.withScores ? items.size() * 2 : items.size()));
+	for (const auto& item : items) {
+		out.append(ResponseFormatter::BulkString(item.first));
+		if (cmd.withScores) out.append(ResponseFormatter::BulkString(ZSetValue::formatScore(item.second)));
+	}
+}
+
+void CommandHandlers::slowlogGet(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<SlowLog::Entry> entries = server.slowLog.get(cmd.count);
+	out.append(ResponseFormatter::ArrayHeader(entries.size()));
+	for (const SlowLog::Entry& entry : entries) {
+		out.append(ResponseFormatter::ArrayHeader(6));
+		out.append(ResponseFormatter::Integer(static_cast<long long>(entry.id)));
+		out.append(ResponseFormatter::Integer(entry.timestamp));
+		out.append(ResponseFormatter::Integer(static_cast<long long>(entry.durationMicros)));
+		out.append(ResponseFormatter::ArrayHeader(entry.args.size()));
+		for (const std::string& arg : entry.args) {
+			out.append(ResponseFormatter::BulkString(arg));
+		}
+		out.append(ResponseFormatter::BulkString(entry.peer));
+		out.append(ResponseFormatter::BulkString("")); // client name
+	}
+}
+
+void CommandHandlers::slowlogLen(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::Integer(static_cast<long long>(server.slowLog.length())));
+}
+
+void CommandHandlers::slowlogReset(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	server.slowLog.reset();
+	out.append(ResponseFormatter::SimpleString("OK"));
+}
+
+void CommandHandlers::latencyLatest(TCPServer&, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<LatencyMonitor::EventSummary> events = LatencyMonitor::latest();
+	out.append(ResponseFormatter::ArrayHeader(events.size()));
+	for (const LatencyMonitor::EventSummary& e : events) {
+		out.append(ResponseFormatter::ArrayHeader(4));
+		out.append(ResponseFormatter::BulkString(e.event));
+		out.append(ResponseFormatter::Integer(e.time));
+		out.append(ResponseFormatter::Integer(e.latestMs));
+		out.append(ResponseFormatter::Integer(e.maxMs));
+	}
+}
+
+void CommandHandlers::latencyHistory(TCPServer&, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	std::vector<LatencyMonitor::Sample> samples = LatencyMonitor::history(cmd.key);
+	out.append(ResponseFormatter::ArrayHeader(samples.size()));
+	for (const LatencyMonitor::Sample& sample : samples) {
+		out.append(ResponseFormatter::ArrayHeader(2));
+		out.append(ResponseFormatter::Integer(sample.time));
+		out.append(ResponseFormatter::Integer(sample.latencyMs));
+	}
+}
+
+void CommandHandlers::latencyReset(TCPServer&, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	size_t removed = LatencyMonitor::reset(cmd.args.data() + 2, cmd.args.size() - 2);
+	out.append(ResponseFormatter::Integer(static_cast<long long>(removed)));
+}
+
+void CommandHandlers::ping(TCPServer&, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!conn.resp3 && conn.subscriber && conn.subscriber->count() > 0) {
+		out.append(ResponseFormatter::ArrayHeader(2));
+		out.append(ResponseFormatter::BulkString("pong"));
+		out.append(ResponseFormatter::BulkString(std::string(cmd.value)));
+	} else if (cmd.args.size() > 1) {
+		out.append(ResponseFormatter::BulkString(std::string(cmd.value)));
+	} else {
+		out.append(ResponseFormatter::SimpleString("PONG"));
+	}
+}
+
+void CommandHandlers::replconf(TCPServer&, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (cmd.key == "ACK") {
+		return; // never answered
+	}
+	if (cmd.count > 0 && cmd.count <= 65535) {
+		conn.replicaListeningPort = static_cast<int>(cmd.count);
+	}
+	out.append(ResponseFormatter::SimpleString("OK"));
+}
+
+void CommandHandlers::psync(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!server.replication->canServeReplicas()) {
+		out.append(ResponseFormatter::Error("NOMASTERLINK", "Can't SYNC while not connected with my master"));
+		return;
+	}
+	// The I/O layer hands the socket to server.replication once earlier replies are out.
+	conn.replicaHandoff = true;
+	conn.psyncReplid = std::string(cmd.key);
+	conn.psyncOffset = cmd.count;
+}
+
+void CommandHandlers::replicaof(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (cmd.key.empty()) {
+		server.replication->promote();
+	} else {
+		server.replication->replicaOf(std::string(cmd.key), static_cast<int>(cmd.count));
+	}
+	out.append(ResponseFormatter::SimpleString("OK"));
+}
+
+void CommandHandlers::role(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	ReplicationManager::Info repl = server.replication->info();
+	if (repl.replica) {
+		const char* state = repl.linkUp ? "connected" : repl.syncInProgress ? "sync" : "connect";
+		out.append(ResponseFormatter::ArrayHeader(5));
+		out.append(ResponseFormatter::BulkString("slave"));
+		out.append(ResponseFormatter::BulkString(repl.primaryHost));
+		out.append(ResponseFormatter::Integer(repl.primaryPort));
+		out.append(ResponseFormatter::BulkString(state));
+		out.append(ResponseFormatter::Integer(static_cast<long long>(repl.offset)));
+		return;
+	}
+	out.append(ResponseFormatter::ArrayHeader(3));
+	out.append(ResponseFormatter::BulkString("master"));
+	out.append(ResponseFormatter::Integer(static_cast<long long>(repl.offset)));
+	out.append(ResponseFormatter::ArrayHeader(repl.replicas.size()));
+	for (const ReplicationManager::ReplicaInfo& r : repl.replicas) {
+		out.append(ResponseFormatter::ArrayHeader(3));
+		out.append(ResponseFormatter::BulkString(r.ip));
+		out.append(ResponseFormatter::BulkString(std::to_string(r.port)));
+		out.append(ResponseFormatter::BulkString(std::to_string(r.ackOffset)));
+	}
+}
+
+void CommandHandlers::subscribe(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	bool pattern = cmd.type == CommandType::PSUBSCRIBE;
+	if (!conn.subscriber) {
+		conn.subscriber = std::make_unique<PubSub::Subscriber>(conn.notifyOwner);
+	}
+	PubSub::Subscriber& subscriber = *conn.subscriber;
+	for (size_t i = 1; i < cmd.args.size(); ++i) {
+		if (pattern) {
+			server.pubsub.psubscribe(subscriber, cmd.args[i]);
+		} else {
+			server.pubsub.subscribe(subscriber, cmd.args[i]);
+		}
+		appendSubscriptionReply(out, pattern ? "psubscribe" : "subscribe", cmd.args[i], subscriber.count());
+	}
+	server.updateEndpoint(conn);
+}
+
+void CommandHandlers::unsubscribe(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	bool pattern = cmd.type == CommandType::PUNSUBSCRIBE;
+	const char* kind = pattern ? "punsubscribe" : "unsubscribe";
+	std::vector<std::string> names(cmd.args.begin() + 1, cmd.args.end());
+	if (names.empty() && conn.subscriber) {
+		const auto& current = pattern ? conn.subscriber->patterns : conn.subscriber->channels;
+		names.assign(current.begin(), current.end());
+	}
+	if (names.empty()) {
+		// Nothing to leave: one reply with a nil name, as Redis sends.
+		out.append(ResponseFormatter::ArrayHeader(3));
+		out.append(ResponseFormatter::BulkString(kind));
+		out.append(ResponseFormatter::NilBulkString());
+		out.append(ResponseFormatter::Integer(conn.subscriber ? static_cast<long long>(conn.subscriber->count()) : 0));
+		return;
+	}
+	for (const std::string& name : names) {
+		if (conn.subscriber && pattern) {
+			server.pubsub.punsubscribe(*conn.subscriber, name);
+		} else if (conn.subscriber) {
+			server.pubsub.unsubscribe(*conn.subscriber, name);
+		}
+		appendSubscriptionReply(out, kind, name, conn.subscriber ? conn.subscriber->count() : 0);
+	}
+	server.updateEndpoint(conn);
+}
+
+void CommandHandlers::publish(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::Integer(static_cast<long long>(server.pubsub.publish(cmd.key, cmd.value))));
+}
+
+void CommandHandlers::hello(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (cmd.count != 0 && cmd.count != 2 && cmd.count != 3) {
+		out.append(ResponseFormatter::Error("NOPROTO", "unsupported protocol version"));
+		return;
+	}
+	if (cmd.count != 0) {
+		conn.resp3 = cmd.count == 3;
+		server.updateEndpoint(conn);
+	}
+	// Replies other than HELLO's and the invalidation pushes keep their
+	// RESP2 encoding, which RESP3 clients also accept.
+	out.append(conn.resp3 ? ResponseFormatter::MapHeader(7) : ResponseFormatter::ArrayHeader(14));
+	out.append(ResponseFormatter::BulkString("server"));
+	out.append(ResponseFormatter::BulkString("redis"));
+	out.append(ResponseFormatter::BulkString("version"));
+	out.append(ResponseFormatter::BulkString("7.0.0")); // the protocol level implemented
+	out.append(ResponseFormatter::BulkString("proto"));
+	out.append(ResponseFormatter::Integer(conn.resp3 ? 3 : 2));
+	out.append(ResponseFormatter::BulkString("id"));
+	out.append(ResponseFormatter::Integer(static_cast<long long>(conn.id)));
+	out.append(ResponseFormatter::BulkString("mode"));
+	out.append(ResponseFormatter::BulkString("standalone"));
+	out.append(ResponseFormatter::BulkString("role"));
+	out.append(ResponseFormatter::BulkString(server.replication->isReplica() ? "replica" : "master"));
+	out.append(ResponseFormatter::BulkString("modules"));
+	out.append(ResponseFormatter::ArrayHeader(0));
+}
+
+void CommandHandlers::clientId(TCPServer&, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::Integer(static_cast<long long>(conn.id)));
+}
+
+void CommandHandlers::clientTracking(TCPServer& server, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (!cmd.on) {
+		server.tracking.disable(conn.id);
+		conn.trackingReads = false;
+		out.append(ResponseFormatter::SimpleString("OK"));
+		return;
+	}
+	Tracking::Options options;
+	options.redirect = static_cast<uint64_t>(cmd.count);
+	options.bcast = cmd.bcast;
+	options.noloop = cmd.noloop;
+	options.prefixes.assign(cmd.prefixes.begin(), cmd.prefixes.end());
+	std::string error;
+	if (!server.tracking.enable(conn.id, std::move(options), error)) {
+		out.append(ResponseFormatter::Error(error));
+		return;
+	}
+	conn.trackingReads = !cmd.bcast;
+	server.updateEndpoint(conn);
+	out.append(ResponseFormatter::SimpleString("OK"));
+}
+
+void CommandHandlers::clientTrackingInfo(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	Tracking::Options options;
+	bool on = server.tracking.options(conn.id, options);
+	std::vector<const char*> flags;
+	flags.push_back(on ? "on" : "off");
+	if (options.bcast) flags.push_back("bcast");
+	if (options.noloop) flags.push_back("noloop");
+	out.append(conn.resp3 ? ResponseFormatter::MapHeader(3) : ResponseFormatter::ArrayHeader(6));
+	out.append(ResponseFormatter::BulkString("flags"));
+	out.append(ResponseFormatter::ArrayHeader(flags.size()));
+	for (const char* flag : flags) {
+		out.append(ResponseFormatter::BulkString(flag));
+	}
+	out.append(ResponseFormatter::BulkString("redirect"));
+	appendTrackingRedirect(out, on, options);
+	out.append(ResponseFormatter::BulkString("prefixes"));
+	out.append(ResponseFormatter::ArrayHeader(options.prefixes.size()));
+	for (const std::string& prefix : options.prefixes) {
+		out.append(ResponseFormatter::BulkString(prefix));
+	}
+}
+
+void CommandHandlers::clientGetRedir(TCPServer& server, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	Tracking::Options options;
+	bool on = server.tracking.options(conn.id, options);
+	appendTrackingRedirect(out, on, options);
+}
+
+void CommandHandlers::commandInfo(TCPServer&, const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	if (cmd.args.size() <= 2) {
+		out.append(ResponseFormatter::ArrayHeader(topLevelCommandCount()));
+		for (size_t i = 0; i < CommandParser::COMMAND_COUNT; ++i) {
+			const CommandSpec& entry = CommandParser::command(i);
+			if (!isSubcommand(entry)) appendCommandInfo(out, entry);
+		}
+		return;
+	}
+	out.append(ResponseFormatter::ArrayHeader(cmd.args.size() - 2));
+	for (size_t i = 2; i < cmd.args.size(); ++i) {
+		const CommandSpec* entry = CommandParser::lookup(cmd.args[i]);
+		if (entry) {
+			appendCommandInfo(out, *entry);
+		} else {
+			out.append(ResponseFormatter::NilBulkString());
+		}
+	}
+}
+
+void CommandHandlers::commandCount(TCPServer&, const Command&, Connection& conn) {
+	OutputBuffer& out = conn.output;
+	out.append(ResponseFormatter::Integer(static_cast<long long>(topLevelCommandCount())));
+}
+
+void TCPServer::executeCommand(const Command& cmd, Connection& conn) {
+	OutputBuffer& out = conn.output;
+
+	const CommandSpec& spec = *cmd.spec;
+	if (!conn.fromPrimary && (spec.flags & CMD_WRITE) && replication->isReplica()) {
+		out.append(ResponseFormatter::Error("READONLY", "You can't write against a read only replica."));
+		return;
+	}
+	if (!conn.resp3 && conn.subscriber && conn.subscriber->count() > 0 && !allowedWhileSubscribed(cmd.type)) {
+		out.append(ResponseFormatter::Error("Can't execute '" + std::string(spec.name)
+			+ "': only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context"));
+		return;
+	}
+	if ((spec.flags & CMD_DENYOOM) && !ensureMemory(conn)) {
+		return;
+	}
+	// Before the read, so a write that races with it is still reported.
+	if (conn.trackingReads && (spec.flags & CMD_READONLY)) {
+		forEachKey(cmd, [&](std::string_view key) { tracking.trackRead(conn.id, key); });
+	}
+
+	if (!spec.handler) {
+		out.append(ResponseFormatter::Error("Unknown command"));
+		return;
+	}
+	spec.handler(*this, cmd, conn);
+
+	// After the change, so a client that read the old value always hears of it.
+	if ((spec.flags & CMD_WRITE) && tracking.active()) {
+		forEachKey(cmd, [&](std::string_view key) { tracking.invalidate(key, conn.id); });
+	}
+}
+
+#ifdef __linux__
+
+bool TCPServer::startEventLoops() {
+	if (!setNonBlocking(serverSocket)) {
+		Logger::warning("Failed to make listening socket non-blocking: ", errno);
+		return false;
+	}
+
+	for (int i = 0; i < config.ioThreads; ++i) {
+		auto loop = std::make_unique<EventLoop>();
+		loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+		loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (loop->epollFd == -1 || loop->wakeFd == -1) {
+			Logger::warning("Failed to create event loop: ", errno);
+			if (loop->epollFd != -1) ::close(loop->epollFd);
+			if (loop->wakeFd != -1) ::close(loop->wakeFd);
+			return false;
+		}
+
+		// EPOLLEXCLUSIVE wakes only one loop per incoming connection.
+		epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+		ev.data.fd = serverSocket;
+		epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, serverSocket, &ev);
+
+		ev.events = EPOLLIN;
+		ev.data.fd = loop->wakeFd;
+		epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &ev);
+
+		eventLoops.push_back(std::move(loop));
+	}
+
+	for (auto& loop : eventLoops) {
+		loop->thread = std::thread(&TCPServer::runEventLoop, this, std::ref(*loop));
+	}
+	return true;
+}
+
+void TCPServer::stopEventLoops() {
+	for (auto& loop : eventLoops) {
+		uint64_t one = 1;
+		ssize_t ignored = ::write(loop->wakeFd, &one, sizeof(one));
+		(void)ignored;
+	}
+	for (auto& loop : eventLoops) {
+		if (loop->thread.joinable()) {
+			loop->thread.join();
+		}
+		for (auto& entry : loop->connections) {
+			dropSubscriptions(*entry.second);
+			closesocket(entry.first);
+			Metrics::clientDisconnected();
+		}
+		loop->connections.clear();
+		::close(loop->wakeFd);
+		::close(loop->epollFd);
+	}
+	eventLoops.clear();
+}
+
+void TCPServer::runEventLoop(EventLoop& loop) {
+	const int MAX_EVENTS = 256;
+	epoll_event events[MAX_EVENTS];
+
+	while (running.load()) {
+		// Connections with bytes left unread must not wait for a new event.
+		int n = epoll_wait(loop.epollFd, events, MAX_EVENTS, loop.readReady.empty() ? -1 : 0);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			Logger::warning("epoll_wait() failed: ", errno);
+			break;
+		}
+
+		for (int i = 0; i < n; ++i) {
+			SOCKET fd = events[i].data.fd;
+			uint32_t flags = events[i].events;
+
+			if (fd == loop.wakeFd) {
+				deliverPublished(loop); // or stop() was called; the while condition handles that
+				continue;
+			}
+			if (fd == serverSocket) {
+				acceptPending(loop);
 				continue;
 			}
 
-			const Command& cmd = result.command;
-			std::string response;
-
-			switch (cmd.type) {
-				case CommandType::SET:
-					kvStore.set(cmd.key, cmd.value, cmd.ttlSeconds);
-					response = ResponseFormatter::SimpleString("OK");
-					if (aofManager) aofManager->appendCommand(cmd);
-					break;
-
-				case CommandType::GET: {
-					auto val = kvStore.get(cmd.key);
-					if (val.has_value()) {
-						response = ResponseFormatter::BulkString(val.value());
-					}
-					else {
-						response = ResponseFormatter::NilBulkString();
-					}
-					break;
-				}
+			auto it = loop.connections.find(fd);
+			if (it == loop.connections.end()) continue;
+			Connection& conn = *it->second;
 
-				case CommandType::DEL: {
-					bool deleted = kvStore.del(cmd.key);
-					response = ResponseFormatter::Integer(deleted ? 1 : 0);
-					if (aofManager) aofManager->appendCommand(cmd);
-					break;
-				}
-				case CommandType::EXISTS: {
-					bool exists = kvStore.exists(cmd.key);
-					response = ResponseFormatter::Integer(exists ? 1 : 0);
-					break;
+			bool ok = !(flags & EPOLLERR);
+			if (ok && (flags & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))) {
+				ok = handleReadable(loop, conn);
+				if (ok && conn.replicaHandoff) {
+					handOverReplica(loop, fd);
+					continue;
 				}
+			}
+			if (ok && (flags & EPOLLOUT)) {
+				ok = flushOutput(conn);
+			}
+			if (!ok) {
+				closeConnection(loop, fd);
+			}
+		}
+
+		readPendingConnections(loop);
+		flushAwaitingDurable(loop);
+	}
+}
 
-				default:
-					response = ResponseFormatter::Error("Unknown command");
-					break;
+// Group commit across one loop iteration: wait once for the newest AOF record
+// any connection produced, then send all replies that depended on it.
+void TCPServer::flushAwaitingDurable(EventLoop& loop) {
+	if (loop.awaitingDurable.empty()) return;
+
+	uint64_t maxSeq = 0;
+	for (SOCKET fd : loop.awaitingDurable) {
+		auto it = loop.connections.find(fd);
+		if (it != loop.connections.end() && it->second->pendingAofSeq > maxSeq) {
+			maxSeq = it->second->pendingAofSeq;
+		}
+	}
+	if (maxSeq != 0) {
+		aofManager->waitForDurable(maxSeq);
+	}
+
+	for (SOCKET fd : loop.awaitingDurable) {
+		auto it = loop.connections.find(fd);
+		if (it == loop.connections.end()) continue;
+		it->second->pendingAofSeq = 0;
+		if (!flushOutput(*it->second)) {
+			closeConnection(loop, fd);
+		}
+	}
+	loop.awaitingDurable.clear();
+}
+
+void TCPServer::acceptPending(EventLoop& loop) {
+	while (true) {
+		SOCKET clientSocket = accept4(serverSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (clientSocket == INVALID_SOCKET) {
+			if (errno == EINTR) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK && running.load()) {
+				static Logger::RateLimit acceptLimit;
+				Logger::logLimited(acceptLimit, LogLevel::WARNING, "accept() failed: ", errno);
 			}
+			return;
+		}
 
-			int sent = send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
-			if (sent == SOCKET_ERROR) {
-				int err = WSAGetLastError();
-				std::cerr << "send() failed: " << err << std::endl;
-				break;
+		setNoDelay(clientSocket);
+		auto conn = std::make_unique<Connection>(clientSocket, peerAddress(clientSocket));
+		registerClient(*conn);
+		EventLoop* owner = &loop;
+		conn->notifyOwner = [owner, clientSocket]() {
+			bool first = false;
+			{
+				std::lock_guard<std::mutex> lock(owner->mailboxMtx);
+				first = owner->mailboxReady.empty();
+				owner->mailboxReady.push_back(clientSocket);
 			}
+			if (first) {
+				uint64_t one = 1;
+				ssize_t ignored = ::write(owner->wakeFd, &one, sizeof(one));
+				(void)ignored;
+			}
+		};
 
-			buffer.erase(0, result.bytesConsumed);
+		// Registered once for both directions; with EPOLLET the loop is only
+		// woken on state changes, so idle connections cost nothing per iteration.
+		epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.fd = clientSocket;
+		if (epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, clientSocket, &ev) == -1) {
+			Logger::warning("epoll_ctl(ADD) failed: ", errno);
+			closesocket(clientSocket);
+			continue;
 		}
+
+		Metrics::clientConnected();
+		Logger::verbose("Client connected: ", conn->peer);
+		loop.connections.emplace(clientSocket, std::move(conn));
 	}
+}
 
-	closesocket(clientSocket);
-	std::cout << "Client disconnected: " << clientIp << ":" << ntohs(addr.sin_port) << std::endl;
-}
\ No newline at end of file
+// Edge-triggered: read until EAGAIN or READ_BUDGET, then answer everything
+// that arrived in one flush. A connection stopped by the budget goes on
+// readReady. Returns false if the connection should be closed.
+bool TCPServer::handleReadable(EventLoop& loop, Connection& conn) {
+	const size_t READ_CHUNK = 16 * 1024;
+	bool peerClosed = false;
+	bool drained = false;
+	size_t startSize = conn.readBuffer.size();
+
+	while (conn.readBuffer.size() - startSize < READ_BUDGET) {
+		size_t oldSize = conn.readBuffer.size();
+		conn.readBuffer.resize(oldSize + READ_CHUNK);
+		ssize_t bytesRead = recv(conn.fd, conn.readBuffer.data() + oldSize, READ_CHUNK, 0);
+		conn.readBuffer.resize(oldSize + (bytesRead > 0 ? static_cast<size_t>(bytesRead) : 0));
+
+		if (bytesRead > 0) continue;
+		if (bytesRead == 0) {
+			peerClosed = true;
+			break;
+		}
+		if (errno == EINTR) continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			drained = true;
+			break;
+		}
+		return false;
+	}
+	bump(Metrics::local().bytesIn, conn.readBuffer.size() - startSize);
+	bool more = !drained && !peerClosed;
+	if (more && !conn.readPending) {
+		loop.readReady.push_back(conn.fd);
+	}
+	conn.readPending = more;
+
+	if (!processInput(conn) || queryBufferExceeded(conn)) {
+		return false;
+	}
+	if (conn.closeAfterReply) {
+		// Replies to the commands before the error still wait for the AOF.
+		if (conn.pendingAofSeq != 0) {
+			aofManager->waitForDurable(conn.pendingAofSeq);
+		}
+		flushOutput(conn);
+		return false;
+	}
+	if (conn.pendingAofSeq != 0 && !peerClosed) {
+		loop.awaitingDurable.push_back(conn.fd); // flushed at the end of this iteration
+		return true;
+	}
+	if (!flushOutput(conn)) {
+		return false;
+	}
+	return !peerClosed;
+}
+
+// Gives every connection that hit its read budget last time another turn,
+// after the connections that had events.
+void TCPServer::readPendingConnections(EventLoop& loop) {
+	if (loop.readReady.empty()) return;
+	std::vector<SOCKET> ready;
+	ready.swap(loop.readReady);
+	for (SOCKET fd : ready) {
+		auto it = loop.connections.find(fd);
+		if (it == loop.connections.end() || !it->second->readPending) continue; // closed, or drained since
+		Connection& conn = *it->second;
+		conn.readPending = false;
+		if (!handleReadable(loop, conn)) {
+			closeConnection(loop, fd);
+		}
+		else if (conn.replicaHandoff) {
+			handOverReplica(loop, fd);
+		}
+	}
+}
+
+// PSYNC turns a client into a replica: its socket leaves the loop without
+// being closed and is served by replication from then on.
+void TCPServer::handOverReplica(EventLoop& loop, SOCKET fd) {
+	auto it = loop.connections.find(fd);
+	if (it == loop.connections.end()) return;
+	std::unique_ptr<Connection> conn = std::move(it->second);
+	loop.connections.erase(it);
+	epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	Metrics::clientDisconnected();
+	dropSubscriptions(*conn);
+
+	// Replies to anything the replica sent before PSYNC go out first.
+	if (conn->pendingAofSeq != 0) {
+		aofManager->waitForDurable(conn->pendingAofSeq);
+	}
+	setBlocking(fd);
+	if (!flushOutput(*conn)) {
+		closesocket(fd);
+		return;
+	}
+	replication->attachReplica(fd, conn->peer, conn->psyncReplid, conn->psyncOffset, conn->replicaListeningPort);
+}
+
+// Queues the messages published to this loop's subscribers since the last
+// wakeup and sends them.
+void TCPServer::deliverPublished(EventLoop& loop) {
+	uint64_t count = 0;
+	ssize_t ignored = ::read(loop.wakeFd, &count, sizeof(count));
+	(void)ignored;
+	std::vector<SOCKET> ready;
+	{
+		std::lock_guard<std::mutex> lock(loop.mailboxMtx);
+		ready.swap(loop.mailboxReady);
+	}
+	for (SOCKET fd : ready) {
+		auto it = loop.connections.find(fd);
+		if (it == loop.connections.end() || !it->second->subscriber) continue;
+		Connection& conn = *it->second;
+		queuePublished(conn);
+		if (conn.output.size() > PUBSUB_OUTPUT_LIMIT) {
+			static Logger::RateLimit limitLog;
+			Logger::logLimited(limitLog, LogLevel::WARNING, "[PubSub] Closing subscriber ", conn.peer,
+				" for overcoming of output buffer limits.");
+			closeConnection(loop, fd);
+			continue;
+		}
+		if (!flushOutput(conn)) {
+			closeConnection(loop, fd);
+		}
+	}
+}
+
+void TCPServer::closeConnection(EventLoop& loop, SOCKET fd) {
+	auto it = loop.connections.find(fd);
+	if (it == loop.connections.end()) return;
+
+	Metrics::clientDisconnected();
+	Logger::verbose("Client disconnected: ", it->second->peer);
+	dropSubscriptions(*it->second);
+	epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	closesocket(fd);
+	loop.connections.erase(it);
+}
+
+#endif
\ No newline at end of file
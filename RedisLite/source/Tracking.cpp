@@ -0,0 +1,261 @@
+#include "../headers/Tracking.h"
+#include "../headers/HashTable.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+
+static void appendBulk(std::string& out, std::string_view s) {
+	out += '$';
+	out += std::to_string(s.size());
+	out += "\r\n";
+	out.append(s.data(), s.size());
+	out += "\r\n";
+}
+
+static bool hasPrefix(std::string_view key, std::string_view prefix) {
+	return key.substr(0, prefix.size()) == prefix;
+}
+
+Tracking::Tracking(size_t maxKeys) : maxKeys(maxKeys) {}
+
+Tracking::Shard& Tracking::shardFor(std::string_view key) {
+	return shards[HashTable::hashKey(key) & (SHARDS - 1)];
+}
+
+void Tracking::addClient(uint64_t id) {
+	std::unique_lock<std::shared_mutex> lock(clientsMtx);
+	clients.try_emplace(id);
+}
+
+void Tracking::removeClient(uint64_t id) {
+	std::unique_lock<std::shared_mutex> lock(clientsMtx);
+	auto it = clients.find(id);
+	if (it == clients.end()) return;
+	if (it->second.on) stopTracking(id, it->second);
+	clients.erase(it);
+}
+
+void Tracking::setEndpoint(uint64_t id, PubSub::Subscriber* mailbox, bool resp3, bool listening) {
+	std::unique_lock<std::shared_mutex> lock(clientsMtx);
+	auto it = clients.find(id);
+	if (it == clients.end()) return;
+	it->second.mailbox = mailbox;
+	it->second.resp3 = resp3;
+	it->second.listening = listening;
+}
+
+bool Tracking::enable(uint64_t id, Options options, std::string& error) {
+	std::unique_lock<std::shared_mutex> lock(clientsMtx);
+	auto it = clients.find(id);
+	if (it == clients.end()) return false;
+	Client& client = it->second;
+	if (options.redirect != 0 && clients.find(options.redirect) == clients.end()) {
+		error = "The client ID you want redirect to does not exist";
+		return false;
+	}
+	if (client.on && client.options.bcast != options.bcast) {
+		error = "You can't switch BCAST mode on/off before disabling tracking for this client, and then re-enabling it with a different mode.";
+		return false;
+	}
+
+	if (client.on) {
+		stopTracking(id, client);
+	}
+	if (options.bcast) {
+		if (options.prefixes.empty()) options.prefixes.emplace_back();
+		std::unique_lock<std::shared_mutex> prefixLock(prefixMtx);
+		for (const std::string& prefix : options.prefixes) {
+			auto entry = std::find_if(prefixes.begin(), prefixes.end(),
+				[&](const Prefix& p) { return p.prefix == prefix; });
+			if (entry == prefixes.end()) {
+				prefixes.push_back({ prefix, {} });
+				entry = prefixes.end() - 1;
+			}
+			if (std::find(entry->clients.begin(), entry->clients.end(), id) == entry->clients.end()) {
+				entry->clients.push_back(id);
+			}
+		}
+		bcastClients.fetch_add(1, std::memory_order_relaxed);
+	}
+	client.on = true;
+	client.options = std::move(options);
+	trackingClients.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void Tracking::disable(uint64_t id) {
+	std::unique_lock<std::shared_mutex> lock(clientsMtx);
+	auto it = clients.find(id);
+	if (it != clients.end() && it->second.on) {
+		stopTracking(id, it->second);
+	}
+}
+
+// Called with clientsMtx held. The client's entries in the key table are
+// left to go stale: flush skips clients that are no longer tracking, and
+// the table is emptied once nobody is.
+void Tracking::stopTracking(uint64_t id, Client& client) {
+	if (client.options.bcast) {
+		std::unique_lock<std::shared_mutex> prefixLock(prefixMtx);
+		for (Prefix& entry : prefixes) {
+			auto member = std::find(entry.clients.begin(), entry.clients.end(), id);
+			if (member != entry.clients.end()) {
+				*member = entry.clients.back();
+				entry.clients.pop_back();
+			}
+		}
+		prefixes.erase(std::remove_if(prefixes.begin(), prefixes.end(),
+			[](const Prefix& p) { return p.clients.empty(); }), prefixes.end());
+		bcastClients.fetch_sub(1, std::memory_order_relaxed);
+	}
+	client.on = false;
+	client.options = Options();
+	if (trackingClients.fetch_sub(1, std::memory_order_relaxed) == 1) {
+		for (Shard& shard : shards) {
+			std::lock_guard<std::mutex> shardLock(shard.mtx);
+			keyCount.fetch_sub(shard.readers.size(), std::memory_order_relaxed);
+			shard.readers.clear();
+		}
+	}
+}
+
+bool Tracking::options(uint64_t id, Options& out) {
+	std::shared_lock<std::shared_mutex> lock(clientsMtx);
+	auto it = clients.find(id);
+	if (it == clients.end() || !it->second.on) return false;
+	out = it->second.options;
+	return true;
+}
+
+void Tracking::trackRead(uint64_t id, std::string_view key) {
+	Shard& shard = shardFor(key);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	auto [it, added] = shard.readers.try_emplace(std::string(key));
+	std::vector<uint64_t>& readers = it->second;
+	if (std::find(readers.begin(), readers.end(), id) == readers.end()) {
+		readers.push_back(id);
+	}
+	if (!added || keyCount.fetch_add(1, std::memory_order_relaxed) < maxKeys || maxKeys == 0) {
+		return;
+	}
+	// Over the bound: drop a key from this shard, or else from another one
+	// that is not locked (waiting for it could deadlock with its holder).
+	if (evictFrom(shard, key)) return;
+	size_t start = HashTable::hashKey(key);
+	for (size_t i = 1; i < SHARDS; ++i) {
+		Shard& other = shards[(start + i) & (SHARDS - 1)];
+		std::unique_lock<std::mutex> otherLock(other.mtx, std::try_to_lock);
+		if (otherLock.owns_lock() && evictFrom(other, key)) return;
+	}
+}
+
+// Drops a random key other than keep from a shard, telling its readers to
+// drop it too, as Redis does when tracking-table-max-keys is reached.
+// Returns false if the shard has no other key.
+bool Tracking::evictFrom(Shard& shard, std::string_view keep) {
+	thread_local std::minstd_rand rng(std::random_device{}());
+	size_t buckets = shard.readers.bucket_count();
+	size_t start = rng() % buckets;
+	for (size_t i = 0; i < buckets; ++i) {
+		size_t bucket = (start + i) % buckets;
+		for (auto it = shard.readers.begin(bucket); it != shard.readers.end(bucket); ++it) {
+			if (it->first == keep) continue;
+			Invalidation invalidation{ it->first, 0, std::move(it->second) };
+			shard.readers.erase(invalidation.key);
+			keyCount.fetch_sub(1, std::memory_order_relaxed);
+			queue(std::move(invalidation));
+			return true;
+		}
+	}
+	return false;
+}
+
+void Tracking::invalidate(std::string_view key, uint64_t writer) {
+	Invalidation invalidation{ std::string(key), writer, {} };
+	{
+		Shard& shard = shardFor(key);
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		auto it = shard.readers.find(invalidation.key);
+		if (it != shard.readers.end()) {
+			invalidation.clients = std::move(it->second);
+			shard.readers.erase(it);
+			keyCount.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+	if (bcastClients.load(std::memory_order_relaxed) > 0) {
+		std::shared_lock<std::shared_mutex> lock(prefixMtx);
+		for (const Prefix& entry : prefixes) {
+			if (hasPrefix(key, entry.prefix)) {
+				invalidation.clients.insert(invalidation.clients.end(), entry.clients.begin(), entry.clients.end());
+			}
+		}
+	}
+	if (!invalidation.clients.empty()) {
+		queue(std::move(invalidation));
+	}
+}
+
+void Tracking::queue(Invalidation&& invalidation) {
+	std::lock_guard<std::mutex> lock(pendingMtx);
+	pending.push_back(std::move(invalidation));
+	hasPending.store(true, std::memory_order_release);
+}
+
+void Tracking::flush() {
+	if (!hasPending.load(std::memory_order_acquire)) return;
+	std::vector<Invalidation> batch;
+	{
+		std::lock_guard<std::mutex> lock(pendingMtx);
+		batch.swap(pending);
+		hasPending.store(false, std::memory_order_relaxed);
+	}
+
+	std::shared_lock<std::shared_mutex> lock(clientsMtx);
+	// Keys per receiving client id, in the order they changed.
+	std::unordered_map<uint64_t, std::vector<const std::string*>> keysFor;
+	for (const Invalidation& invalidation : batch) {
+		for (uint64_t id : invalidation.clients) {
+			auto it = clients.find(id);
+			if (it == clients.end() || !it->second.on) continue;
+			const Options& options = it->second.options;
+			if (options.noloop && id == invalidation.writer) continue;
+			std::vector<const std::string*>& keys = keysFor[options.redirect != 0 ? options.redirect : id];
+			// A BCAST client under several matching prefixes hears of the key once.
+			if (keys.empty() || keys.back() != &invalidation.key) {
+				keys.push_back(&invalidation.key);
+			}
+		}
+	}
+
+	for (const auto& [id, keys] : keysFor) {
+		auto it = clients.find(id);
+		if (it == clients.end() || it->second.mailbox == nullptr) continue;
+		const Client& target = it->second;
+		if (!target.resp3 && !target.listening) continue;
+
+		auto message = std::make_shared<std::string>();
+		if (target.resp3) {
+			*message += ">2\r\n$10\r\ninvalidate\r\n";
+		}
+		else {
+			*message += "*3\r\n$7\r\nmessage\r\n";
+			appendBulk(*message, CHANNEL);
+		}
+		*message += '*';
+		*message += std::to_string(keys.size());
+		*message += "\r\n";
+		for (const std::string* key : keys) {
+			appendBulk(*message, *key);
+		}
+		target.mailbox->deliver(std::move(message));
+	}
+}
+
+Tracking::Stats Tracking::stats() {
+	Stats stats;
+	stats.clients = trackingClients.load(std::memory_order_relaxed);
+	stats.keys = keyCount.load(std::memory_order_relaxed);
+	std::shared_lock<std::shared_mutex> lock(prefixMtx);
+	stats.prefixes = prefixes.size();
+	return stats;
+}
@@ -0,0 +1,94 @@
+// Tests for pattern subscriptions that share a trie node. Run by ctest, or
+// directly: redislite-tests exits non-zero and names each failed check.
+#include "../headers/PubSub.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+	if (!ok) {
+		std::fprintf(stderr, "FAILED: %s\n", what);
+		++failures;
+	}
+}
+
+// Messages delivered to subscriber since the last call.
+std::vector<PubSub::Message> received(PubSub::Subscriber& subscriber) {
+	std::vector<PubSub::Message> messages;
+	subscriber.take(messages);
+	return messages;
+}
+
+bool isPmessage(const PubSub::Message& message, const std::string& pattern) {
+	std::string expected = "*4\r\n$8\r\npmessage\r\n$" + std::to_string(pattern.size()) + "\r\n" + pattern + "\r\n";
+	return message->compare(0, expected.size(), expected) == 0;
+}
+
+// "news.*" and "news.**" collapse to one '*' token and end on the same node.
+void testCollapsedStars() {
+	PubSub pubsub;
+	PubSub::Subscriber one(nullptr), two(nullptr);
+	pubsub.psubscribe(one, "news.*");
+	pubsub.psubscribe(two, "news.**");
+
+	check(pubsub.publish("news.x", "hello") == 2, "both star patterns receive the message");
+	auto first = received(one);
+	auto second = received(two);
+	check(first.size() == 1 && isPmessage(first[0], "news.*"), "news.* gets a pmessage for its own pattern");
+	check(second.size() == 1 && isPmessage(second[0], "news.**"), "news.** gets a pmessage for its own pattern");
+
+	pubsub.punsubscribe(two, "news.**");
+	check(pubsub.publish("news.x", "hello") == 1, "news.* survives the unsubscribe of news.**");
+	check(received(one).size() == 1, "news.* still receives after news.** leaves");
+	check(received(two).empty(), "news.** no longer receives");
+
+	pubsub.punsubscribe(one, "news.*");
+	check(pubsub.publish("news.x", "hello") == 0, "no receivers once both patterns are gone");
+	check(pubsub.patternCount() == 0, "no patterns left");
+}
+
+// An escaped literal ends on the same node as the plain one.
+void testEscapes() {
+	PubSub pubsub;
+	PubSub::Subscriber one(nullptr), two(nullptr);
+	pubsub.psubscribe(one, "a\\b");
+	pubsub.psubscribe(two, "ab");
+
+	check(pubsub.publish("ab", "x") == 2, "a\\b and ab both match ab");
+	pubsub.punsubscribe(one, "a\\b");
+	check(pubsub.publish("ab", "x") == 1, "ab survives the unsubscribe of a\\b");
+	auto messages = received(two);
+	check(messages.size() == 2 && isPmessage(messages[1], "ab"), "ab receives both messages");
+	pubsub.unsubscribeAll(two);
+}
+
+// Enough churn to rebuild the trie, with shared end nodes among the survivors.
+void testRebuild() {
+	PubSub pubsub;
+	PubSub::Subscriber keep(nullptr), churn(nullptr);
+	pubsub.psubscribe(keep, "news.*");
+	pubsub.psubscribe(keep, "news.**");
+	for (int i = 0; i < 200; ++i) {
+		pubsub.psubscribe(churn, "other." + std::to_string(i) + ".*");
+	}
+	pubsub.unsubscribeAll(churn);
+
+	check(pubsub.publish("news.x", "hello") == 2, "both star patterns survive a rebuild");
+	check(received(keep).size() == 2, "the subscriber gets one pmessage per pattern");
+	pubsub.unsubscribeAll(keep);
+}
+
+}
+
+int main() {
+	testCollapsedStars();
+	testEscapes();
+	testRebuild();
+	if (failures == 0) std::printf("All pubsub tests passed\n");
+	return failures == 0 ? 0 : 1;
+}